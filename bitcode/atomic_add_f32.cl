@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2023 CHIP-SPV developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Atomic add on floats using the native atomic of cl_ext_float_atomics
+// (SPV_EXT_shader_atomic_float_add). The runtime links this library with
+// the modules using atomicAdd() if the device supports the atomic, which
+// replaces the compare-and-swap loop of the device library (devicelib.cl).
+
+// Translated to OpAtomicFAddEXT by llvm-spirv.
+float __attribute__((overloadable))
+__spirv_AtomicFAddEXT(volatile global float *pointer, int scope, int semantics,
+                      float value);
+float __attribute__((overloadable))
+__spirv_AtomicFAddEXT(volatile local float *pointer, int scope, int semantics,
+                      float value);
+
+// SPIR-V scopes and memory semantics.
+#define SCOPE_DEVICE 1
+#define SCOPE_WORKGROUP 2
+#define SEMANTICS_RELAXED 0
+
+float __chip_atomic_add_f32_global(volatile global float *address, float val) {
+  return __spirv_AtomicFAddEXT(address, SCOPE_DEVICE, SEMANTICS_RELAXED, val);
+}
+
+float __chip_atomic_add_f32_local(volatile local float *address, float val) {
+  return __spirv_AtomicFAddEXT(address, SCOPE_WORKGROUP, SEMANTICS_RELAXED,
+                               val);
+}
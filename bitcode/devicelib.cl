@@ -607,7 +607,27 @@ DEF_CHIP_ATOMIC3(cmpxchg) // __chip_atomic_cmpxchg_i, __chip_atomic_cmpxchg_u, _
 
 /* This code adapted from AMD's HIP sources */
 
-static OVLD float __chip_atomic_add_f32(volatile local float *address, float val) {
+// The floating-point atomic adds as compare-and-swap loops, which work on all
+// devices. The runtime replaces them with the native atomics of
+// cl_ext_float_atomics by linking atomic_add_f32.cl or atomic_add_f64.cl on
+// the devices supporting them. So they are kept out of line and 'used' keeps
+// their signatures intact until the HIP passes export them.
+__attribute__((noinline, used)) float
+__chip_atomic_add_f32_global(volatile global float *address, float val) {
+  volatile global uint *uaddr = (volatile global uint *)address;
+  uint old = *uaddr;
+  uint r;
+
+  do {
+    r = old;
+    old = atomic_cmpxchg(uaddr, r, as_uint(val + as_float(r)));
+  } while (r != old);
+
+  return as_float(r);
+}
+
+__attribute__((noinline, used)) float
+__chip_atomic_add_f32_local(volatile local float *address, float val) {
   volatile local uint *uaddr = (volatile local uint *)address;
   uint old = *uaddr;
   uint r;
@@ -620,7 +640,22 @@ static OVLD float __chip_atomic_add_f32(volatile local float *address, float val
   return as_float(r);
 }
 
-static OVLD double __chip_atom_add_f64(volatile local double *address, double val) {
+__attribute__((noinline, used)) double
+__chip_atomic_add_f64_global(volatile global double *address, double val) {
+  volatile global ulong *uaddr = (volatile global ulong *)address;
+  ulong old = *uaddr;
+  ulong r;
+
+  do {
+    r = old;
+    old = atom_cmpxchg(uaddr, r, as_ulong(val + as_double(r)));
+  } while (r != old);
+
+  return as_double(r);
+}
+
+__attribute__((noinline, used)) double
+__chip_atomic_add_f64_local(volatile local double *address, double val) {
   volatile local ulong *uaddr = (volatile local ulong *)address;
   ulong old = *uaddr;
   ulong r;
@@ -700,33 +735,6 @@ static OVLD double __chip_atom_add_f64(volatile local double *address, double va
   }
 
 
-static OVLD float __chip_atomic_add_f32(volatile global float *address, float val) {
-  volatile global uint *uaddr = (volatile global uint *)address;
-  uint old = *uaddr;
-  uint r;
-
-  do {
-    r = old;
-    old = atomic_cmpxchg(uaddr, r, as_uint(val + as_float(r)));
-  } while (r != old);
-
-  return as_float(r);
-}
-
-static OVLD double __chip_atom_add_f64(volatile global double *address, double val) {
-  volatile global ulong *uaddr = (volatile global ulong *)address;
-  ulong old = *uaddr;
-  ulong r;
-
-  do {
-    r = old;
-    old = atom_cmpxchg(uaddr, r, as_ulong(val + as_double(r)));
-  } while (r != old);
-
-  return as_double(r);
-}
-
-
 static OVLD uint __chip_atomic_inc2_u(volatile local uint *address, uint val) {
   uint old = *address;
   uint r;
@@ -775,10 +783,10 @@ EXPORT float __chip_atomic_add_f32(DEFAULT_AS float *address,
                                  float val) {
   volatile global float *gi = to_global(address);
   if (gi)
-    return __chip_atomic_add_f32(gi, val);
+    return __chip_atomic_add_f32_global(gi, val);
   volatile local float *li = to_local(address);
   if (li)
-    return __chip_atomic_add_f32(li, val);
+    return __chip_atomic_add_f32_local(li, val);
   return 0;
 }
 
@@ -786,10 +794,10 @@ EXPORT double __chip_atomic_add_f64(DEFAULT_AS double *address,
                                   double val) {
   volatile global double *gi = to_global((DEFAULT_AS double *)address);
   if (gi)
-    return __chip_atom_add_f64(gi, val);
+    return __chip_atomic_add_f64_global(gi, val);
   volatile local double *li = to_local((DEFAULT_AS double *)address);
   if (li)
-    return __chip_atom_add_f64(li, val);
+    return __chip_atomic_add_f64_local(li, val);
   return 0;
 }
 
@@ -929,6 +937,97 @@ EXPORT OVLD void __chip_syncwarp() {
   return sub_group_barrier(CLK_GLOBAL_MEM_FENCE);
 }
 
+// Warp and block reductions and scans. Blocks map to the work-group
+// collectives of OpenCL 2.0 and tiles of lanes to a shuffle tree. For whole
+// warps the trees are called through the __chip_sg_* functions, which the
+// runtime replaces with the subgroup collectives of cl_khr_subgroups by
+// linking subgroup_collectives*.cl on the devices supporting them. Like the
+// float atomic adds, these are kept out of line and 'used'.
+#define COLLECTIVE_ADD(a, b) ((a) + (b))
+#define COLLECTIVE_MIN(a, b) min(a, b)
+#define COLLECTIVE_MAX(a, b) max(a, b)
+
+#define DEF_CHIP_COLLECTIVES(T, S, NAME, OP)                                   \
+  static OVLD T __chip_tree_reduce_##NAME(T var, int wSize) {                  \
+    for (int offset = wSize / 2; offset > 0; offset /= 2)                      \
+      var = OP(var, __shfl_xor(var, offset, wSize));                           \
+    return var;                                                                \
+  }                                                                            \
+  static OVLD T __chip_tree_scan_inclusive_##NAME(T var, int wSize) {          \
+    uint lane = get_sub_group_local_id() % wSize;                              \
+    for (uint offset = 1; offset < (uint)wSize; offset *= 2) {                 \
+      T other = __shfl_up(var, offset, wSize);                                 \
+      if (lane >= offset)                                                      \
+        var = OP(var, other);                                                  \
+    }                                                                          \
+    return var;                                                                \
+  }                                                                            \
+  __attribute__((noinline, used)) T __chip_sg_##S##_reduce_##NAME(T var) {     \
+    return __chip_tree_reduce_##NAME(var, DEFAULT_WARP_SIZE);                  \
+  }                                                                            \
+  __attribute__((noinline, used)) T __chip_sg_##S##_scan_inclusive_##NAME(     \
+      T var) {                                                                 \
+    return __chip_tree_scan_inclusive_##NAME(var, DEFAULT_WARP_SIZE);          \
+  }                                                                            \
+  EXPORT OVLD T __chip_reduce_##NAME(T var, int wSize) {                       \
+    if (wSize == DEFAULT_WARP_SIZE)                                            \
+      return __chip_sg_##S##_reduce_##NAME(var);                               \
+    return __chip_tree_reduce_##NAME(var, wSize);                              \
+  }                                                                            \
+  EXPORT OVLD T __chip_scan_inclusive_##NAME(T var, int wSize) {               \
+    if (wSize == DEFAULT_WARP_SIZE)                                            \
+      return __chip_sg_##S##_scan_inclusive_##NAME(var);                       \
+    return __chip_tree_scan_inclusive_##NAME(var, wSize);                      \
+  }                                                                            \
+  EXPORT OVLD T __chip_block_reduce_##NAME(T var) {                            \
+    return work_group_reduce_##NAME(var);                                      \
+  }                                                                            \
+  EXPORT OVLD T __chip_block_scan_inclusive_##NAME(T var) {                    \
+    return work_group_scan_inclusive_##NAME(var);                              \
+  }
+
+#define DEF_CHIP_COLLECTIVES_ALL_OPS(T, S)                                     \
+  DEF_CHIP_COLLECTIVES(T, S, add, COLLECTIVE_ADD)                              \
+  DEF_CHIP_COLLECTIVES(T, S, min, COLLECTIVE_MIN)                              \
+  DEF_CHIP_COLLECTIVES(T, S, max, COLLECTIVE_MAX)
+
+DEF_CHIP_COLLECTIVES_ALL_OPS(int, i)
+DEF_CHIP_COLLECTIVES_ALL_OPS(uint, u)
+DEF_CHIP_COLLECTIVES_ALL_OPS(long, l)
+DEF_CHIP_COLLECTIVES_ALL_OPS(ulong, ul)
+DEF_CHIP_COLLECTIVES_ALL_OPS(float, f)
+DEF_CHIP_COLLECTIVES_ALL_OPS(double, d)
+
+// Grid-wide barrier of cooperative launches. state[0] counts the arrived
+// work-groups and state[1] is incremented each time the barrier opens, so
+// the counter is back at zero for the next barrier or launch. All
+// work-groups must be resident at the same time, which
+// hipLaunchCooperativeKernel() checks.
+EXPORT void __chip_grid_sync(DEFAULT_AS uint *state) {
+  work_group_barrier(CLK_GLOBAL_MEM_FENCE | CLK_LOCAL_MEM_FENCE);
+  if (get_local_linear_id() == 0) {
+    volatile global atomic_uint *count =
+        (volatile global atomic_uint *)to_global(state);
+    volatile global atomic_uint *generation = count + 1;
+    uint num_groups =
+        get_num_groups(0) * get_num_groups(1) * get_num_groups(2);
+    uint gen = atomic_load_explicit(generation, memory_order_acquire,
+                                    memory_scope_device);
+    if (atomic_fetch_add_explicit(count, 1, memory_order_acq_rel,
+                                  memory_scope_device) == num_groups - 1) {
+      atomic_store_explicit(count, 0, memory_order_relaxed,
+                            memory_scope_device);
+      atomic_fetch_add_explicit(generation, 1, memory_order_release,
+                                memory_scope_device);
+    } else {
+      while (atomic_load_explicit(generation, memory_order_acquire,
+                                  memory_scope_device) == gen)
+        ;
+    }
+  }
+  work_group_barrier(CLK_GLOBAL_MEM_FENCE | CLK_LOCAL_MEM_FENCE);
+}
+
 typedef struct {
   intptr_t  image;
   intptr_t  sampler;
@@ -0,0 +1,278 @@
+/*
+ * Copyright (c) 2023 CHIP-SPV developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Device-side malloc() and free().
+//
+// The heap, set up by the runtime, is divided into chunks. A chunk is split
+// into blocks of one size class on demand and returned to the free chunks
+// when its last block is freed. Allocations larger than the blocks take a
+// run of whole chunks. Everything is updated with atomics so the threads
+// never wait for each other:
+//
+// - A thread reserves a block in a chunk by incrementing the chunk's Used
+//   count with a compare-and-swap, which fails when the chunk is full, and
+//   then claims any free bit of the chunk's bitmap. The reservation
+//   guarantees there is one.
+//
+// - The Used count of a chunk not split into blocks is CHUNK_NOT_SPLIT so
+//   the reservations fail on it. The thread splitting a chunk sets the count
+//   after the state, and the thread freeing the last block of a chunk swaps
+//   the count from zero to CHUNK_NOT_SPLIT before it releases the chunk.
+//   A thread which reserved a block after the chunk was reused for another
+//   size class notices it from the state and backs off.
+//
+// - Each size class allocates from its current chunk first and looks for
+//   another chunk when it is full.
+
+// Keep in sync with CHIPMallocHeap and CHIPMallocChunk in src/common.hh.
+#define CHUNK_SHIFT 16
+#define CHUNK_SIZE (1u << CHUNK_SHIFT)
+#define MIN_BLOCK_SHIFT 4
+#define NUM_CLASSES 8
+#define BITMAP_WORDS (CHUNK_SIZE >> MIN_BLOCK_SHIFT >> 5)
+#define CHUNK_NOT_SPLIT 0xffffffffu
+
+// Chunk states besides the split chunks (one plus the size class).
+#define CHUNK_FREE 0u
+#define CHUNK_LARGE_HEAD 0x80000000u // | the number of chunks.
+#define CHUNK_LARGE_TAIL 0x40000000u
+
+typedef struct {
+  atomic_uint State;
+  atomic_uint Used;
+  atomic_uint Bitmap[BITMAP_WORDS];
+} chip_malloc_chunk;
+
+typedef struct {
+  uint NumChunks;
+  uint ArenaOffset;
+  atomic_uint Current[NUM_CLASSES];
+} chip_malloc_heap;
+
+#define LOAD(Obj)                                                              \
+  atomic_load_explicit(Obj, memory_order_acquire, memory_scope_device)
+#define STORE(Obj, Val)                                                        \
+  atomic_store_explicit(Obj, Val, memory_order_release, memory_scope_device)
+#define CAS(Obj, Expected, Desired)                                            \
+  atomic_compare_exchange_strong_explicit(                                     \
+      Obj, Expected, Desired, memory_order_acq_rel, memory_order_acquire,      \
+      memory_scope_device)
+
+static global chip_malloc_chunk *get_chunks(global chip_malloc_heap *Heap) {
+  return (global chip_malloc_chunk *)(Heap + 1);
+}
+
+static global uchar *get_arena(global chip_malloc_heap *Heap) {
+  return (global uchar *)Heap + Heap->ArenaOffset;
+}
+
+static uint get_capacity(uint Class) {
+  return CHUNK_SIZE >> (MIN_BLOCK_SHIFT + Class);
+}
+
+// Spread the threads over the chunks and the bitmap words.
+static uint get_start_hint() {
+  return (uint)get_global_linear_id() * 2654435761u;
+}
+
+// Give back a reservation made with reserve_block(). Release the chunk if
+// it became empty and is not the current chunk of its size class.
+static void unreserve_block(global chip_malloc_heap *Heap, uint ChunkIdx) {
+  global chip_malloc_chunk *Chunk = &get_chunks(Heap)[ChunkIdx];
+  if (atomic_fetch_sub_explicit(&Chunk->Used, 1, memory_order_acq_rel,
+                                memory_scope_device) != 1)
+    return;
+
+  uint State = LOAD(&Chunk->State);
+  if (State == CHUNK_FREE || State > NUM_CLASSES ||
+      LOAD(&Heap->Current[State - 1]) == ChunkIdx + 1)
+    return;
+
+  // Fails if a block was reserved meanwhile. All the bits are clear if it
+  // succeeds, as they are cleared before the reservations are given back.
+  uint Expected = 0;
+  if (!CAS(&Chunk->Used, &Expected, CHUNK_NOT_SPLIT))
+    return;
+  STORE(&Chunk->State, CHUNK_FREE);
+}
+
+// Reserve a block in a chunk of the size class. Return false if the chunk
+// is full or does not serve the class.
+static bool reserve_block(global chip_malloc_heap *Heap, uint ChunkIdx,
+                          uint Class) {
+  global chip_malloc_chunk *Chunk = &get_chunks(Heap)[ChunkIdx];
+  uint Capacity = get_capacity(Class);
+  uint Used = LOAD(&Chunk->Used);
+  do {
+    if (Used >= Capacity)
+      return false;
+  } while (!CAS(&Chunk->Used, &Used, Used + 1));
+
+  // The chunk may have been released and split for another size class
+  // since the caller looked at its state.
+  if (LOAD(&Chunk->State) == Class + 1)
+    return true;
+  unreserve_block(Heap, ChunkIdx);
+  return false;
+}
+
+// Claim a free bit of a chunk in which a block has been reserved.
+static uint take_block(global chip_malloc_chunk *Chunk, uint Class) {
+  uint NumWords = get_capacity(Class) / 32;
+  for (uint I = get_start_hint();; I++) {
+    global atomic_uint *Word = &Chunk->Bitmap[I % NumWords];
+    uint Bits = LOAD(Word);
+    while (Bits != 0xffffffffu) {
+      uint Bit = 1u << ctz(~Bits);
+      Bits = atomic_fetch_or_explicit(Word, Bit, memory_order_acq_rel,
+                                      memory_scope_device);
+      if (!(Bits & Bit))
+        return (I % NumWords) * 32 + ctz(Bit);
+      Bits |= Bit;
+    }
+  }
+}
+
+// Find a chunk with room for a block of the size class, splitting a free
+// chunk if needed, and reserve the block in it. Return one plus the index
+// of the chunk, or zero if the heap is full.
+static uint find_chunk(global chip_malloc_heap *Heap, uint Class) {
+  global chip_malloc_chunk *Chunks = get_chunks(Heap);
+  uint NumChunks = Heap->NumChunks;
+  uint Start = get_start_hint() % NumChunks;
+
+  for (uint N = 0; N < NumChunks; N++) {
+    uint I = (Start + N) % NumChunks;
+    if (LOAD(&Chunks[I].State) == Class + 1 &&
+        reserve_block(Heap, I, Class))
+      return I + 1;
+  }
+
+  for (uint N = 0; N < NumChunks; N++) {
+    uint I = (Start + N) % NumChunks;
+    uint Expected = CHUNK_FREE;
+    if (LOAD(&Chunks[I].State) == CHUNK_FREE &&
+        CAS(&Chunks[I].State, &Expected, Class + 1)) {
+      // The bitmap was cleared when the chunk was released.
+      STORE(&Chunks[I].Used, 1);
+      return I + 1;
+    }
+  }
+  return 0;
+}
+
+static void *allocate_block(global chip_malloc_heap *Heap, uint Class) {
+  global chip_malloc_chunk *Chunks = get_chunks(Heap);
+  uint Current = LOAD(&Heap->Current[Class]);
+  uint ChunkIdx = Current;
+  if (!Current || !reserve_block(Heap, Current - 1, Class)) {
+    ChunkIdx = find_chunk(Heap, Class);
+    if (!ChunkIdx)
+      return 0;
+    // Let the other threads allocate from the found chunk unless one of
+    // them has already moved on to another chunk.
+    CAS(&Heap->Current[Class], &Current, ChunkIdx);
+  }
+  ChunkIdx--;
+  uint Block = take_block(&Chunks[ChunkIdx], Class);
+  return get_arena(Heap) + ((size_t)ChunkIdx << CHUNK_SHIFT) +
+         ((size_t)Block << (MIN_BLOCK_SHIFT + Class));
+}
+
+static void release_chunks(global chip_malloc_chunk *Chunks, uint First,
+                           uint Count) {
+  for (uint I = First; I < First + Count; I++)
+    STORE(&Chunks[I].State, CHUNK_FREE);
+}
+
+// Allocate a run of NumChunks free chunks.
+static void *allocate_chunks(global chip_malloc_heap *Heap, uint NumChunks) {
+  global chip_malloc_chunk *Chunks = get_chunks(Heap);
+  uint Total = Heap->NumChunks;
+  if (NumChunks > Total)
+    return 0;
+
+  for (uint First = 0; First <= Total - NumChunks;) {
+    uint Claimed = 0;
+    for (; Claimed < NumChunks; Claimed++) {
+      uint Expected = CHUNK_FREE;
+      if (!CAS(&Chunks[First + Claimed].State, &Expected, CHUNK_LARGE_TAIL))
+        break;
+    }
+    if (Claimed == NumChunks) {
+      STORE(&Chunks[First].State, CHUNK_LARGE_HEAD | NumChunks);
+      return get_arena(Heap) + ((size_t)First << CHUNK_SHIFT);
+    }
+    // Continue after the chunk which is in use.
+    release_chunks(Chunks, First, Claimed);
+    First += Claimed + 1;
+  }
+  return 0;
+}
+
+void *__chip_malloc(void *HeapPtr, size_t Size) {
+  global chip_malloc_heap *Heap = (global chip_malloc_heap *)HeapPtr;
+  if (!Heap || !Size)
+    return 0;
+
+  size_t MaxBlockSize = (size_t)1 << (MIN_BLOCK_SHIFT + NUM_CLASSES - 1);
+  if (Size > MaxBlockSize) {
+    size_t NumChunks = (Size + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+    if (NumChunks >= CHUNK_LARGE_TAIL)
+      return 0;
+    return allocate_chunks(Heap, (uint)NumChunks);
+  }
+
+  uint Class = 0;
+  while (((size_t)1 << (MIN_BLOCK_SHIFT + Class)) < Size)
+    Class++;
+  return allocate_block(Heap, Class);
+}
+
+void __chip_free(void *HeapPtr, void *Ptr) {
+  global chip_malloc_heap *Heap = (global chip_malloc_heap *)HeapPtr;
+  if (!Heap || !Ptr)
+    return;
+
+  size_t Offset = (global uchar *)Ptr - get_arena(Heap);
+  uint ChunkIdx = Offset >> CHUNK_SHIFT;
+  if (ChunkIdx >= Heap->NumChunks)
+    return; // Not allocated from the heap.
+
+  global chip_malloc_chunk *Chunks = get_chunks(Heap);
+  uint State = LOAD(&Chunks[ChunkIdx].State);
+  if (State & CHUNK_LARGE_HEAD) {
+    uint NumChunks = State & ~CHUNK_LARGE_HEAD;
+    release_chunks(Chunks, ChunkIdx + 1, NumChunks - 1);
+    STORE(&Chunks[ChunkIdx].State, CHUNK_FREE);
+    return;
+  }
+  if (State == CHUNK_FREE || State > NUM_CLASSES)
+    return; // Not an allocated block.
+
+  uint Class = State - 1;
+  uint Block = (Offset & (CHUNK_SIZE - 1)) >> (MIN_BLOCK_SHIFT + Class);
+  atomic_fetch_and_explicit(&Chunks[ChunkIdx].Bitmap[Block / 32],
+                            ~(1u << (Block % 32)), memory_order_acq_rel,
+                            memory_scope_device);
+  unreserve_block(Heap, ChunkIdx);
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2023 CHIP-SPV developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Device-side support for the printf() calls lowered by HipPrintf.cpp.
+
+// Keep in sync with CHIPPrintfBuffer and CHIPPrintfRecord in src/common.hh.
+typedef struct {
+  uint Used;
+  uint Capacity;
+  uint Dropped;
+  uint Consumed;
+} chip_printf_buffer;
+
+typedef struct {
+  uint Size;
+  uint FormatOffset;
+} chip_printf_record;
+
+// FormatOffset of the padding records, ChipPrintfPadding.
+#define CHIP_PRINTF_PADDING 0xffffffffu
+
+// Reserve Size bytes for a record in Buffer. Return null if it does not
+// fit or the runtime has not set up a buffer.
+static global uchar *__attribute__((used))
+_chip_printf_alloc(void *Buffer, uint Size) {
+  global chip_printf_buffer *Buf = (global chip_printf_buffer *)Buffer;
+  if (!Buf)
+    return 0;
+
+  global uchar *Data = (global uchar *)(Buf + 1);
+  uint Capacity = Buf->Capacity;
+  uint Old = *(volatile global uint *)&Buf->Used;
+  for (;;) {
+    // The records are contiguous: if the record does not fit at the end of
+    // the ring, pad the end and start from the beginning.
+    uint Pos = Old & (Capacity - 1);
+    uint Start = Pos + Size > Capacity ? Old + (Capacity - Pos) : Old;
+    uint End = Start + Size;
+    // The records not printed by the runtime yet can't be overwritten.
+    if (End - *(volatile global uint *)&Buf->Consumed > Capacity) {
+      atomic_inc(&Buf->Dropped);
+      return 0;
+    }
+    uint Prev = atomic_cmpxchg(&Buf->Used, Old, End);
+    if (Prev != Old) {
+      Old = Prev;
+      continue;
+    }
+    if (Start != Old) {
+      global chip_printf_record *Pad =
+          (global chip_printf_record *)(Data + Pos);
+      Pad->FormatOffset = CHIP_PRINTF_PADDING;
+      mem_fence(CLK_GLOBAL_MEM_FENCE);
+      atomic_xchg(&Pad->Size, Start - Old);
+    }
+    return Data + (Start & (Capacity - 1));
+  }
+}
+
+// Publish a record written to the space reserved by _chip_printf_alloc().
+static void __attribute__((used))
+_chip_printf_commit(global uchar *Record, uint Size) {
+  // The runtime reads the record once its size is set.
+  mem_fence(CLK_GLOBAL_MEM_FENCE);
+  atomic_xchg(&((global chip_printf_record *)Record)->Size, Size);
+}
+
+// Return the length of the %s argument S.
+static uint __attribute__((used)) _chip_printf_strlen(const char *S) {
+  uint Len = 0;
+  if (S)
+    while (S[Len])
+      ++Len;
+  return Len;
+}
+
+static void __attribute__((used))
+_chip_printf_strcpy(global uchar *Dst, const char *Src, uint Len) {
+  for (uint Pos = 0; Pos < Len; ++Pos)
+    Dst[Pos] = Src[Pos];
+}
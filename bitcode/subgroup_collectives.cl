@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2023 CHIP-SPV developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Warp reductions and scans using the subgroup collectives of
+// cl_khr_subgroups. The runtime links this library with the modules using
+// them if the device supports the collectives, which replaces the shuffle
+// trees of the device library (devicelib.cl). The double variants are in
+// subgroup_collectives_f64.cl so the devices without doubles can link this.
+
+#pragma OPENCL EXTENSION cl_khr_subgroups : enable
+
+#define DEF_SG_COLLECTIVES(T, S, NAME)                                         \
+  T __chip_sg_##S##_reduce_##NAME(T var) {                                     \
+    return sub_group_reduce_##NAME(var);                                       \
+  }                                                                            \
+  T __chip_sg_##S##_scan_inclusive_##NAME(T var) {                             \
+    return sub_group_scan_inclusive_##NAME(var);                               \
+  }
+
+#define DEF_SG_COLLECTIVES_ALL_OPS(T, S)                                       \
+  DEF_SG_COLLECTIVES(T, S, add)                                                \
+  DEF_SG_COLLECTIVES(T, S, min)                                                \
+  DEF_SG_COLLECTIVES(T, S, max)
+
+DEF_SG_COLLECTIVES_ALL_OPS(int, i)
+DEF_SG_COLLECTIVES_ALL_OPS(uint, u)
+DEF_SG_COLLECTIVES_ALL_OPS(long, l)
+DEF_SG_COLLECTIVES_ALL_OPS(ulong, ul)
+DEF_SG_COLLECTIVES_ALL_OPS(float, f)
@@ -1092,6 +1092,15 @@ cudaLaunchKernel(T HostFunction, dim3 GridDim, dim3 BlockDim, void **Args,
                          SharedMem, Stream);
 }
 
+template <typename T>
+static inline cudaError_t
+cudaLaunchCooperativeKernel(T HostFunction, dim3 GridDim, dim3 BlockDim,
+                            void **Args, size_t SharedMem,
+                            cudaStream_t Stream) {
+  return hipLaunchCooperativeKernel((const void *)HostFunction, GridDim,
+                                    BlockDim, Args, SharedMem, Stream);
+}
+
 // old launch API
 template <typename T>
 static inline cudaError_t cudaLaunchByPtr(T *HostFunction) {
@@ -1218,6 +1227,61 @@ cudaOccupancyMaxPotentialBlockSize(int *GridSize, int *BlockSize, T Func,
                                            DynSharedMemPerBlk, BlockSizeLimit);
 }
 
+// Like cudaOccupancyMaxPotentialBlockSize() but the dynamic shared memory
+// depends on the block size. Tries the multiples of the warp size.
+template <typename UnaryFunction, typename T>
+static inline cudaError_t
+cudaOccupancyMaxPotentialBlockSizeVariableSMemWithFlags(
+    int *GridSize, int *BlockSize, T Func,
+    UnaryFunction BlockSizeToDynamicSMemSize, int BlockSizeLimit = 0,
+    unsigned int Flags = 0) {
+  if (!GridSize || !BlockSize)
+    return hipErrorInvalidValue;
+  hipFuncAttributes Attr;
+  hipError_t Err =
+      hipFuncGetAttributes(&Attr, reinterpret_cast<const void *>(Func));
+  int Device, NumCUs, WarpSize;
+  if (Err == hipSuccess)
+    Err = hipGetDevice(&Device);
+  if (Err == hipSuccess)
+    Err = hipDeviceGetAttribute(&NumCUs, hipDeviceAttributeMultiprocessorCount,
+                                Device);
+  if (Err == hipSuccess)
+    Err = hipDeviceGetAttribute(&WarpSize, hipDeviceAttributeWarpSize, Device);
+  if (Err != hipSuccess)
+    return Err;
+
+  int Limit = Attr.maxThreadsPerBlock;
+  if (BlockSizeLimit > 0 && BlockSizeLimit < Limit)
+    Limit = BlockSizeLimit;
+  int BestSize = 0, BestBlocks = 0;
+  for (int Size = Limit >= WarpSize ? Limit / WarpSize * WarpSize : Limit;
+       Size > 0; Size -= WarpSize) {
+    int NumBlocks;
+    Err = hipOccupancyMaxActiveBlocksPerMultiprocessorWithFlags(
+        &NumBlocks, reinterpret_cast<const void *>(Func), Size,
+        BlockSizeToDynamicSMemSize(Size), Flags);
+    if (Err != hipSuccess)
+      return Err;
+    if ((long long)NumBlocks * Size > (long long)BestBlocks * BestSize) {
+      BestSize = Size;
+      BestBlocks = NumBlocks;
+    }
+  }
+  *BlockSize = BestSize;
+  *GridSize = BestBlocks * NumCUs;
+  return hipSuccess;
+}
+
+template <typename UnaryFunction, typename T>
+static inline cudaError_t cudaOccupancyMaxPotentialBlockSizeVariableSMem(
+    int *GridSize, int *BlockSize, T Func,
+    UnaryFunction BlockSizeToDynamicSMemSize, int BlockSizeLimit = 0) {
+  return cudaOccupancyMaxPotentialBlockSizeVariableSMemWithFlags(
+      GridSize, BlockSize, Func, BlockSizeToDynamicSMemSize, BlockSizeLimit,
+      cudaOccupancyDefault);
+}
+
 //###################
 
 /* Texture driver API, deprecated by CUDA, unsupported by CHIP-SPV */
@@ -149,6 +149,74 @@ DECL_LONGLONG_SHFL(__shfl_xor, int);
 DECL_LONGLONG_SHFL(__shfl_up, unsigned int);
 DECL_LONGLONG_SHFL(__shfl_down, unsigned int);
 
+// Reductions and inclusive scans over tiles of warpsize lanes, and over the
+// whole block. The block variants must be reached by all threads of the
+// block, like __syncthreads().
+#define DECL_COLLECTIVE_OPS(TYPE_, OP_)                                        \
+  extern __device__ TYPE_ __chip_reduce_##OP_(TYPE_ var, int warpsize);       \
+  extern __device__ TYPE_ __chip_scan_inclusive_##OP_(TYPE_ var,              \
+                                                      int warpsize);          \
+  extern __device__ TYPE_ __chip_block_reduce_##OP_(TYPE_ var);               \
+  extern __device__ TYPE_ __chip_block_scan_inclusive_##OP_(TYPE_ var);       \
+  inline __device__ TYPE_ __block_reduce_##OP_(TYPE_ var) {                   \
+    return __chip_block_reduce_##OP_(var);                                    \
+  }                                                                           \
+  inline __device__ TYPE_ __block_scan_inclusive_##OP_(TYPE_ var) {           \
+    return __chip_block_scan_inclusive_##OP_(var);                            \
+  }
+
+#define DECL_COLLECTIVE_ALL_OPS(TYPE_)                                         \
+  DECL_COLLECTIVE_OPS(TYPE_, add)                                              \
+  DECL_COLLECTIVE_OPS(TYPE_, min)                                              \
+  DECL_COLLECTIVE_OPS(TYPE_, max)
+
+DECL_COLLECTIVE_ALL_OPS(int)
+DECL_COLLECTIVE_ALL_OPS(unsigned int)
+DECL_COLLECTIVE_ALL_OPS(long)
+DECL_COLLECTIVE_ALL_OPS(unsigned long)
+DECL_COLLECTIVE_ALL_OPS(float)
+DECL_COLLECTIVE_ALL_OPS(double)
+
+// Collectives for cases where sizeof(long long) == sizeof(int64_t).
+#define DECL_LONGLONG_COLLECTIVE_OPS(TYPE_, CAST_TYPE_, OP_)                   \
+  inline __device__ TYPE_ __chip_reduce_##OP_(TYPE_ var, int warpsize) {       \
+    return __chip_reduce_##OP_(static_cast<CAST_TYPE_>(var), warpsize);        \
+  }                                                                            \
+  inline __device__ TYPE_ __chip_scan_inclusive_##OP_(TYPE_ var,               \
+                                                      int warpsize) {          \
+    return __chip_scan_inclusive_##OP_(static_cast<CAST_TYPE_>(var),           \
+                                       warpsize);                              \
+  }                                                                            \
+  inline __device__ TYPE_ __block_reduce_##OP_(TYPE_ var) {                    \
+    return __chip_block_reduce_##OP_(static_cast<CAST_TYPE_>(var));            \
+  }                                                                            \
+  inline __device__ TYPE_ __block_scan_inclusive_##OP_(TYPE_ var) {            \
+    return __chip_block_scan_inclusive_##OP_(static_cast<CAST_TYPE_>(var));    \
+  }
+
+#define DECL_LONGLONG_COLLECTIVE_ALL_OPS(TYPE_, CAST_TYPE_)                    \
+  DECL_LONGLONG_COLLECTIVE_OPS(TYPE_, CAST_TYPE_, add)                         \
+  DECL_LONGLONG_COLLECTIVE_OPS(TYPE_, CAST_TYPE_, min)                         \
+  DECL_LONGLONG_COLLECTIVE_OPS(TYPE_, CAST_TYPE_, max)
+
+DECL_LONGLONG_COLLECTIVE_ALL_OPS(long long, long)
+DECL_LONGLONG_COLLECTIVE_ALL_OPS(unsigned long long, unsigned long)
+
+// CUDA warp reductions. As with __syncwarp(), the mask is ignored: the whole
+// warp must participate.
+#define DECL_REDUCE_SYNC(TYPE_, OP_)                                           \
+  inline __device__ TYPE_ __reduce_##OP_##_sync(unsigned long long mask,      \
+                                                TYPE_ value) {                \
+    return __chip_reduce_##OP_(value, CHIP_DEFAULT_WARP_SIZE);                \
+  }
+
+DECL_REDUCE_SYNC(int, add)
+DECL_REDUCE_SYNC(int, min)
+DECL_REDUCE_SYNC(int, max)
+DECL_REDUCE_SYNC(unsigned int, add)
+DECL_REDUCE_SYNC(unsigned int, min)
+DECL_REDUCE_SYNC(unsigned int, max)
+
 
 }
 
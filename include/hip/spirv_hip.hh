@@ -52,6 +52,36 @@ __device__ void __chipspv_abort(int32_t *abort_flag);
 static inline __device__ void abort() {
   __chipspv_abort(&__chipspv_abort_called);
 }
+
+// A global pointer included in all HIP device modules, set by the runtime
+// to the buffer the printf() calls write to.
+__attribute__((weak)) __device__ void *__chipspv_printf_buffer;
+
+// A global pointer included in all HIP device modules, set by the runtime
+// to the heap malloc() allocates from.
+__attribute__((weak)) __device__ void *__chipspv_malloc_heap;
+
+__device__ void *__chip_malloc(void *heap, size_t size);
+__device__ void __chip_free(void *heap, void *ptr);
+
+static inline __device__ void *malloc(size_t size) {
+  return __chip_malloc(__chipspv_malloc_heap, size);
+}
+
+static inline __device__ void free(void *ptr) {
+  __chip_free(__chipspv_malloc_heap, ptr);
+}
+}
+
+__device__ inline void *operator new(size_t size) { return malloc(size); }
+__device__ inline void *operator new[](size_t size) { return malloc(size); }
+__device__ inline void operator delete(void *ptr) noexcept { free(ptr); }
+__device__ inline void operator delete[](void *ptr) noexcept { free(ptr); }
+__device__ inline void operator delete(void *ptr, size_t) noexcept {
+  free(ptr);
+}
+__device__ inline void operator delete[](void *ptr, size_t) noexcept {
+  free(ptr);
 }
 
 typedef int hipLaunchParm;
@@ -1,12 +1,252 @@
+/*
+ * Copyright (c) 2023 CHIP-SPV developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
 #ifndef HIP_INCLUDE_HIP_SPIRV_HIP_COOPERATIVE_GROUPS_H
 #define HIP_INCLUDE_HIP_SPIRV_HIP_COOPERATIVE_GROUPS_H
 
-//// Include CUDA headers
-//#include <cuda_runtime.h>
-//#include <cooperative_groups.h>
-//
-//// Include HIP wrapper headers around CUDA
-//#include <hip/hip_runtime.h>
-//#include <hip/hip_runtime_api.h>
+#include <hip/hip_runtime.h>
+
+extern "C" {
+// State of the grid-wide barrier of the module: the number of blocks which
+// have arrived and the number of times the barrier has opened. The barrier
+// resets itself, so the state needs no initialization between launches.
+__attribute__((weak)) __device__ uint32_t __chipspv_grid_barrier[2];
+
+__device__ void __chip_grid_sync(uint32_t *State); // Custom
+}
+
+namespace cooperative_groups {
+
+/// The threads of a block.
+class thread_block {
+  friend __device__ thread_block this_thread_block();
+  __device__ thread_block() {}
+
+public:
+  __device__ void sync() const { __syncthreads(); }
+  __device__ unsigned size() const {
+    return blockDim.x * blockDim.y * blockDim.z;
+  }
+  __device__ unsigned num_threads() const { return size(); }
+  __device__ unsigned thread_rank() const {
+    return (threadIdx.z * blockDim.y + threadIdx.y) * blockDim.x +
+           threadIdx.x;
+  }
+  __device__ bool is_valid() const { return true; }
+  __device__ dim3 group_index() const { return blockIdx; }
+  __device__ dim3 thread_index() const { return threadIdx; }
+  __device__ dim3 group_dim() const { return blockDim; }
+};
+
+__device__ inline thread_block this_thread_block() { return thread_block(); }
+
+/// The threads of a grid. sync() is only valid in kernels launched with
+/// hipLaunchCooperativeKernel().
+class grid_group {
+  friend __device__ grid_group this_grid();
+  __device__ grid_group() {}
+
+public:
+  __device__ void sync() const { __chip_grid_sync(__chipspv_grid_barrier); }
+  __device__ unsigned long long size() const {
+    return (unsigned long long)num_blocks() * this_thread_block().size();
+  }
+  __device__ unsigned long long num_threads() const { return size(); }
+  __device__ unsigned long long thread_rank() const {
+    return (unsigned long long)block_rank() * this_thread_block().size() +
+           this_thread_block().thread_rank();
+  }
+  __device__ unsigned num_blocks() const {
+    return gridDim.x * gridDim.y * gridDim.z;
+  }
+  __device__ unsigned block_rank() const {
+    return (blockIdx.z * gridDim.y + blockIdx.y) * gridDim.x + blockIdx.x;
+  }
+  __device__ bool is_valid() const { return true; }
+  __device__ dim3 group_dim() const { return gridDim; }
+};
+
+__device__ inline grid_group this_grid() { return grid_group(); }
+
+/// A partition of a block into tiles of dynamic size. Tiles larger than a
+/// warp synchronize the whole block, so all of its threads must call sync().
+class thread_group {
+  unsigned Size_;
+
+public:
+  __device__ explicit thread_group(unsigned Size) : Size_(Size) {}
+  __device__ void sync() const {
+    if (Size_ <= warpSize)
+      __syncwarp();
+    else
+      __syncthreads();
+  }
+  __device__ unsigned size() const { return Size_; }
+  __device__ unsigned num_threads() const { return Size_; }
+  __device__ unsigned thread_rank() const {
+    return this_thread_block().thread_rank() % Size_;
+  }
+  __device__ unsigned meta_group_rank() const {
+    return this_thread_block().thread_rank() / Size_;
+  }
+  __device__ unsigned meta_group_size() const {
+    return (this_thread_block().size() + Size_ - 1) / Size_;
+  }
+  __device__ bool is_valid() const { return true; }
+};
+
+/// A partition of a block into tiles of Size threads, which must be a power
+/// of two no larger than a warp.
+template <unsigned Size> class thread_block_tile : public thread_group {
+  static_assert(Size > 0 && (Size & (Size - 1)) == 0 &&
+                    Size <= CHIP_DEFAULT_WARP_SIZE,
+                "Tile size must be a power of two no larger than a warp");
+
+public:
+  __device__ thread_block_tile() : thread_group(Size) {}
+  __device__ void sync() const { __syncwarp(); }
+  __device__ unsigned size() const { return Size; }
+  __device__ unsigned num_threads() const { return Size; }
+  __device__ unsigned thread_rank() const {
+    return this_thread_block().thread_rank() % Size;
+  }
+
+  template <typename T> __device__ T shfl(T Var, int SrcRank) const {
+    return __shfl(Var, SrcRank, Size);
+  }
+  template <typename T> __device__ T shfl_down(T Var, unsigned Delta) const {
+    return __shfl_down(Var, Delta, Size);
+  }
+  template <typename T> __device__ T shfl_up(T Var, unsigned Delta) const {
+    return __shfl_up(Var, Delta, Size);
+  }
+  template <typename T> __device__ T shfl_xor(T Var, int LaneMask) const {
+    return __shfl_xor(Var, LaneMask, Size);
+  }
+
+  /// The bits of the tile's threads are placed at the bottom of the mask.
+  __device__ unsigned long long ballot(int Predicate) const {
+    unsigned Shift = (__lane_id() / Size) * Size;
+    return (__ballot(Predicate) >> Shift) & TileMask;
+  }
+  __device__ int any(int Predicate) const { return ballot(Predicate) != 0; }
+  __device__ int all(int Predicate) const {
+    return ballot(Predicate) == TileMask;
+  }
+
+private:
+  static constexpr unsigned long long TileMask = ~0ull >> (64 - Size);
+};
+
+template <unsigned Size, typename ParentT>
+__device__ thread_block_tile<Size> tiled_partition(const ParentT &) {
+  return thread_block_tile<Size>();
+}
+
+__device__ inline thread_group tiled_partition(const thread_block &,
+                                               unsigned TileSize) {
+  return thread_group(TileSize);
+}
+
+template <typename GroupT> __device__ void sync(const GroupT &Group) {
+  Group.sync();
+}
+
+template <typename T> struct plus {
+  __device__ T operator()(T A, T B) const { return A + B; }
+};
+template <typename T> struct less {
+  __device__ T operator()(T A, T B) const { return A < B ? A : B; }
+};
+template <typename T> struct greater {
+  __device__ T operator()(T A, T B) const { return A < B ? B : A; }
+};
+
+/// Reduce over a tile. plus, less and greater map to the device library
+/// collectives, which use the subgroup collectives on whole warps where the
+/// device supports them. Other operations use a shuffle tree.
+template <unsigned Size, typename T, typename OpT>
+__device__ T reduce(const thread_block_tile<Size> &Tile, T Value, OpT Op) {
+  for (unsigned Offset = Size / 2; Offset > 0; Offset /= 2)
+    Value = Op(Value, Tile.shfl_xor(Value, Offset));
+  return Value;
+}
+template <unsigned Size, typename T>
+__device__ T reduce(const thread_block_tile<Size> &, T Value, plus<T>) {
+  return __chip_reduce_add(Value, Size);
+}
+template <unsigned Size, typename T>
+__device__ T reduce(const thread_block_tile<Size> &, T Value, less<T>) {
+  return __chip_reduce_min(Value, Size);
+}
+template <unsigned Size, typename T>
+__device__ T reduce(const thread_block_tile<Size> &, T Value, greater<T>) {
+  return __chip_reduce_max(Value, Size);
+}
+
+/// Inclusive scan over a tile in the order of thread_rank().
+template <unsigned Size, typename T, typename OpT>
+__device__ T inclusive_scan(const thread_block_tile<Size> &Tile, T Value,
+                            OpT Op) {
+  for (unsigned Offset = 1; Offset < Size; Offset *= 2) {
+    T Other = Tile.shfl_up(Value, Offset);
+    if (Tile.thread_rank() >= Offset)
+      Value = Op(Value, Other);
+  }
+  return Value;
+}
+template <unsigned Size, typename T>
+__device__ T inclusive_scan(const thread_block_tile<Size> &, T Value,
+                            plus<T>) {
+  return __chip_scan_inclusive_add(Value, Size);
+}
+template <unsigned Size, typename T>
+__device__ T inclusive_scan(const thread_block_tile<Size> &, T Value,
+                            less<T>) {
+  return __chip_scan_inclusive_min(Value, Size);
+}
+template <unsigned Size, typename T>
+__device__ T inclusive_scan(const thread_block_tile<Size> &, T Value,
+                            greater<T>) {
+  return __chip_scan_inclusive_max(Value, Size);
+}
+template <unsigned Size, typename T>
+__device__ T inclusive_scan(const thread_block_tile<Size> &Tile, T Value) {
+  return inclusive_scan(Tile, Value, plus<T>());
+}
+
+/// Exclusive scan over a tile: the inclusive scan shifted up by one thread.
+/// The first thread gets a value-initialized T.
+template <unsigned Size, typename T, typename OpT>
+__device__ T exclusive_scan(const thread_block_tile<Size> &Tile, T Value,
+                            OpT Op) {
+  T Preceding = Tile.shfl_up(inclusive_scan(Tile, Value, Op), 1);
+  return Tile.thread_rank() == 0 ? T() : Preceding;
+}
+template <unsigned Size, typename T>
+__device__ T exclusive_scan(const thread_block_tile<Size> &Tile, T Value) {
+  return exclusive_scan(Tile, Value, plus<T>());
+}
+
+} // namespace cooperative_groups
 
-#endif  // HIP_INCLUDE_HIP_NVIDIA_DETAIL_HIP_COOPERATIVE_GROUPS_H
+#endif // HIP_INCLUDE_HIP_SPIRV_HIP_COOPERATIVE_GROUPS_H
@@ -26,6 +26,9 @@
 #include "HipEmitLoweredNames.h"
 #include "HipKernelArgSpiller.h"
 #include "HipLowerZeroLengthArrays.h"
+#include "HipResolveAddrSpaces.h"
+
+#include "../src/common.hh"
 
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
@@ -38,13 +41,16 @@
 
 using namespace llvm;
 
-// A pass that removes noinline and optnone attributes from functions.
+// A pass that removes noinline and optnone attributes from functions. The
+// functions the runtime device libraries replace stay out of line so the
+// calls to them can be linked to the native variants.
 class RemoveNoInlineOptNoneAttrsPass
     : public PassInfoMixin<RemoveNoInlineOptNoneAttrsPass> {
 public:
   PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM) {
     for (auto &F : M) {
-      F.removeFnAttr(Attribute::NoInline);
+      if (!findRtDevLib(F.getName()))
+        F.removeFnAttr(Attribute::NoInline);
       F.removeFnAttr(Attribute::OptimizeNone);
     }
     return PreservedAnalyses::none();
@@ -82,6 +88,60 @@ public:
   static bool isRequired() { return true; }
 };
 
+// Exports the emulated device library functions the runtime device
+// libraries have native variants of (see ChipRtDevLibs) so the runtime can
+// link those instead. The device library is internalized when it is linked,
+// so there may be a copy of each function per translation unit; they are
+// merged into one under the original name.
+class HipExportRtDevLibFunctionsPass
+    : public PassInfoMixin<HipExportRtDevLibFunctionsPass> {
+public:
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM) {
+    SmallVector<Function *, 8> Functions;
+    for (auto &F : M)
+      if (!F.isDeclaration() && findRtDevLib(F.getName()))
+        Functions.push_back(&F);
+
+    for (auto *F : Functions) {
+      auto Name = F->getName().split('.').first;
+      auto *Export = M.getFunction(Name);
+      if (Export && Export != F &&
+          Export->getFunctionType() == F->getFunctionType()) {
+        F->replaceAllUsesWith(Export);
+        F->eraseFromParent();
+        continue;
+      }
+      if (!Export)
+        F->setName(Name);
+      F->setLinkage(GlobalValue::ExternalLinkage);
+      F->setVisibility(GlobalValue::DefaultVisibility);
+    }
+    return Functions.empty() ? PreservedAnalyses::all()
+                             : PreservedAnalyses::none();
+  }
+
+  static bool isRequired() { return true; }
+};
+
+// Removes the malloc() heap pointer from the modules which do not allocate
+// so the runtime does not set up a heap for them.
+class HipRemoveUnusedMallocHeapPass
+    : public PassInfoMixin<HipRemoveUnusedMallocHeapPass> {
+public:
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM) {
+    auto *HeapVar = M.getGlobalVariable(ChipDeviceMallocHeapName);
+    if (!HeapVar)
+      return PreservedAnalyses::all();
+    HeapVar->removeDeadConstantUsers();
+    if (!HeapVar->use_empty())
+      return PreservedAnalyses::all();
+    HeapVar->eraseFromParent();
+    return PreservedAnalyses::none();
+  }
+
+  static bool isRequired() { return true; }
+};
+
 static void addFullLinkTimePasses(ModulePassManager &MPM) {
   /// For extracting name expression to lowered name expressions (hiprtc).
   MPM.addPass(HipEmitLoweredNamesPass());
@@ -111,13 +171,12 @@ static void addFullLinkTimePasses(ModulePassManager &MPM) {
 
   MPM.addPass(HipTextureLoweringPass());
 
-  // TODO: Update printf pass for HIP-Clang 14+. It now triggers an assert:
-  //
-  //  Assertion `isa<X>(Val) && "cast<Ty>() argument of incompatible type!"'
-  //  failed.
-  MPM.addPass(HipPrintfToOpenCLPrintfPass());
+  MPM.addPass(HipPrintfPass());
   MPM.addPass(createModuleToFunctionPassAdaptor(HipDefrostPass()));
   MPM.addPass(HipAbortPass());
+  // Must be run after inlining so the uses of the heap pointer by unused
+  // functions are gone.
+  MPM.addPass(HipRemoveUnusedMallocHeapPass());
   // This pass must appear after HipDynMemExternReplaceNewPass.
   MPM.addPass(HipGlobalVariablesPass());
 
@@ -131,8 +190,13 @@ static void addFullLinkTimePasses(ModulePassManager &MPM) {
   MPM.addPass(HipStripUsedIntrinsicsPass());
   MPM.addPass(createModuleToFunctionPassAdaptor(DCEPass()));
   MPM.addPass(GlobalDCEPass());
+  // Must be run after GlobalDCE has removed the unused copies.
+  MPM.addPass(HipExportRtDevLibFunctionsPass());
 
   MPM.addPass(createModuleToFunctionPassAdaptor(InferAddressSpacesPass(4)));
+  // Drop the runtime address space queries of the device library functions
+  // on the pointers InferAddressSpaces made specific.
+  MPM.addPass(HipResolveAddrSpacesPass());
   MPM.addPass(HipFixOpenCLMDPass());
 }
 
@@ -153,6 +217,23 @@ llvmGetPassPluginInfo() {
                     addFullLinkTimePasses(MPM);
                     return true;
                   }
+                  // Individual passes for testing.
+                  if (Name == "hip-warps") {
+                    MPM.addPass(HipWarpsPass());
+                    return true;
+                  }
+                  if (Name == "hip-resolve-addr-spaces") {
+                    MPM.addPass(HipResolveAddrSpacesPass());
+                    return true;
+                  }
+                  if (Name == "hip-printf") {
+                    MPM.addPass(HipPrintfPass());
+                    return true;
+                  }
+                  if (Name == "hip-export-rtdevlib") {
+                    MPM.addPass(HipExportRtDevLibFunctionsPass());
+                    return true;
+                  }
                   return false;
                 });
           }};
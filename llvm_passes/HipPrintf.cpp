@@ -6,466 +6,334 @@
 // SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
 //
 //===----------------------------------------------------------------------===//
-// LLVM IR pass to convert calls to the CUDA/HIP printf() to OpenCL/SPIR-V
-// compatible ones.
+// LLVM IR pass to lower the CUDA/HIP printf() calls to records written to a
+// buffer which the runtime formats on the host.
 //
 // (c) 2021-2022 Pekka Jääskeläinen / Parmance for Argonne National Laboratory
 // (c) 2023 CHIP-SPV developers
 //===----------------------------------------------------------------------===//
 //
-// This pass moves the format string from global to the OpenCL constant address
-// space before we pass the IR to SPIR-V emission, which is required by the
-// SPIR-V's OpenCL profile.
+// The OpenCL printf() requires the %s arguments to be string literals and
+// its output depends on the printf buffer of the driver. Instead of mapping
+// to it, each printf() call appends a record to a buffer the runtime has set
+// up and the runtime formats the records on the host at the next
+// synchronization point, like CUDA does.
 //
-// More annoyingly, in OpenCL 1.2 the printf string args must be pointers to
-// _literal srings_ according to the specs.
-// https://www.khronos.org/registry/OpenCL/sdk/1.2/docs/man/xhtml/
-// printfFunction.html
+// E.g. printf("%d %s\n", X, S) is converted to:
 //
-// This deviates from the C99 printf (and thus CUDA) which allows dynamic
-// string arguments. To implement this on top of the OpenCL printf, we split the
-// format string such that whenever there's a %s we print the string using
-// a printf("%c", c) loop and delegate the surrounding parts format string
-// parts to the printf as is.
+//   Len = _chip_printf_strlen(S);
+//   Size = 8 + 2 * 8 + roundUp(Len, 8);
+//   Record = _chip_printf_alloc(__chipspv_printf_buffer, Size);
+//   if (Record) {
+//     Record->FormatOffset = <the offset of "%d %s\n">;
+//     *(int64_t *)&Record[8] = X;
+//     *(int64_t *)&Record[16] = Len;
+//     _chip_printf_strcpy(&Record[24], S, Len);
+//     _chip_printf_commit(Record, Size);
+//   }
 //
-// E.g. printf("%d %s %d", ...) would be converted to a chain of calls:
-// printf("%d ", ...), _putstr(...), ... printf(" %d", ...)
+// The record layout is described in src/common.hh and the helper functions
+// are defined in bitcode/printf_support.cl. The size is stored last by
+// _chip_printf_commit() since the runtime may read the buffer while kernels
+// are running. A record which does not fit in the buffer is dropped and
+// counted for the runtime to report.
 //
-// This works as long as we can analyze the format string at compile time to
-// detect the string arg positions,  thus dynamic _format_ strings are still
-// not supported.
+// The format strings are collected into a constant variable which the
+// runtime reads from the SPIR-V binary. They must be known at compile time.
 //
-// However, since SPIR-V doesn't mention a need of the string arguments to
-// be in the constant space, we by default let them pass since implementations
-// appear to allow it.
-//
-// Also counts the number of format args for replacing the return value of
-// the printf() call with it for rough CUDA-behavior emulation.
+// The printf() calls return the number of format specifiers for rough
+// CUDA-behavior emulation.
 //
 //===----------------------------------------------------------------------===//
 
 #include "HipPrintf.h"
 
-#include "llvm/ADT/SmallPtrSet.h"
+#include "LLVMSPIRV.h"
+#include "../src/common.hh"
+
+#include "llvm/ADT/StringMap.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instructions.h"
-#include "llvm/Pass.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
 
-#include <vector>
+#include <optional>
 #include <string>
-#include <iostream>
 
 #define DEBUG_TYPE "hip-printf"
 
-#define SPIRV_OPENCL_CONSTANT_AS 2
-#define SPIRV_OPENCL_GENERIC_AS 4
-#define SPIRV_OPENCL_PRINTF_FMT_ARG_AS SPIRV_OPENCL_CONSTANT_AS
-
-#define ORIG_PRINTF_FUNC_NAME "_hip_printf"
-#define ORIG_PRINT_STRING_FUNC_NAME "_cl_print_str"
-
-// The SPIR-V specification doesn't especially forbid %s
-// arguments that are not "literals" (in constant address
-// space as specified by OpenCL). Assume a SPIR-V printf
-// can print strings that are not moved to constant space
-// and no special functions is needed for their printout.
-// The SPIR-V implementations seen so far do not care about this.
-#define ASSUME_PRINTF_SUPPORTS_GLOBAL_STRING_ARGS 0
-
 using namespace llvm;
 
+namespace {
+
 unsigned NumFormatSpecs(StringRef FmtString) {
   return FmtString.count("%") - 2 * FmtString.count("%%");
 }
 
-// Strip address space casts, GEPs etc. towards the global string
-// literal and return it.
-GlobalVariable *findGlobalStr(Value *Arg) {
-
-  if (auto *GV = dyn_cast<GlobalVariable>(Arg))
-    return GV;
+// Return the format string passed in FmtArg if it is known at compile time.
+std::optional<std::string> getFormatString(Value *FmtArg) {
+  auto *GV = dyn_cast<GlobalVariable>(FmtArg->stripPointerCasts());
+  if (!GV || !GV->isConstant() || !GV->hasInitializer())
+    return std::nullopt;
+  if (GV->getInitializer()->isZeroValue())
+    return std::string();
+  auto *Data = dyn_cast<ConstantDataSequential>(GV->getInitializer());
+  if (!Data || !Data->isCString())
+    return std::nullopt;
+  return Data->getAsCString().str();
+}
 
-  if (auto GEP = dyn_cast<GetElementPtrInst>(Arg)) {
-    assert(GEP->hasAllZeroIndices());
-    return findGlobalStr(GEP->getPointerOperand());
-  }
-  if (auto ASCast = dyn_cast<AddrSpaceCastInst>(Arg))
-    return findGlobalStr(ASCast->getPointerOperand());
-  else if (auto CE = dyn_cast<ConstantExpr>(Arg)) {
-    if (CE->getOpcode() == llvm::Instruction::AddrSpaceCast ||
-        CE->getOpcode() == llvm::Instruction::GetElementPtr)
-      return findGlobalStr(CE->getOperand(0));
-    else
-      llvm_unreachable("Unexpected printf format string format!");
+// Return the conversions of the format string, one per argument they take:
+// '*' for a width or precision given as an argument. Keep in sync with the
+// formatting in src/CHIPPrintf.cc.
+std::string getArgConversions(StringRef Fmt) {
+  std::string Conversions;
+  size_t I = 0;
+  auto Skip = [&](StringRef Chars) {
+    while (I < Fmt.size() && Chars.contains(Fmt[I]))
+      ++I;
+  };
+  auto SkipField = [&]() {
+    if (I < Fmt.size() && Fmt[I] == '*') {
+      Conversions += '*';
+      ++I;
+    } else
+      Skip("0123456789");
+  };
+  while (I < Fmt.size()) {
+    if (Fmt[I++] != '%')
+      continue;
+    if (I < Fmt.size() && Fmt[I] == '%') {
+      ++I;
+      continue;
+    }
+    Skip("-+ #0");
+    SkipField();
+    if (I < Fmt.size() && Fmt[I] == '.') {
+      ++I;
+      SkipField();
+    }
+    Skip("hljztL");
+    if (I < Fmt.size())
+      Conversions += Fmt[I++];
   }
-  llvm_unreachable("Unrecognized instruction or constant expression.");
+  return Conversions;
 }
 
-// Extracts the format string in the printf argument passed as FmtStrArg,
-// and (possibly) splits it to a number of format strings if there are %s
-// format args. In such a case the %s format string is returned as a separate
-// "%s" format string. Also counts the total number of format specifiers in
-// NumberOfFormatSpecs to returns it as a final return value.
-static std::vector<std::string>
-getFormatStringPieces(Value *FmtStrArg, unsigned &NumberOfFormatSpecs) {
-
-  Value *Temp = FmtStrArg;
+// Convert a printf() argument to the value stored in its slot.
+Value *getSlotValue(IRBuilder<> &B, Value *Arg) {
+  Type *Ty = Arg->getType();
+  if (Ty->isIntegerTy())
+    return B.CreateSExtOrTrunc(Arg, B.getInt64Ty());
+  if (Ty->isFloatingPointTy())
+    return B.CreateFPCast(Arg, B.getDoubleTy());
+  if (Ty->isPointerTy())
+    return B.CreatePtrToInt(Arg, B.getInt64Ty());
+  LLVM_DEBUG(dbgs() << "Unsupported printf argument: " << *Arg << "\n");
+  return B.getInt64(0);
+}
 
-  // the ARG is a GEP, get the first operand
-  if (Instruction *I = dyn_cast<Instruction>(Temp)) {
-    Temp = I->getOperand(0);
+class PrintfLowering {
+  Module &M_;
+  GlobalVariable *BufferVar_;
+  /// The format strings, each terminated by a nul.
+  std::string Formats_;
+  StringMap<uint32_t> FormatOffsets_;
+  FunctionCallee AllocF_;
+  FunctionCallee StrLenF_;
+  FunctionCallee StrCpyF_;
+  FunctionCallee CommitF_;
+
+  FunctionCallee getHelper(StringRef Name, Type *RetTy,
+                           ArrayRef<Type *> ParamTys) {
+    auto Callee = M_.getOrInsertFunction(
+        Name, FunctionType::get(RetTy, ParamTys, false));
+    if (auto *F = dyn_cast<Function>(Callee.getCallee()))
+      F->setCallingConv(CallingConv::SPIR_FUNC);
+    return Callee;
   }
 
-  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(Temp)) {
-    Temp = CE->getOperand(0);
+  CallInst *createCall(IRBuilder<> &B, FunctionCallee Callee,
+                       ArrayRef<Value *> Args) {
+    CallInst *Call = B.CreateCall(Callee, Args);
+    Call->setCallingConv(CallingConv::SPIR_FUNC);
+    return Call;
   }
 
-  GlobalVariable *OrigFmtStr = findGlobalStr(Temp);
-
-  std::vector<std::string> FmtStrPieces;
-  ConstantDataSequential *FmtStrData =
-      dyn_cast<ConstantDataSequential>(OrigFmtStr->getInitializer());
-
-  if (FmtStrData == nullptr) {
-    assert(OrigFmtStr->getInitializer()->isZeroValue());
-    FmtStrPieces.push_back("");
-    NumberOfFormatSpecs = 0;
-    return FmtStrPieces;
+  uint32_t getFormatOffset(StringRef Fmt) {
+    auto Inserted = FormatOffsets_.try_emplace(Fmt, Formats_.size());
+    if (Inserted.second) {
+      Formats_ += Fmt;
+      Formats_ += '\0';
+    }
+    return Inserted.first->second;
   }
 
-  auto FmtString = FmtStrData->getAsString();
-
-  // Counting the format specs is a more accurate approximation for the return
-  // value than counting the passed arguments due to the dynamic width
-  // specifier (*) which is given as an argument and should not be counted
-  // in to the processed arguments (I believe).
-  NumberOfFormatSpecs = NumFormatSpecs(FmtString);
-
-  // FmtStrData has one byte larger size since it includes the trailing
-  // byte, so if we convert it directly to a std::string, it gets a corrupted
-  // string due to the wrong size passed to it (occurs at least with LLVM 13)?
-  // TO CHECK again.
-  std::string FmtStr = std::string(FmtStrData->getAsCString());
-
-  // TODO: %s can also have * specifier. We have to treat it as a special
-  // case, adding strlen() - width for padding.
-  size_t Pos = 0;
-  while ((Pos = FmtStr.find("%s")) != std::string::npos &&
-         // Without this we'd handle %%s wrongly.
-         !(Pos > 0 && FmtStr[Pos - 1] == '%')) {
-    std::string TokenBefore = FmtStr.substr(0, Pos);
-    if (TokenBefore != "")
-      FmtStrPieces.push_back(TokenBefore);
-    assert(FmtStr.size() > Pos + 2 - 1);
-    FmtStr.erase(0, Pos + 2);
-    FmtStrPieces.push_back("%s");
+public:
+  PrintfLowering(Module &M, GlobalVariable *BufferVar)
+      : M_(M), BufferVar_(BufferVar) {
+    LLVMContext &Ctx = M.getContext();
+    auto *Int8Ty = Type::getInt8Ty(Ctx);
+    auto *Int32Ty = Type::getInt32Ty(Ctx);
+    auto *GenericPtrTy = PointerType::get(Int8Ty, SPIRV_GENERIC_AS);
+    auto *GlobalPtrTy = PointerType::get(Int8Ty, SPIRV_CROSSWORKGROUP_AS);
+    AllocF_ = getHelper("_chip_printf_alloc", GlobalPtrTy,
+                        {GenericPtrTy, Int32Ty});
+    StrLenF_ = getHelper("_chip_printf_strlen", Int32Ty, {GenericPtrTy});
+    StrCpyF_ = getHelper("_chip_printf_strcpy", Type::getVoidTy(Ctx),
+                         {GlobalPtrTy, GenericPtrTy, Int32Ty});
+    CommitF_ = getHelper("_chip_printf_commit", Type::getVoidTy(Ctx),
+                         {GlobalPtrTy, Int32Ty});
   }
-  if (FmtStr != "")
-    FmtStrPieces.push_back(FmtStr);
-  return FmtStrPieces;
-}
-
-std::string getCDSAsString(GlobalVariable *OrigStr, bool &IsEmpty) {
-
-  assert(OrigStr != nullptr && OrigStr->hasInitializer());
-
-  ConstantDataSequential *CDSInitializer =
-      dyn_cast<ConstantDataSequential>(OrigStr->getInitializer());
-
-  assert(OrigStr->getInitializer()->isZeroValue() || CDSInitializer != nullptr);
-
-  IsEmpty = OrigStr->getInitializer()->isZeroValue();
-  return (IsEmpty ? "" : std::string(CDSInitializer->getAsCString()));
-}
-
-// Tries to convert the string argument to an OpenCL compatible one
-// by creating a copy of it in the module global scope. Returns nullptr
-// if unable to do so.
-Value *HipPrintfToOpenCLPrintfPass::cloneStrArgToConstantAS(
-    Value *StrArg, llvm::IRBuilder<> &B, bool *IsEmpty) {
-
-  ConstantExpr *CE = dyn_cast<ConstantExpr>(StrArg);
-  if (CE == nullptr)
-    return nullptr;
-
-  Value *StrOpr = CE->getOperand(0);
-
-  GlobalVariable *OrigStr = findGlobalStr(StrOpr);
-  if (OrigStr == nullptr || !OrigStr->hasInitializer())
-    return nullptr;
-
-  std::string NewStr = getCDSAsString(OrigStr, *IsEmpty);
-  return getOrCreateStrLiteralArg(NewStr, B);
-}
 
-// Checks if the GlobalVariable a literal string.
-bool isLiteralString(const GlobalVariable &Var) {
-
-  if (!Var.isConstant())
-    return false;
-
-  auto ArrayTy = dyn_cast<ArrayType>(Var.getType()->getArrayElementType());
-  if (!ArrayTy)
-    return false;
-
-  auto IntTy = dyn_cast<IntegerType>(ArrayTy->getArrayElementType());
-  if (!IntTy)
-    return false;
-
-  return IntTy->getBitWidth() == 8;
-}
-
-// Create a new string literal that can be passed to an OpenCL printf
-// as an argument. Try to reuse previously created ones, if possible.
-Constant *
-HipPrintfToOpenCLPrintfPass::getOrCreateStrLiteralArg(const std::string &Str,
-                                                      llvm::IRBuilder<> &B) {
-
-  auto &LiteralArg = LiteralArgs_[Str];
-  if (LiteralArg != nullptr)
-    return LiteralArg;
-
-#if LLVM_VERSION_MAJOR >= 15
-#if LLVM_VERSION_MAJOR == 15
-  assert(B.getContext().hasSetOpaquePointersValue());
-#endif
-
-  if (B.getContext().supportsTypedPointers()) {
-#endif
-    GlobalVariable *LiteralStr = B.CreateGlobalString(Str.c_str(), ".cl_printf_fmt_str",
-                                            SPIRV_OPENCL_PRINTF_FMT_ARG_AS);
-
-    IntegerType *Int64Ty = Type::getInt64Ty(M_->getContext());
-    ConstantInt *Zero = ConstantInt::get(Int64Ty, 0);
-    std::array<Constant *, 2> Indices = {Zero, Zero};
-
-    LiteralArg = llvm::ConstantExpr::getGetElementPtr(
-               LiteralStr->getValueType(), LiteralStr, Indices);
-#if LLVM_VERSION_MAJOR >= 15
-  } else {
-    LiteralArg = B.CreateGlobalString(Str.c_str(), ".cl_printf_fmt_str",
-                              SPIRV_OPENCL_PRINTF_FMT_ARG_AS);
+  void lower(CallInst *CI);
+  void emitFormats();
+};
+
+void PrintfLowering::lower(CallInst *CI) {
+  LLVM_DEBUG(dbgs() << "Original printf call: " << *CI << "\n");
+  IRBuilder<> B(CI);
+  auto *Int8Ty = B.getInt8Ty();
+  auto *GenericPtrTy = PointerType::get(Int8Ty, SPIRV_GENERIC_AS);
+  unsigned NumArgs = CI->arg_size() - 1;
+
+  std::string Conversions;
+  Value *RetVal = PoisonValue::get(B.getInt32Ty());
+  auto Fmt = getFormatString(CI->getArgOperand(0));
+  if (!Fmt) {
+    LLVM_DEBUG(dbgs() << "  Format string is not a constant\n");
+    Fmt = "Error: printf format string is not a constant\n";
+  } else if ((Conversions = getArgConversions(*Fmt)).size() > NumArgs) {
+    // More specifiers than format arguments. Either the user forgot
+    // arguments or the format string has invalid specifiers - in either
+    // case this triggers UB.
+    LLVM_DEBUG(dbgs() << "  Invalid format string or missing arguments?\n");
+    Fmt = "Error: Invalid printf format string\n";
+    Conversions.clear();
+  } else
+    RetVal = B.getInt32(NumFormatSpecs(*Fmt));
+
+  // Compute the size of the record.
+  SmallVector<Value *, 4> Strings(Conversions.size());
+  SmallVector<Value *, 4> StrLens(Conversions.size());
+  auto RoundUpToSlot = [&](Value *Size) {
+    return B.CreateAnd(B.CreateAdd(Size, B.getInt32(ChipPrintfSlotSize - 1)),
+                       B.getInt32(~(ChipPrintfSlotSize - 1)));
+  };
+  Value *Size = B.getInt32(sizeof(CHIPPrintfRecord) +
+                           Conversions.size() * ChipPrintfSlotSize);
+  for (size_t I = 0; I < Conversions.size(); I++) {
+    if (Conversions[I] != 's')
+      continue;
+    Value *Arg = CI->getArgOperand(I + 1);
+    Strings[I] = Arg->getType()->isPointerTy()
+                     ? B.CreatePointerBitCastOrAddrSpaceCast(Arg, GenericPtrTy)
+                     : ConstantPointerNull::get(GenericPtrTy);
+    StrLens[I] = createCall(B, StrLenF_, {Strings[I]});
+    Size = B.CreateAdd(Size, RoundUpToSlot(StrLens[I]));
   }
-#endif
-
-  return LiteralArg;
-}
 
-Function *HipPrintfToOpenCLPrintfPass::getOrCreatePrintStringF() {
-
-  if (GlobalValue *OldPrintStrF =
-          M_->getNamedValue(ORIG_PRINT_STRING_FUNC_NAME))
-    return cast<Function>(OldPrintStrF);
-
-  auto *Int8Ty = IntegerType::get(M_->getContext(), 8);
-  PointerType *GenericCStrArgT =
-      PointerType::get(Int8Ty, SPIRV_OPENCL_GENERIC_AS);
-
-  FunctionType *PrintStrFTy = FunctionType::get(
-      Type::getVoidTy(M_->getContext()), {GenericCStrArgT}, false);
+  Value *Buffer = B.CreateLoad(BufferVar_->getValueType(), BufferVar_);
+  Buffer = B.CreatePointerBitCastOrAddrSpaceCast(Buffer, GenericPtrTy);
+  Value *Record = createCall(B, AllocF_, {Buffer, Size});
+  Instruction *Then =
+      SplitBlockAndInsertIfThen(B.CreateIsNotNull(Record), CI, false);
+  B.SetInsertPoint(Then);
+
+  auto Store = [&](Value *V, Value *Offset, unsigned Alignment) {
+    Value *Ptr = B.CreateGEP(Int8Ty, Record, Offset);
+    Ptr = B.CreateBitCast(
+        Ptr, PointerType::get(V->getType(), SPIRV_CROSSWORKGROUP_AS));
+    B.CreateAlignedStore(V, Ptr, Align(Alignment));
+  };
+  Store(B.getInt32(getFormatOffset(*Fmt)),
+        B.getInt32(offsetof(CHIPPrintfRecord, FormatOffset)), 4);
+
+  Value *Offset = B.getInt32(sizeof(CHIPPrintfRecord));
+  for (size_t I = 0; I < Conversions.size(); I++) {
+    if (StrLens[I]) {
+      Store(B.CreateZExt(StrLens[I], B.getInt64Ty()), Offset,
+            ChipPrintfSlotSize);
+      Offset = B.CreateAdd(Offset, B.getInt32(ChipPrintfSlotSize));
+      createCall(B, StrCpyF_,
+                 {B.CreateGEP(Int8Ty, Record, Offset), Strings[I], StrLens[I]});
+      Offset = B.CreateAdd(Offset, RoundUpToSlot(StrLens[I]));
+      continue;
+    }
+    Store(getSlotValue(B, CI->getArgOperand(I + 1)), Offset,
+          ChipPrintfSlotSize);
+    Offset = B.CreateAdd(Offset, B.getInt32(ChipPrintfSlotSize));
+  }
+  createCall(B, CommitF_, {Record, Size});
 
-  FunctionCallee PrintStrF =
-      M_->getOrInsertFunction(ORIG_PRINT_STRING_FUNC_NAME, PrintStrFTy);
-  cast<Function>(PrintStrF.getCallee())
-      ->setCallingConv(llvm::CallingConv::SPIR_FUNC);
-  return cast<Function>(PrintStrF.getCallee());
+  CI->replaceAllUsesWith(RetVal);
+  CI->eraseFromParent();
 }
 
-// Get called function from 'CI' call or return nullptr the call is indirect.
-static Function* getCalledFunction(CallInst *CI, const LLVMContext &Ctx) {
-  assert(CI);
-  if (auto *Callee = CI->getCalledFunction())
-    return Callee;
-
-  if (CI->isIndirectCall())
-    return nullptr;
-  // A call with mismatched call signature.
-
-#if LLVM_VERSION_MAJOR > 14
-#if LLVM_VERSION_MAJOR == 15
-  assert(Ctx.hasSetOpaquePointersValue());
-#endif
-
-  if (!Ctx.supportsTypedPointers())
-    return cast<Function>(CI->getCalledOperand());
-#endif
-
-  auto *CalledOp = dyn_cast<ConstantExpr>(CI->getCalledOperand());
-  assert(CalledOp && CalledOp->getOpcode() == Instruction::BitCast);
-  return cast<Function>(CalledOp->getOperand(0));
+void PrintfLowering::emitFormats() {
+  auto *Init = ConstantDataArray::getString(M_.getContext(), Formats_,
+                                            /*AddNull=*/false);
+  auto *GV = new GlobalVariable(
+      M_, Init->getType(), true,
+      // Mark the GV as external for keeping it alive at least until the
+      // CHIP-SPV runtime reads it.
+      GlobalValue::ExternalLinkage, Init, ChipPrintfFormatsName, nullptr,
+      GlobalValue::NotThreadLocal, SPIRV_CROSSWORKGROUP_AS);
+  LLVM_DEBUG(dbgs() << "Printf format strings: " << *GV << "\n");
+  (void)GV;
 }
 
-PreservedAnalyses HipPrintfToOpenCLPrintfPass::run(Module &Mod,
-                                                   ModuleAnalysisManager &AM) {
-
-  M_ = &Mod;
-  LiteralArgs_.clear();
-
-  GlobalValue *Printf = Mod.getNamedValue("printf");
-  GlobalValue *HipPrintf = Mod.getNamedValue(ORIG_PRINTF_FUNC_NAME);
-
-  // No printf decl in the module, no printf calls to handle.
-  // 1 use if the "printf" is only used by "_cl_printf"
-  if (Printf == nullptr || Printf->getNumUses() == 1)
-    return PreservedAnalyses::all();
-  LLVM_DEBUG(dbgs() << "Found printf decl: "; Printf->dump());
-
-  Function *PrintfF = cast<Function>(Printf);
-
-  LLVMContext &Ctx = Mod.getContext();
-  auto *Int8Ty = IntegerType::get(Ctx, 8);
-  auto *Int32Ty = IntegerType::get(Ctx, 32);
-
-  PointerType *ConstStrPtrT =
-      PointerType::get(Int8Ty, SPIRV_OPENCL_CONSTANT_AS);
-
-  PointerType *OCLPrintfFmtArgT = ConstStrPtrT;
-
-  FunctionType *OpenCLPrintfTy =
-      FunctionType::get(Int32Ty, {OCLPrintfFmtArgT}, true);
-
-  FunctionCallee OpenCLPrintfF;
+} // namespace
 
-  if (HipPrintf == nullptr) {
-    // Create the OpenCL printf decl which will be used instead. Rename the
-    // old one away to _hip_printf.
-    PrintfF->setName(ORIG_PRINTF_FUNC_NAME);
-    HipPrintf = PrintfF;
-    OpenCLPrintfF = Mod.getOrInsertFunction(
-        "printf", OpenCLPrintfTy, cast<Function>(HipPrintf)->getAttributes());
-    Function *PrintfF = cast<Function>(OpenCLPrintfF.getCallee());
-    PrintfF->setCallingConv(llvm::CallingConv::SPIR_FUNC);
-    PrintfF->setVisibility(llvm::GlobalValue::HiddenVisibility);
-  } else {
-    OpenCLPrintfF = FunctionCallee(OpenCLPrintfTy, PrintfF);
+PreservedAnalyses HipPrintfPass::run(Module &Mod, ModuleAnalysisManager &AM) {
+  auto *PrintfF = dyn_cast_or_null<Function>(Mod.getNamedValue("printf"));
+  GlobalVariable *BufferVar =
+      Mod.getGlobalVariable(ChipDevicePrintfBufferName);
+
+  SmallVector<CallInst *, 16> Calls;
+  if (PrintfF)
+    for (auto &F : Mod)
+      for (auto &BB : F)
+        for (auto &I : BB)
+          if (auto *CI = dyn_cast<CallInst>(&I))
+            // Look through the bitcasts of calls with mismatched signature.
+            if (CI->getCalledOperand()->stripPointerCasts() == PrintfF)
+              Calls.push_back(CI);
+
+  if (Calls.empty()) {
+    // Remove the buffer from the modules which do not print so the
+    // runtime does not have to set it up and check it.
+    if (!BufferVar)
+      return PreservedAnalyses::all();
+    BufferVar->replaceAllUsesWith(
+        Constant::getNullValue(BufferVar->getType()));
+    BufferVar->eraseFromParent();
+    return PreservedAnalyses::none();
   }
 
-  bool Modified = false;
-
-  for (auto &F : Mod) {
-    SmallPtrSet<Instruction *, 8> EraseList;
-    for (auto &BB : F) {
-      for (auto &I : BB) {
-        CallInst *CI = dyn_cast<CallInst>(&I);
-        if (!CI)
-          continue;
-
-        Function *Callee = getCalledFunction(CI, Ctx);
-        if (!Callee) {
-          // There is a call signature mismatch if getCalledFunction() returns
-          // nullptr.
-          Value *CalledOpV = CI->getCalledOperand();
-          Instruction *CalledOpInst = dyn_cast<Instruction>(CalledOpV);
-          assert(CalledOpInst->getOpcode() == Instruction::BitCast);
-          Callee = cast<Function>(CalledOpInst->getOperand(0));
-          if (Callee == nullptr)
-            llvm_unreachable("callee is not a function!");
-        }
-        if (Callee->getName() != ORIG_PRINTF_FUNC_NAME)
-          continue;
-
-        LLVM_DEBUG(dbgs() << "Original printf call: "; CI->dump());
-
-        CallInst &OrigCall = cast<CallInst>(I);
-        unsigned TotalFmtSpecCount;
-        auto FmtSpecPieces =
-            getFormatStringPieces(*OrigCall.args().begin(), TotalFmtSpecCount);
-
-        IRBuilder<> B(&I);
-
-        if (TotalFmtSpecCount > OrigCall.arg_size() - 1) {
-          // More specifiers than format arguments. Either the user forgot
-          // arguments or the format string has invalid specifiers - in either
-          // case this triggers UB.
-          LLVM_DEBUG(dbgs()
-                     << "  Invalid format string or missing arguments?\n");
-          Value *ErrorFmt = getOrCreateStrLiteralArg(
-              "Error: Invalid printf format string\n", B);
-          CallInst::Create(OpenCLPrintfF, ArrayRef(ErrorFmt), "", &OrigCall);
-          auto *PoisonInt = PoisonValue::get(Type::getInt32Ty(Ctx));
-          OrigCall.replaceAllUsesWith(PoisonInt);
-          EraseList.insert(&OrigCall);
-          continue;
-        }
-
-        auto OrigCallArgs = OrigCall.args();
-        auto OrigCallArgI = OrigCallArgs.begin();
-        // Skip the original format string arg and recreate it.
-        OrigCallArgI++;
-
-        for (auto FmtStr : FmtSpecPieces) {
-          unsigned FormatSpecCount = NumFormatSpecs(FmtStr);
-          std::vector<Value *> Args;
-
-          // TODO: handle a (compile time known) null ptr format string arg and
-          // return -1 like CUDA does.
-          if (FmtStr == "") {
-            // No output, the return value suffices.
-            continue;
-          } else if (FmtStr == "%s" || FmtStr == "%*s") {
-            // This is a string printout, we do not pass the format string
-            // in that case, but just call a string printer.
-            // We can use the normal printf if the %s arg can be resolved to
-            // a literal C string. However, it must be moved to constant AS
-            // for OpenCL compatibility.
-            Value *OrigArg = *OrigCallArgI++;
-            bool IsEmpty = false;
-            if (Value *ConstantSpaceCStr =
-                    cloneStrArgToConstantAS(OrigArg, B, &IsEmpty)) {
-              if (IsEmpty)
-                continue; // empty str arg to a %s, no output needed
-              // We could copy the arg to constant space, printf it
-              // directly. No format string needed.
-              Args.push_back(ConstantSpaceCStr);
-              CallInst::Create(OpenCLPrintfF, Args, "", &OrigCall);
-            } else if (ASSUME_PRINTF_SUPPORTS_GLOBAL_STRING_ARGS) {
-              if (IsEmpty)
-                continue;
-              // Create a constant space format string for %s.
-              Args.push_back(getOrCreateStrLiteralArg("%s", B));
-              // ...and then assume the data arg can point to a generic
-              // address space string (eventually residing in global AS).
-              Args.push_back(OrigArg);
-              CallInst::Create(OpenCLPrintfF, Args, "", &OrigCall);
-            } else {
-              Args.push_back(OrigArg);
-              CallInst::Create(getOrCreatePrintStringF(), Args, "", &OrigCall);
-            }
-            continue;
-          }
-
-          // Handle as a normal printf() call.
-          Args.push_back(getOrCreateStrLiteralArg(FmtStr, B));
-          while (FormatSpecCount--) {
-            assert(OrigCallArgI != OrigCallArgs.end());
-            Value *OrigArg = *OrigCallArgI++;
-            Args.push_back(OrigArg);
-          }
-          CallInst::Create(OpenCLPrintfF, Args, "", &OrigCall);
-        }
-
-        // Instead of returning the success/failure from the OpenCL printf(),
-        // assume that the parsing succeeds and return the number of format
-        // strings. A slight improvement would be to return 0 in case of a
-        // failure, but it still would not necessarily match CUDA nor HIP
-        // since it should return the number of _valid_ format replacements.
-        IntegerType *Int32Ty = Type::getInt32Ty(Ctx);
-        ConstantInt *RV = ConstantInt::get(Int32Ty, TotalFmtSpecCount);
-        OrigCall.replaceAllUsesWith(RV);
-
-        EraseList.insert(&I);
-      }
-    }
-    for (auto I : EraseList)
-      I->eraseFromParent();
-    Modified |= EraseList.size() > 0;
+  if (!BufferVar) {
+    // Not a HIP module. The runtime does not set up a buffer for it so the
+    // output is dropped.
+    auto *PtrTy =
+        PointerType::get(Type::getInt8Ty(Mod.getContext()), SPIRV_GENERIC_AS);
+    BufferVar = new GlobalVariable(
+        Mod, PtrTy, false, GlobalValue::WeakAnyLinkage,
+        Constant::getNullValue(PtrTy), ChipDevicePrintfBufferName, nullptr,
+        GlobalValue::NotThreadLocal, SPIRV_CROSSWORKGROUP_AS);
   }
 
-  SmallPtrSet<GlobalVariable *, 8> UnusedGlobals;
-  return Modified ? PreservedAnalyses::none() : PreservedAnalyses::all();
+  PrintfLowering Lowering(Mod, BufferVar);
+  for (auto *CI : Calls)
+    Lowering.lower(CI);
+  Lowering.emitFormats();
+
+  if (PrintfF->use_empty())
+    PrintfF->eraseFromParent();
+  return PreservedAnalyses::none();
 }
 
 namespace {
@@ -478,7 +346,7 @@ llvmGetPassPluginInfo() {
                 [](StringRef Name, ModulePassManager &FPM,
                    ArrayRef<PassBuilder::PipelineElement>) {
                   if (Name == "hip-printf") {
-                    FPM.addPass(HipPrintfToOpenCLPrintfPass());
+                    FPM.addPass(HipPrintfPass());
                     return true;
                   }
                   return false;
@@ -1,4 +1,4 @@
-//===- HipPrintf.cpp ------------------------------------------------------===//
+//===- HipPrintf.h --------------------------------------------------------===//
 //
 // Part of the CHIP-SPV Project, under the Apache License v2.0 with LLVM
 // Exceptions.
@@ -6,37 +6,24 @@
 // SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
 //
 //===----------------------------------------------------------------------===//
-// LLVM IR pass to convert calls to the CUDA/HIP printf() to OpenCL/SPIR-V
-// compatible ones.
+// LLVM IR pass to lower the CUDA/HIP printf() calls to records written to a
+// buffer which the runtime formats on the host.
 //
 // (c) 2021-2022 Pekka Jääskeläinen / Parmance for Argonne National Laboratory
+// (c) 2023 CHIP-SPV developers
 //===----------------------------------------------------------------------===//
 
 #ifndef LLVM_PASSES_HIP_PRINTF_H
 #define LLVM_PASSES_HIP_PRINTF_H
 
-#include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/PassManager.h"
 
-#include <map>
-
 using namespace llvm;
 
-class HipPrintfToOpenCLPrintfPass
-    : public PassInfoMixin<HipPrintfToOpenCLPrintfPass> {
+class HipPrintfPass : public PassInfoMixin<HipPrintfPass> {
 public:
   PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM);
   static bool isRequired() { return true; }
-
-private:
-  Constant *getOrCreateStrLiteralArg(
-      const std::string& Str, llvm::IRBuilder<>& B);
-  Function *getOrCreatePrintStringF();
-  Value* cloneStrArgToConstantAS(
-    Value *StrArg, llvm::IRBuilder<>& B, bool *IsEmpty);
-
-  std::map<std::string, Constant*> LiteralArgs_;
-  Module *M_;
 };
 
 #endif
@@ -0,0 +1,193 @@
+//===- HipResolveAddrSpaces.cpp -------------------------------------------===//
+//
+// Part of the CHIP-SPV Project, under the Apache License v2.0 with LLVM
+// Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+// Resolves to_global(), to_local() and to_private() on pointers whose
+// address space is known at compile time.
+//
+// The device library implements the atomics and other functions on generic
+// pointers by asking the pointer's address space at runtime and calling the
+// builtin for that space, for example:
+//
+//   volatile global int *gi = to_global(address);
+//   if (gi)
+//     return atomic_add(gi, i);
+//   volatile local int *li = to_local(address);
+//   if (li)
+//     return atomic_add(li, i);
+//   return 0;
+//
+// Once the device library is inlined and InferAddressSpaces has run, the
+// address space of most of these pointers is known. This pass replaces the
+// queries on them with the pointer itself or with null, and folds the
+// branches on the results, so only the path for the actual address space is
+// left. Queries on truly generic pointers are kept.
+//
+// Copyright (c) 2023 CHIP-SPV developers
+//===----------------------------------------------------------------------===//
+
+#include "HipResolveAddrSpaces.h"
+
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/ConstantFolding.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/ValueHandle.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Transforms/Utils/Local.h"
+
+#define PASS_NAME "hip-resolve-addr-spaces"
+#define DEBUG_TYPE PASS_NAME
+
+using namespace llvm;
+
+STATISTIC(NumResolved, "Number of resolved address space queries");
+
+namespace {
+
+// SPIR address spaces.
+constexpr unsigned PrivateAS = 0;
+constexpr unsigned GlobalAS = 1;
+constexpr unsigned LocalAS = 3;
+
+// Return true if F is to_global(), to_local() or to_private(). Clang emits
+// them as calls to __to_<space>, the mangled forms come from bitcode built
+// elsewhere.
+bool isAddrSpaceQuery(const Function &F) {
+  StringRef Name = F.getName();
+  return Name == "__to_global" || Name == "__to_local" ||
+         Name == "__to_private" || Name.startswith("_Z9to_global") ||
+         Name.startswith("_Z8to_local") || Name.startswith("_Z10to_private");
+}
+
+// Fold the instructions which became constant due to the resolved queries,
+// and the branches on them.
+void foldConstantUsers(Value *V, const DataLayout &DL,
+                       SmallPtrSetImpl<BasicBlock *> &Terminators) {
+  SmallVector<WeakTrackingVH, 8> Worklist;
+  for (User *U : V->users())
+    Worklist.push_back(U);
+  while (!Worklist.empty()) {
+    auto *I = dyn_cast_or_null<Instruction>(Worklist.pop_back_val());
+    if (!I)
+      continue;
+    if (I->isTerminator()) {
+      Terminators.insert(I->getParent());
+      continue;
+    }
+    Constant *C = ConstantFoldInstruction(I, DL);
+    if (!C)
+      continue;
+    for (User *U : I->users())
+      Worklist.push_back(U);
+    I->replaceAllUsesWith(C);
+    I->eraseFromParent();
+  }
+}
+
+// Report the resolved and all queries of each function as optimization
+// remarks (-pass-remarks=hip-resolve-addr-spaces).
+void emitRemarks(
+    const MapVector<Function *, std::pair<unsigned, unsigned>> &Counts) {
+  for (const auto &Count : Counts) {
+    Function *F = Count.first;
+    OptimizationRemarkEmitter ORE(F);
+    ORE.emit([&]() {
+      return OptimizationRemark(PASS_NAME, "Resolved", F)
+             << "resolved " << ore::NV("Resolved", Count.second.first)
+             << " of " << ore::NV("Queries", Count.second.second)
+             << " address space queries in " << ore::NV("Function", F);
+    });
+  }
+}
+
+bool resolveAddrSpaces(Module &M) {
+  SmallVector<WeakTrackingVH, 16> Queries;
+  // The resolved and all queries of each function.
+  MapVector<Function *, std::pair<unsigned, unsigned>> Counts;
+  for (auto &F : M)
+    if (isAddrSpaceQuery(F))
+      for (User *U : F.users())
+        if (auto *CI = dyn_cast<CallInst>(U))
+          if (CI->getCalledFunction() == &F) {
+            Queries.push_back(CI);
+            Counts[CI->getFunction()].second++;
+          }
+
+  SmallPtrSet<Function *, 8> Changed;
+  SmallPtrSet<BasicBlock *, 16> Terminators;
+  for (WeakTrackingVH &Query : Queries) {
+    // The query may have been deleted as dead code of an earlier one.
+    auto *CI = dyn_cast_or_null<CallInst>(Query);
+    if (!CI)
+      continue;
+    Value *Arg = CI->getArgOperand(0);
+    Value *Ptr = Arg->stripPointerCasts();
+    unsigned SrcAS = Ptr->getType()->getPointerAddressSpace();
+    unsigned DstAS = CI->getType()->getPointerAddressSpace();
+    // Generic pointers need the runtime query.
+    if (SrcAS != GlobalAS && SrcAS != LocalAS && SrcAS != PrivateAS)
+      continue;
+
+    Value *Result;
+    if (SrcAS == DstAS) {
+      IRBuilder<> B(CI);
+      Result = B.CreatePointerBitCastOrAddrSpaceCast(Ptr, CI->getType());
+    } else
+      Result = ConstantPointerNull::get(cast<PointerType>(CI->getType()));
+    LLVM_DEBUG(dbgs() << "Resolve: " << *CI << "\n    to: " << *Result
+                      << "\n");
+
+    Function *F = CI->getFunction();
+    CI->replaceAllUsesWith(Result);
+    CI->eraseFromParent();
+    RecursivelyDeleteTriviallyDeadInstructions(Arg);
+    foldConstantUsers(Result, M.getDataLayout(), Terminators);
+    Changed.insert(F);
+    Counts[F].first++;
+    NumResolved++;
+  }
+
+  for (BasicBlock *BB : Terminators)
+    ConstantFoldTerminator(BB, /*DeleteDeadConditions=*/true);
+  for (Function *F : Changed)
+    removeUnreachableBlocks(*F);
+
+  LLVM_DEBUG(dbgs() << "Resolved " << NumResolved << " of " << Queries.size()
+                    << " address space queries\n");
+  emitRemarks(Counts);
+  return !Changed.empty();
+}
+
+} // namespace
+
+PreservedAnalyses HipResolveAddrSpacesPass::run(Module &M,
+                                                ModuleAnalysisManager &AM) {
+  return resolveAddrSpaces(M) ? PreservedAnalyses::none()
+                              : PreservedAnalyses::all();
+}
+
+extern "C" ::llvm::PassPluginLibraryInfo LLVM_ATTRIBUTE_WEAK
+llvmGetPassPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, PASS_NAME, LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            PB.registerPipelineParsingCallback(
+                [](StringRef Name, ModulePassManager &FPM,
+                   ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name == PASS_NAME) {
+                    FPM.addPass(HipResolveAddrSpacesPass());
+                    return true;
+                  }
+                  return false;
+                });
+          }};
+}
@@ -0,0 +1,33 @@
+//===- HipResolveAddrSpaces.h ---------------------------------------------===//
+//
+// Part of the CHIP-SPV Project, under the Apache License v2.0 with LLVM
+// Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+// Resolves to_global(), to_local() and to_private() on pointers whose
+// address space is known at compile time.
+//
+// Copyright (c) 2023 CHIP-SPV developers
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_PASSES_HIP_RESOLVE_ADDR_SPACES_H
+#define LLVM_PASSES_HIP_RESOLVE_ADDR_SPACES_H
+
+#include "llvm/IR/PassManager.h"
+
+using namespace llvm;
+
+#if LLVM_VERSION_MAJOR < 14
+#error LLVM 14+ required.
+#endif
+
+class HipResolveAddrSpacesPass
+    : public PassInfoMixin<HipResolveAddrSpacesPass> {
+public:
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM);
+  static bool isRequired() { return true; }
+};
+
+#endif
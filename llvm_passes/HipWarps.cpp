@@ -24,11 +24,83 @@
 
 #include "HipWarps.h"
 
-#include <llvm/IR/Metadata.h>
+#include <llvm/ADT/SmallPtrSet.h>
 #include <llvm/IR/Constants.h>
+#include <llvm/IR/InstrTypes.h>
+#include <llvm/IR/Metadata.h>
 
 #include "CHIPSPVConfig.hh"
 
+// The CUDA warp-size sensitive functions and the OpenCL builtins they are
+// implemented with, matched by the mangled name up to the parameter types to
+// cover all the overloads. The subgroup collectives are included for all the
+// operations.
+static const char *WarpSizeSensitiveFuncPrefixes[] = {
+    "_Z6__shfl",
+    "_Z10__shfl_xor",
+    "_Z9__shfl_up",
+    "_Z11__shfl_down",
+    "_Z8__ballot",
+    "_Z13__chip_ballot",
+    "_Z16sub_group_ballot",
+    "_Z17sub_group_shuffle",
+    "_Z21sub_group_shuffle_xor",
+    "_Z22sub_group_shuffle_down",
+    "_Z20sub_group_shuffle_up",
+    "_Z23intel_sub_group_shuffle",
+    "_Z27intel_sub_group_shuffle_xor",
+    "_Z28intel_sub_group_shuffle_down",
+    "_Z26intel_sub_group_shuffle_up",
+    "_Z20sub_group_reduce_",
+    "_Z28sub_group_scan_inclusive_"};
+
+static bool isWarpSizeSensitive(const Function &F) {
+  StringRef Name = F.getName();
+  for (const char *Prefix : WarpSizeSensitiveFuncPrefixes)
+    if (Name.startswith(Prefix))
+      return true;
+  return false;
+}
+
+// Return true if C is only referred to by llvm.used and llvm.compiler.used,
+// which don't call anything.
+static bool isOnlyInUsedLists(const Constant *C) {
+  for (const User *U : C->users()) {
+    if (const auto *GV = dyn_cast<GlobalVariable>(U)) {
+      if (GV->getName() != "llvm.used" && GV->getName() != "llvm.compiler.used")
+        return false;
+    } else if (const auto *UC = dyn_cast<Constant>(U)) {
+      if (!isOnlyInUsedLists(UC))
+        return false;
+    } else
+      return false;
+  }
+  return true;
+}
+
+// Queue the functions calling V, looking through pointer casts. Return false
+// if V is used other than as a callee, in which case its callers can't be
+// known.
+static bool addCallers(Value *V, SmallPtrSetImpl<Function *> &Reaching,
+                       SmallVectorImpl<Function *> &Worklist) {
+  for (Use &U : V->uses()) {
+    User *Usr = U.getUser();
+    if (auto *Call = dyn_cast<CallBase>(Usr)) {
+      if (!Call->isCallee(&U))
+        return false;
+      Function *Caller = Call->getFunction();
+      if (Reaching.insert(Caller).second)
+        Worklist.push_back(Caller);
+    } else if (auto *CE = dyn_cast<ConstantExpr>(Usr)) {
+      if (CE->isCast() ? !addCallers(CE, Reaching, Worklist)
+                       : !isOnlyInUsedLists(CE))
+        return false;
+    } else if (!isa<Constant>(Usr) || !isOnlyInUsedLists(cast<Constant>(Usr)))
+      return false;
+  }
+  return true;
+}
+
 PreservedAnalyses HipWarpsPass::run(Module &Mod, ModuleAnalysisManager &AM) {
 
   // We emulate warps with subgroups of which size is implementation and
@@ -36,53 +108,40 @@ PreservedAnalyses HipWarpsPass::run(Module &Mod, ModuleAnalysisManager &AM) {
   // constant that can be queried from the device info.
   //
   // Add the intel_reqd_sub_group_size kernel metadata to force the subgroup
-  // size to be fixed to the warp size used by the CHIP-SPV build in case there
-  // is a possibility the kernel's semantically sensitive to the warp width.
-  //
-  // For now check if the CUDA warp-size sensitive intrinsic declarations appear
-  // in the module and assume all the kernels call them. TO OPTIMIZE: Use
-  // CallGraph to analyze if the kernels really call them to allow subgroup
-  // freedom for those that don't.
+  // size to be fixed to the warp size used by the CHIP-SPV build to the
+  // kernels which may call the warp-size sensitive functions, directly or
+  // through other functions. The other kernels are left for the driver to
+  // pick the best subgroup size for. Uses of warpSize alone don't need the
+  // metadata as it is a compile time constant.
+  SmallPtrSet<Function *, 16> Reaching;
+  SmallVector<Function *, 16> Worklist;
+  for (auto &F : Mod)
+    if (isWarpSizeSensitive(F) && Reaching.insert(&F).second)
+      Worklist.push_back(&F);
 
-  std::vector<const char *> WarpSizeSensitiveFuncNames = {
-      "_Z6__shfliii",
-      "_Z6__shflfii",
-      "_Z10__shfl_xoriii",
-      "_Z10__shfl_xorfii",
-      "_Z9__shfl_upiji",
-      "_Z9__shfl_upfji",
-      "_Z11__shfl_downiji",
-      "_Z11__shfl_downfji",
-      "_Z8__balloti",
-      "_Z16sub_group_balloti",
-      "_Z17sub_group_shufflefj",
-      "_Z17sub_group_shuffleij",
-      "_Z21sub_group_shuffle_xorij",
-      "_Z21sub_group_shuffle_xorfj",
-      "_Z22sub_group_shuffle_downiij",
-      "_Z22sub_group_shuffle_downffj",
-      "_Z20sub_group_shuffle_upiij",
-      "_Z20sub_group_shuffle_upffj",
-      "_Z23intel_sub_group_shuffleij",
-      "_Z23intel_sub_group_shufflefj",
-      "_Z27intel_sub_group_shuffle_xorij",
-      "_Z27intel_sub_group_shuffle_xorfj"};
+  if (Worklist.empty())
+    return PreservedAnalyses::all();
 
-  bool SensitiveFuncFound = false;
-  for (auto &FuncName : WarpSizeSensitiveFuncNames) {
-    if (Mod.getNamedValue(FuncName)) {
-      SensitiveFuncFound = true;
+  // Walk the call graph backwards from the sensitive functions. If a function
+  // on the way has its address taken, fall back to pinning all kernels.
+  bool AllKernels = false;
+  while (!Worklist.empty()) {
+    Function *F = Worklist.pop_back_val();
+    // Calls between kernels are not possible in HIP.
+    if (F->getCallingConv() == CallingConv::SPIR_KERNEL)
+      continue;
+    if (!addCallers(F, Reaching, Worklist)) {
+      AllKernels = true;
       break;
     }
   }
 
-  if (!SensitiveFuncFound)
-    return PreservedAnalyses::all();
-
   auto &Ctx = Mod.getContext();
   for (auto &F : Mod) {
     if (F.getCallingConv() != CallingConv::SPIR_KERNEL)
       continue;
+    if (!AllKernels && !Reaching.count(&F))
+      continue;
 
     IntegerType *I32Type = IntegerType::get(Ctx, 32);
     F.setMetadata("intel_reqd_sub_group_size",
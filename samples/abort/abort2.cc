@@ -37,6 +37,8 @@ int main(int argc, char *argv[]) {
   hipError_t Err = hipMalloc(&OutD, sizeof(int));
   assert(Err == hipSuccess);
   abort_kernel<<<dim3(1), dim3(1)>>>(OutD);
+  // The abort is noticed at the next synchronization point.
+  (void)hipDeviceSynchronize();
   // Control should not reach here.
   printf("Error: abort() was ignored!\n");
   return 0;
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2023 CHIP-SPV developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Compares an iterative 1D Jacobi smoother run as one kernel launch per
+// iteration with one persistent cooperative kernel which separates the
+// iterations with grid_group::sync(). Both must give the same result.
+
+#include "hip/hip_runtime.h"
+#include "hip/hip_cooperative_groups.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace cg = cooperative_groups;
+
+#define CHECK(cmd)                                                             \
+  {                                                                            \
+    hipError_t error = cmd;                                                    \
+    if (error != hipSuccess) {                                                 \
+      fprintf(stderr, "error: '%s'(%d) at %s:%d\n", hipGetErrorString(error),  \
+              error, __FILE__, __LINE__);                                      \
+      exit(1);                                                                 \
+    }                                                                          \
+  }
+
+constexpr int NumIters = 1000;
+constexpr int BlockSize = 256;
+constexpr int N = 1 << 16;
+
+__device__ void smooth(const float *In, float *Out, int I) {
+  float Left = I > 0 ? In[I - 1] : 0.0f;
+  float Right = I < N - 1 ? In[I + 1] : 0.0f;
+  Out[I] = 0.5f * In[I] + 0.25f * (Left + Right);
+}
+
+__global__ void step(const float *In, float *Out) {
+  for (int I = blockIdx.x * blockDim.x + threadIdx.x; I < N;
+       I += gridDim.x * blockDim.x)
+    smooth(In, Out, I);
+}
+
+__global__ void persistent(float *A, float *B) {
+  cg::grid_group Grid = cg::this_grid();
+  for (int Iter = 0; Iter < NumIters; Iter++) {
+    const float *In = Iter % 2 ? B : A;
+    float *Out = Iter % 2 ? A : B;
+    for (int I = Grid.thread_rank(); I < N; I += Grid.size())
+      smooth(In, Out, I);
+    Grid.sync();
+  }
+}
+
+static void reset(float *A, float *B) {
+  std::vector<float> Init(N);
+  for (int I = 0; I < N; I++)
+    Init[I] = (I % 97) / 97.0f;
+  CHECK(hipMemcpy(A, Init.data(), N * sizeof(float), hipMemcpyHostToDevice));
+  CHECK(hipMemset(B, 0, N * sizeof(float)));
+}
+
+int main() {
+  int Device, NumCUs, Supported;
+  CHECK(hipGetDevice(&Device));
+  CHECK(hipDeviceGetAttribute(&Supported,
+                              hipDeviceAttributeCooperativeLaunch, Device));
+  if (!Supported) {
+    printf("SKIP: cooperative launches are not supported\n");
+    return 0;
+  }
+  CHECK(hipDeviceGetAttribute(&NumCUs, hipDeviceAttributeMultiprocessorCount,
+                              Device));
+  int NumBlocks = std::min(NumCUs, N / BlockSize);
+
+  float *A, *B;
+  CHECK(hipMalloc(&A, N * sizeof(float)));
+  CHECK(hipMalloc(&B, N * sizeof(float)));
+  // NumIters is even, so the result ends up in A.
+  std::vector<float> Separate(N), Cooperative(N);
+
+  reset(A, B);
+  auto Start = std::chrono::steady_clock::now();
+  for (int Iter = 0; Iter < NumIters; Iter++)
+    hipLaunchKernelGGL(step, dim3(NumBlocks), dim3(BlockSize), 0, nullptr,
+                       Iter % 2 ? B : A, Iter % 2 ? A : B);
+  CHECK(hipDeviceSynchronize());
+  double SeparateMs = std::chrono::duration<double, std::milli>(
+                          std::chrono::steady_clock::now() - Start)
+                          .count();
+  CHECK(hipMemcpy(Separate.data(), A, N * sizeof(float),
+                  hipMemcpyDeviceToHost));
+
+  reset(A, B);
+  void *Args[] = {&A, &B};
+  Start = std::chrono::steady_clock::now();
+  CHECK(hipLaunchCooperativeKernel((const void *)persistent, dim3(NumBlocks),
+                                   dim3(BlockSize), Args, 0, nullptr));
+  CHECK(hipDeviceSynchronize());
+  double CooperativeMs = std::chrono::duration<double, std::milli>(
+                             std::chrono::steady_clock::now() - Start)
+                             .count();
+  CHECK(hipMemcpy(Cooperative.data(), A, N * sizeof(float),
+                  hipMemcpyDeviceToHost));
+
+  printf("%d iterations on %d blocks\n", NumIters, NumBlocks);
+  printf("separate launches  %10.2f ms\n", SeparateMs);
+  printf("cooperative kernel %10.2f ms\n", CooperativeMs);
+
+  for (int I = 0; I < N; I++)
+    if (std::fabs(Separate[I] - Cooperative[I]) > 1e-6f) {
+      printf("FAILED: results differ at %d: %f vs %f\n", I, Separate[I],
+             Cooperative[I]);
+      return 1;
+    }
+
+  CHECK(hipFree(A));
+  CHECK(hipFree(B));
+  printf("PASSED\n");
+  return 0;
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2023 CHIP-SPV developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+// Measures how much a large device-to-device copy on one stream overlaps with
+// a compute kernel on another stream. On backends with dedicated copy engines
+// (see CHIP_L0_COPY_ENGINE_THRESHOLD) the combined run should take less time
+// than the kernel and the copy back-to-back.
+
+#include "hip/hip_runtime.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#define CHECK(cmd)                                                             \
+  {                                                                            \
+    hipError_t error = cmd;                                                    \
+    if (error != hipSuccess) {                                                 \
+      fprintf(stderr, "error: '%s'(%d) at %s:%d\n", hipGetErrorString(error),  \
+              error, __FILE__, __LINE__);                                      \
+      exit(1);                                                                 \
+    }                                                                          \
+  }
+
+__global__ void busyKernel(float *Data, int Iters) {
+  int Tid = blockIdx.x * blockDim.x + threadIdx.x;
+  float X = Data[Tid];
+  for (int I = 0; I < Iters; I++)
+    X = X * 0.999f + 0.001f;
+  Data[Tid] = X;
+}
+
+static double nowMs() {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+int main() {
+  const size_t CopySize = 256 << 20;
+  const int Threads = 256, Blocks = 1024, Iters = 20000, NumRuns = 3;
+
+  hipStream_t ComputeStream, CopyStream;
+  CHECK(hipStreamCreate(&ComputeStream));
+  CHECK(hipStreamCreate(&CopyStream));
+
+  float *KernelData;
+  char *Src, *Dst;
+  CHECK(hipMalloc(&KernelData, sizeof(float) * Threads * Blocks));
+  CHECK(hipMalloc(&Src, CopySize));
+  CHECK(hipMalloc(&Dst, CopySize));
+  CHECK(hipMemset(KernelData, 0, sizeof(float) * Threads * Blocks));
+  CHECK(hipMemset(Src, 1, CopySize));
+
+  auto RunKernel = [&]() {
+    hipLaunchKernelGGL(busyKernel, dim3(Blocks), dim3(Threads), 0,
+                       ComputeStream, KernelData, Iters);
+    CHECK(hipGetLastError());
+  };
+  auto RunCopy = [&]() {
+    CHECK(hipMemcpyAsync(Dst, Src, CopySize, hipMemcpyDeviceToDevice,
+                         CopyStream));
+  };
+
+  // Warm up: JIT-compiles the kernel and creates the copy queues.
+  RunKernel();
+  RunCopy();
+  CHECK(hipDeviceSynchronize());
+
+  double KernelMs = 1e30, CopyMs = 1e30, BothMs = 1e30;
+  for (int I = 0; I < NumRuns; I++) {
+    double Start = nowMs();
+    RunKernel();
+    CHECK(hipStreamSynchronize(ComputeStream));
+    KernelMs = std::min(KernelMs, nowMs() - Start);
+
+    Start = nowMs();
+    RunCopy();
+    CHECK(hipStreamSynchronize(CopyStream));
+    CopyMs = std::min(CopyMs, nowMs() - Start);
+
+    Start = nowMs();
+    RunKernel();
+    RunCopy();
+    CHECK(hipDeviceSynchronize());
+    BothMs = std::min(BothMs, nowMs() - Start);
+  }
+
+  double Serial = KernelMs + CopyMs;
+  double Hidden = std::min(KernelMs, CopyMs);
+  double Overlap = Hidden > 0 ? (Serial - BothMs) / Hidden : 0.0;
+  printf("kernel: %.2f ms, copy: %.2f ms (%.2f GB/s), both: %.2f ms\n",
+         KernelMs, CopyMs, CopySize / CopyMs / 1e6, BothMs);
+  printf("overlap: %.0f%% of the shorter operation hidden\n",
+         std::max(0.0, Overlap) * 100.0);
+
+  char Check;
+  CHECK(hipMemcpy(&Check, Dst + CopySize - 1, 1, hipMemcpyDeviceToHost));
+  if (Check != 1) {
+    printf("FAILED: wrong copy result\n");
+    return 1;
+  }
+
+  CHECK(hipFree(KernelData));
+  CHECK(hipFree(Src));
+  CHECK(hipFree(Dst));
+  CHECK(hipStreamDestroy(ComputeStream));
+  CHECK(hipStreamDestroy(CopyStream));
+  printf("PASSED\n");
+  return 0;
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2023 CHIP-SPV developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Measures the throughput of small commands when no events are recorded,
+// when events created with hipEventDisableTiming are recorded and when timed
+// events are recorded. Only the last case should pay for device timestamps.
+// Also checks that hipEventElapsedTime() stays consistent with the host
+// clock.
+
+#include "hip/hip_runtime.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#define CHECK(cmd)                                                             \
+  {                                                                            \
+    hipError_t error = cmd;                                                    \
+    if (error != hipSuccess) {                                                 \
+      fprintf(stderr, "error: '%s'(%d) at %s:%d\n", hipGetErrorString(error),  \
+              error, __FILE__, __LINE__);                                      \
+      exit(1);                                                                 \
+    }                                                                          \
+  }
+
+__global__ void increment(int *Data) { (*Data)++; }
+
+constexpr int NumCommands = 20000;
+// An event is recorded after every this many commands.
+constexpr int RecordInterval = 8;
+
+// Returns the achieved commands per second.
+static double measure(int *Data, hipStream_t Stream, hipEvent_t Event) {
+  auto Start = std::chrono::steady_clock::now();
+  for (int I = 0; I < NumCommands; I++) {
+    hipLaunchKernelGGL(increment, dim3(1), dim3(1), 0, Stream, Data);
+    if (Event && I % RecordInterval == 0)
+      CHECK(hipEventRecord(Event, Stream));
+  }
+  CHECK(hipStreamSynchronize(Stream));
+  auto End = std::chrono::steady_clock::now();
+  return NumCommands / std::chrono::duration<double>(End - Start).count();
+}
+
+int main() {
+  int *Data;
+  hipStream_t Stream;
+  hipEvent_t Untimed, Timed, Stop;
+  CHECK(hipMalloc(&Data, sizeof(int)));
+  CHECK(hipMemset(Data, 0, sizeof(int)));
+  CHECK(hipStreamCreate(&Stream));
+  CHECK(hipEventCreateWithFlags(&Untimed, hipEventDisableTiming));
+  CHECK(hipEventCreate(&Timed));
+  CHECK(hipEventCreate(&Stop));
+
+  // Warm up the kernel and the queues.
+  measure(Data, Stream, Timed);
+
+  const struct {
+    hipEvent_t Event;
+    const char *Name;
+  } Modes[] = {{nullptr, "no events"},
+               {Untimed, "untimed events"},
+               {Timed, "timed events"}};
+  for (const auto &Mode : Modes)
+    printf("%-16s %12.0f commands/s\n", Mode.Name,
+           measure(Data, Stream, Mode.Event));
+
+  // The device time between two events can't exceed the host time around
+  // them.
+  auto Start = std::chrono::steady_clock::now();
+  CHECK(hipEventRecord(Timed, Stream));
+  for (int I = 0; I < NumCommands / 10; I++)
+    hipLaunchKernelGGL(increment, dim3(1), dim3(1), 0, Stream, Data);
+  CHECK(hipEventRecord(Stop, Stream));
+  CHECK(hipEventSynchronize(Stop));
+  auto End = std::chrono::steady_clock::now();
+  float DeviceMs;
+  CHECK(hipEventElapsedTime(&DeviceMs, Timed, Stop));
+  double HostMs =
+      std::chrono::duration<double, std::milli>(End - Start).count();
+  printf("elapsed %.3f ms on the device, %.3f ms on the host\n", DeviceMs,
+         HostMs);
+  if (DeviceMs <= 0.0f || DeviceMs > HostMs * 1.05 + 0.1) {
+    printf("FAILED: hipEventElapsedTime() is inconsistent\n");
+    return 1;
+  }
+
+  if (hipEventElapsedTime(&DeviceMs, Untimed, Stop) !=
+      hipErrorInvalidResourceHandle) {
+    printf("FAILED: an untimed event was accepted\n");
+    return 1;
+  }
+
+  int NumRuns;
+  CHECK(hipMemcpy(&NumRuns, Data, sizeof(int), hipMemcpyDeviceToHost));
+  if (NumRuns != 4 * NumCommands + NumCommands / 10) {
+    printf("FAILED: got %d kernel runs\n", NumRuns);
+    return 1;
+  }
+
+  CHECK(hipEventDestroy(Untimed));
+  CHECK(hipEventDestroy(Timed));
+  CHECK(hipEventDestroy(Stop));
+  CHECK(hipStreamDestroy(Stream));
+  CHECK(hipFree(Data));
+  printf("PASSED\n");
+  return 0;
+}
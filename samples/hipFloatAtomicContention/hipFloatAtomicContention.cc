@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2023 CHIP-SPV developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Measures atomicAdd() on floats and doubles under contention: every thread
+// adds to one of NumCounters counters in global memory, or to a counter in
+// shared memory. The runtime implements atomicAdd() with the native float
+// atomics of the device if it has them, and with a compare-and-swap loop
+// otherwise. The CAS variant spells out the loop to show the difference.
+
+#include "hip/hip_runtime.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#define CHECK(cmd)                                                             \
+  {                                                                            \
+    hipError_t error = cmd;                                                    \
+    if (error != hipSuccess) {                                                 \
+      fprintf(stderr, "error: '%s'(%d) at %s:%d\n", hipGetErrorString(error),  \
+              error, __FILE__, __LINE__);                                      \
+      exit(1);                                                                 \
+    }                                                                          \
+  }
+
+constexpr int NumReps = 10;
+constexpr int BlockSize = 256;
+constexpr int NumThreads = 1 << 18;
+constexpr int NumAdds = 16;
+
+__device__ float casAdd(float *Address, float Value) {
+  unsigned *Bits = reinterpret_cast<unsigned *>(Address);
+  unsigned Old = *Bits, Assumed;
+  do {
+    Assumed = Old;
+    Old = atomicCAS(Bits, Assumed,
+                    __float_as_uint(Value + __uint_as_float(Old)));
+  } while (Assumed != Old);
+  return __uint_as_float(Old);
+}
+
+__device__ double casAdd(double *Address, double Value) {
+  auto *Bits = reinterpret_cast<unsigned long long *>(Address);
+  unsigned long long Old = *Bits, Assumed;
+  do {
+    Assumed = Old;
+    Old = atomicCAS(Bits, Assumed,
+                    __double_as_longlong(Value + __longlong_as_double(Old)));
+  } while (Assumed != Old);
+  return __longlong_as_double(Old);
+}
+
+template <typename T>
+__global__ void nativeGlobal(T *Counters, int NumCounters) {
+  int Tid = blockIdx.x * blockDim.x + threadIdx.x;
+  for (int I = 0; I < NumAdds; I++)
+    atomicAdd(&Counters[Tid % NumCounters], T(1));
+}
+
+template <typename T>
+__global__ void casGlobal(T *Counters, int NumCounters) {
+  int Tid = blockIdx.x * blockDim.x + threadIdx.x;
+  for (int I = 0; I < NumAdds; I++)
+    casAdd(&Counters[Tid % NumCounters], T(1));
+}
+
+// The block total goes to the counter of the block.
+template <typename T>
+__global__ void nativeShared(T *Counters, int NumCounters) {
+  __shared__ T Counter;
+  if (threadIdx.x == 0)
+    Counter = 0;
+  __syncthreads();
+  for (int I = 0; I < NumAdds; I++)
+    atomicAdd(&Counter, T(1));
+  __syncthreads();
+  if (threadIdx.x == 0)
+    atomicAdd(&Counters[blockIdx.x % NumCounters], Counter);
+}
+
+template <typename T>
+__global__ void casShared(T *Counters, int NumCounters) {
+  __shared__ T Counter;
+  if (threadIdx.x == 0)
+    Counter = 0;
+  __syncthreads();
+  for (int I = 0; I < NumAdds; I++)
+    casAdd(&Counter, T(1));
+  __syncthreads();
+  if (threadIdx.x == 0)
+    casAdd(&Counters[blockIdx.x % NumCounters], Counter);
+}
+
+template <typename T> using KernelT = void (*)(T *, int);
+
+// Run the kernel and check that every counter got its share of the adds.
+template <typename T>
+static bool run(const char *Name, KernelT<T> Kernel, int NumCounters,
+                T *Counters) {
+  std::vector<T> Host(NumCounters);
+  double Ms = 0;
+  for (int Rep = 0; Rep < NumReps; Rep++) {
+    CHECK(hipMemset(Counters, 0, NumCounters * sizeof(T)));
+    CHECK(hipDeviceSynchronize());
+    auto Start = std::chrono::steady_clock::now();
+    hipLaunchKernelGGL(Kernel, dim3(NumThreads / BlockSize), dim3(BlockSize),
+                       0, nullptr, Counters, NumCounters);
+    CHECK(hipDeviceSynchronize());
+    Ms += std::chrono::duration<double, std::milli>(
+              std::chrono::steady_clock::now() - Start)
+              .count();
+  }
+  printf("%-16s %5d counters %8.3f ms %10.1f Madds/s\n", Name, NumCounters,
+         Ms / NumReps, NumThreads * (double)NumAdds * NumReps / Ms / 1000);
+
+  CHECK(hipMemcpy(Host.data(), Counters, NumCounters * sizeof(T),
+                  hipMemcpyDeviceToHost));
+  T Expected = (T)NumThreads * NumAdds / NumCounters;
+  for (int I = 0; I < NumCounters; I++)
+    if (Host[I] != Expected) {
+      printf("FAILED: %s counter %d is %f, expected %f\n", Name, I,
+             (double)Host[I], (double)Expected);
+      return false;
+    }
+  return true;
+}
+
+template <typename T> static bool runAll(const char *TypeName) {
+  T *Counters;
+  CHECK(hipMalloc(&Counters, 1024 * sizeof(T)));
+  bool Ok = true;
+  printf("%s:\n", TypeName);
+  for (int NumCounters : {1, 32, 1024}) {
+    Ok &= run<T>("native global", nativeGlobal<T>, NumCounters, Counters);
+    Ok &= run<T>("CAS global", casGlobal<T>, NumCounters, Counters);
+  }
+  Ok &= run<T>("native shared", nativeShared<T>, 1, Counters);
+  Ok &= run<T>("CAS shared", casShared<T>, 1, Counters);
+  CHECK(hipFree(Counters));
+  return Ok;
+}
+
+int main() {
+  bool Ok = runAll<float>("float");
+  Ok &= runAll<double>("double");
+  if (!Ok)
+    return 1;
+  printf("PASSED\n");
+  return 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2023 CHIP-SPV developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+// Measures hipMemcpy bandwidth between device memory and pageable host memory
+// with the direct path (CHIP_HOST_STAGING_THRESHOLD=0) and with pipelined
+// staging through pinned buffers (the default). Each configuration runs in a
+// child process since the threshold is read once per process.
+//
+// Usage: hipPageableMemcpyBandwidth [max size in MiB, default 256]
+// Sizes go from 1 MiB up to the maximum (4096 for the full sweep), limited by
+// the device's maximum allocation size.
+
+#include "hip/hip_runtime.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#define CHECK(cmd)                                                             \
+  {                                                                            \
+    hipError_t error = cmd;                                                    \
+    if (error != hipSuccess) {                                                 \
+      fprintf(stderr, "error: '%s'(%d) at %s:%d\n", hipGetErrorString(error),  \
+              error, __FILE__, __LINE__);                                      \
+      exit(1);                                                                 \
+    }                                                                          \
+  }
+
+static double nowSec() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static int runChild(size_t MaxMiB) {
+  hipDeviceProp_t Props;
+  CHECK(hipGetDeviceProperties(&Props, 0));
+  size_t MaxSize =
+      std::min(MaxMiB << 20, (size_t)Props.maxMemoryAllocationSize);
+
+  void *Dev;
+  CHECK(hipMalloc(&Dev, MaxSize));
+  // Pageable memory: a plain malloc the runtime does not know about.
+  char *Host = (char *)malloc(MaxSize);
+  memset(Host, 1, MaxSize);
+
+  for (size_t Size = 1 << 20; Size <= MaxSize; Size *= 4) {
+    int Reps = (int)std::max<size_t>(2, (256 << 20) / Size);
+    CHECK(hipMemcpy(Dev, Host, Size, hipMemcpyHostToDevice)); // Warm up
+    double Start = nowSec();
+    for (int I = 0; I < Reps; I++)
+      CHECK(hipMemcpy(Dev, Host, Size, hipMemcpyHostToDevice));
+    double H2D = Size * Reps / (nowSec() - Start) / 1e9;
+
+    Start = nowSec();
+    for (int I = 0; I < Reps; I++)
+      CHECK(hipMemcpy(Host, Dev, Size, hipMemcpyDeviceToHost));
+    double D2H = Size * Reps / (nowSec() - Start) / 1e9;
+    printf("RESULT %zu %f %f\n", Size, H2D, D2H);
+  }
+
+  if (Host[MaxSize - 1] != 1) {
+    printf("FAILED: wrong copy result\n");
+    return 1;
+  }
+  free(Host);
+  CHECK(hipFree(Dev));
+  return 0;
+}
+
+struct Bandwidth {
+  double H2D, D2H;
+};
+
+static bool runConfig(const std::string &Cmd,
+                      std::map<size_t, Bandwidth> &Results) {
+  FILE *Child = popen(Cmd.c_str(), "r");
+  if (!Child) {
+    perror("popen");
+    return false;
+  }
+  char Line[256];
+  while (fgets(Line, sizeof(Line), Child)) {
+    size_t Size;
+    Bandwidth BW;
+    if (sscanf(Line, "RESULT %zu %lf %lf", &Size, &BW.H2D, &BW.D2H) == 3)
+      Results[Size] = BW;
+  }
+  return pclose(Child) == 0 && !Results.empty();
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 2 && !strcmp(argv[1], "--child"))
+    return runChild(strtoul(argv[2], nullptr, 10));
+
+  size_t MaxMiB = argc > 1 ? strtoul(argv[1], nullptr, 10) : 256;
+  std::string Child =
+      std::string(argv[0]) + " --child " + std::to_string(MaxMiB);
+
+  std::map<size_t, Bandwidth> Direct, Staged;
+  if (!runConfig("CHIP_HOST_STAGING_THRESHOLD=0 " + Child, Direct) ||
+      !runConfig(Child, Staged)) {
+    printf("FAILED: benchmark run failed\n");
+    return 1;
+  }
+
+  printf("%10s %12s %12s %12s %12s\n", "size(MiB)", "H2D direct",
+         "H2D staged", "D2H direct", "D2H staged");
+  for (auto &Entry : Direct) {
+    auto &S = Staged[Entry.first];
+    printf("%10zu %9.2f GB/s %7.2f GB/s %7.2f GB/s %7.2f GB/s\n",
+           Entry.first >> 20, Entry.second.H2D, S.H2D, Entry.second.D2H,
+           S.D2H);
+  }
+  printf("PASSED\n");
+  return 0;
+}
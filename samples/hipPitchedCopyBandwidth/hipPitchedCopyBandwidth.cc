@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2023 CHIP-SPV developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Measures the bandwidth of copies between 2D buffers with the pitch picked
+// by hipMallocPitch() and with a pitch equal to the power-of-two row width.
+// The row copy reads and writes along the rows. The column copy makes
+// consecutive threads access consecutive rows, the access pattern of
+// stencils and transposes, which suffers from cache set and memory channel
+// conflicts when the pitch is a multiple of a large power of two.
+
+#include "hip/hip_runtime.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#define CHECK(cmd)                                                             \
+  {                                                                            \
+    hipError_t error = cmd;                                                    \
+    if (error != hipSuccess) {                                                 \
+      fprintf(stderr, "error: '%s'(%d) at %s:%d\n", hipGetErrorString(error),  \
+              error, __FILE__, __LINE__);                                      \
+      exit(1);                                                                 \
+    }                                                                          \
+  }
+
+constexpr int NumReps = 10;
+constexpr int Height = 2048;
+constexpr int BlockSize = 256;
+
+__global__ void copyRows(float *Dst, const float *Src, size_t Pitch,
+                         int Width) {
+  int X = blockIdx.x * blockDim.x + threadIdx.x;
+  int Y = blockIdx.y;
+  if (X >= Width)
+    return;
+  size_t Offset = Y * (Pitch / sizeof(float)) + X;
+  Dst[Offset] = Src[Offset];
+}
+
+__global__ void copyColumns(float *Dst, const float *Src, size_t Pitch,
+                            int Width) {
+  int Y = blockIdx.x * blockDim.x + threadIdx.x;
+  int X = blockIdx.y;
+  if (Y >= Height || X >= Width)
+    return;
+  size_t Offset = Y * (Pitch / sizeof(float)) + X;
+  Dst[Offset] = Src[Offset];
+}
+
+using KernelT = void (*)(float *, const float *, size_t, int);
+
+static double run(KernelT Kernel, dim3 Grid, float *Dst, const float *Src,
+                  size_t Pitch, int Width) {
+  hipLaunchKernelGGL(Kernel, Grid, dim3(BlockSize), 0, nullptr, Dst, Src,
+                     Pitch, Width);
+  CHECK(hipDeviceSynchronize());
+  auto Start = std::chrono::steady_clock::now();
+  for (int Rep = 0; Rep < NumReps; Rep++)
+    hipLaunchKernelGGL(Kernel, Grid, dim3(BlockSize), 0, nullptr, Dst, Src,
+                       Pitch, Width);
+  CHECK(hipDeviceSynchronize());
+  double Seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - Start)
+                       .count();
+  // Read and write.
+  return 2.0 * Width * Height * sizeof(float) * NumReps / Seconds / 1e9;
+}
+
+// Copy a buffer of the given pitch with both kernels and check the result.
+static bool measure(const char *Name, float *Dst, float *Src, size_t Pitch,
+                    int Width) {
+  size_t WidthBytes = Width * sizeof(float);
+  std::vector<float> Host(Width * Height);
+  for (size_t I = 0; I < Host.size(); I++)
+    Host[I] = I;
+  CHECK(hipMemcpy2D(Src, Pitch, Host.data(), WidthBytes, WidthBytes, Height,
+                    hipMemcpyHostToDevice));
+  CHECK(hipMemset2D(Dst, Pitch, 0, WidthBytes, Height));
+
+  double Rows = run(copyRows, dim3((Width + BlockSize - 1) / BlockSize, Height),
+                    Dst, Src, Pitch, Width);
+  double Columns =
+      run(copyColumns, dim3((Height + BlockSize - 1) / BlockSize, Width), Dst,
+          Src, Pitch, Width);
+  printf("%-14s width %5zu B pitch %6zu B: rows %7.2f GB/s, columns %7.2f "
+         "GB/s\n",
+         Name, WidthBytes, Pitch, Rows, Columns);
+
+  std::vector<float> Result(Width * Height);
+  CHECK(hipMemcpy2D(Result.data(), WidthBytes, Dst, Pitch, WidthBytes, Height,
+                    hipMemcpyDeviceToHost));
+  if (Result != Host) {
+    printf("FAILED: %s copy of width %zu is wrong\n", Name, WidthBytes);
+    return false;
+  }
+  return true;
+}
+
+int main() {
+  int Device;
+  CHECK(hipGetDevice(&Device));
+  int PitchAlignment;
+  CHECK(hipDeviceGetAttribute(&PitchAlignment,
+                              hipDeviceAttributeTexturePitchAlignment, Device));
+  printf("Texture pitch alignment: %d B\n", PitchAlignment);
+
+  bool Ok = true;
+  for (int Width : {1000, 1024, 2048, 4096}) {
+    size_t WidthBytes = Width * sizeof(float);
+    float *Src, *Dst;
+    size_t Pitch, DstPitch;
+    CHECK(hipMallocPitch((void **)&Src, &Pitch, WidthBytes, Height));
+    CHECK(hipMallocPitch((void **)&Dst, &DstPitch, WidthBytes, Height));
+    if (Pitch != DstPitch || Pitch < WidthBytes || Pitch % PitchAlignment ||
+        (size_t)Src % PitchAlignment) {
+      printf("FAILED: pitch %zu of width %zu does not match the alignment\n",
+             Pitch, WidthBytes);
+      Ok = false;
+    }
+    Ok &= measure("hipMallocPitch", Dst, Src, Pitch, Width);
+    CHECK(hipFree(Src));
+    CHECK(hipFree(Dst));
+
+    // The same with the rows packed at a power-of-two pitch.
+    size_t PackedPitch = 1;
+    while (PackedPitch < WidthBytes)
+      PackedPitch *= 2;
+    CHECK(hipMalloc(&Src, PackedPitch * Height));
+    CHECK(hipMalloc(&Dst, PackedPitch * Height));
+    Ok &= measure("power of two", Dst, Src, PackedPitch, Width);
+    CHECK(hipFree(Src));
+    CHECK(hipFree(Dst));
+  }
+
+  if (!Ok)
+    return 1;
+  printf("PASSED\n");
+  return 0;
+}
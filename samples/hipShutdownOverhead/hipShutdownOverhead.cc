@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2023 CHIP-SPV developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Measures the init-to-exit overhead of a trivial HIP program. The program
+// re-executes itself as a child which initializes the runtime, uses a
+// per-thread stream from a worker thread and exits. The time from the end of
+// the child's main() to the parent observing the child's exit is the
+// shutdown overhead. It is reported for comparing builds; the wall-clock
+// time depends on the load of the machine, so only the child runs failing
+// fail the sample.
+
+#include "hip/hip_runtime.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#define CHECK(cmd)                                                             \
+  {                                                                            \
+    hipError_t error = cmd;                                                    \
+    if (error != hipSuccess) {                                                 \
+      fprintf(stderr, "error: '%s'(%d) at %s:%d\n", hipGetErrorString(error),  \
+              error, __FILE__, __LINE__);                                      \
+      exit(1);                                                                 \
+    }                                                                          \
+  }
+
+static long long nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static int runChild() {
+  CHECK(hipSetDevice(0));
+  CHECK(hipFree(nullptr));
+
+  std::thread Worker([] { CHECK(hipStreamSynchronize(hipStreamPerThread)); });
+  Worker.join();
+
+  printf("EXIT_TS %lld\n", nowNs());
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 1 && !strcmp(argv[1], "--child"))
+    return runChild();
+
+  const int NumRuns = 5;
+
+  std::string Cmd = std::string(argv[0]) + " --child";
+  double TotalMs = 0.0, ExitMs = 0.0;
+  for (int I = 0; I < NumRuns; I++) {
+    long long Start = nowNs();
+    FILE *Child = popen(Cmd.c_str(), "r");
+    if (!Child) {
+      perror("popen");
+      return 1;
+    }
+    long long ChildExitTs = 0;
+    char Line[256];
+    while (fgets(Line, sizeof(Line), Child))
+      sscanf(Line, "EXIT_TS %lld", &ChildExitTs);
+    int Status = pclose(Child);
+    long long End = nowNs();
+    if (Status != 0 || !ChildExitTs) {
+      printf("FAILED: child run %d failed (status %d)\n", I, Status);
+      return 1;
+    }
+    TotalMs += (End - Start) / 1e6;
+    ExitMs += (End - ChildExitTs) / 1e6;
+  }
+
+  TotalMs /= NumRuns;
+  ExitMs /= NumRuns;
+  printf("init-to-exit: %.2f ms, shutdown: %.2f ms (average of %d runs)\n",
+         TotalMs, ExitMs, NumRuns);
+  printf("PASSED\n");
+  return 0;
+}
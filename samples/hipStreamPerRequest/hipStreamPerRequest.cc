@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2023 CHIP-SPV developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Measures the cost of the stream-per-request pattern: every request creates
+// a stream, launches a kernel into it, synchronizes and destroys the stream.
+// Also keeps many streams alive at once. The program re-executes itself as a
+// child with CHIP_QUEUE_POOL_SIZE set to 0 and 4 to compare creating a native
+// queue for every stream against reusing the native queues of destroyed
+// streams.
+
+#include "hip/hip_runtime.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define CHECK(cmd)                                                             \
+  {                                                                            \
+    hipError_t error = cmd;                                                    \
+    if (error != hipSuccess) {                                                 \
+      fprintf(stderr, "error: '%s'(%d) at %s:%d\n", hipGetErrorString(error),  \
+              error, __FILE__, __LINE__);                                      \
+      exit(1);                                                                 \
+    }                                                                          \
+  }
+
+__global__ void increment(int *Data) { atomicAdd(&Data[blockIdx.x], 1); }
+
+constexpr int NumRequests = 1000;
+constexpr int NumLiveStreams = 512;
+
+static double msSince(std::chrono::steady_clock::time_point Start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - Start)
+      .count();
+}
+
+static int runChild() {
+  int *Data;
+  CHECK(hipMalloc(&Data, NumLiveStreams * sizeof(int)));
+  CHECK(hipMemset(Data, 0, NumLiveStreams * sizeof(int)));
+
+  auto Start = std::chrono::steady_clock::now();
+  for (int I = 0; I < NumRequests; I++) {
+    hipStream_t Stream;
+    CHECK(hipStreamCreate(&Stream));
+    hipLaunchKernelGGL(increment, dim3(1), dim3(1), 0, Stream, Data);
+    CHECK(hipStreamSynchronize(Stream));
+    CHECK(hipStreamDestroy(Stream));
+  }
+  double RequestMs = msSince(Start);
+
+  Start = std::chrono::steady_clock::now();
+  std::vector<hipStream_t> Streams(NumLiveStreams);
+  for (auto &Stream : Streams)
+    CHECK(hipStreamCreate(&Stream));
+  for (int I = 0; I < NumLiveStreams; I++)
+    hipLaunchKernelGGL(increment, dim3(I + 1), dim3(1), 0, Streams[I], Data);
+  CHECK(hipDeviceSynchronize());
+  for (auto &Stream : Streams)
+    CHECK(hipStreamDestroy(Stream));
+  double LiveMs = msSince(Start);
+
+  // Element I is incremented by the streams I..NumLiveStreams-1.
+  std::vector<int> Host(NumLiveStreams);
+  CHECK(hipMemcpy(Host.data(), Data, NumLiveStreams * sizeof(int),
+                  hipMemcpyDeviceToHost));
+  CHECK(hipFree(Data));
+  for (int I = 0; I < NumLiveStreams; I++) {
+    int Expected = NumLiveStreams - I + (I == 0 ? NumRequests : 0);
+    if (Host[I] != Expected) {
+      printf("FAILED: element %d is %d instead of %d\n", I, Host[I],
+             Expected);
+      return 1;
+    }
+  }
+
+  printf("REQUEST_US %.2f\n", RequestMs * 1000 / NumRequests);
+  printf("LIVE_MS %.2f\n", LiveMs);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 1 && !strcmp(argv[1], "--child"))
+    return runChild();
+
+  const char *PoolSizes[] = {"0", "4"};
+  printf("%-10s %16s %24s\n", "pool size", "us per request",
+         "ms for 512 live streams");
+  for (const char *PoolSize : PoolSizes) {
+    std::string Cmd = std::string("CHIP_QUEUE_POOL_SIZE=") + PoolSize + " " +
+                      argv[0] + " --child";
+    FILE *Child = popen(Cmd.c_str(), "r");
+    if (!Child) {
+      perror("popen");
+      return 1;
+    }
+    double RequestUs = 0.0, LiveMs = 0.0;
+    char Line[256];
+    while (fgets(Line, sizeof(Line), Child)) {
+      sscanf(Line, "REQUEST_US %lf", &RequestUs);
+      sscanf(Line, "LIVE_MS %lf", &LiveMs);
+      if (!strncmp(Line, "FAILED", 6))
+        fputs(Line, stdout);
+    }
+    int Status = pclose(Child);
+    if (Status != 0 || RequestUs == 0.0) {
+      printf("FAILED: child with pool size %s failed (status %d)\n", PoolSize,
+             Status);
+      return 1;
+    }
+    printf("%-10s %16.1f %24.1f\n", PoolSize, RequestUs, LiveMs);
+  }
+  printf("PASSED\n");
+  return 0;
+}
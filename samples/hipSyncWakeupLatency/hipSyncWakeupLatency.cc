@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2023 CHIP-SPV developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Measures how quickly the host wakes up after the device has finished, for
+// each of the synchronization schedules selectable with hipSetDeviceFlags().
+// A tiny kernel is launched and waited for with hipStreamSynchronize() and
+// hipEventSynchronize(). The round trip is dominated by the wakeup latency;
+// the host CPU time spent per wait shows what the latency costs.
+
+#include "hip/hip_runtime.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+
+#define CHECK(cmd)                                                             \
+  {                                                                            \
+    hipError_t error = cmd;                                                    \
+    if (error != hipSuccess) {                                                 \
+      fprintf(stderr, "error: '%s'(%d) at %s:%d\n", hipGetErrorString(error),  \
+              error, __FILE__, __LINE__);                                      \
+      exit(1);                                                                 \
+    }                                                                          \
+  }
+
+__global__ void increment(int *Data) { (*Data)++; }
+
+constexpr int NumWarmup = 10, NumIters = 500;
+
+struct Result {
+  double MedianUs;
+  double CpuUsPerWait;
+};
+
+template <typename WaitFn>
+static Result measure(int *Data, hipStream_t Stream, WaitFn Wait) {
+  std::vector<double> Times;
+  std::clock_t CpuStart = 0;
+  for (int I = 0; I < NumWarmup + NumIters; I++) {
+    if (I == NumWarmup)
+      CpuStart = std::clock();
+    auto Start = std::chrono::steady_clock::now();
+    hipLaunchKernelGGL(increment, dim3(1), dim3(1), 0, Stream, Data);
+    Wait();
+    auto End = std::chrono::steady_clock::now();
+    if (I >= NumWarmup)
+      Times.push_back(
+          std::chrono::duration<double, std::micro>(End - Start).count());
+  }
+  double CpuUs = (std::clock() - CpuStart) * 1e6 / CLOCKS_PER_SEC;
+  std::sort(Times.begin(), Times.end());
+  return {Times[Times.size() / 2], CpuUs / NumIters};
+}
+
+int main() {
+  const struct {
+    unsigned Flags;
+    const char *Name;
+  } Schedules[] = {{hipDeviceScheduleAuto, "auto"},
+                   {hipDeviceScheduleSpin, "spin"},
+                   {hipDeviceScheduleYield, "yield"},
+                   {hipDeviceScheduleBlockingSync, "blocking"}};
+
+  int *Data;
+  hipStream_t Stream;
+  hipEvent_t Event;
+  CHECK(hipMalloc(&Data, sizeof(int)));
+  CHECK(hipMemset(Data, 0, sizeof(int)));
+  CHECK(hipStreamCreate(&Stream));
+  CHECK(hipEventCreate(&Event));
+
+  printf("%-10s %22s %22s\n", "schedule", "stream sync us (cpu)",
+         "event sync us (cpu)");
+  int Expected = 0;
+  for (const auto &Schedule : Schedules) {
+    CHECK(hipSetDeviceFlags(Schedule.Flags));
+    unsigned Flags;
+    CHECK(hipGetDeviceFlags(&Flags));
+    if (Flags != Schedule.Flags) {
+      printf("FAILED: hipGetDeviceFlags() returned %u instead of %u\n", Flags,
+             Schedule.Flags);
+      return 1;
+    }
+
+    Result StreamSync =
+        measure(Data, Stream, [&]() { CHECK(hipStreamSynchronize(Stream)); });
+    Result EventSync = measure(Data, Stream, [&]() {
+      CHECK(hipEventRecord(Event, Stream));
+      CHECK(hipEventSynchronize(Event));
+    });
+    Expected += 2 * (NumWarmup + NumIters);
+    printf("%-10s %12.1f (%7.1f) %12.1f (%7.1f)\n", Schedule.Name,
+           StreamSync.MedianUs, StreamSync.CpuUsPerWait, EventSync.MedianUs,
+           EventSync.CpuUsPerWait);
+  }
+
+  if (hipSetDeviceFlags(hipDeviceScheduleSpin | hipDeviceScheduleYield) !=
+      hipErrorInvalidValue) {
+    printf("FAILED: conflicting schedules were accepted\n");
+    return 1;
+  }
+
+  int NumRuns;
+  CHECK(hipMemcpy(&NumRuns, Data, sizeof(int), hipMemcpyDeviceToHost));
+  if (NumRuns != Expected) {
+    printf("FAILED: expected %d kernel runs, got %d\n", Expected, NumRuns);
+    return 1;
+  }
+
+  CHECK(hipEventDestroy(Event));
+  CHECK(hipStreamDestroy(Stream));
+  CHECK(hipFree(Data));
+  printf("PASSED\n");
+  return 0;
+}
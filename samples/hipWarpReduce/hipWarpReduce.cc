@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2023 CHIP-SPV developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Compares sum reductions written as a __shfl_down tree, which is how CUDA
+// code usually spells them, with __reduce_add_sync(), cg::reduce() and
+// __block_reduce_add(), which map to the subgroup and work-group collectives
+// of the device. All variants must give the same sums.
+
+#include "hip/hip_runtime.h"
+#include "hip/hip_cooperative_groups.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace cg = cooperative_groups;
+
+#define CHECK(cmd)                                                             \
+  {                                                                            \
+    hipError_t error = cmd;                                                    \
+    if (error != hipSuccess) {                                                 \
+      fprintf(stderr, "error: '%s'(%d) at %s:%d\n", hipGetErrorString(error),  \
+              error, __FILE__, __LINE__);                                      \
+      exit(1);                                                                 \
+    }                                                                          \
+  }
+
+constexpr int NumReps = 100;
+constexpr int BlockSize = 256;
+constexpr int N = 1 << 22;
+constexpr int WarpSize = CHIP_DEFAULT_WARP_SIZE;
+
+// Each variant adds the sums of its warps (or blocks) to Out[0].
+__global__ void shuffleTree(const int *In, int *Out) {
+  int Value = In[blockIdx.x * blockDim.x + threadIdx.x];
+  for (int Offset = warpSize / 2; Offset > 0; Offset /= 2)
+    Value += __shfl_down(Value, Offset);
+  if (__lane_id() == 0)
+    atomicAdd(Out, Value);
+}
+
+__global__ void reduceSync(const int *In, int *Out) {
+  int Value = In[blockIdx.x * blockDim.x + threadIdx.x];
+  Value = __reduce_add_sync(~0ull, Value);
+  if (__lane_id() == 0)
+    atomicAdd(Out, Value);
+}
+
+__global__ void tileReduce(const int *In, int *Out) {
+  auto Tile = cg::tiled_partition<WarpSize>(cg::this_thread_block());
+  int Value = In[blockIdx.x * blockDim.x + threadIdx.x];
+  Value = cg::reduce(Tile, Value, cg::plus<int>());
+  if (Tile.thread_rank() == 0)
+    atomicAdd(Out, Value);
+}
+
+__global__ void blockReduce(const int *In, int *Out) {
+  int Value = In[blockIdx.x * blockDim.x + threadIdx.x];
+  Value = __block_reduce_add(Value);
+  if (threadIdx.x == 0)
+    atomicAdd(Out, Value);
+}
+
+typedef void (*KernelT)(const int *, int *);
+
+static double run(KernelT Kernel, const int *In, int *Out, int &Sum) {
+  CHECK(hipMemset(Out, 0, sizeof(int)));
+  hipLaunchKernelGGL(Kernel, dim3(N / BlockSize), dim3(BlockSize), 0,
+                     nullptr, In, Out);
+  CHECK(hipMemcpy(&Sum, Out, sizeof(int), hipMemcpyDeviceToHost));
+
+  auto Start = std::chrono::steady_clock::now();
+  for (int Rep = 0; Rep < NumReps; Rep++)
+    hipLaunchKernelGGL(Kernel, dim3(N / BlockSize), dim3(BlockSize), 0,
+                       nullptr, In, Out);
+  CHECK(hipDeviceSynchronize());
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - Start)
+             .count() /
+         NumReps;
+}
+
+int main() {
+  std::vector<int> Host(N);
+  int Expected = 0;
+  for (int I = 0; I < N; I++) {
+    Host[I] = I % 7 - 3;
+    Expected += Host[I];
+  }
+
+  int *In, *Out;
+  CHECK(hipMalloc(&In, N * sizeof(int)));
+  CHECK(hipMalloc(&Out, sizeof(int)));
+  CHECK(hipMemcpy(In, Host.data(), N * sizeof(int), hipMemcpyHostToDevice));
+
+  struct {
+    const char *Name;
+    KernelT Kernel;
+  } Variants[] = {{"__shfl_down tree", shuffleTree},
+                  {"__reduce_add_sync", reduceSync},
+                  {"cg::reduce", tileReduce},
+                  {"__block_reduce_add", blockReduce}};
+
+  bool Failed = false;
+  for (auto &Variant : Variants) {
+    int Sum;
+    double Ms = run(Variant.Kernel, In, Out, Sum);
+    printf("%-20s %8.3f ms\n", Variant.Name, Ms);
+    if (Sum != Expected) {
+      printf("FAILED: %s gave %d, expected %d\n", Variant.Name, Sum,
+             Expected);
+      Failed = true;
+    }
+  }
+
+  CHECK(hipFree(In));
+  CHECK(hipFree(Out));
+  if (Failed)
+    return 1;
+  printf("PASSED\n");
+  return 0;
+}
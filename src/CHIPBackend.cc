@@ -21,6 +21,111 @@
  */
 
 #include "CHIPBackend.hh"
+#include "CHIPPrintf.hh"
+#include "Utils.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <thread>
+
+/// Blocking copies between device memory and pageable host memory of at least
+/// this many bytes are staged through pinned buffers. Overridden by
+/// CHIP_HOST_STAGING_THRESHOLD, 0 disables staging.
+static size_t getStagingThreshold() {
+  static size_t Threshold = [] {
+    auto Str = readEnvVar("CHIP_HOST_STAGING_THRESHOLD");
+    return Str.empty() ? (size_t)4 << 20
+                       : (size_t)std::strtoul(Str.c_str(), nullptr, 10);
+  }();
+  return Threshold;
+}
+
+namespace {
+/// Host threads sharing large host-to-host copies with the calling thread.
+/// Started on first use and kept until the process exits.
+class HostCopyPool {
+  struct Task {
+    void *Dst;
+    const void *Src;
+    size_t Size;
+    size_t *Remaining; ///< Tasks of the copy not yet done
+  };
+  std::mutex Mtx_;
+  std::condition_variable WorkCv_;
+  std::condition_variable DoneCv_;
+  std::deque<Task> Tasks_;
+  std::vector<std::thread> Workers_;
+  bool Stop_ = false;
+
+  void work() {
+    std::unique_lock<std::mutex> Lock(Mtx_); // HostCopyPool::Tasks_
+    while (true) {
+      WorkCv_.wait(Lock, [&]() { return Stop_ || !Tasks_.empty(); });
+      if (Tasks_.empty())
+        return;
+      Task T = Tasks_.front();
+      Tasks_.pop_front();
+      Lock.unlock();
+      memcpy(T.Dst, T.Src, T.Size);
+      Lock.lock();
+      if (--*T.Remaining == 0)
+        DoneCv_.notify_all();
+    }
+  }
+
+public:
+  HostCopyPool(size_t NumWorkers) {
+    for (size_t I = 0; I < NumWorkers; I++)
+      Workers_.emplace_back([this]() { work(); });
+  }
+
+  ~HostCopyPool() {
+    {
+      LOCK(Mtx_); // HostCopyPool::Stop_
+      Stop_ = true;
+    }
+    WorkCv_.notify_all();
+    for (auto &Worker : Workers_)
+      Worker.join();
+  }
+
+  /// Copy in NumChunks chunks, the first one on the calling thread.
+  void copy(void *Dst, const void *Src, size_t Size, size_t NumChunks) {
+    size_t ChunkSize = (Size + NumChunks - 1) / NumChunks;
+    size_t Remaining = NumChunks - 1;
+    {
+      LOCK(Mtx_); // HostCopyPool::Tasks_
+      for (size_t I = 1; I < NumChunks; I++) {
+        size_t Offset = I * ChunkSize;
+        Tasks_.push_back({(char *)Dst + Offset, (const char *)Src + Offset,
+                          std::min(ChunkSize, Size - Offset), &Remaining});
+      }
+    }
+    WorkCv_.notify_all();
+    memcpy(Dst, Src, ChunkSize);
+    std::unique_lock<std::mutex> Lock(Mtx_); // HostCopyPool::Tasks_
+    DoneCv_.wait(Lock, [&]() { return Remaining == 0; });
+  }
+};
+} // namespace
+
+/// memcpy() which splits large copies over several host threads.
+static void hostMemCopy(void *Dst, const void *Src, size_t Size) {
+  constexpr size_t MinBytesPerThread = 4 << 20, MaxThreads = 8;
+  size_t MaxUsefulThreads =
+      std::min((size_t)std::thread::hardware_concurrency(), MaxThreads);
+  size_t NumThreads = std::min(MaxUsefulThreads, Size / MinBytesPerThread);
+  if (NumThreads < 2) {
+    memcpy(Dst, Src, Size);
+    return;
+  }
+
+  static HostCopyPool Pool(MaxUsefulThreads - 1);
+  Pool.copy(Dst, Src, Size, NumThreads);
+}
 
 /// Queue a kernel for retrieving information about the device variable.
 static void queueKernel(CHIPQueue *Q, CHIPKernel *K, void *Args[] = nullptr,
@@ -88,7 +193,178 @@ CHIPCallbackData::CHIPCallbackData(hipStreamCallback_t TheCallbackF,
       CallbackF(TheCallbackF) {}
 
 void CHIPCallbackData::execute(hipError_t ResultFromDependency) {
-  CallbackF(ChipQueue, ResultFromDependency, CallbackArgs);
+  if (HostFn)
+    HostFn(CallbackArgs);
+  else
+    CallbackF(ChipQueue, ResultFromDependency, CallbackArgs);
+}
+
+// CHIPCallbackExecutor
+// ************************************************************************
+CHIPCallbackExecutor::CHIPCallbackExecutor() {
+  auto Str = readEnvVar("CHIP_CALLBACK_THREADS");
+  size_t NumWorkers = Str.empty() ? 0 : std::strtoul(Str.c_str(), nullptr, 10);
+  if (!NumWorkers)
+    NumWorkers = 4;
+  logDebug("Starting {} callback worker threads", NumWorkers);
+  for (size_t I = 0; I < NumWorkers; I++)
+    Workers_.emplace_back(&CHIPCallbackExecutor::work, this);
+}
+
+CHIPCallbackExecutor::~CHIPCallbackExecutor() {
+  waitIdle();
+  {
+    LOCK(Mtx_); // CHIPCallbackExecutor::Stop_
+    Stop_ = true;
+  }
+  ReadyCv_.notify_all();
+  for (auto &Worker : Workers_)
+    Worker.join();
+}
+
+void CHIPCallbackExecutor::add(CHIPCallbackData *Cb) {
+  {
+    LOCK(Mtx_); // CHIPCallbackExecutor::NumPending_
+    NumPending_++;
+  }
+  Cb->enqueue();
+}
+
+void CHIPCallbackExecutor::setReady(CHIPCallbackData *Cb) {
+  {
+    LOCK(Mtx_); // CHIPCallbackExecutor::Ready_
+    Ready_.push_back(Cb);
+  }
+  ReadyCv_.notify_one();
+}
+
+void CHIPCallbackExecutor::waitIdle() {
+  std::unique_lock<std::mutex> Lock(Mtx_); // CHIPCallbackExecutor::NumPending_
+  IdleCv_.wait(Lock, [&] { return NumPending_ == 0; });
+}
+
+void CHIPCallbackExecutor::work() {
+  while (true) {
+    CHIPCallbackData *Cb;
+    {
+      std::unique_lock<std::mutex> Lock(Mtx_); // CHIPCallbackExecutor::Ready_
+      ReadyCv_.wait(Lock, [&] { return Stop_ || !Ready_.empty(); });
+      if (Ready_.empty())
+        return;
+      Cb = Ready_.front();
+      Ready_.pop_front();
+    }
+
+    logTrace("CHIPCallbackExecutor: running callback of queue {}",
+             (void *)Cb->ChipQueue);
+    Cb->execute(hipSuccess);
+    Cb->complete();
+    delete Cb;
+
+    {
+      LOCK(Mtx_); // CHIPCallbackExecutor::NumPending_
+      if (--NumPending_ == 0)
+        IdleCv_.notify_all();
+    }
+  }
+}
+
+// CHIPSyncPolicy
+// ************************************************************************
+static std::chrono::microseconds readMicroseconds(const char *EnvVar,
+                                                  unsigned Default) {
+  auto Str = readEnvVar(EnvVar);
+  return std::chrono::microseconds(
+      Str.empty() ? Default : std::strtoul(Str.c_str(), nullptr, 10));
+}
+
+CHIPSyncPolicy::CHIPSyncPolicy()
+    : SpinTime_(readMicroseconds("CHIP_SYNC_SPIN_US", 0)),
+      YieldTime_(readMicroseconds("CHIP_SYNC_YIELD_US", 0)) {}
+
+bool CHIPSyncPolicy::blocksRightAway() const {
+  unsigned Schedule = Schedule_;
+  return Schedule == hipDeviceScheduleBlockingSync ||
+         (Schedule != hipDeviceScheduleSpin &&
+          Schedule != hipDeviceScheduleYield && SpinTime_.count() == 0 &&
+          YieldTime_.count() == 0);
+}
+
+void CHIPSyncPolicy::wait(const std::function<bool()> &Poll,
+                          const std::function<void()> &Block) const {
+  switch (Schedule_) {
+  case hipDeviceScheduleSpin:
+    while (!Poll())
+      ;
+    return;
+  case hipDeviceScheduleYield:
+    while (!Poll())
+      std::this_thread::yield();
+    return;
+  case hipDeviceScheduleBlockingSync:
+    Block();
+    return;
+  default:
+    if (blocksRightAway()) {
+      Block();
+      return;
+    }
+    break;
+  }
+
+  auto Start = std::chrono::steady_clock::now();
+  while (std::chrono::steady_clock::now() - Start < SpinTime_)
+    if (Poll())
+      return;
+  while (std::chrono::steady_clock::now() - Start < YieldTime_) {
+    if (Poll())
+      return;
+    std::this_thread::yield();
+  }
+  Block();
+}
+
+// CHIPQueuePool
+// ************************************************************************
+CHIPQueuePool::CHIPQueuePool() {
+  auto Str = readEnvVar("CHIP_QUEUE_POOL_SIZE");
+  Capacity_ = Str.empty() ? DEFAULT_QUEUE_POOL_SIZE
+                         : std::strtoul(Str.c_str(), nullptr, 10);
+}
+
+CHIPQueuePool::~CHIPQueuePool() {
+  for (auto &E : Idle_)
+    E.Destroy(E.Handle);
+}
+
+void *CHIPQueuePool::acquire(int Priority,
+                             const std::function<void *()> &Create) {
+  {
+    LOCK(Mtx_); // CHIPQueuePool::Idle_
+    for (auto It = Idle_.begin(); It != Idle_.end(); ++It) {
+      if (It->Priority != Priority)
+        continue;
+      void *Handle = It->Handle;
+      Idle_.erase(It);
+      logDebug("Reusing native queue {} of priority {}", Handle, Priority);
+      return Handle;
+    }
+  }
+  return Create();
+}
+
+void CHIPQueuePool::release(void *Handle, int Priority, Destroyer Destroy) {
+  {
+    LOCK(Mtx_); // CHIPQueuePool::Idle_
+    size_t NumIdle = std::count_if(
+        Idle_.begin(), Idle_.end(),
+        [=](const Entry &E) { return E.Priority == Priority; });
+    if (NumIdle < Capacity_) {
+      Idle_.push_back({Handle, std::move(Destroy), Priority});
+      return;
+    }
+  }
+  Destroy(Handle);
 }
 
 // CHIPDeviceVar
@@ -162,8 +438,10 @@ void CHIPAllocationTracker::recordAllocation(void *DevPtr, void *HostPtr,
   if (MemoryType == hipMemoryTypeHost) {
     AllocInfo->HostPtr = AllocInfo->DevPtr;
     // Map onto host so that the data can be potentially initialized on host
-    Backend->getActiveDevice()->getDefaultQueue()->MemMap(
-        AllocInfo, CHIPQueue::MEM_MAP_TYPE::HOST_WRITE);
+    auto *Dev = Backend->getActiveDevice();
+    if (!Dev->getMemoryProfile().HostAllocsCoherent)
+      Dev->getDefaultQueue()->MemMap(AllocInfo,
+                                     CHIPQueue::MEM_MAP_TYPE::HOST_WRITE);
   }
 
   if (MemoryType == hipMemoryTypeUnified)
@@ -211,6 +489,11 @@ CHIPEvent::CHIPEvent(CHIPContext *Ctx, CHIPEventFlags Flags)
   *Refc_ = 1;
 }
 
+void CHIPEvent::setRecordedQueue(CHIPQueue *ChipQueue) {
+  RecordedDevice_ = ChipQueue->getDevice();
+  RecordedQueueId_ = ChipQueue->getId();
+}
+
 void CHIPEvent::releaseDependencies() {
   assert(!Deleted_ && "Event use after delete!");
   for (auto Event : DependsOnList) {
@@ -261,7 +544,9 @@ void CHIPModule::consumeSPIRV() {
   BinaryData_ = new uint32_t[NumWords + 1];
   std::memcpy(BinaryData_, FuncIL_, IlSize_);
   // Extract kernel function information
-  bool Res = parseSPIR(BinaryData_, NumWords, FuncInfos_);
+  RtDevLibExports_.clear();
+  bool Res = parseSPIR(BinaryData_, NumWords, FuncInfos_, RtDevLibExports_,
+                       PrintfFormats_);
   delete[] BinaryData_;
   if (!Res) {
     CHIPERR_LOG_AND_THROW("SPIR-V parsing failed", hipErrorUnknown);
@@ -270,6 +555,57 @@ void CHIPModule::consumeSPIRV() {
   dumpSpirv(Src_->getBinary());
 }
 
+// The runtime device library binaries loaded so far, by file name.
+static std::mutex RtDevLibMtx;
+static std::map<std::string, std::string> RtDevLibBinaries;
+
+static const std::string *loadRtDevLib(const std::string &FileName) {
+  LOCK(RtDevLibMtx); // RtDevLibBinaries
+  auto It = RtDevLibBinaries.find(FileName);
+  if (It != RtDevLibBinaries.end())
+    return &It->second;
+
+  auto Path = getRtDevLibPath(FileName);
+  auto Binary = Path ? readFromFile(*Path) : std::nullopt;
+  if (!Binary) {
+    logWarn("Could not load the device library {}", FileName);
+    return nullptr;
+  }
+  logDebug("Loaded device library {}", Path->string());
+  return &RtDevLibBinaries.emplace(FileName, std::move(*Binary))
+              .first->second;
+}
+
+std::vector<std::string_view>
+CHIPModule::getRtDevLibBinaries(CHIPDevice *Device, std::string &Binary) {
+  std::vector<std::string_view> Binaries;
+  std::set<std::string_view> Imports;
+  if (!Device->hasFeature(CHIPDeviceFeature::ProgramLinking))
+    return Binaries;
+
+  for (const auto &Lib : ChipRtDevLibs) {
+    if (!Device->hasFeature(Lib.NativeFeature))
+      continue;
+    std::vector<std::string_view> Names;
+    for (const auto &Name : RtDevLibExports_)
+      if (findRtDevLib(Name) == &Lib)
+        Names.push_back(Name);
+    if (Names.empty())
+      continue;
+    auto *LibBinary = loadRtDevLib(std::string(Lib.Name) + "_native.spv");
+    if (!LibBinary)
+      continue; // Keep the emulation.
+    logDebug("Linking the native variant of {}", Lib.Name);
+    Binaries.push_back(*LibBinary);
+    Imports.insert(Names.begin(), Names.end());
+  }
+
+  if (!Imports.empty() &&
+      !importDefinitions(Src_->getBinary(), Imports, Binary))
+    CHIPERR_LOG_AND_THROW("SPIR-V rewriting failed", hipErrorUnknown);
+  return Binaries;
+}
+
 CHIPModule::~CHIPModule() {}
 
 void CHIPModule::addKernel(CHIPKernel *Kernel) {
@@ -378,6 +714,24 @@ hipError_t CHIPModule::allocateDeviceVariablesNoLock(CHIPDevice *Device,
     assert(Var->getSize() == Size && "Object size discrepancy!");
     queueVariableBindShadowKernel(Queue, this, Var);
   }
+
+  // The HipPrintf pass removes the printf buffer variable from the modules
+  // which do not print.
+  CHIPPrintfBuffer PrintfHeader = {};
+  if (getGlobalVar(ChipDevicePrintfBufferName)) {
+    // The records are located modulo the capacity of the ring, so it must
+    // divide 2^32.
+    size_t MaxCapacity = size_t(1) << 31;
+    PrintfHeader.Capacity = std::min(
+        roundUpToPowerOfTwo(std::max<size_t>(Device->getPrintfFifoSize(),
+                                             ChipPrintfSlotSize)),
+        MaxCapacity);
+    PrintfDropped = 0;
+    PrintfBuffer_ = (CHIPPrintfBuffer *)Ctx->allocate(
+        sizeof(CHIPPrintfBuffer) + PrintfHeader.Capacity, ChipPrintfSlotSize,
+        hipMemoryType::hipMemoryTypeUnified);
+    Queue->memCopyAsync(PrintfBuffer_, &PrintfHeader, sizeof(PrintfHeader));
+  }
   Queue->finish();
   DeviceVariablesAllocated_ = true;
 
@@ -401,21 +755,38 @@ void CHIPModule::prepareDeviceVariablesNoLock(CHIPDevice *Device,
 
   logTrace("Initialize device variables in module: {}", (void *)this);
 
-  bool QueuedKernels = false;
+  bool QueuedWork = false;
   for (auto *Var : ChipVars_) {
     if (!Var->hasInitializer())
       continue;
     queueVariableInitShadowKernel(Queue, this, Var);
-    QueuedKernels = true;
+    QueuedWork = true;
   }
 
   // Launch kernel for resetting host-inaccessible global device variables.
   if (NonSymbolResetKernel) {
     queueKernel(Queue, NonSymbolResetKernel);
-    QueuedKernels = true;
+    QueuedWork = true;
+  }
+
+  // Point the printf() calls to their buffer after the initializers have
+  // cleared the pointer.
+  if (auto *PrintfVar = getGlobalVar(ChipDevicePrintfBufferName)) {
+    Queue->memCopyAsync(PrintfVar->getDevAddr(), &PrintfBuffer_,
+                        sizeof(PrintfBuffer_));
+    QueuedWork = true;
+  }
+
+  // Likewise for malloc(). The heap is shared by the modules of the device.
+  void *MallocHeap = nullptr;
+  if (auto *HeapVar = getGlobalVar(ChipDeviceMallocHeapName)) {
+    MallocHeap = Device->getMallocHeapNoLock(Queue);
+    Queue->memCopyAsync(HeapVar->getDevAddr(), &MallocHeap,
+                        sizeof(MallocHeap));
+    QueuedWork = true;
   }
 
-  if (QueuedKernels)
+  if (QueuedWork)
     Queue->finish();
 
   DeviceVariablesInitialized_ = true;
@@ -432,6 +803,11 @@ void CHIPModule::deallocateDeviceVariablesNoLock(CHIPDevice *Device) {
     (void)Err;
     Var->setDevAddr(nullptr);
   }
+  if (PrintfBuffer_) {
+    auto Err = Device->getContext()->free(PrintfBuffer_);
+    (void)Err;
+    PrintfBuffer_ = nullptr;
+  }
   DeviceVariablesAllocated_ = false;
 }
 
@@ -442,7 +818,9 @@ SPVFuncInfo *CHIPModule::findFunctionInfo(const std::string &FName) {
 // CHIPKernel
 //*************************************************************************************
 CHIPKernel::CHIPKernel(std::string HostFName, SPVFuncInfo *FuncInfo)
-    : HostFName_(HostFName), FuncInfo_(FuncInfo) {}
+    : HostFName_(HostFName), FuncInfo_(FuncInfo) {
+  Resources_.UsesDynamicLocalMem = FuncInfo && FuncInfo->hasWorkgroupPtrArgs();
+}
 CHIPKernel::~CHIPKernel(){};
 std::string CHIPKernel::getName() { return HostFName_; }
 const void *CHIPKernel::getHostPtr() { return HostFPtr_; }
@@ -520,6 +898,8 @@ CHIPDevice::CHIPDevice(CHIPContext *Ctx, int DeviceIdx)
 CHIPDevice::~CHIPDevice() {
   LOCK(DeviceMtx); // CHIPDevice::ChipQueues_
   logDebug("~CHIPDevice() {}", (void *)this);
+  if (LastCooperativeLaunch_)
+    LastCooperativeLaunch_->decreaseRefCount("~CHIPDevice");
   while (this->ChipQueues_.size() > 0) {
     delete ChipQueues_[0];
     ChipQueues_.erase(ChipQueues_.begin());
@@ -530,6 +910,110 @@ CHIPDevice::~CHIPDevice() {
 }
 CHIPQueue *CHIPDevice::getLegacyDefaultQueue() { return LegacyDefaultQueue; }
 
+int CHIPDevice::getMaxActiveBlocksPerCU(int BlockSize,
+                                        size_t SharedMemPerBlock) {
+  const hipDeviceProp_t &Props = HipDeviceProps_;
+  if (BlockSize <= 0 || BlockSize > Props.maxThreadsPerBlock ||
+      SharedMemPerBlock > Props.sharedMemPerBlock)
+    return 0;
+
+  int NumBlocks = Props.maxThreadsPerMultiProcessor / BlockSize;
+  if (SharedMemPerBlock)
+    NumBlocks = std::min<size_t>(
+        NumBlocks, Props.maxSharedMemoryPerMultiProcessor / SharedMemPerBlock);
+  return NumBlocks;
+}
+
+int CHIPDevice::getKernelOccupancy(CHIPKernel *Kernel, int BlockSize,
+                                   size_t DynSharedMem) {
+  const CHIPKernelResources &Res = Kernel->getResources();
+  if (BlockSize <= 0 || (size_t)BlockSize > Res.MaxWorkGroupSize)
+    return 0;
+  // Without an extern __shared__ array the dynamic size isn't allocated.
+  size_t SharedMem = Res.StaticLocalSize;
+  if (Res.UsesDynamicLocalMem) {
+    if (DynSharedMem > Res.MaxDynamicLocalSize)
+      return 0;
+    SharedMem += DynSharedMem;
+  }
+  return getMaxActiveBlocksPerCU(BlockSize, SharedMem);
+}
+
+void CHIPDevice::getKernelMaxPotentialBlockSize(CHIPKernel *Kernel,
+                                                size_t DynSharedMem,
+                                                int BlockSizeLimit,
+                                                int &GridSize,
+                                                int &BlockSize) {
+  const CHIPKernelResources &Res = Kernel->getResources();
+  int Limit = std::min<size_t>(Res.MaxWorkGroupSize,
+                               HipDeviceProps_.maxThreadsPerBlock);
+  if (BlockSizeLimit > 0)
+    Limit = std::min(Limit, BlockSizeLimit);
+  int Step = std::max<size_t>(Res.PreferredWorkGroupSizeMultiple, 1);
+
+  // Try the multiples of the preferred size from the largest down. Larger
+  // blocks win ties as they need fewer blocks for the same occupancy.
+  int BestSize = 0, BestBlocks = 0;
+  long long BestThreads = 0;
+  for (int Size = Limit >= Step ? Limit / Step * Step : Limit; Size > 0;
+       Size -= Step) {
+    int NumBlocks = getKernelOccupancy(Kernel, Size, DynSharedMem);
+    if ((long long)NumBlocks * Size > BestThreads) {
+      BestThreads = (long long)NumBlocks * Size;
+      BestSize = Size;
+      BestBlocks = NumBlocks;
+    }
+  }
+
+  BlockSize = BestSize;
+  GridSize = std::min<long long>(
+      (long long)BestBlocks * HipDeviceProps_.multiProcessorCount,
+      std::numeric_limits<int>::max());
+  logDebug("Max potential block size of {}: {}, grid size {}",
+           Kernel->getName(), BlockSize, GridSize);
+}
+
+void CHIPDevice::launchCooperativeKernel(CHIPQueue *ChipQueue,
+                                         CHIPKernel *ChipKernel,
+                                         dim3 NumBlocks, dim3 DimBlocks,
+                                         void **Args, size_t SharedMemBytes) {
+  // Blocks waiting in __chip_grid_sync() for blocks which aren't resident
+  // would spin forever, so launch only where residency is guaranteed.
+  if (!HipDeviceProps_.cooperativeLaunch)
+    CHIPERR_LOG_AND_THROW("The device can't guarantee that the blocks of a "
+                          "cooperative launch are resident at the same time",
+                          hipErrorNotSupported);
+
+  long long GridSize = (long long)NumBlocks.x * NumBlocks.y * NumBlocks.z;
+  int BlockSize = DimBlocks.x * DimBlocks.y * DimBlocks.z;
+  long long MaxBlocks =
+      (long long)HipDeviceProps_.multiProcessorCount *
+      getKernelOccupancy(ChipKernel, BlockSize, SharedMemBytes);
+  logDebug("Cooperative launch of {}: {} blocks, at most {} co-resident",
+           ChipKernel->getName(), GridSize, MaxBlocks);
+  if (GridSize > MaxBlocks)
+    CHIPERR_LOG_AND_THROW("The blocks of a cooperative launch can't all be "
+                          "resident at the same time",
+                          hipErrorCooperativeLaunchTooLarge);
+
+  LOCK(CooperativeLaunchMtx_); // CHIPDevice::LastCooperativeLaunch_
+  if (LastCooperativeLaunch_)
+    LastCooperativeLaunch_->updateFinishStatus(false);
+  if (LastCooperativeLaunch_ && !LastCooperativeLaunch_->isFinished()) {
+    std::vector<CHIPEvent *> EventsToWaitFor = {LastCooperativeLaunch_};
+    ChipQueue->enqueueBarrier(&EventsToWaitFor);
+  }
+  ChipQueue->launchKernel(ChipKernel, NumBlocks, DimBlocks, Args,
+                          SharedMemBytes);
+
+  CHIPEvent *LaunchEvent = ChipQueue->getLastEvent();
+  if (LaunchEvent)
+    LaunchEvent->increaseRefCount("launchCooperativeKernel");
+  if (LastCooperativeLaunch_)
+    LastCooperativeLaunch_->decreaseRefCount("launchCooperativeKernel");
+  LastCooperativeLaunch_ = LaunchEvent;
+}
+
 CHIPQueue *CHIPDevice::getDefaultQueue() {
 #ifdef HIP_API_PER_THREAD_DEFAULT_STREAM
   return getPerThreadDefaultQueue();
@@ -562,6 +1046,7 @@ CHIPQueue *CHIPDevice::getPerThreadDefaultQueueNoLock() {
         std::unique_ptr<CHIPQueue>(Backend->createCHIPQueue(this));
     PerThreadStreamUsed_ = true;
     PerThreadDefaultQueue.get()->PerThreadQueueForDevice = this;
+    Backend->registerPerThreadQueue();
   }
 
   return PerThreadDefaultQueue.get();
@@ -808,6 +1293,13 @@ size_t CHIPDevice::getGlobalMemSize() { return HipDeviceProps_.totalGlobalMem; }
 
 void CHIPDevice::eraseModule(CHIPModule *Module) {
   LOCK(DeviceMtx); // SrcModToCompiledMod_
+  for (auto *Q : ChipQueues_)
+    Q->discardPendingDeviceRequests(Module);
+  if (LegacyDefaultQueue)
+    LegacyDefaultQueue->discardPendingDeviceRequests(Module);
+  if (PerThreadDefaultQueue)
+    PerThreadDefaultQueue->discardPendingDeviceRequests(Module);
+
   for (auto &Kv : SrcModToCompiledMod_)
     if (Kv.second == Module) {
       delete Module;
@@ -816,6 +1308,43 @@ void CHIPDevice::eraseModule(CHIPModule *Module) {
     }
 }
 
+std::shared_ptr<const std::string>
+CHIPDevice::getNativeBinary(std::string_view SpirV) {
+  size_t Hash = std::hash<std::string_view>()(SpirV);
+  LOCK(NativeBinaryMtx_); // CHIPDevice::NativeBinaries_
+  auto [It, End] = NativeBinaries_.equal_range(Hash);
+  while (It != End) {
+    auto Entry = It->second.lock();
+    if (!Entry) {
+      It = NativeBinaries_.erase(It);
+      continue;
+    }
+    if (Entry->SpirV == SpirV)
+      return std::shared_ptr<const std::string>(Entry, &Entry->Binary);
+    ++It;
+  }
+  return nullptr;
+}
+
+std::shared_ptr<const std::string>
+CHIPDevice::addNativeBinary(std::string_view SpirV, std::string &&Binary) {
+  auto Entry = std::make_shared<const NativeBinaryEntry>(
+      NativeBinaryEntry{std::string(SpirV), std::move(Binary)});
+  size_t Hash = std::hash<std::string_view>()(SpirV);
+  LOCK(NativeBinaryMtx_); // CHIPDevice::NativeBinaries_
+  // Drop the entries whose modules have all been unloaded and the one
+  // being replaced.
+  for (auto It = NativeBinaries_.begin(); It != NativeBinaries_.end();) {
+    auto Cached = It->second.lock();
+    if (!Cached || (It->first == Hash && Cached->SpirV == SpirV))
+      It = NativeBinaries_.erase(It);
+    else
+      ++It;
+  }
+  NativeBinaries_.emplace(Hash, Entry);
+  return std::shared_ptr<const std::string>(Entry, &Entry->Binary);
+}
+
 void CHIPDevice::addQueue(CHIPQueue *ChipQueue) {
   LOCK(DeviceMtx) // writing CHIPDevice::ChipQueues_
   logDebug("{} CHIPDevice::addQueue({})", (void *)this, (void *)ChipQueue);
@@ -912,6 +1441,10 @@ bool CHIPDevice::removeQueue(CHIPQueue *ChipQueue) {
     CHIPERR_LOG_AND_THROW(Msg, hipErrorUnknown);
   }
   ChipQueues_.erase(FoundQueue);
+  for (auto Queue : ChipQueues_)
+    Queue->forgetSyncedQueue(ChipQueue);
+  if (LegacyDefaultQueue)
+    LegacyDefaultQueue->forgetSyncedQueue(ChipQueue);
 
   delete ChipQueue;
   return true;
@@ -945,18 +1478,89 @@ void CHIPDevice::invalidateDeviceVariables() {
   // CHIPDevice::SrcModToCompiledMod_
   // CHIPModule::invalidateDeviceVariablesNoLock()
   LOCK(DeviceVarMtx); // CHIPDevice::SrcModToCompiledMod_
+                      // CHIPDevice::MallocHeap_
   logTrace("invalidate device variables.");
   for (auto &Kv : SrcModToCompiledMod_)
     Kv.second->invalidateDeviceVariablesNoLock();
+  // The modules set up a new heap when their variables get reinitialized.
+  freeMallocHeapNoLock();
 }
 
 void CHIPDevice::deallocateDeviceVariables() {
   // CHIPDevice::SrcModToCompiledMod_
   // CHIPModule::deallocateDeviceVariablesNoLock()
   LOCK(DeviceVarMtx); // CHIPDevice::SrcModToCompiledMod_
+                      // CHIPDevice::MallocHeap_
   logTrace("Deallocate storage for device variables.");
   for (auto &Kv : SrcModToCompiledMod_)
     Kv.second->deallocateDeviceVariablesNoLock(this);
+  freeMallocHeapNoLock();
+}
+
+size_t CHIPDevice::getAllocationPitch(size_t WidthBytes) {
+  // Row strides of a multiple of this are padded.
+  constexpr size_t ConflictStride = 2048;
+  size_t Alignment = std::max<size_t>(HipDeviceProps_.texturePitchAlignment, 1);
+  size_t Pitch = roundUp(std::max<size_t>(WidthBytes, 1), Alignment);
+  if (Pitch % ConflictStride == 0)
+    Pitch += Alignment;
+  return Pitch;
+}
+
+size_t CHIPDevice::getMallocHeapSize() {
+  LOCK(DeviceVarMtx); // CHIPDevice::MallocHeapSize_
+  return MallocHeapSize_;
+}
+
+bool CHIPDevice::setMallocHeapSize(size_t Size) {
+  LOCK(DeviceVarMtx); // CHIPDevice::MallocHeapSize_, CHIPDevice::MallocHeap_
+  if (MallocHeap_)
+    return false;
+  MallocHeapSize_ = Size;
+  return true;
+}
+
+void *CHIPDevice::getMallocHeapNoLock(CHIPQueue *Queue) {
+  if (MallocHeap_)
+    return MallocHeap_;
+
+  // The chunk indices and the offset of the arena are 32-bit on the device.
+  size_t NumChunks = std::clamp<size_t>(
+      MallocHeapSize_ / ChipMallocChunkSize, 1,
+      (std::numeric_limits<uint32_t>::max() - sizeof(CHIPMallocHeap)) /
+          sizeof(CHIPMallocChunk));
+  size_t ArenaOffset =
+      roundUp(sizeof(CHIPMallocHeap) + NumChunks * sizeof(CHIPMallocChunk),
+              ChipMallocMinBlockSize);
+  logDebug("Allocate a {} byte malloc() heap", NumChunks * ChipMallocChunkSize);
+
+  // All chunks are free. Only the header and the chunk states need to be
+  // initialized.
+  std::vector<char> Init(ArenaOffset);
+  auto *Header = reinterpret_cast<CHIPMallocHeap *>(Init.data());
+  Header->NumChunks = NumChunks;
+  Header->ArenaOffset = ArenaOffset;
+  auto *Chunks = reinterpret_cast<CHIPMallocChunk *>(Header + 1);
+  for (size_t I = 0; I < NumChunks; I++)
+    Chunks[I].Used = ChipMallocChunkNotSplit;
+
+  MallocHeap_ = Ctx_->allocate(ArenaOffset + NumChunks * ChipMallocChunkSize,
+                               ChipMallocMinBlockSize,
+                               hipMemoryType::hipMemoryTypeDevice);
+  if (!MallocHeap_)
+    CHIPERR_LOG_AND_THROW("Could not allocate the device malloc() heap",
+                          hipErrorOutOfMemory);
+  Queue->memCopyAsync(MallocHeap_, Init.data(), Init.size());
+  Queue->finish();
+  return MallocHeap_;
+}
+
+void CHIPDevice::freeMallocHeapNoLock() {
+  if (!MallocHeap_)
+    return;
+  auto Err = Ctx_->free(MallocHeap_);
+  (void)Err;
+  MallocHeap_ = nullptr;
 }
 
 /// Get compiled module associated with the host pointer 'Ptr'. Return
@@ -1049,6 +1653,8 @@ CHIPModule *CHIPDevice::getOrCreateModule(const SPVModule &SrcMod) {
 CHIPContext::CHIPContext() {}
 CHIPContext::~CHIPContext() {
   logDebug("~CHIPContext() {}", (void *)this);
+  logInfo("syncQueues(): {} barriers enqueued, {} avoided",
+          getNumSyncBarriers(), getNumSyncBarriersAvoided());
   delete ChipDevice_;
 }
 
@@ -1089,24 +1695,31 @@ void CHIPContext::syncQueues(CHIPQueue *TargetQueue) {
   // default stream waits on all blocking streams to complete
   std::vector<CHIPEvent *> EventsToWaitOn;
 
-  CHIPEvent *SyncQueuesEvent;
   if (TargetQueue == DefaultQueue) {
     for (auto &q : QueuesToSyncWith) {
-      auto Ev = q->getLastEvent();
+      if (q == TargetQueue)
+        continue;
+      auto Ev = q->getLastEventToSyncWith(TargetQueue);
       if (Ev)
         EventsToWaitOn.push_back(Ev);
     }
-    SyncQueuesEvent = TargetQueue->enqueueBarrierImpl(&EventsToWaitOn);
-    SyncQueuesEvent->Msg = "barrierSyncQueue";
-    TargetQueue->updateLastEvent(SyncQueuesEvent);
   } else { // blocking stream must wait until default stream is done
-    auto Ev = DefaultQueue->getLastEvent();
+    auto Ev = DefaultQueue->getLastEventToSyncWith(TargetQueue);
     if (Ev)
       EventsToWaitOn.push_back(Ev);
-    SyncQueuesEvent = TargetQueue->enqueueBarrierImpl(&EventsToWaitOn);
-    SyncQueuesEvent->Msg = "barrierSyncQueue";
-    TargetQueue->updateLastEvent(SyncQueuesEvent);
   }
+
+  // The target queue is in-order: the work it has already waited for needs
+  // no new barrier.
+  if (EventsToWaitOn.empty()) {
+    NumSyncBarriersAvoided_++;
+    return;
+  }
+  NumSyncBarriers_++;
+
+  auto SyncQueuesEvent = TargetQueue->enqueueBarrierImpl(&EventsToWaitOn);
+  SyncQueuesEvent->Msg = "barrierSyncQueue";
+  TargetQueue->updateLastEvent(SyncQueuesEvent);
   SyncQueuesEvent->track();
 }
 
@@ -1174,6 +1787,15 @@ void CHIPContext::setFlags(unsigned int Flags) { Flags_ = Flags; }
 
 void CHIPContext::reset() {
   logDebug("Resetting CHIPContext: deleting allocations");
+  {
+    LOCK(StagingMtx_); // CHIPContext::FreeStagingBuffers_
+    assert(FreeStagingBuffers_.size() == NumStagingBuffers_ &&
+           "Staging buffers are in use!");
+    for (auto *Buffer : FreeStagingBuffers_)
+      free(Buffer);
+    FreeStagingBuffers_.clear();
+    NumStagingBuffers_ = 0;
+  }
   // Free all allocations in this context
   for (auto &Ptr : AllocatedPtrs_)
     freeImpl(Ptr);
@@ -1199,20 +1821,127 @@ hipError_t CHIPContext::free(void *Ptr) {
   return hipSuccess;
 }
 
+void *CHIPContext::acquireStagingBuffer() {
+  {
+    LOCK(StagingMtx_); // CHIPContext::FreeStagingBuffers_
+    if (FreeStagingBuffers_.size()) {
+      void *Buffer = FreeStagingBuffers_.back();
+      FreeStagingBuffers_.pop_back();
+      return Buffer;
+    }
+    if (NumStagingBuffers_ >= MaxStagingBuffers)
+      return nullptr;
+    NumStagingBuffers_++;
+  }
+
+  void *Buffer = nullptr;
+  try {
+    Buffer = allocate(StagingBufferSize, hipMemoryTypeHost);
+  } catch (CHIPError &Err) {
+    logWarn("Could not allocate a staging buffer: {}", Err.getMsgStr());
+  }
+  if (!Buffer) {
+    LOCK(StagingMtx_); // CHIPContext::NumStagingBuffers_
+    NumStagingBuffers_--;
+  }
+  return Buffer;
+}
+
+void CHIPContext::releaseStagingBuffer(void *Buffer) {
+  assert(Buffer);
+  LOCK(StagingMtx_); // CHIPContext::FreeStagingBuffers_
+  FreeStagingBuffers_.push_back(Buffer);
+}
+
+CHIPContext::StagingConfig CHIPContext::pickStagingConfig(bool ToDevice,
+                                                          size_t Size) {
+  LOCK(StagingMtx_); // CHIPContext::BestStagingConfig_
+  auto Throughput = [&](StagingConfig Config) {
+    return StagingThroughput_[ToDevice][Config.ChunkShift -
+                                        MinStagingChunkShift][Config.Depth];
+  };
+  auto Neighbour = [&](StagingConfig Config, unsigned Idx) {
+    switch (Idx % 4) {
+    case 0:
+      Config.ChunkShift = std::min(Config.ChunkShift + 1, MaxStagingChunkShift);
+      break;
+    case 1:
+      Config.ChunkShift = std::max(Config.ChunkShift - 1, MinStagingChunkShift);
+      break;
+    case 2:
+      Config.Depth = std::min(Config.Depth + 1, MaxStagingDepth);
+      break;
+    default:
+      Config.Depth = std::max(Config.Depth - 1, MinStagingDepth);
+      break;
+    }
+    return Config;
+  };
+
+  StagingConfig Best = BestStagingConfig_[ToDevice];
+  StagingConfig Config = Best;
+  unsigned Copy = NumStagedCopies_[ToDevice]++;
+  for (unsigned Idx = 0; Idx < 4; Idx++)
+    if (Throughput(Neighbour(Best, Idx)) == 0) {
+      Config = Neighbour(Best, Idx);
+      break;
+    }
+  if (Copy % 4 == 3)
+    Config = Neighbour(Best, Copy / 4);
+
+  // Smaller copies get smaller chunks to keep all the buffers busy.
+  while (Config.ChunkShift > MinStagingChunkShift &&
+         ((size_t)Config.Depth << Config.ChunkShift) > Size)
+    Config.ChunkShift--;
+  return Config;
+}
+
+void CHIPContext::recordStagingTime(bool ToDevice, StagingConfig Config,
+                                    size_t Size,
+                                    std::chrono::nanoseconds Time) {
+  assert(Config.ChunkShift >= MinStagingChunkShift &&
+         Config.ChunkShift <= MaxStagingChunkShift &&
+         Config.Depth <= MaxStagingDepth);
+  double Sample = (double)Size / std::max<int64_t>(Time.count(), 1);
+  LOCK(StagingMtx_); // CHIPContext::StagingThroughput_, BestStagingConfig_
+  auto &Table = StagingThroughput_[ToDevice];
+  double &Avg = Table[Config.ChunkShift - MinStagingChunkShift][Config.Depth];
+  Avg = Avg ? 0.75 * Avg + 0.25 * Sample : Sample;
+
+  StagingConfig &Best = BestStagingConfig_[ToDevice];
+  if (Avg > Table[Best.ChunkShift - MinStagingChunkShift][Best.Depth]) {
+    Best = Config;
+    logDebug("Staged memcpys {} device now use {} byte chunks, {} deep "
+             "({:.2f} GB/s)",
+             ToDevice ? "to" : "from", (size_t)1 << Config.ChunkShift,
+             Config.Depth, Avg);
+  }
+}
+
 // CHIPBackend
 //*************************************************************************************
 int CHIPBackend::getPerThreadQueuesActive() {
-  LOCK(Backend->BackendMtx); // Prevent adding/removing devices while iterating
-  int Active = 0;
-  for (auto Dev : getDevices()) {
-    if (Dev->isPerThreadStreamUsed()) {
-      Active++;
-    }
+  LOCK(PerThreadQueuesMtx); // CHIPBackend::PerThreadQueuesActive_
+  return PerThreadQueuesActive_;
+}
+
+void CHIPBackend::registerPerThreadQueue() {
+  LOCK(PerThreadQueuesMtx); // CHIPBackend::PerThreadQueuesActive_
+  PerThreadQueuesActive_++;
+}
+
+void CHIPBackend::unregisterPerThreadQueue() {
+  {
+    LOCK(PerThreadQueuesMtx); // CHIPBackend::PerThreadQueuesActive_
+    assert(PerThreadQueuesActive_ > 0);
+    PerThreadQueuesActive_--;
+    if (PerThreadQueuesActive_)
+      return;
   }
-  return Active;
+  PerThreadQueuesCv.notify_all();
 }
 int CHIPBackend::getQueuePriorityRange() {
-  assert(MinQueuePriority_);
+  assert(MinQueuePriority_ >= 0);
   return MinQueuePriority_;
 }
 
@@ -1245,32 +1974,41 @@ CHIPBackend::~CHIPBackend() {
   }
 }
 
+CHIPCallbackExecutor *CHIPBackend::getCallbackExecutor() {
+  LOCK(CallbackExecutorMtx); // CHIPBackend::CallbackExecutor_
+  if (!CallbackExecutor_)
+    CallbackExecutor_ = new CHIPCallbackExecutor();
+  return CallbackExecutor_;
+}
+
 void CHIPBackend::waitForThreadExit() {
+  // Run the outstanding callbacks while the queues and the event monitors
+  // they rely on are still around.
+  CHIPCallbackExecutor *Executor;
+  {
+    LOCK(CallbackExecutorMtx); // CHIPBackend::CallbackExecutor_
+    Executor = CallbackExecutor_;
+  }
+  if (Executor) {
+    Executor->waitIdle();
+    LOCK(CallbackExecutorMtx); // CHIPBackend::CallbackExecutor_
+    delete CallbackExecutor_;
+    CallbackExecutor_ = nullptr;
+  }
+
   /**
-   * If the main thread just creates a bunch of other threads and tries to exit
-   * right away, it could be the case that all those threads are not yet done
-   * with initialization. In particular, these threads might not have yet
-   * created their per-thread queues which is how we keep track of threads.
-   *
-   * So we just wait for 0.5 seconds before starting to check for thread exit.
+   * Per-thread queues are owned by thread_local storage and get destroyed by
+   * the TLS destructors of their threads which then notify us. Threads which
+   * have not created a per-thread queue have nothing for us to clean up.
    */
-  pthread_yield();
-  // TODO fix-255 is there a better way to do this?
-  unsigned long long int sleepMicroSeconds = 500000;
-  usleep(sleepMicroSeconds);
-
-  while (true) {
-    {
-      auto NumPerThreadQueuesActive = Backend->getPerThreadQueuesActive();
-      if (!NumPerThreadQueuesActive)
-        break;
-
+  {
+    std::unique_lock<std::mutex> Lock(PerThreadQueuesMtx);
+    while (!PerThreadQueuesCv.wait_for(Lock, std::chrono::seconds(1), [&] {
+      return PerThreadQueuesActive_ == 0;
+    }))
       logDebug(
-          "CHIPBackend::waitForThreadExit() per-thread queues still active "
-          "{}. Sleeping for 1s..",
-          NumPerThreadQueuesActive);
-    }
-    sleep(1);
+          "CHIPBackend::waitForThreadExit() per-thread queues still active {}",
+          PerThreadQueuesActive_);
   }
 
   // Cleanup all queues
@@ -1516,18 +2254,164 @@ CHIPQueue::CHIPQueue(CHIPDevice *ChipDevice, CHIPQueueFlags Flags, int Priority)
 CHIPQueue::CHIPQueue(CHIPDevice *ChipDevice, CHIPQueueFlags Flags)
     : CHIPQueue(ChipDevice, Flags, 0){};
 
+CHIPEvent *CHIPQueue::getLastEventToSyncWith(CHIPQueue *Waiter) {
+  LOCK(LastEventMtx); // CHIPQueue::LastEvent_, CHIPQueue::LastEventId_
+  auto &SyncedId = Waiter->SyncedEventIds_[this];
+  if (!LastEvent_ || LastEventId_ == SyncedId)
+    return nullptr;
+  SyncedId = LastEventId_;
+  return LastEvent_;
+}
+
 CHIPQueue::~CHIPQueue() {
   updateLastEvent(nullptr);
   if (PerThreadQueueForDevice) {
     PerThreadQueueForDevice->setPerThreadStreamUsed(false);
+    if (Backend)
+      Backend->unregisterPerThreadQueue();
   }
 };
 
+void CHIPQueue::addPendingDeviceRequests(CHIPModule *Module) {
+  // If the flag is not found, we have removed it in HipAbort pass to
+  // denote abort is not called by any kernel in the module. Likewise the
+  // HipPrintf pass removes the printf buffer.
+  if (!Module->getGlobalVar(ChipDeviceAbortFlagName) &&
+      !Module->getPrintfBuffer())
+    return;
+  LOCK(DeviceRequestMtx); // CHIPQueue::PendingDeviceRequests_
+  PendingDeviceRequests_.insert(Module);
+}
+
+void CHIPQueue::discardPendingDeviceRequests(CHIPModule *Module) {
+  LOCK(DeviceRequestMtx); // CHIPQueue::PendingDeviceRequests_
+  PendingDeviceRequests_.erase(Module);
+}
+
+void CHIPQueue::handlePendingDeviceRequests() {
+  std::set<CHIPModule *> ModulesToCheck;
+  std::map<void *, bool> MirrorsToCopy;
+  {
+    LOCK(DeviceRequestMtx); // CHIPQueue::PendingDeviceRequests_
+    if (PendingDeviceRequests_.empty() && PendingMirrorCopies_.empty())
+      return;
+    ModulesToCheck.swap(PendingDeviceRequests_);
+    MirrorsToCopy.swap(PendingMirrorCopies_);
+  }
+  logTrace("CHIPQueue::handlePendingDeviceRequests() {}", (void *)this);
+
+  // The queue has been drained by the caller so the reads below are
+  // cheap. They bypass syncQueues() on purpose: this is called from sync
+  // points which may already hold CHIPDevice::DeviceMtx.
+  auto ReadWrite = [&](void *Dst, const void *Src, size_t Size) {
+    auto *ChipEvent = memCopyAsyncImpl(Dst, Src, Size);
+    ChipEvent->Msg = "deviceRequestCopy";
+    updateLastEvent(ChipEvent);
+    finish();
+    ChipEvent->track();
+  };
+
+  // Print the records up to the first one still being written by a kernel
+  // running in another queue and let the device reuse their space.
+  auto PrintOutput = [&](CHIPModule *Module, CHIPPrintfBuffer *Buffer) {
+    CHIPPrintfBuffer Header;
+    ReadWrite(&Header, Buffer, sizeof(Header));
+    if (Header.Dropped != Module->PrintfDropped)
+      logWarn("The output of {} printf() calls did not fit in the buffer. "
+              "Enlarge it with hipDeviceSetLimit(hipLimitPrintfFifoSize).",
+              Header.Dropped - Module->PrintfDropped);
+    Module->PrintfDropped = Header.Dropped;
+
+    uint32_t Size = Header.Used - Header.Consumed;
+    if (!Size)
+      return;
+    // The records may wrap around the end of the ring.
+    char *Data = reinterpret_cast<char *>(Buffer + 1);
+    uint32_t Pos = Header.Consumed & (Header.Capacity - 1);
+    uint32_t Head = std::min(Size, Header.Capacity - Pos);
+    std::vector<char> Records(Size);
+    ReadWrite(Records.data(), Data + Pos, Head);
+    if (Head < Size)
+      ReadWrite(Records.data() + Head, Data, Size - Head);
+
+    size_t Consumed;
+    auto Output = formatPrintfRecords(Module->getPrintfFormats(),
+                                      Records.data(), Size, Consumed);
+    fwrite(Output.data(), 1, Output.size(), stdout);
+    fflush(stdout);
+    if (!Consumed)
+      return;
+
+    // The device relies on the space being cleared for spotting the
+    // records still being written.
+    std::vector<char> Zeros(Consumed);
+    uint32_t ZeroHead = std::min<uint32_t>(Consumed, Head);
+    ReadWrite(Data + Pos, Zeros.data(), ZeroHead);
+    if (ZeroHead < Consumed)
+      ReadWrite(Data, Zeros.data(), Consumed - ZeroHead);
+    Header.Consumed += Consumed;
+    ReadWrite(&Buffer->Consumed, &Header.Consumed, sizeof(Header.Consumed));
+  };
+
+  for (auto [HostPtr, Written] : MirrorsToCopy) {
+    // The mirror may have been unregistered since.
+    auto *AllocInfo = ChipDevice_->AllocationTracker->getAllocInfo(HostPtr);
+    if (!AllocInfo || AllocInfo->HostPtr != HostPtr ||
+        AllocInfo->MemoryType != hipMemoryTypeManaged)
+      continue;
+    if (Written)
+      ReadWrite(AllocInfo->HostPtr, AllocInfo->DevPtr, AllocInfo->Size);
+    AllocInfo->MirrorOnDevice = false;
+  }
+
+  for (auto *Module : ModulesToCheck) {
+    // Print first so the output preceding an abort() is not lost.
+    if (auto *Buffer = Module->getPrintfBuffer()) {
+      LOCK(Module->PrintfMtx); // CHIPModule::PrintfDropped
+      PrintOutput(Module, Buffer);
+    }
+
+    CHIPDeviceVar *Var = Module->getGlobalVar(ChipDeviceAbortFlagName);
+    if (!Var)
+      continue; // The module does not call abort.
+
+    int32_t AbortFlag = 0;
+    ReadWrite(&AbortFlag, Var->getDevAddr(), sizeof(AbortFlag));
+    if (!AbortFlag)
+      continue; // Abort was not called.
+
+    // Disable host-side abort behavior for making the unit testing of abort
+    // cases easier.
+    if (!getenv("CHIP_HOST_IGNORES_DEVICE_ABORT"))
+      abort();
+
+    // Just act like nothing happened. Reset the flag so we let there be
+    // more aborts.
+    AbortFlag = 0;
+    ReadWrite(Var->getDevAddr(), &AbortFlag, sizeof(AbortFlag));
+    printf("[ABORT IGNORED]\n");
+  }
+}
+
 ///////// Enqueue Operations //////////
 hipError_t CHIPQueue::memCopy(void *Dst, const void *Src, size_t Size) {
 #ifdef ENFORCE_QUEUE_SYNC
   ChipContext_->syncQueues(this);
 #endif
+  if (ChipDevice_->getMemoryProfile().UnifiedCoherent) {
+    // All memory is host memory: wait for the preceding work of the queue
+    // and copy on the host.
+    finish();
+    hostMemCopy(Dst, Src, Size);
+    handlePendingDeviceRequests();
+    return hipSuccess;
+  }
+
+  if (memCopyStaged(Dst, Src, Size)) {
+    handlePendingDeviceRequests();
+    return hipSuccess;
+  }
+
   CHIPEvent *ChipEvent;
   // Scope this so that we release mutex for finish()
   {
@@ -1535,28 +2419,134 @@ hipError_t CHIPQueue::memCopy(void *Dst, const void *Src, size_t Size) {
         Backend->getActiveDevice()->AllocationTracker->getAllocInfo(Dst);
     auto AllocInfoSrc =
         Backend->getActiveDevice()->AllocationTracker->getAllocInfo(Src);
+    // Unmap and map on this queue so that they are ordered with the copy,
+    // like in memCopyAsync() and memCopyStaged().
     if (AllocInfoDst && AllocInfoDst->MemoryType == hipMemoryTypeHost)
-      Backend->getActiveDevice()->getDefaultQueue()->MemUnmap(AllocInfoDst);
+      this->MemUnmap(AllocInfoDst);
     if (AllocInfoSrc && AllocInfoSrc->MemoryType == hipMemoryTypeHost)
-      Backend->getActiveDevice()->getDefaultQueue()->MemUnmap(AllocInfoSrc);
+      this->MemUnmap(AllocInfoSrc);
 
     ChipEvent = memCopyAsyncImpl(Dst, Src, Size);
 
     if (AllocInfoDst && AllocInfoDst->MemoryType == hipMemoryTypeHost)
-      Backend->getActiveDevice()->getDefaultQueue()->MemMap(
-          AllocInfoDst, CHIPQueue::MEM_MAP_TYPE::HOST_READ_WRITE);
+      this->MemMap(AllocInfoDst, CHIPQueue::MEM_MAP_TYPE::HOST_READ_WRITE);
     if (AllocInfoSrc && AllocInfoSrc->MemoryType == hipMemoryTypeHost)
-      Backend->getActiveDevice()->getDefaultQueue()->MemMap(
-          AllocInfoSrc, CHIPQueue::MEM_MAP_TYPE::HOST_READ_WRITE);
+      this->MemMap(AllocInfoSrc, CHIPQueue::MEM_MAP_TYPE::HOST_READ_WRITE);
 
     ChipEvent->Msg = "memCopy";
     updateLastEvent(ChipEvent);
     this->finish();
   }
   ChipEvent->track();
+  handlePendingDeviceRequests();
 
   return hipSuccess;
 }
+bool CHIPQueue::memCopyStaged(void *Dst, const void *Src, size_t Size) {
+  size_t Threshold = getStagingThreshold();
+  if (!Threshold || Size < Threshold)
+    return false;
+
+  // Stage only between device accessible memory and host memory which is
+  // unknown to the runtime. Pinned host allocations are copied directly.
+  auto &AllocTracker = ChipDevice_->AllocationTracker;
+  auto *AllocInfoDst = AllocTracker->getAllocInfo(Dst);
+  auto *AllocInfoSrc = AllocTracker->getAllocInfo(Src);
+  if ((AllocInfoDst == nullptr) == (AllocInfoSrc == nullptr))
+    return false;
+  bool ToDevice = AllocInfoDst != nullptr;
+  auto *DevAllocInfo = ToDevice ? AllocInfoDst : AllocInfoSrc;
+  if (DevAllocInfo->MemoryType == hipMemoryTypeHost)
+    return false;
+
+  // The chunk size and the pipeline depth are tuned on the measured
+  // throughput of the previous staged copies. The depth is limited by the
+  // available buffers.
+  auto Config = ChipContext_->pickStagingConfig(ToDevice, Size);
+  size_t ChunkSize = (size_t)1 << Config.ChunkShift;
+  size_t NumChunks = (Size + ChunkSize - 1) / ChunkSize;
+
+  std::vector<void *> Buffers;
+  while (Buffers.size() < std::min<size_t>(NumChunks, Config.Depth)) {
+    void *Buffer = ChipContext_->acquireStagingBuffer();
+    if (!Buffer)
+      break;
+    Buffers.push_back(Buffer);
+  }
+  if (Buffers.empty())
+    return false;
+  size_t Depth = Buffers.size();
+  Config.Depth = Depth;
+  auto Start = std::chrono::steady_clock::now();
+  logDebug("CHIPQueue::memCopyStaged {} bytes {} in {} chunks of {} bytes "
+           "through {} buffers",
+           Size, ToDevice ? "to device" : "from device", NumChunks, ChunkSize,
+           Depth);
+
+  // Staging buffers are kept mapped for host access while idle, see
+  // CHIPAllocationTracker::recordAllocation().
+  std::vector<AllocationInfo *> BufferInfos;
+  for (auto *Buffer : Buffers)
+    BufferInfos.push_back(AllocTracker->getAllocInfo(Buffer));
+  std::vector<CHIPEvent *> Pending(Depth, nullptr);
+
+  auto ChunkLength = [&](size_t Chunk) {
+    return std::min(ChunkSize, Size - Chunk * ChunkSize);
+  };
+  auto EnqueueChunk = [&](size_t Chunk) {
+    size_t Slot = Chunk % Depth, Offset = Chunk * ChunkSize;
+    MemUnmap(BufferInfos[Slot]);
+    CHIPEvent *ChipEvent =
+        ToDevice ? memCopyAsyncImpl((char *)Dst + Offset, Buffers[Slot],
+                                    ChunkLength(Chunk))
+                 : memCopyAsyncImpl(Buffers[Slot], (const char *)Src + Offset,
+                                    ChunkLength(Chunk));
+    ChipEvent->Msg = "memCopyStaged";
+    updateLastEvent(ChipEvent);
+    ChipEvent->increaseRefCount("memCopyStaged");
+    ChipEvent->track();
+    Pending[Slot] = ChipEvent;
+  };
+  auto WaitSlot = [&](size_t Slot, CHIPQueue::MEM_MAP_TYPE MapType) {
+    if (!Pending[Slot])
+      return;
+    Pending[Slot]->wait();
+    Pending[Slot]->decreaseRefCount("memCopyStaged");
+    Pending[Slot] = nullptr;
+    MemMap(BufferInfos[Slot], MapType);
+  };
+
+  if (ToDevice) {
+    for (size_t Chunk = 0; Chunk < NumChunks; Chunk++) {
+      size_t Slot = Chunk % Depth;
+      WaitSlot(Slot, CHIPQueue::MEM_MAP_TYPE::HOST_WRITE);
+      memcpy(Buffers[Slot], (const char *)Src + Chunk * ChunkSize,
+             ChunkLength(Chunk));
+      EnqueueChunk(Chunk);
+    }
+  } else {
+    for (size_t Chunk = 0; Chunk < std::min(NumChunks, Depth); Chunk++)
+      EnqueueChunk(Chunk);
+    for (size_t Chunk = 0; Chunk < NumChunks; Chunk++) {
+      size_t Slot = Chunk % Depth;
+      WaitSlot(Slot, CHIPQueue::MEM_MAP_TYPE::HOST_READ);
+      memcpy((char *)Dst + Chunk * ChunkSize, Buffers[Slot],
+             ChunkLength(Chunk));
+      if (Chunk + Depth < NumChunks)
+        EnqueueChunk(Chunk + Depth);
+    }
+  }
+
+  for (size_t Slot = 0; Slot < Depth; Slot++) {
+    WaitSlot(Slot, CHIPQueue::MEM_MAP_TYPE::HOST_READ_WRITE);
+    ChipContext_->releaseStagingBuffer(Buffers[Slot]);
+  }
+  finish();
+  ChipContext_->recordStagingTime(ToDevice, Config, Size,
+                                  std::chrono::steady_clock::now() - Start);
+  return true;
+}
+
 void CHIPQueue::memCopyAsync(void *Dst, const void *Src, size_t Size) {
 #ifdef ENFORCE_QUEUE_SYNC
   ChipContext_->syncQueues(this);
@@ -1686,11 +2676,14 @@ CHIPEvent *CHIPQueue::RegisteredVarCopy(CHIPExecItem *ExecItem,
   //       the kernel does not have any, we only need inspect kernels
   //       pointer arguments for allocations to be synchronized.
 
+  const auto &MemoryProfile = ChipDevice_->getMemoryProfile();
   std::vector<CHIPEvent *> CopyEvents;
   auto PreKernel = ExecState == MANAGED_MEM_STATE::PRE_KERNEL;
   auto &AllocTracker = Backend->getActiveDevice()->AllocationTracker;
   auto ArgVisitor = [&](const AllocationInfo &AllocInfo) -> void {
     if (AllocInfo.MemoryType == hipMemoryTypeHost) {
+      if (MemoryProfile.HostAllocsCoherent)
+        return;
       logDebug("Sync host memory {} ({})", AllocInfo.HostPtr,
                (PreKernel ? "Unmap" : "Map"));
       if (PreKernel)
@@ -1699,6 +2692,22 @@ CHIPEvent *CHIPQueue::RegisteredVarCopy(CHIPExecItem *ExecItem,
         MemMap(&AllocInfo, CHIPQueue::MEM_MAP_TYPE::HOST_READ_WRITE);
     } else if (AllocInfo.HostPtr &&
                AllocInfo.MemoryType == hipMemoryTypeManaged) {
+      // A mirror prefetched to or preferring the device stays there between
+      // launches. The host may only access it after a synchronization point,
+      // which copies it back, or after prefetching it to the host.
+      // Read-mostly mirrors are copied back as well since kernels may still
+      // write to them.
+      int DeviceId = ChipDevice_->getDeviceId();
+      bool OnDevice = AllocInfo.MirrorOnDevice;
+      if (!PreKernel && (OnDevice || AllocInfo.PreferredLocation == DeviceId ||
+                         AllocInfo.LastPrefetchLocation == DeviceId)) {
+        AllocInfo.MirrorOnDevice = true;
+        LOCK(DeviceRequestMtx); // CHIPQueue::PendingMirrorCopies_
+        PendingMirrorCopies_[AllocInfo.HostPtr] = true;
+        return;
+      }
+      if (OnDevice)
+        return;
       void *Src = PreKernel ? AllocInfo.HostPtr : AllocInfo.DevPtr;
       void *Dst = PreKernel ? AllocInfo.DevPtr : AllocInfo.HostPtr;
       logDebug("Sync managed memory {} -> {} ({})", Src, Dst,
@@ -1803,12 +2812,68 @@ CHIPEvent *CHIPQueue::enqueueMarker() {
   return ChipEvent;
 }
 
-void CHIPQueue::memPrefetch(const void *Ptr, size_t Count) {
+void CHIPQueue::memPrefetch(const void *Ptr, size_t Count, bool ToHost) {
 #ifdef ENFORCE_QUEUE_SYNC
   ChipContext_->syncQueues(this);
 #endif
 
-  auto ChipEvent = memPrefetchImpl(Ptr, Count);
+  auto *AllocInfo = ChipDevice_->AllocationTracker->getAllocInfo(Ptr);
+  if (!AllocInfo || (AllocInfo->MemoryType != hipMemoryTypeUnified &&
+                     AllocInfo->MemoryType != hipMemoryTypeManaged))
+    CHIPERR_LOG_AND_THROW("Prefetched memory is not managed",
+                          hipErrorInvalidValue);
+
+  auto *Base = (const char *)AllocInfo->DevPtr;
+  auto *HostBase = (const char *)AllocInfo->HostPtr;
+  if (AllocInfo->MemoryType == hipMemoryTypeManaged &&
+      (const char *)Ptr >= HostBase &&
+      (const char *)Ptr < HostBase + AllocInfo->Size)
+    Base = HostBase;
+  size_t Offset = (const char *)Ptr - Base;
+  if (Offset + Count > AllocInfo->Size)
+    CHIPERR_LOG_AND_THROW("Prefetched range exceeds the allocation",
+                          hipErrorInvalidValue);
+
+  CHIPEvent *ChipEvent;
+  if (AllocInfo->MemoryType == hipMemoryTypeManaged) {
+    // A hipHostRegister() mirror is migrated by copying between the host
+    // memory and its device copy.
+    char *DevPtr = (char *)AllocInfo->DevPtr + Offset;
+    char *HostPtr = (char *)AllocInfo->HostPtr + Offset;
+    bool Whole = Count == AllocInfo->Size;
+    if (ToHost) {
+      ChipEvent = memCopyAsyncImpl(HostPtr, DevPtr, Count);
+      if (Whole && AllocInfo->MirrorOnDevice) {
+        // The copies pending in the queues would overwrite later host
+        // writes.
+        AllocInfo->MirrorOnDevice = false;
+        LOCK(ChipDevice_->DeviceMtx); // CHIPDevice::ChipQueues_
+        std::vector<CHIPQueue *> Queues = ChipDevice_->getQueuesNoLock();
+        Queues.push_back(ChipDevice_->getLegacyDefaultQueue());
+        if (ChipDevice_->isPerThreadStreamUsedNoLock())
+          Queues.push_back(ChipDevice_->getPerThreadDefaultQueueNoLock());
+        for (auto *Queue : Queues) {
+          LOCK(Queue->DeviceRequestMtx); // CHIPQueue::PendingMirrorCopies_
+          Queue->PendingMirrorCopies_.erase(AllocInfo->HostPtr);
+        }
+      }
+    } else if (AllocInfo->MirrorOnDevice) {
+      // The device copy is already the current one.
+      ChipEvent = enqueueMarkerImpl();
+    } else {
+      ChipEvent = memCopyAsyncImpl(DevPtr, HostPtr, Count);
+      if (Whole) {
+        // Launches can skip the upload until the host gets the data back.
+        AllocInfo->MirrorOnDevice = true;
+        LOCK(DeviceRequestMtx); // CHIPQueue::PendingMirrorCopies_
+        PendingMirrorCopies_.emplace(AllocInfo->HostPtr, false);
+      }
+    }
+  } else {
+    ChipEvent = memPrefetchImpl(Ptr, Count, ToHost);
+  }
+  AllocInfo->LastPrefetchLocation =
+      ToHost ? hipCpuDeviceId : ChipDevice_->getDeviceId();
   ChipEvent->Msg = "memPrefetch";
   updateLastEvent(ChipEvent);
   ChipEvent->track();
@@ -1843,11 +2908,12 @@ int CHIPQueue::getPriority() { return Priority_; }
 void CHIPQueue::addCallback(hipStreamCallback_t Callback, void *UserData) {
   CHIPCallbackData *Callbackdata =
       Backend->createCallbackData(Callback, UserData, this);
+  Backend->getCallbackExecutor()->add(Callbackdata);
+}
 
-  {
-    LOCK(Backend->CallbackQueueMtx); // CHIPBackend::CallbackQueue
-    Backend->CallbackQueue.push(Callbackdata);
-  }
-
-  return;
+void CHIPQueue::launchHostFunc(hipHostFn_t HostFn, void *UserData) {
+  CHIPCallbackData *Callbackdata =
+      Backend->createCallbackData(nullptr, UserData, this);
+  Callbackdata->HostFn = HostFn;
+  Backend->getCallbackExecutor()->add(Callbackdata);
 }
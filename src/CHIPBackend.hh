@@ -47,7 +47,15 @@
 #include "CHIPGraph.hh"
 #include "SPVRegister.hh"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <thread>
+
 #define DEFAULT_QUEUE_PRIORITY 1
+#define DEFAULT_QUEUE_POOL_SIZE 4
 
 inline CHIPContext *PrimaryContext = nullptr;
 inline thread_local std::stack<CHIPExecItem *> ChipExecStack;
@@ -295,32 +303,104 @@ public:
 };
 
 /**
- * @brief This object gets created when a callback is requested. Once created,
- * it gets placed on the CHIPBackend callback queue. A Callback monitor thread
- * gets created and executes these callback objects. This object stores all the
- * necessary data to execute a callback function:
+ * @brief This object gets created when a callback or a host function is
+ * added to a stream. It stores all the necessary data to execute it:
  * - Events for synching
  * - Callback function
  * - Arguments for the callback function
+ *
+ * The backends implement how the callback is inserted into the stream and
+ * how the stream is released afterwards. The callback itself is run by
+ * CHIPCallbackExecutor.
  */
 class CHIPCallbackData {
 protected:
   virtual ~CHIPCallbackData() = default;
+  friend class CHIPCallbackExecutor;
 
 public:
   CHIPQueue *ChipQueue;
-  CHIPEvent *GpuReady;
-  CHIPEvent *CpuCallbackComplete;
-  CHIPEvent *GpuAck;
+  /// The work preceding the callback in the stream, nullptr if there is none
+  CHIPEvent *GpuReady = nullptr;
+  /// Signaled once the callback has returned. The work following the
+  /// callback in the stream waits for it.
+  CHIPEvent *CpuCallbackComplete = nullptr;
 
   hipError_t Status;
   void *CallbackArgs;
   hipStreamCallback_t CallbackF;
+  /// Set instead of CallbackF for hipLaunchHostFunc()
+  hipHostFn_t HostFn = nullptr;
 
   CHIPCallbackData(hipStreamCallback_t CallbackF, void *CallbackArgs,
                    CHIPQueue *ChipQueue);
 
+  /**
+   * @brief Insert the callback into its stream: take the last event of the
+   * stream as GpuReady, make the following work wait for
+   * CpuCallbackComplete and arrange for CHIPCallbackExecutor::setReady() to
+   * be called once GpuReady has completed.
+   */
+  virtual void enqueue() = 0;
+
   void execute(hipError_t ResultFromDependency);
+
+  /**
+   * @brief Signal CpuCallbackComplete and release the events held.
+   */
+  virtual void complete() = 0;
+};
+
+/**
+ * @brief Runs stream callbacks and host functions on a small pool of host
+ * threads.
+ *
+ * Callbacks are handed to the pool by the backends once the preceding work
+ * of their stream has completed, so no worker is tied up waiting for the
+ * device. The callbacks of a stream are ordered by their events: the next
+ * one cannot become ready before the previous one has completed. Callbacks
+ * of different streams run concurrently.
+ */
+class CHIPCallbackExecutor {
+  std::mutex Mtx_;
+  std::condition_variable ReadyCv_;
+  std::condition_variable IdleCv_;
+  std::deque<CHIPCallbackData *> Ready_;
+  std::vector<std::thread> Workers_;
+  /// Callbacks added but not yet completed
+  size_t NumPending_ = 0;
+  bool Stop_ = false;
+
+  void work();
+
+public:
+  /**
+   * @brief Start the worker threads. CHIP_CALLBACK_THREADS overrides the
+   * default of 4 workers.
+   */
+  CHIPCallbackExecutor();
+
+  /**
+   * @brief Wait for the pending callbacks and join the workers.
+   */
+  ~CHIPCallbackExecutor();
+
+  /**
+   * @brief Insert the callback into its stream. It is run once the backend
+   * reports the preceding work completed via setReady().
+   */
+  void add(CHIPCallbackData *Cb);
+
+  /**
+   * @brief Queue a callback whose preceding work has completed for
+   * execution. May be called from any thread, including driver threads.
+   */
+  void setReady(CHIPCallbackData *Cb);
+
+  /**
+   * @brief Wait until all the added callbacks have completed.
+   */
+  void waitIdle();
 };
 
 class CHIPEventMonitor {
@@ -441,6 +521,20 @@ struct AllocationInfo {
   bool Managed = false;
   enum hipMemoryType MemoryType;
   bool RequiresMapUnmap = false;
+  /// Host memory imported by hipHostRegister(). The device accesses it at
+  /// the host address, so DevPtr == HostPtr.
+  bool HostRegistered = false;
+  /// hipMemAdvise() hints. They are passed to the driver where it has a
+  /// counterpart. A hipHostRegister() mirror preferring the device keeps
+  /// its data there between launches, see CHIPQueue::RegisteredVarCopy().
+  bool ReadMostly = false;
+  int PreferredLocation = hipInvalidDeviceId;
+  std::vector<int> AccessedBy;
+  /// Target of the last hipMemPrefetchAsync() of the allocation.
+  int LastPrefetchLocation = hipInvalidDeviceId;
+  /// Set while the current data of a mirror is on the device only. It is
+  /// copied back to the host at the next synchronization point.
+  mutable std::atomic<bool> MirrorOnDevice{false};
 };
 
 /**
@@ -621,6 +715,11 @@ protected:
    */
   CHIPContext *ChipContext_;
 
+  /// The device and the id (see CHIPQueue::getId()) of the queue the event
+  /// was last recorded into by hipEventRecord().
+  CHIPDevice *RecordedDevice_ = nullptr;
+  uint64_t RecordedQueueId_ = 0;
+
   /**
    * @brief hidden default constructor for CHIPEvent. Only derived class
    * constructor should be called.
@@ -659,6 +758,14 @@ public:
     return ChipContext_;
   }
 
+  void setRecordedQueue(CHIPQueue *ChipQueue);
+  /// Get the device of the queue the event was last recorded into, or
+  /// nullptr if it has not been recorded.
+  CHIPDevice *getRecordedDevice() const { return RecordedDevice_; }
+  /// Get the id of the queue the event was last recorded into. The queue
+  /// may have been destroyed since.
+  uint64_t getRecordedQueueId() const { return RecordedQueueId_; }
+
   /**
    * @brief Query the state of this event and update it's status
    * Each backend must override this method with implementation specific calls
@@ -825,10 +932,21 @@ class CHIPModule : public ihipModule_t {
   bool DeviceVariablesInitialized_ = false;
 
   OpenCLFunctionInfoMap FuncInfos_;
+  /// The functions the module defines that runtime device libraries have
+  /// native variants of.
+  std::set<std::string> RtDevLibExports_;
+  /// The format strings of the printf() calls (see ChipPrintfFormatsName).
+  std::string PrintfFormats_;
+  /// The buffer the printf() calls write to, allocated with the device
+  /// variables.
+  CHIPPrintfBuffer *PrintfBuffer_ = nullptr;
 
 protected:
   uint8_t *FuncIL_;
   size_t IlSize_;
+  /// The native binary the module was built from or compiled to, shared
+  /// with the modules of identical SPIR-V (see CHIPDevice::getNativeBinary).
+  std::shared_ptr<const std::string> NativeBinary_;
   std::mutex Mtx_;
   // Global variables
   std::vector<CHIPDeviceVar *> ChipVars_;
@@ -947,6 +1065,17 @@ public:
    */
   void consumeSPIRV();
 
+  /**
+   * @brief Get the SPIR-V binaries of the native runtime device libraries
+   * the module is to be linked with on the device. If there are any, Binary
+   * is set to the module with the emulated variants of their functions
+   * turned into imports, which is to be compiled instead of the original.
+   * Empty if the device has no native variants to link or cannot link.
+   * Available after consumeSPIRV().
+   */
+  std::vector<std::string_view> getRtDevLibBinaries(CHIPDevice *Device,
+                                                    std::string &Binary);
+
   /**
    * @brief Record a device variable
    *
@@ -962,11 +1091,39 @@ public:
   void invalidateDeviceVariablesNoLock();
   void deallocateDeviceVariablesNoLock(CHIPDevice *Device);
 
+  /// The buffer of the module's printf() calls, or nullptr if the module
+  /// does not print or its device variables are not allocated.
+  CHIPPrintfBuffer *getPrintfBuffer() const { return PrintfBuffer_; }
+
+  /// Guards PrintfDropped and the draining of the printf buffer, which the
+  /// queues running kernels of the module do at their synchronization
+  /// points.
+  std::mutex PrintfMtx;
+  /// The Dropped count of the printf buffer reported so far.
+  uint32_t PrintfDropped = 0;
+  std::string_view getPrintfFormats() const { return PrintfFormats_; }
+
   SPVFuncInfo *findFunctionInfo(const std::string &FName);
 
   const SPVModule &getSourceModule() const { return *Src_; }
 };
 
+/// What a kernel uses of its device, queried once when the kernel is
+/// created. The occupancy calculations are based on it.
+struct CHIPKernelResources {
+  /// Largest block the kernel can be launched with.
+  size_t MaxWorkGroupSize = 0;
+  /// Blocks whose size is a multiple of this have no partial subgroups.
+  size_t PreferredWorkGroupSizeMultiple = 1;
+  /// Shared memory of the __shared__ variables of the kernel.
+  size_t StaticLocalSize = 0;
+  /// Largest dynamic shared memory allocation of a launch.
+  size_t MaxDynamicLocalSize = 0;
+  /// Whether the kernel has an extern __shared__ array, i.e. the dynamic
+  /// shared memory size of a launch is actually allocated.
+  bool UsesDynamicLocalMem = false;
+};
+
 /**
  * @brief Contains information about the function on the host and device
  */
@@ -987,9 +1144,14 @@ protected:
 
   SPVFuncInfo *FuncInfo_;
 
+  /// Filled in by the constructors of the backends.
+  CHIPKernelResources Resources_;
+
 public:
   virtual ~CHIPKernel();
 
+  const CHIPKernelResources &getResources() const { return Resources_; }
+
   /**
    * @brief Get the Name object
    *
@@ -1202,6 +1364,104 @@ public:
   };
 };
 
+/**
+ * @brief How the memory of a device relates to host memory. Set by the
+ * backend when the device is created.
+ */
+struct CHIPMemoryProfile {
+  /// hipMemoryTypeHost allocations are coherent with the host and need no
+  /// MemMap()/MemUnmap() around host or device accesses.
+  bool HostAllocsCoherent = false;
+  /// All allocations, device allocations included, reside in coherent host
+  /// memory (e.g. CPU devices with fine-grain SVM). The host can access any
+  /// allocation directly, so managed memory needs no copies and copies need
+  /// no device commands.
+  bool UnifiedCoherent = false;
+};
+
+/**
+ * @brief How the host waits for the device, selected per device with
+ * hipSetDeviceFlags():
+ * - hipDeviceScheduleSpin: poll the completion status in a busy loop.
+ * - hipDeviceScheduleYield: poll, yielding the core between the polls.
+ * - hipDeviceScheduleBlockingSync: block in the driver right away.
+ * - hipDeviceScheduleAuto: block like hipDeviceScheduleBlockingSync unless
+ *   CHIP_SYNC_SPIN_US or CHIP_SYNC_YIELD_US is set. Then spin for
+ *   CHIP_SYNC_SPIN_US microseconds, yield until CHIP_SYNC_YIELD_US
+ *   microseconds have passed and then block.
+ */
+class CHIPSyncPolicy {
+  std::atomic<unsigned> Schedule_{hipDeviceScheduleAuto};
+  std::chrono::microseconds SpinTime_;
+  std::chrono::microseconds YieldTime_;
+
+public:
+  CHIPSyncPolicy();
+
+  void setSchedule(unsigned Schedule) {
+    Schedule_ = Schedule & hipDeviceScheduleMask;
+  }
+  unsigned getSchedule() const { return Schedule_; }
+
+  /// Whether wait() blocks without polling first.
+  bool blocksRightAway() const;
+
+  /**
+   * @brief Wait according to the schedule.
+   *
+   * @param Poll returns true once the awaited work has completed. Must not
+   * block.
+   * @param Block returns once the awaited work has completed. Called at
+   * most once, when the policy stops polling.
+   */
+  void wait(const std::function<bool()> &Poll,
+            const std::function<void()> &Block) const;
+};
+
+/**
+ * @brief Idle native queues of a device kept for reuse by new streams.
+ *
+ * The native queue of a destroyed stream is kept (at most
+ * CHIP_QUEUE_POOL_SIZE per priority, DEFAULT_QUEUE_POOL_SIZE by default) and
+ * handed to the next stream created with the same priority, which makes the
+ * stream-per-request pattern cheap. A native queue is used by one stream at a
+ * time so streams stay independent.
+ */
+class CHIPQueuePool {
+public:
+  using Destroyer = std::function<void(void *)>;
+
+private:
+  struct Entry {
+    void *Handle;
+    Destroyer Destroy;
+    int Priority;
+  };
+
+  std::mutex Mtx_;
+  std::vector<Entry> Idle_;
+  size_t Capacity_;
+
+public:
+  CHIPQueuePool();
+  ~CHIPQueuePool();
+
+  bool isEnabled() const { return Capacity_ > 0; }
+
+  /**
+   * @brief Get an idle native queue of the given priority or create a new
+   * one with Create().
+   */
+  void *acquire(int Priority, const std::function<void *()> &Create);
+
+  /**
+   * @brief Return the native queue of a destroyed stream. The queue must
+   * have no outstanding work. It is destroyed with Destroy() if the pool
+   * already holds CHIP_QUEUE_POOL_SIZE idle queues of the priority.
+   */
+  void release(void *Handle, int Priority, Destroyer Destroy);
+};
+
 /**
  * @brief Compute device class
  */
@@ -1219,6 +1479,18 @@ class CHIPDevice {
   /// Host pointer mapping to modules.
   std::unordered_map<const void *, CHIPModule *> HostPtrToCompiledMod_;
 
+  /// A native binary along with the SPIR-V it was compiled from.
+  struct NativeBinaryEntry {
+    std::string SpirV;
+    std::string Binary;
+  };
+  /// The native binaries of the modules compiled for the device, keyed by
+  /// the hash of their SPIR-V. The modules built from a binary own its
+  /// entry, so an entry is freed with the last of them.
+  std::unordered_multimap<size_t, std::weak_ptr<const NativeBinaryEntry>>
+      NativeBinaries_;
+  std::mutex NativeBinaryMtx_;
+
 protected:
   std::string DeviceName_;
   CHIPContext *Ctx_;
@@ -1231,12 +1503,32 @@ protected:
   size_t TotalUsedMem_;
   size_t MaxUsedMem_;
   size_t MaxMallocSize_ = 0;
+  /// Size of the device-side printf() buffers, set by hipDeviceSetLimit().
+  std::atomic<size_t> PrintfFifoSize_{1 << 20};
+  /// Size of the device-side malloc() heap, set by hipDeviceSetLimit().
+  /// Guarded by DeviceVarMtx.
+  size_t MallocHeapSize_ = 8 << 20;
+  /// The heap of the device-side malloc(), allocated when the first module
+  /// calling malloc() is set up. Guarded by DeviceVarMtx.
+  void *MallocHeap_ = nullptr;
 
   /// Maps host-side shadow variables to the corresponding device variables.
   std::unordered_map<const void *, CHIPDeviceVar *> DeviceVarLookup_;
 
   int Idx_ = -1; // Initialized with a value indicating unset ID.
 
+  CHIPMemoryProfile MemoryProfile_;
+  CHIPSyncPolicy SyncPolicy_;
+  /// Outlives the queues, which are destroyed by ~CHIPDevice()
+  CHIPQueuePool QueuePool_;
+  /// The flags set with hipSetDeviceFlags()
+  std::atomic<unsigned> Flags_{0};
+  /// The next cooperative launch is ordered after this one
+  CHIPEvent *LastCooperativeLaunch_ = nullptr;
+  std::mutex CooperativeLaunchMtx_;
+  /// Optional capabilities, found by populateDevicePropertiesImpl()
+  std::set<CHIPDeviceFeature> Features_;
+
   // only callable from derived classes, because we need to call also init()
   CHIPDevice(CHIPContext *Ctx, int DeviceIdx);
   // initializer. may call virtual methods
@@ -1245,6 +1537,59 @@ protected:
 
 public:
   hipDeviceProp_t getDeviceProps() { return HipDeviceProps_; }
+  const CHIPMemoryProfile &getMemoryProfile() const { return MemoryProfile_; }
+  const CHIPSyncPolicy &getSyncPolicy() const { return SyncPolicy_; }
+  CHIPQueuePool &getQueuePool() { return QueuePool_; }
+  void setFlags(unsigned Flags) {
+    Flags_ = Flags;
+    SyncPolicy_.setSchedule(Flags);
+  }
+  unsigned getFlags() const { return Flags_; }
+  bool hasFeature(CHIPDeviceFeature Feature) const {
+    return Features_.count(Feature);
+  }
+
+  /**
+   * @brief Get how many blocks of a kernel a compute unit runs at the same
+   * time.
+   *
+   * @param BlockSize number of threads in a block
+   * @param SharedMemPerBlock static and dynamic shared memory of a block
+   */
+  virtual int getMaxActiveBlocksPerCU(int BlockSize, size_t SharedMemPerBlock);
+
+  /**
+   * @brief Get how many blocks of the kernel a compute unit runs at the same
+   * time, based on the resources of the kernel.
+   *
+   * @param DynSharedMem dynamic shared memory of a block
+   */
+  int getKernelOccupancy(CHIPKernel *Kernel, int BlockSize,
+                         size_t DynSharedMem);
+
+  /**
+   * @brief Get the block size giving the kernel the most active threads per
+   * compute unit, and the smallest grid which keeps the device fully
+   * occupied with it. Both are zero if the kernel can't be launched.
+   *
+   * @param BlockSizeLimit largest block size considered, 0 for no limit
+   */
+  void getKernelMaxPotentialBlockSize(CHIPKernel *Kernel, size_t DynSharedMem,
+                                      int BlockSizeLimit, int &GridSize,
+                                      int &BlockSize);
+
+  /**
+   * @brief Launch a kernel whose blocks may synchronize with
+   * grid_group::sync().
+   *
+   * Throws hipErrorCooperativeLaunchTooLarge if the blocks can't all be
+   * resident at the same time. Cooperative launches on the device run one
+   * after another, as each may need the whole device and the launches of a
+   * module share its grid barrier state.
+   */
+  void launchCooperativeKernel(CHIPQueue *ChipQueue, CHIPKernel *ChipKernel,
+                               dim3 NumBlocks, dim3 DimBlocks, void **Args,
+                               size_t SharedMemBytes);
   std::mutex DeviceVarMtx;
   std::mutex DeviceMtx;
 
@@ -1308,6 +1653,36 @@ public:
     return MaxMallocSize_;
   }
 
+  /// Size of the buffers the printf() calls of the modules write to. A
+  /// new size applies to the modules whose buffers are not yet allocated.
+  size_t getPrintfFifoSize() const { return PrintfFifoSize_; }
+  void setPrintfFifoSize(size_t Size) { PrintfFifoSize_ = Size; }
+
+  /**
+   * @brief Return the pitch of the rows of a 2D or 3D allocation whose rows
+   * are WidthBytes wide.
+   *
+   * The pitch is a multiple of the texturePitchAlignment property. Pitches
+   * which are multiples of a large power of two are padded further as such
+   * rows map to the same cache sets and memory channels.
+   */
+  size_t getAllocationPitch(size_t WidthBytes);
+
+  size_t getMallocHeapSize();
+  /**
+   * @brief Set the size of the device-side malloc() heap.
+   *
+   * @return false if the heap is in use and can't be resized until the
+   * device is reset
+   */
+  bool setMallocHeapSize(size_t Size);
+  /**
+   * @brief Get the heap of the device-side malloc(), allocating and
+   * initializing it through the Queue on the first call.
+   */
+  void *getMallocHeapNoLock(CHIPQueue *Queue);
+  void freeMallocHeapNoLock();
+
   CHIPAllocationTracker *AllocationTracker = nullptr;
 
   virtual ~CHIPDevice();
@@ -1542,6 +1917,21 @@ public:
 
   void eraseModule(CHIPModule *Module);
 
+  /**
+   * @brief Get the native binary of a module compiled from the same SPIR-V
+   * earlier, if one is still loaded.
+   *
+   * Modules loaded several times or embedded in several fatbins are built
+   * from the binary instead of JIT compiling their SPIR-V again. Each of
+   * them still gets its own program and thus its own device variables.
+   */
+  std::shared_ptr<const std::string> getNativeBinary(std::string_view SpirV);
+
+  /// Cache the native binary of a module compiled from the SPIR-V binary,
+  /// replacing the one cached for the same SPIR-V, if any.
+  std::shared_ptr<const std::string> addNativeBinary(std::string_view SpirV,
+                                                     std::string &&Binary);
+
   virtual CHIPTexture *
   createTexture(const hipResourceDesc *ResDesc, const hipTextureDesc *TexDesc,
                 const struct hipResourceViewDesc *ResViewDesc) = 0;
@@ -1576,6 +1966,35 @@ protected:
 
   unsigned int Flags_;
 
+  std::mutex StagingMtx_;
+  /// Idle pinned host buffers used for staging pageable memcpys
+  std::vector<void *> FreeStagingBuffers_;
+  /// Number of staging buffers allocated, including the ones in use
+  size_t NumStagingBuffers_ = 0;
+
+public:
+  /// Chunk size and pipeline depth of a staged memcpy
+  struct StagingConfig {
+    unsigned ChunkShift; ///< log2 of the chunk size
+    unsigned Depth;      ///< number of chunks in flight
+  };
+  static constexpr unsigned MinStagingChunkShift = 18; // 256 KiB
+  static constexpr unsigned MaxStagingChunkShift = 23; // StagingBufferSize
+  static constexpr unsigned MinStagingDepth = 2, MaxStagingDepth = 8;
+
+protected:
+  /// Average throughput (bytes/ns) of the staged memcpys per direction (host
+  /// to device at index 1), chunk size and depth. 0 if not measured yet.
+  double StagingThroughput_[2][MaxStagingChunkShift - MinStagingChunkShift +
+                               1][MaxStagingDepth + 1] = {};
+  /// Best measured configuration per direction
+  StagingConfig BestStagingConfig_[2] = {{20, 4}, {20, 4}};
+  unsigned NumStagedCopies_[2] = {0, 0};
+
+  /// Barriers enqueued and avoided by syncQueues()
+  std::atomic<size_t> NumSyncBarriers_{0};
+  std::atomic<size_t> NumSyncBarriersAvoided_{0};
+
   /**
    * @brief Construct a new CHIPContext object
    *
@@ -1687,6 +2106,24 @@ public:
    */
   virtual void freeImpl(void *Ptr) = 0;
 
+  /**
+   * @brief Make host memory allocated outside of HIP accessible by the
+   * device at its host address. To be overriden by the backend.
+   *
+   * @param HostPtr start of the host memory
+   * @param Size size of the host memory in bytes
+   * @return true if the memory was imported, false if the backend can't
+   * access it directly and the caller must mirror it in device memory
+   */
+  virtual bool registerHostMemory(void *HostPtr, size_t Size) { return false; }
+
+  /**
+   * @brief Release host memory imported by registerHostMemory()
+   *
+   * @param HostPtr the pointer passed to registerHostMemory()
+   */
+  virtual void unregisterHostMemory(void *HostPtr) {}
+
   /**
    * @brief Get the flags set on this context
    *
@@ -1701,6 +2138,45 @@ public:
    */
   void setFlags(unsigned int Flags);
 
+  /// Size of the pinned host buffers handed out by acquireStagingBuffer()
+  static constexpr size_t StagingBufferSize = (size_t)1
+                                              << MaxStagingChunkShift;
+  /// Upper limit for the number of staging buffers of a context
+  static constexpr size_t MaxStagingBuffers = 16;
+
+  /**
+   * @brief Get a pinned host buffer of StagingBufferSize bytes for staging
+   * transfers from/to pageable host memory.
+   *
+   * @return void* the buffer, or nullptr if MaxStagingBuffers are in use or
+   * the allocation failed
+   */
+  void *acquireStagingBuffer();
+
+  /**
+   * @brief Return a buffer obtained from acquireStagingBuffer(). The caller
+   * must have waited for the commands using the buffer.
+   */
+  void releaseStagingBuffer(void *Buffer);
+
+  /// Number of barriers syncQueues() has enqueued so far
+  size_t getNumSyncBarriers() const { return NumSyncBarriers_; }
+  /// Number of barriers syncQueues() has found unnecessary so far
+  size_t getNumSyncBarriersAvoided() const { return NumSyncBarriersAvoided_; }
+
+  /**
+   * @brief Choose the chunk size and depth of a staged memcpy of Size bytes.
+   *
+   * Usually the configuration with the best measured throughput. Untried
+   * neighbours of it, and periodically the other neighbours, are handed out
+   * as well so that the choice adapts to the device and the host.
+   */
+  StagingConfig pickStagingConfig(bool ToDevice, size_t Size);
+
+  /// Record the duration of a staged memcpy done with Config.
+  void recordStagingTime(bool ToDevice, StagingConfig Config, size_t Size,
+                         std::chrono::nanoseconds Time);
+
   /**
    * @brief Reset this context.
    *
@@ -1730,13 +2206,20 @@ class CHIPBackend {
 protected:
   CHIPEventMonitor *CallbackEventMonitor_ = nullptr;
   CHIPEventMonitor *StaleEventMonitor_ = nullptr;
+  CHIPCallbackExecutor *CallbackExecutor_ = nullptr;
 
-  int MinQueuePriority_;
+  int MinQueuePriority_ = -1;
   int MaxQueuePriority_ = 0;
 
   CHIPContext *ActiveCtx_;
   CHIPDevice *ActiveDev_;
 
+  /// Number of live per-thread default queues. Decremented by the
+  /// thread-local queue destructors when their threads exit.
+  int PerThreadQueuesActive_ = 0;
+  std::mutex PerThreadQueuesMtx;
+  std::condition_variable PerThreadQueuesCv;
+
   // Keep hold on the default logger instance to make sure that it is
   // not destructed before the backend finishes uninitialization.
   std::shared_ptr<spdlog::logger> Logger;
@@ -1752,14 +2235,29 @@ public:
                                            hipStream_t ChipQueue) = 0;
 
   int getPerThreadQueuesActive();
+
+  /**
+   * @brief Account for a newly created per-thread default queue.
+   */
+  void registerPerThreadQueue();
+
+  /**
+   * @brief Account for a destroyed per-thread default queue and wake up
+   * waitForThreadExit() if it was the last one.
+   */
+  void unregisterPerThreadQueue();
+
   std::mutex SetActiveMtx;
   std::mutex QueueCreateDestroyMtx;
   mutable std::mutex BackendMtx;
-  std::mutex CallbackQueueMtx;
+  std::mutex CallbackExecutorMtx;
   std::vector<CHIPEvent *> Events;
   std::mutex EventsMtx;
 
-  std::queue<CHIPCallbackData *> CallbackQueue;
+  /**
+   * @brief Get the executor of stream callbacks, starting it on first use.
+   */
+  CHIPCallbackExecutor *getCallbackExecutor();
 
   // Adds -std=c++17 requirement
   inline static thread_local hipError_t TlsLastError;
@@ -1852,7 +2350,8 @@ public:
   virtual void uninitialize() = 0;
 
   /**
-   * @brief Wait for all per-thread queues to finish
+   * @brief Wait for all per-thread queues to finish. Returns as soon as the
+   * threads owning per-thread queues have exited.
    *
    */
   void waitForThreadExit();
@@ -2005,10 +2504,27 @@ protected:
   CHIPDevice *ChipDevice_;
   /// Context to which device belongs to
   CHIPContext *ChipContext_;
+  /// Identifies the queue, unlike its address, also after it is destroyed.
+  const uint64_t Id_ = NextId_++;
+  inline static std::atomic<uint64_t> NextId_{1};
 
   /** Keep track of what was the last event submitted to this queue. Required
    * for enforcing proper queue syncronization as per HIP/CUDA API. */
   CHIPEvent *LastEvent_ = nullptr;
+  /// Identifies LastEvent_, unique across all the queues. 0 if there is none.
+  uint64_t LastEventId_ = 0;
+  inline static std::atomic<uint64_t> NextLastEventId_{1};
+  /// LastEventId_ of the other queues at the time this queue last waited for
+  /// them in CHIPContext::syncQueues(). Protected by CHIPDevice::DeviceMtx.
+  std::unordered_map<const CHIPQueue *, uint64_t> SyncedEventIds_;
+
+  std::mutex DeviceRequestMtx;
+  /// Modules with a device-side abort flag or printf buffer which have had
+  /// kernels launched into this queue since the last synchronization point.
+  std::set<CHIPModule *> PendingDeviceRequests_;
+  /// Host addresses of the mirrors kept on the device by this queue, mapped
+  /// to whether a kernel may have written to them since.
+  std::map<void *, bool> PendingMirrorCopies_;
 
   enum class MANAGED_MEM_STATE { PRE_KERNEL, POST_KERNEL };
 
@@ -2087,6 +2603,33 @@ public:
   virtual ~CHIPQueue();
 
   CHIPQueueFlags getQueueFlags() { return QueueFlags_; }
+
+  /**
+   * @brief Note a kernel launch from a module which may call abort() or
+   * printf() so the module's abort flag and printf buffer get inspected at
+   * the next synchronization point instead of right after the launch.
+   *
+   * @param Module module of the launched kernel
+   */
+  void addPendingDeviceRequests(CHIPModule *Module);
+
+  /**
+   * @brief Forget the pending requests of a module about to be destroyed.
+   *
+   * @param Module module being destroyed
+   */
+  void discardPendingDeviceRequests(CHIPModule *Module);
+
+  /**
+   * @brief Print the printf() output and inspect the abort flags of the
+   * modules launched into this queue since the last call, and copy the
+   * mirrors kept on the device back to the host. Must be called
+   * only after the queue has been finished so the buffers and the flags
+   * reflect the completed launches. The output of the module's kernels
+   * still running in other queues is printed once they have completed.
+   */
+  void handlePendingDeviceRequests();
+
   virtual void updateLastEvent(CHIPEvent *NewEvent) {
     LOCK(LastEventMtx); // CHIPQueue::LastEvent_
     logDebug("Setting LastEvent for {} {} -> {}", (void *)this,
@@ -2102,6 +2645,25 @@ public:
       NewEvent->increaseRefCount("updateLastEvent - new event");
     }
     LastEvent_ = NewEvent;
+    LastEventId_ = NewEvent ? NextLastEventId_++ : 0;
+  }
+
+  /**
+   * @brief Get the last event for Waiter to wait for in
+   * CHIPContext::syncQueues(). Must be called with CHIPDevice::DeviceMtx
+   * held.
+   *
+   * @return nullptr if there is no last event or Waiter has already waited
+   * for it.
+   */
+  CHIPEvent *getLastEventToSyncWith(CHIPQueue *Waiter);
+
+  /**
+   * @brief Forget the events of Queue waited for in CHIPContext::syncQueues()
+   * when Queue is destroyed. Must be called with CHIPDevice::DeviceMtx held.
+   */
+  void forgetSyncedQueue(const CHIPQueue *Queue) {
+    SyncedEventIds_.erase(Queue);
   }
 
   /**
@@ -2114,6 +2676,16 @@ public:
    */
   hipError_t memCopy(void *Dst, const void *Src, size_t Size);
 
+  /**
+   * @brief Blocking memory copy between device memory and pageable host
+   * memory, pipelined in chunks through pinned staging buffers so that the
+   * host-side memcpy of one chunk overlaps the device transfer of others.
+   *
+   * @return true if the copy was done, false if it is not eligible for
+   * staging and should take the direct path
+   */
+  bool memCopyStaged(void *Dst, const void *Src, size_t Size);
+
   /**
    * @brief Non-blocking memory copy
    *
@@ -2192,6 +2764,8 @@ public:
    */
 
   CHIPDevice *getDevice();
+  /// Get the id of the queue, unique across all the queues of the process.
+  uint64_t getId() const { return Id_; }
   /**
    * @brief Wait for this queue to finish.
    *
@@ -2256,17 +2830,33 @@ public:
    */
 
   virtual void addCallback(hipStreamCallback_t Callback, void *UserData);
+
   /**
-   * @brief Insert a memory prefetch
+   * @brief Insert a host function to be called once the preceding work of
+   * the stream is done. @see hipLaunchHostFunc
+   */
+  void launchHostFunc(hipHostFn_t HostFn, void *UserData);
+  /**
+   * @brief Insert a migration of managed memory to this queue's device or,
+   * if ToHost is set, to the host.
    *
-   * @param ptr
-   * @param count
-   * @return true
-   * @return false
+   * @param Ptr start of the range, must lie in a managed allocation
+   * @param Count size of the range in bytes
+   * @param ToHost migrate to the host instead of the device
    */
+  virtual CHIPEvent *memPrefetchImpl(const void *Ptr, size_t Count,
+                                     bool ToHost) = 0;
+  void memPrefetch(const void *Ptr, size_t Count, bool ToHost = false);
 
-  virtual CHIPEvent *memPrefetchImpl(const void *Ptr, size_t Count) = 0;
-  void memPrefetch(const void *Ptr, size_t Count);
+  /**
+   * @brief Pass a hipMemAdvise() hint on managed memory to the driver.
+   * The hint is recorded in the allocation tracker by the caller. Backends
+   * without a counterpart ignore it.
+   *
+   * @param DstDevId device the hint refers to or hipCpuDeviceId
+   */
+  virtual void memAdvise(const void *Ptr, size_t Count,
+                         hipMemoryAdvise Advice, int DstDevId) {}
 
   /**
    * @brief Launch a kernel on this queue given a host pointer and arguments
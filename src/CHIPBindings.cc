@@ -40,6 +40,7 @@
 #include <sys/mman.h>
 #include <errno.h>
 #include <fstream>
+#include <algorithm>
 
 #include "CHIPBackend.hh"
 #include "CHIPDriver.hh"
@@ -53,8 +54,6 @@
 #include "SPVRegister.hh"
 #include "hipCtx.hh"
 
-#define SVM_ALIGNMENT 128 // TODO Pass as CMAKE Define?
-
 #define GRAPH(x) static_cast<CHIPGraph *>(x)
 
 #define NODE(x) static_cast<CHIPGraphNode *>(x)
@@ -82,10 +81,6 @@ hipError_t hipGetChannelDesc(hipChannelFormatDesc *desc,
 hipError_t hipDeviceGetUuid(hipUUID *uuid, hipDevice_t device) {
   UNIMPLEMENTED(hipErrorNotSupported);
 }
-hipError_t hipDeviceSetLimit(enum hipLimit_t limit, size_t value) {
-  UNIMPLEMENTED(hipErrorNotSupported);
-}
-
 hipError_t hipExtStreamCreateWithCUMask(hipStream_t *stream,
                                         uint32_t cuMaskSize,
                                         const uint32_t *cuMask) {
@@ -106,13 +101,6 @@ hipError_t hipDrvPointerGetAttributes(unsigned int numAttributes,
   UNIMPLEMENTED(hipErrorNotSupported);
 }
 
-hipError_t hipMemRangeGetAttributes(void **data, size_t *data_sizes,
-                                    hipMemRangeAttribute *attributes,
-                                    size_t num_attributes, const void *dev_ptr,
-                                    size_t count) {
-  UNIMPLEMENTED(hipErrorNotSupported);
-}
-
 hipError_t hipPointerGetAttribute(void *data, hipPointer_attribute attribute,
                                   hipDeviceptr_t ptr) {
   UNIMPLEMENTED(hipErrorNotSupported);
@@ -182,10 +170,6 @@ hipError_t hipMemPoolDestroy(hipMemPool_t mem_pool) {
   UNIMPLEMENTED(hipErrorNotSupported);
 }
 
-hipError_t hipLaunchHostFunc(hipStream_t stream, hipHostFn_t fn,
-                             void *userData) {
-  UNIMPLEMENTED(hipErrorNotSupported);
-}
 hipError_t hipStreamIsCapturing(hipStream_t stream,
                                 hipStreamCaptureStatus *pCaptureStatus) {
   UNIMPLEMENTED(hipErrorNotSupported);
@@ -226,42 +210,21 @@ hipError_t hipGraphReleaseUserObject(hipGraph_t graph, hipUserObject_t object,
 
 hipError_t hipInit(unsigned int flags) { return hipSuccess; };
 
-// Handles device side abort() call by checking the abort flag global
-// variable used for signaling the request.
-static void handleAbortRequest(CHIPQueue &Q, CHIPModule &M) {
-  logTrace("handleAbortRequest()");
-  CHIPDeviceVar *Var = M.getGlobalVar("__chipspv_abort_called");
-
-  if (!Var)
-    // If the flag is not found, we have removed it in HipAbort pass
-    // to denote abort is not called by any kernel in the module. This
-    // is used for avoiding kernel launches to read the value to
-    // minimize overheads when abort is not used.
-    return;
-
-  int32_t AbortFlag = 0;
-  hipError_t Err = Q.memCopy(&AbortFlag, Var->getDevAddr(), sizeof(int32_t));
-  if (Err != hipSuccess)
-    // We know the abort flag exist so what went wrong on the copy?
-    CHIPERR_LOG_AND_THROW("Unexpected mem copy failure.", hipErrorTbd);
-
-  if (!AbortFlag)
-    return; // Abort was not called.
-
-  // Disable host-side abort behavior for making the unit testing of abort
-  // cases easier.
-  if (!getenv("CHIP_HOST_IGNORES_DEVICE_ABORT"))
-    abort();
-
-  // Just act like nothing happened. Reset the flag so we let there be more
-  // aborts.
-  AbortFlag = 0;
-  Err = Q.memCopy(Var->getDevAddr(), &AbortFlag, sizeof(int32_t));
-  if (Err != hipSuccess)
-    // Device->host copy succeeded. What went wrong with host->device copy?
-    CHIPERR_LOG_AND_THROW("Unexpected mem copy failure.", hipErrorTbd);
-
-  printf("[ABORT IGNORED]\n");
+// Handles the device-side abort() and printf() requests of the modules
+// launched into the queue of the device with the id (see CHIPQueue::getId())
+// if the queue has already drained and is still alive. Otherwise the
+// requests are handled at its next synchronization point.
+static void handleDeviceRequests(CHIPDevice &Dev, uint64_t QueueId) {
+  LOCK(Dev.DeviceMtx); // prevents queues from being destroyed while checking
+  std::vector<CHIPQueue *> Queues = Dev.getQueuesNoLock();
+  Queues.push_back(Dev.getLegacyDefaultQueue());
+  if (Dev.isPerThreadStreamUsedNoLock())
+    Queues.push_back(Dev.getPerThreadDefaultQueueNoLock());
+  auto It = std::find_if(Queues.begin(), Queues.end(), [=](CHIPQueue *Q) {
+    return Q->getId() == QueueId;
+  });
+  if (It != Queues.end() && (*It)->query())
+    (*It)->handlePendingDeviceRequests();
 }
 
 hipError_t hipGraphCreate(hipGraph_t *pGraph, unsigned int flags) {
@@ -1303,10 +1266,65 @@ hipError_t hipMemRangeGetAttribute(void *Data, size_t DataSize,
                                    const void *DevPtr, size_t Count) {
   CHIP_TRY
   CHIPInitialize();
-  UNIMPLEMENTED(hipErrorNotSupported);
+  NULLCHECK(Data, DevPtr);
+  ERROR_IF(Count == 0, hipErrorInvalidValue);
+
+  // Advice and prefetches are tracked per allocation.
+  auto AllocInfo =
+      Backend->getActiveDevice()->AllocationTracker->getAllocInfo(DevPtr);
+  ERROR_IF(!AllocInfo || (AllocInfo->MemoryType != hipMemoryTypeUnified &&
+                          AllocInfo->MemoryType != hipMemoryTypeManaged),
+           hipErrorInvalidValue);
+
+  int *Values = static_cast<int *>(Data);
+  if (Attribute == hipMemRangeAttributeAccessedBy) {
+    ERROR_IF(DataSize == 0 || DataSize % sizeof(int), hipErrorInvalidValue);
+    size_t NumValues = DataSize / sizeof(int);
+    for (size_t I = 0; I < NumValues; I++)
+      Values[I] = I < AllocInfo->AccessedBy.size() ? AllocInfo->AccessedBy[I]
+                                                   : hipInvalidDeviceId;
+    RETURN(hipSuccess);
+  }
+
+  ERROR_IF(DataSize != sizeof(int), hipErrorInvalidValue);
+  switch (Attribute) {
+  case hipMemRangeAttributeReadMostly:
+    *Values = AllocInfo->ReadMostly;
+    break;
+  case hipMemRangeAttributePreferredLocation:
+    *Values = AllocInfo->PreferredLocation;
+    break;
+  case hipMemRangeAttributeLastPrefetchLocation:
+    *Values = AllocInfo->LastPrefetchLocation;
+    break;
+  default:
+    RETURN(hipErrorInvalidValue);
+  }
+
+  RETURN(hipSuccess);
   CHIP_CATCH
 };
 
+hipError_t hipMemRangeGetAttributes(void **Data, size_t *DataSizes,
+                                    hipMemRangeAttribute *Attributes,
+                                    size_t NumAttributes, const void *DevPtr,
+                                    size_t Count) {
+  CHIP_TRY
+  CHIPInitialize();
+  NULLCHECK(Data, DataSizes, Attributes);
+  ERROR_IF(NumAttributes == 0, hipErrorInvalidValue);
+
+  for (size_t I = 0; I < NumAttributes; I++) {
+    hipError_t Err = hipMemRangeGetAttribute(Data[I], DataSizes[I],
+                                             Attributes[I], DevPtr, Count);
+    if (Err != hipSuccess)
+      RETURN(Err);
+  }
+
+  RETURN(hipSuccess);
+  CHIP_CATCH
+}
+
 hipError_t hipMemcpyPeerAsync(void *Dst, int DstDeviceId, const void *Src,
                               int SrcDevice, size_t SizeBytes,
                               hipStream_t Stream) {
@@ -1428,12 +1446,18 @@ hipError_t hipDeviceSynchronize(void) {
     LOCK(Dev->DeviceMtx); // prevents queues from being destryed while iterating
     for (auto Q : Dev->getQueuesNoLock()) {
       Q->finish();
+      Q->handlePendingDeviceRequests();
     }
   }
 
   Backend->getActiveDevice()->getLegacyDefaultQueue()->finish();
+  Backend->getActiveDevice()
+      ->getLegacyDefaultQueue()
+      ->handlePendingDeviceRequests();
   if (Backend->getActiveDevice()->isPerThreadStreamUsed()) {
     Backend->getActiveDevice()->getPerThreadDefaultQueue()->finish();
+    Backend->getActiveDevice()->getPerThreadDefaultQueue()
+        ->handlePendingDeviceRequests();
   }
 
   RETURN(hipSuccess);
@@ -1520,10 +1544,10 @@ hipError_t hipDeviceGetLimit(size_t *PValue, enum hipLimit_t Limit) {
   auto Device = Backend->getActiveDevice();
   switch (Limit) {
   case hipLimitMallocHeapSize:
-    *PValue = Device->getMaxMallocSize();
+    *PValue = Device->getMallocHeapSize();
     break;
   case hipLimitPrintfFifoSize:
-    UNIMPLEMENTED(hipErrorNotSupported);
+    *PValue = Device->getPrintfFifoSize();
     break;
   default:
     CHIPERR_LOG_AND_THROW("Invalid Limit value", hipErrorInvalidHandle);
@@ -1533,6 +1557,31 @@ hipError_t hipDeviceGetLimit(size_t *PValue, enum hipLimit_t Limit) {
   CHIP_CATCH
 }
 
+hipError_t hipDeviceSetLimit(enum hipLimit_t Limit, size_t Value) {
+  CHIP_TRY
+  CHIPInitialize();
+
+  auto Device = Backend->getActiveDevice();
+  switch (Limit) {
+  case hipLimitMallocHeapSize:
+    if (!Value)
+      CHIPERR_LOG_AND_THROW("Invalid malloc heap size", hipErrorInvalidValue);
+    if (!Device->setMallocHeapSize(Value))
+      CHIPERR_LOG_AND_THROW("The malloc heap is in use", hipErrorInvalidValue);
+    break;
+  case hipLimitPrintfFifoSize:
+    if (!Value)
+      CHIPERR_LOG_AND_THROW("Invalid printf FIFO size", hipErrorInvalidValue);
+    Device->setPrintfFifoSize(Value);
+    break;
+  default:
+    CHIPERR_LOG_AND_THROW("Invalid Limit value", hipErrorInvalidValue);
+  }
+
+  RETURN(hipSuccess);
+  CHIP_CATCH
+}
+
 hipError_t hipDeviceGetName(char *Name, int Len, hipDevice_t Device) {
   CHIP_TRY
   CHIPInitialize();
@@ -1662,7 +1711,20 @@ hipError_t hipDeviceGetByPCIBusId(int *DeviceId, const char *PciBusId) {
 hipError_t hipSetDeviceFlags(unsigned Flags) {
   CHIP_TRY
   CHIPInitialize();
-  UNIMPLEMENTED(hipErrorNotSupported);
+  if (Flags & ~(hipDeviceScheduleMask | hipDeviceMapHost |
+                hipDeviceLmemResizeToMax))
+    RETURN(hipErrorInvalidValue);
+  switch (Flags & hipDeviceScheduleMask) {
+  case hipDeviceScheduleAuto:
+  case hipDeviceScheduleSpin:
+  case hipDeviceScheduleYield:
+  case hipDeviceScheduleBlockingSync:
+    break;
+  default:
+    RETURN(hipErrorInvalidValue);
+  }
+
+  Backend->getActiveDevice()->setFlags(Flags);
   RETURN(hipSuccess);
   CHIP_CATCH
 }
@@ -1901,7 +1963,7 @@ hipError_t hipStreamCreate(hipStream_t *Stream) {
 }
 
 hipError_t hipStreamCreateWithFlags(hipStream_t *Stream, unsigned int Flags) {
-  RETURN(hipStreamCreateWithPriority(Stream, Flags, 1));
+  RETURN(hipStreamCreateWithPriority(Stream, Flags, DEFAULT_QUEUE_PRIORITY));
 }
 
 hipError_t hipStreamCreateWithPriority(hipStream_t *Stream, unsigned int Flags,
@@ -1964,6 +2026,7 @@ hipError_t hipStreamDestroy(hipStream_t Stream) {
 
   // make sure nothing is pending in the stream
   ChipQueue->finish();
+  ChipQueue->handlePendingDeviceRequests();
 
   if (Dev->removeQueue(ChipQueue))
     RETURN(hipSuccess);
@@ -1984,6 +2047,7 @@ hipError_t hipStreamQuery(hipStream_t Stream) {
   }
 
   if (ChipQueue->query()) {
+    ChipQueue->handlePendingDeviceRequests();
     RETURN(hipSuccess);
   } else
     RETURN(hipErrorNotReady);
@@ -2003,6 +2067,7 @@ hipError_t hipStreamSynchronize(hipStream_t Stream) {
 
   Backend->getActiveDevice()->getContext()->syncQueues(ChipQueue);
   ChipQueue->finish();
+  ChipQueue->handlePendingDeviceRequests();
   RETURN(hipSuccess);
 
   CHIP_CATCH
@@ -2106,6 +2171,24 @@ hipError_t hipStreamAddCallback(hipStream_t Stream,
   CHIP_CATCH
 }
 
+hipError_t hipLaunchHostFunc(hipStream_t Stream, hipHostFn_t Fn,
+                             void *UserData) {
+  CHIP_TRY
+  CHIPInitialize();
+  if (Fn == nullptr)
+    CHIPERR_LOG_AND_THROW("passed in nullptr", hipErrorInvalidValue);
+  auto ChipQueue = static_cast<CHIPQueue *>(Stream);
+  ChipQueue = Backend->findQueue(ChipQueue);
+  hipHostNodeParams Params = {Fn, UserData};
+  if (ChipQueue->captureIntoGraph<CHIPGraphNodeHost>(&Params)) {
+    RETURN(hipSuccess);
+  }
+
+  ChipQueue->launchHostFunc(Fn, UserData);
+  RETURN(hipSuccess);
+  CHIP_CATCH
+}
+
 hipError_t hipMemGetAddressRange(hipDeviceptr_t *Base, size_t *Size,
                                  hipDeviceptr_t Ptr) {
   CHIP_TRY
@@ -2158,6 +2241,7 @@ hipError_t hipEventRecord(hipEvent_t Event, hipStream_t Stream) {
   }
 
   ChipEvent->recordStream(ChipQueue);
+  ChipEvent->setRecordedQueue(ChipQueue);
   RETURN(hipSuccess);
 
   CHIP_CATCH
@@ -2185,6 +2269,8 @@ hipError_t hipEventSynchronize(hipEvent_t Event) {
   CHIPEvent *ChipEvent = static_cast<CHIPEvent *>(Event);
 
   ChipEvent->wait();
+  if (auto *Dev = ChipEvent->getRecordedDevice())
+    handleDeviceRequests(*Dev, ChipEvent->getRecordedQueueId());
   RETURN(hipSuccess);
 
   CHIP_CATCH
@@ -2350,19 +2436,23 @@ hipError_t hipFreeHost(void *Ptr) { RETURN(hipHostFree(Ptr)); }
 hipError_t hipMemPrefetchAsync(const void *Ptr, size_t Count, int DstDevId,
                                hipStream_t Stream) {
   CHIP_TRY
-  UNIMPLEMENTED(hipErrorTbd);
   CHIPInitialize();
   NULLCHECK(Ptr);
   auto ChipQueue = static_cast<CHIPQueue *>(Stream);
   ChipQueue = Backend->findQueue(ChipQueue);
   // TODO Graphs - async operation should be supported by graphs but no prefetch
   // node is defined
-  ERROR_CHECK_DEVNUM(DstDevId);
-  CHIPDevice *Dev = Backend->getDevices()[DstDevId];
+  bool ToHost = DstDevId == hipCpuDeviceId;
+  if (!ToHost) {
+    ERROR_CHECK_DEVNUM(DstDevId);
+    CHIPDevice *Dev = Backend->getDevices()[DstDevId];
 
-  // Check if given Stream belongs to the requested device
-  ERROR_IF(ChipQueue->getDevice() != Dev, hipErrorInvalidDevice);
-  ChipQueue->memPrefetch(Ptr, Count);
+    // Check if given Stream belongs to the requested device
+    ERROR_IF(ChipQueue->getDevice() != Dev, hipErrorInvalidDevice);
+  }
+  if (Count == 0)
+    RETURN(hipSuccess);
+  ChipQueue->memPrefetch(Ptr, Count, ToHost);
 
   RETURN(hipSuccess);
   CHIP_CATCH
@@ -2378,7 +2468,51 @@ hipError_t hipMemAdvise(const void *Ptr, size_t Count, hipMemoryAdvise Advice,
     RETURN(hipSuccess);
   }
 
-  UNIMPLEMENTED(hipErrorNotSupported);
+  auto Device = Backend->getActiveDevice();
+  auto AllocInfo = Device->AllocationTracker->getAllocInfo(Ptr);
+  ERROR_IF(!AllocInfo || (AllocInfo->MemoryType != hipMemoryTypeUnified &&
+                          AllocInfo->MemoryType != hipMemoryTypeManaged),
+           hipErrorInvalidValue);
+  bool TargetsDevice = Advice == hipMemAdviseSetPreferredLocation ||
+                       Advice == hipMemAdviseSetAccessedBy ||
+                       Advice == hipMemAdviseUnsetAccessedBy;
+  if (TargetsDevice && DstDevId != hipCpuDeviceId) {
+    ERROR_CHECK_DEVNUM(DstDevId);
+    Device = Backend->getDevices()[DstDevId];
+  }
+
+  auto &AccessedBy = AllocInfo->AccessedBy;
+  auto Found = std::find(AccessedBy.begin(), AccessedBy.end(), DstDevId);
+  switch (Advice) {
+  case hipMemAdviseSetReadMostly:
+    AllocInfo->ReadMostly = true;
+    break;
+  case hipMemAdviseUnsetReadMostly:
+    AllocInfo->ReadMostly = false;
+    break;
+  case hipMemAdviseSetPreferredLocation:
+    AllocInfo->PreferredLocation = DstDevId;
+    break;
+  case hipMemAdviseUnsetPreferredLocation:
+    AllocInfo->PreferredLocation = hipInvalidDeviceId;
+    break;
+  case hipMemAdviseSetAccessedBy:
+    if (Found == AccessedBy.end())
+      AccessedBy.push_back(DstDevId);
+    break;
+  case hipMemAdviseUnsetAccessedBy:
+    if (Found != AccessedBy.end())
+      AccessedBy.erase(Found);
+    break;
+  default:
+    logWarn("hipMemAdvise: ignoring advice {}", (int)Advice);
+    RETURN(hipSuccess);
+  }
+
+  // hipHostRegister() mirrors are migrated by the runtime, the rest by the
+  // driver.
+  if (AllocInfo->MemoryType == hipMemoryTypeUnified)
+    Device->getDefaultQueue()->memAdvise(Ptr, Count, Advice, DstDevId);
 
   RETURN(hipSuccess);
   CHIP_CATCH
@@ -2397,6 +2531,10 @@ hipError_t hipHostGetDevicePointer(void **DevPtr, void *HostPtr,
             "pointer as device pointer (in case host pointer was mapped "
             "through hipMallocShared or hipMallocHost");
     *DevPtr = HostPtr;
+  } else if (AllocInfo->HostPtr) {
+    // HostPtr may point into the middle of the registered region.
+    *DevPtr = (char *)AllocInfo->DevPtr +
+              ((char *)HostPtr - (char *)AllocInfo->HostPtr);
   } else
     *DevPtr = AllocInfo->DevPtr;
 
@@ -2438,12 +2576,29 @@ hipError_t hipHostRegister(void *HostPtr, size_t SizeBytes,
                             hipErrorInvalidValue);
     }
 
+  auto Device = Backend->getActiveDevice();
+  if (Device->AllocationTracker->getAllocInfo(HostPtr))
+    RETURN(hipErrorHostMemoryAlreadyRegistered);
+
+  // Zero-copy: let the device access the host pages directly.
+  if (Backend->getActiveContext()->registerHostMemory(HostPtr, SizeBytes)) {
+    Device->AllocationTracker->recordAllocation(
+        HostPtr, nullptr, Device->getDeviceId(), SizeBytes,
+        CHIPHostAllocFlags(Flags), hipMemoryTypeUnified);
+    Device->AllocationTracker->getAllocInfo(HostPtr)->HostRegistered = true;
+    RETURN(hipSuccess);
+  }
+
+  // Otherwise mirror the memory on the device. The mirror is synchronized
+  // around kernel launches, see CHIPQueue::RegisteredVarCopy().
+  logDebug("hipHostRegister: can't import host memory {}, using a device "
+           "mirror",
+           HostPtr);
   void *DevPtr;
   auto Err = hipMalloc(&DevPtr, SizeBytes);
   ERROR_IF(Err != hipSuccess, Err);
 
   // Associate the pointer
-  auto Device = Backend->getActiveDevice();
   // TODO fixOpenCLTests - use recordAllocation()
   Device->AllocationTracker->registerHostPointer(HostPtr, DevPtr);
 
@@ -2459,6 +2614,32 @@ hipError_t hipHostUnregister(void *HostPtr) {
 
   auto Device = Backend->getActiveDevice();
   auto AllocInfo = Device->AllocationTracker->getAllocInfo(HostPtr);
+  if (!AllocInfo || AllocInfo->HostPtr != HostPtr)
+    RETURN(hipErrorHostMemoryNotRegistered);
+
+  if (AllocInfo->HostRegistered) {
+    // Device work using the memory must have completed before the pages are
+    // released from the device.
+    {
+      LOCK(Device->DeviceMtx); // CHIPDevice::ChipQueues_
+      for (auto *Queue : Device->getQueuesNoLock())
+        Queue->finish();
+    }
+    Device->getLegacyDefaultQueue()->finish();
+    if (Device->isPerThreadStreamUsed())
+      Device->getPerThreadDefaultQueue()->finish();
+    Backend->getActiveContext()->unregisterHostMemory(HostPtr);
+    Device->AllocationTracker->eraseRecord(AllocInfo);
+    RETURN(hipSuccess);
+  }
+
+  if (AllocInfo->MirrorOnDevice) {
+    // Copy the mirror kept on the device back to the host first.
+    auto Err = hipDeviceSynchronize();
+    if (Err != hipSuccess)
+      RETURN(Err);
+  }
+
   auto Err = hipFree(AllocInfo->DevPtr);
   RETURN(Err);
 
@@ -2471,12 +2652,16 @@ static hipError_t hipMallocPitch3D(void **Ptr, size_t *Pitch, size_t Width,
   CHIPInitialize();
   NULLCHECK(Ptr, Pitch);
 
-  *Pitch = ((((int)Width - 1) / SVM_ALIGNMENT) + 1) * SVM_ALIGNMENT;
+  auto *Device = Backend->getActiveDevice();
+  *Pitch = Device->getAllocationPitch(Width);
   const size_t SizeBytes =
       (*Pitch) * std::max<size_t>(1, Height) * std::max<size_t>(1, Depth);
 
+  // Align the first row like the others.
+  size_t Alignment = std::max<size_t>(
+      Device->getAttr(hipDeviceAttributeTexturePitchAlignment), 1);
   void *RetVal = Backend->getActiveContext()->allocate(
-      SizeBytes, hipMemoryType::hipMemoryTypeDevice);
+      SizeBytes, Alignment, hipMemoryType::hipMemoryTypeDevice);
   ERROR_IF((RetVal == nullptr), hipErrorMemoryAllocation);
 
   *Ptr = RetVal;
@@ -3660,9 +3845,22 @@ hipError_t hipModuleLoadData(hipModule_t *ModuleHandle, const void *Image) {
     RETURN(hipErrorTbd);
   }
 
-  auto Entry = getSPVRegister().registerSource(ModuleCode);
+  // Each load gets a module of its own with its own device variables.
+  // Loads of identical images share the native binary of the module (see
+  // CHIPDevice::getNativeBinary()) instead of JIT compiling it again.
+  auto Entry = getSPVRegister().loadSource(ModuleCode);
   auto *SrcMod = getSPVRegister().getSource(Entry);
-  auto *ChipModule = Backend->getActiveDevice()->getOrCreateModule(*SrcMod);
+  CHIPModule *ChipModule = nullptr;
+  try {
+    ChipModule = Backend->getActiveDevice()->getOrCreateModule(*SrcMod);
+  } catch (...) {
+    getSPVRegister().unregisterSource(SrcMod);
+    throw;
+  }
+  if (!ChipModule) {
+    getSPVRegister().unregisterSource(SrcMod);
+    RETURN(hipErrorTbd);
+  }
   *ModuleHandle = ChipModule;
 
   RETURN(hipSuccess);
@@ -3699,8 +3897,32 @@ hipError_t hipLaunchKernel(const void *HostFunction, dim3 GridDim,
   if (!ChipKernel)
     CHIPERR_LOG_AND_THROW("Unexpected error: could not find a kernel.",
                           hipErrorTbd);
+  ChipQueue->addPendingDeviceRequests(ChipKernel->getModule());
   ChipQueue->launchKernel(ChipKernel, GridDim, BlockDim, Args, SharedMem);
-  handleAbortRequest(*ChipQueue, *ChipKernel->getModule());
+
+  RETURN(hipSuccess);
+  CHIP_CATCH
+}
+
+hipError_t hipLaunchCooperativeKernel(const void *HostFunction, dim3 GridDim,
+                                      dim3 BlockDim, void **Args,
+                                      unsigned int SharedMem,
+                                      hipStream_t Stream) {
+  CHIP_TRY
+  CHIPInitialize();
+  NULLCHECK(HostFunction, Args);
+
+  auto ChipQueue = Backend->findQueue(static_cast<CHIPQueue *>(Stream));
+  auto *Device = Backend->getActiveDevice();
+  Device->prepareDeviceVariables(HostPtr(HostFunction));
+
+  auto *ChipKernel = Device->findKernel(HostPtr(HostFunction));
+  if (!ChipKernel)
+    CHIPERR_LOG_AND_THROW("Unexpected error: could not find a kernel.",
+                          hipErrorTbd);
+  ChipQueue->addPendingDeviceRequests(ChipKernel->getModule());
+  Device->launchCooperativeKernel(ChipQueue, ChipKernel, GridDim, BlockDim,
+                                  Args, SharedMem);
 
   RETURN(hipSuccess);
   CHIP_CATCH
@@ -3868,9 +4090,9 @@ hipError_t hipModuleUnload(hipModule_t Module) {
   logInfo("hipModuleUnload(Module={}", (void *)Module);
 
   auto *ChipModule = reinterpret_cast<CHIPModule *>(Module);
-  const auto &SrcMod = ChipModule->getSourceModule();
+  const auto *SrcMod = &ChipModule->getSourceModule();
   Backend->getActiveDevice()->eraseModule(ChipModule);
-  getSPVRegister().unregisterSource(&SrcMod);
+  getSPVRegister().unregisterSource(SrcMod);
 
   RETURN(hipSuccess);
   CHIP_CATCH
@@ -3912,6 +4134,7 @@ hipError_t hipModuleLaunchKernel(hipFunction_t Kernel, unsigned int GridDimX,
   auto ChipKernel = static_cast<CHIPKernel *>(Kernel);
   Backend->getActiveDevice()->prepareDeviceVariables(
       HostPtr(ChipKernel->getHostPtr()));
+  ChipQueue->addPendingDeviceRequests(ChipKernel->getModule());
 
   if (KernelParams)
     ChipQueue->launchKernel(ChipKernel, Grid, Block, KernelParams,
@@ -3947,7 +4170,6 @@ hipError_t hipModuleLaunchKernel(hipFunction_t Kernel, unsigned int GridDimX,
                             SharedMemBytes);
   }
 
-  handleAbortRequest(*ChipQueue, *ChipKernel->getModule());
   return hipSuccess;
   CHIP_CATCH
 }
@@ -4023,8 +4245,8 @@ hipError_t hipLaunchByPtr(const void *HostFunction) {
   auto *ChipKernel = ChipDev->findKernel(HostPtr(HostFunction));
   ExecItem->setKernel(ChipKernel);
 
+  ChipQueue->addPendingDeviceRequests(ChipKernel->getModule());
   ChipQueue->launch(ExecItem);
-  handleAbortRequest(*ChipQueue, *ChipKernel->getModule());
   delete ExecItem;
 
   return hipSuccess;
@@ -4190,28 +4412,44 @@ hipError_t hipIpcGetEventHandle(hipIpcEventHandle_t *Handle, hipEvent_t Event) {
   CHIP_CATCH
 }
 
+static CHIPKernel *findOccupancyKernel(CHIPDevice *Dev,
+                                       const void *HostFunction) {
+  CHIPKernel *Kernel = Dev->findKernel(HostPtr(HostFunction));
+  if (!Kernel)
+    CHIPERR_LOG_AND_THROW("Could not find a kernel.",
+                          hipErrorInvalidDeviceFunction);
+  return Kernel;
+}
+
 hipError_t hipModuleOccupancyMaxPotentialBlockSize(int *GridSize,
                                                    int *BlockSize,
                                                    hipFunction_t Func,
                                                    size_t DynSharedMemPerBlk,
-                                                   int BlockSizeLimit);
+                                                   int BlockSizeLimit) {
+  return hipModuleOccupancyMaxPotentialBlockSizeWithFlags(
+      GridSize, BlockSize, Func, DynSharedMemPerBlk, BlockSizeLimit,
+      hipOccupancyDefault);
+}
 
 hipError_t hipModuleOccupancyMaxPotentialBlockSizeWithFlags(
     int *GridSize, int *BlockSize, hipFunction_t Func,
     size_t DynSharedMemPerBlk, int BlockSizeLimit, unsigned int Flags) {
   CHIP_TRY
   CHIPInitialize();
-  UNIMPLEMENTED(hipErrorNotSupported);
+  NULLCHECK(GridSize, BlockSize, Func);
+  // The flags only concern caching, which doesn't affect the occupancy.
+  Backend->getActiveDevice()->getKernelMaxPotentialBlockSize(
+      static_cast<CHIPKernel *>(Func), DynSharedMemPerBlk, BlockSizeLimit,
+      *GridSize, *BlockSize);
+  RETURN(hipSuccess);
   CHIP_CATCH
 }
 
 hipError_t hipModuleOccupancyMaxActiveBlocksPerMultiprocessor(
     int *NumBlocks, hipFunction_t Func, int BlockSize,
     size_t DynSharedMemPerBlk) {
-  CHIP_TRY
-  CHIPInitialize();
-  UNIMPLEMENTED(hipErrorNotSupported);
-  CHIP_CATCH
+  return hipModuleOccupancyMaxActiveBlocksPerMultiprocessorWithFlags(
+      NumBlocks, Func, BlockSize, DynSharedMemPerBlk, hipOccupancyDefault);
 }
 
 hipError_t hipModuleOccupancyMaxActiveBlocksPerMultiprocessorWithFlags(
@@ -4219,7 +4457,10 @@ hipError_t hipModuleOccupancyMaxActiveBlocksPerMultiprocessorWithFlags(
     size_t DynSharedMemPerBlk, unsigned int Flags) {
   CHIP_TRY
   CHIPInitialize();
-  UNIMPLEMENTED(hipErrorNotSupported);
+  NULLCHECK(NumBlocks, Func);
+  *NumBlocks = Backend->getActiveDevice()->getKernelOccupancy(
+      static_cast<CHIPKernel *>(Func), BlockSize, DynSharedMemPerBlk);
+  RETURN(hipSuccess);
   CHIP_CATCH
 }
 
@@ -4227,10 +4468,8 @@ hipError_t
 hipOccupancyMaxActiveBlocksPerMultiprocessor(int *NumBlocks, const void *Func,
                                              int BlockSize,
                                              size_t DynSharedMemPerBlk) {
-  CHIP_TRY
-  CHIPInitialize();
-  UNIMPLEMENTED(hipErrorNotSupported);
-  CHIP_CATCH
+  return hipOccupancyMaxActiveBlocksPerMultiprocessorWithFlags(
+      NumBlocks, Func, BlockSize, DynSharedMemPerBlk, hipOccupancyDefault);
 }
 
 hipError_t hipOccupancyMaxActiveBlocksPerMultiprocessorWithFlags(
@@ -4238,7 +4477,11 @@ hipError_t hipOccupancyMaxActiveBlocksPerMultiprocessorWithFlags(
     unsigned int Flags) {
   CHIP_TRY
   CHIPInitialize();
-  UNIMPLEMENTED(hipErrorNotSupported);
+  NULLCHECK(NumBlocks, Func);
+  CHIPDevice *Dev = Backend->getActiveDevice();
+  *NumBlocks = Dev->getKernelOccupancy(findOccupancyKernel(Dev, Func),
+                                       BlockSize, DynSharedMemPerBlk);
+  RETURN(hipSuccess);
   CHIP_CATCH
 }
 
@@ -4248,14 +4491,21 @@ hipError_t hipOccupancyMaxPotentialBlockSize(int *GridSize, int *BlockSize,
                                              int BlockSizeLimit) {
   CHIP_TRY
   CHIPInitialize();
-  UNIMPLEMENTED(hipErrorNotSupported);
+  NULLCHECK(GridSize, BlockSize, Func);
+  CHIPDevice *Dev = Backend->getActiveDevice();
+  Dev->getKernelMaxPotentialBlockSize(findOccupancyKernel(Dev, Func),
+                                      DynSharedMemPerBlk, BlockSizeLimit,
+                                      *GridSize, *BlockSize);
+  RETURN(hipSuccess);
   CHIP_CATCH
 }
 
 hipError_t hipGetDeviceFlags(unsigned int *Flags) {
   CHIP_TRY
   CHIPInitialize();
-  UNIMPLEMENTED(hipErrorNotSupported);
+  NULLCHECK(Flags);
+  *Flags = Backend->getActiveDevice()->getFlags();
+  RETURN(hipSuccess);
   CHIP_CATCH
 }
 
@@ -146,7 +146,9 @@ hipError_t hipLaunchCooperativeKernel_spt(const void *f, dim3 gridDim,
                                           dim3 blockDim, void **kernelParams,
                                           uint32_t sharedMemBytes,
                                           hipStream_t hStream) {
-  UNIMPLEMENTED(hipErrorNotSupported);
+  auto Queue = hStream ? hStream : hipStreamPerThread;
+  return hipLaunchCooperativeKernel(f, gridDim, blockDim, kernelParams,
+                                    sharedMemBytes, Queue);
 }
 #ifdef __cplusplus
 extern "C" {
@@ -358,8 +358,7 @@ void CHIPGraphExec::compile() {
 }
 
 void CHIPGraphNodeHost::execute(CHIPQueue *Queue) const {
-  Queue->finish();
-  Params_.fn(Params_.userData);
+  Queue->launchHostFunc(Params_.fn, Params_.userData);
 }
 
 void CHIPGraphExec::ExtractSubGraphs_() {
@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2023 CHIP-SPV developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "CHIPPrintf.hh"
+
+#include "common.hh"
+#include "logging.hh"
+#include "Utils.hh"
+
+#include <cctype>
+#include <cstdio>
+
+namespace {
+
+/// Reads the argument slots of a printf() record.
+class SlotReader {
+  const char *Pos_;
+  const char *End_;
+
+public:
+  SlotReader(const char *Begin, const char *End) : Pos_(Begin), End_(End) {}
+
+  bool next(uint64_t &Value) {
+    if ((size_t)(End_ - Pos_) < ChipPrintfSlotSize)
+      return false;
+    Value = copyAs<uint64_t>(Pos_);
+    Pos_ += ChipPrintfSlotSize;
+    return true;
+  }
+
+  bool nextString(std::string &Str) {
+    uint64_t Len;
+    if (!next(Len) || Len > (uint64_t)(End_ - Pos_))
+      return false;
+    Str.assign(Pos_, Len);
+    Pos_ += std::min<size_t>(roundUp(Len, ChipPrintfSlotSize), End_ - Pos_);
+    return true;
+  }
+};
+
+} // namespace
+
+template <typename T>
+static void appendFormatted(std::string &Out, const std::string &Spec,
+                            T Value) {
+  int Len = std::snprintf(nullptr, 0, Spec.c_str(), Value);
+  if (Len <= 0)
+    return;
+  size_t Pos = Out.size();
+  Out.resize(Pos + Len + 1);
+  std::snprintf(&Out[Pos], Len + 1, Spec.c_str(), Value);
+  Out.resize(Pos + Len);
+}
+
+static int64_t toSigned(uint64_t Value, std::string_view Length) {
+  if (Length == "hh")
+    return (signed char)Value;
+  if (Length == "h")
+    return (short)Value;
+  if (Length.empty())
+    return (int32_t)Value;
+  return (int64_t)Value;
+}
+
+static uint64_t toUnsigned(uint64_t Value, std::string_view Length) {
+  if (Length == "hh")
+    return (unsigned char)Value;
+  if (Length == "h")
+    return (unsigned short)Value;
+  if (Length.empty())
+    return (uint32_t)Value;
+  return Value;
+}
+
+static bool isFlag(char C) { return C && std::strchr("-+ #0", C); }
+static bool isLengthModifier(char C) { return C && std::strchr("hljztL", C); }
+
+/// Append the output of a printf() call with the format string Fmt to Out.
+/// The arguments are read from Args the same way HipPrintf.cpp stores them.
+/// Return false if the arguments ran out.
+static bool formatRecord(std::string_view Fmt, SlotReader &Args,
+                         std::string &Out) {
+  size_t I = 0;
+  auto IsDigit = [&]() { return I < Fmt.size() && std::isdigit(Fmt[I]); };
+  while (I < Fmt.size()) {
+    char C = Fmt[I++];
+    if (C != '%') {
+      Out += C;
+      continue;
+    }
+    if (I < Fmt.size() && Fmt[I] == '%') {
+      Out += '%';
+      ++I;
+      continue;
+    }
+
+    // Rebuild the conversion specification with the '*' fields replaced by
+    // their arguments. The length modifier is replaced by one matching the
+    // host type the argument is passed in.
+    size_t SpecBegin = I - 1;
+    std::string Spec = "%";
+    while (I < Fmt.size() && isFlag(Fmt[I]))
+      Spec += Fmt[I++];
+    uint64_t Value;
+    if (I < Fmt.size() && Fmt[I] == '*') {
+      ++I;
+      if (!Args.next(Value))
+        return false;
+      Spec += std::to_string((int32_t)Value);
+    } else
+      while (IsDigit())
+        Spec += Fmt[I++];
+    if (I < Fmt.size() && Fmt[I] == '.') {
+      ++I;
+      if (I < Fmt.size() && Fmt[I] == '*') {
+        ++I;
+        if (!Args.next(Value))
+          return false;
+        // A negative precision is taken as if it was omitted.
+        if ((int32_t)Value >= 0)
+          Spec += "." + std::to_string((int32_t)Value);
+      } else {
+        Spec += '.';
+        while (IsDigit())
+          Spec += Fmt[I++];
+      }
+    }
+    size_t LengthBegin = I;
+    while (I < Fmt.size() && isLengthModifier(Fmt[I]))
+      ++I;
+    auto Length = Fmt.substr(LengthBegin, I - LengthBegin);
+    if (I == Fmt.size()) {
+      // An incomplete specification. Print it as is.
+      Out += Fmt.substr(SpecBegin);
+      break;
+    }
+
+    char Conversion = Fmt[I++];
+    std::string Str;
+    switch (Conversion) {
+    case 's':
+      if (!Args.nextString(Str))
+        return false;
+      appendFormatted(Out, Spec + 's', Str.c_str());
+      continue;
+    default:
+      if (!Args.next(Value))
+        return false;
+    }
+
+    switch (Conversion) {
+    case 'd':
+    case 'i':
+      appendFormatted(Out, Spec + "lld", (long long)toSigned(Value, Length));
+      break;
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X':
+      appendFormatted(Out, Spec + "ll" + Conversion,
+                      (unsigned long long)toUnsigned(Value, Length));
+      break;
+    case 'c':
+      appendFormatted(Out, Spec + 'c', (int)(unsigned char)Value);
+      break;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+      appendFormatted(Out, Spec + Conversion, copyAs<double>(&Value));
+      break;
+    case 'p':
+      appendFormatted(Out, Spec + 'p', (void *)(uintptr_t)Value);
+      break;
+    case 'n':
+      break; // Not supported: the argument points to the device memory.
+    default:
+      // An invalid conversion. Print the specification as is.
+      Out += Fmt.substr(SpecBegin, I - SpecBegin);
+    }
+  }
+  return true;
+}
+
+std::string formatPrintfRecords(std::string_view Formats, const char *Records,
+                                size_t Size, size_t &Consumed) {
+  std::string Out;
+  size_t Pos = 0;
+  while (Size - Pos >= sizeof(CHIPPrintfRecord)) {
+    auto Record = copyAs<CHIPPrintfRecord>(Records, Pos);
+    if (!Record.Size)
+      break; // Still being written by a running kernel.
+    if (Record.Size < sizeof(CHIPPrintfRecord) || Record.Size > Size - Pos ||
+        (Record.FormatOffset >= Formats.size() &&
+         Record.FormatOffset != ChipPrintfPadding)) {
+      logError("Corrupted printf() record at offset {}", Pos);
+      // Skip the rest rather than getting stuck on it.
+      Pos = Size;
+      break;
+    }
+    if (Record.FormatOffset == ChipPrintfPadding) {
+      Pos += Record.Size;
+      continue;
+    }
+
+    auto Fmt = Formats.substr(Record.FormatOffset);
+    Fmt = Fmt.substr(0, Fmt.find('\0'));
+    SlotReader Args(Records + Pos + sizeof(CHIPPrintfRecord),
+                    Records + Pos + Record.Size);
+    if (!formatRecord(Fmt, Args, Out))
+      logError("Missing printf() arguments for the format string '{}'", Fmt);
+    Pos += Record.Size;
+  }
+  Consumed = Pos;
+  return Out;
+}
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2021-23 CHIP-SPV developers
+ * Copyright (c) 2023 CHIP-SPV developers
  *
  * Permission is hereby granted, free of charge, to any person obtaining a copy
  * of this software and associated documentation files (the "Software"), to deal
@@ -20,11 +20,23 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
-static void __attribute__((used)) _cl_print_str(__generic const char *S) {
-  unsigned Pos = 0;
-  char C;
-  while ((C = S[Pos]) != 0) {
-    printf("%c", C);
-    ++Pos;
-  }
-}
+
+#ifndef SRC_CHIP_PRINTF_HH
+#define SRC_CHIP_PRINTF_HH
+
+#include <string>
+#include <string_view>
+
+/// Format the records written by the device-side printf() calls.
+///
+/// \param Formats the format strings of the module the records were written
+///        by (see ChipPrintfFormatsName)
+/// \param Records the records copied from a printf buffer
+/// \param Size the size of the records in bytes
+/// \param Consumed set to the bytes of the records before the first one
+///        still being written
+/// \return the formatted output
+std::string formatPrintfRecords(std::string_view Formats, const char *Records,
+                                size_t Size, size_t &Consumed);
+
+#endif
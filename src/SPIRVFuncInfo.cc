@@ -212,3 +212,12 @@ unsigned SPVFuncInfo::getNumClientArgs() const {
   }
   return Count;
 }
+
+/// Return true if the kernel takes dynamic shared memory, which the HipDynMem
+/// pass turns into a pointer argument with workgroup storage class.
+bool SPVFuncInfo::hasWorkgroupPtrArgs() const {
+  for (const auto &ArgTI : ArgTypeInfo_)
+    if (ArgTI.isWorkgroupPtr())
+      return true;
+  return false;
+}
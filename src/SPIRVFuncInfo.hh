@@ -118,6 +118,9 @@ public:
   /// defined in HIP source code)
   unsigned getNumKernelArgs() const { return ArgTypeInfo_.size(); }
 
+  /// Return true if the kernel has an extern __shared__ array.
+  bool hasWorkgroupPtrArgs() const;
+
   /// Return true is any argument is passed via intermediate buffer.
   bool hasByRefArgs() const { return SpilledArgs_.size(); }
 
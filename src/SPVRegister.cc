@@ -52,6 +52,22 @@ SPVRegister::Handle SPVRegister::registerSource(std::string_view SourceModule) {
   return Handle{reinterpret_cast<void *>(SrcMod)};
 }
 
+/// Register a source module loaded at runtime, e.g. by
+/// hipModuleLoadData(). The source is copied so the caller may release
+/// it.
+///
+/// The functions and variables of the module may not be bound to host
+/// pointers.
+SPVRegister::Handle SPVRegister::loadSource(std::string_view SourceModule) {
+  assert(SourceModule.size() && "Source module must be non-empty.");
+  LOCK(Mtx_); // SPVRegister::Sources_
+  auto Ins = Sources_.emplace(std::make_unique<SPVModule>());
+  SPVModule *SrcMod = Ins.first->get();
+  SrcMod->LoadedBinary_ = SourceModule;
+  SrcMod->OriginalBinary_ = SrcMod->LoadedBinary_;
+  return Handle{reinterpret_cast<void *>(SrcMod)};
+}
+
 /// Associates the given host-pointer with a function by name in the
 /// source module (Handle).
 void SPVRegister::bindFunction(SPVRegister::Handle Handle, HostPtr Ptr,
@@ -88,9 +104,13 @@ void SPVRegister::bindVariable(SPVRegister::Handle Handle, HostPtr Ptr,
       // Host pointer should be associated with one source module and variable
       // at most.
       (!HostPtrLookup_.count(Ptr)) ||
-      // A variable made for abort() implementation is an exception to this due
-      // to the way it's modeled.
-      (Name == ChipDeviceAbortFlagName && HostPtrLookup_[Ptr]->Name == Name) &&
+      // The variables made for abort(), printf() and malloc()
+      // implementation are an exception to this due to the way they are
+      // modeled.
+      ((Name == ChipDeviceAbortFlagName ||
+        Name == ChipDevicePrintfBufferName ||
+        Name == ChipDeviceMallocHeapName) &&
+       HostPtrLookup_[Ptr]->Name == Name) &&
           "Host-pointer is already mapped.");
 
   SrcMod->Variables.emplace_back(SPVVariable{{SrcMod, Ptr, Name}, Size});
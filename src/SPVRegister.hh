@@ -76,6 +76,10 @@ class SPVModule {
   /// post-processing step has not been performed (yet).
   std::string FinalizedBinary_;
 
+  /// A copy of the original source of a module loaded at runtime (see
+  /// SPVRegister::loadSource()). OriginalBinary_ refers to it.
+  std::string LoadedBinary_;
+
 public:
   // Using lists for iterator stability.
   std::list<SPVFunction> Kernels;
@@ -102,6 +106,7 @@ public:
   };
 
   Handle registerSource(std::string_view SourceModule);
+  Handle loadSource(std::string_view SourceModule);
 
   void bindFunction(Handle Handle, HostPtr Ptr, std::string_view Name);
   void bindVariable(Handle Handle, HostPtr Ptr, std::string_view Name,
@@ -143,6 +143,15 @@ std::optional<fs::path> getHIPCCPath() {
   return std::nullopt;
 }
 
+std::optional<fs::path> getRtDevLibPath(std::string_view FileName) {
+  for (const auto &Dir : {fs::path(CHIP_INSTALL_DIR) / "lib/hip-device-lib",
+                          fs::path(CHIP_BUILD_DIR) / "lib/hip-device-lib"})
+    if (fs::exists(Dir / FileName))
+      return Dir / FileName;
+
+  return std::nullopt;
+}
+
 std::string_view extractSPIRVModule(const void *Bundle, std::string &ErrorMsg) {
   // NOTE: This method is designed to read from possibly misaligned buffer.
 
@@ -78,6 +78,10 @@ std::optional<std::string> readFromFile(const fs::path Path);
 /// Locate hipcc tool. Return an absolute path to it if found.
 std::optional<fs::path> getHIPCCPath();
 
+/// Locate a device library linked to the modules at runtime. Return an
+/// absolute path to it if found.
+std::optional<fs::path> getRtDevLibPath(std::string_view FileName);
+
 /// Returns a span (string_view) over SPIR-V module in the given clang
 /// offload bundle.  Returns empty span if an error was encountered
 /// and 'ErrorMsg' is set to describe the encountered error.
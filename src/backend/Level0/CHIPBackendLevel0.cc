@@ -28,8 +28,9 @@
  * if L0_IMM_QUEUES is used. There is only one such handle for a queue and a
  * queue can be shared between multiple threads thus this lock is necessary.
  *
- * If immediate command lists are not used, getCmdList will create a new
- * handle which is a thread safe operation
+ * If immediate command lists are not used, getCmdList will return the open
+ * command list batch of the queue which is likewise shared between threads.
+ * The lock is held until the command has been passed to executeCommandList().
  */
 #ifdef L0_IMM_QUEUES
 #define GET_COMMAND_LIST(Queue)                                                \
@@ -39,9 +40,44 @@
 #else
 #define GET_COMMAND_LIST(Queue)                                                \
   ze_command_list_handle_t CommandList;                                        \
+  LOCK(Queue->CmdListMtx); /* CHIPQueueLevel0::ZeCmdListBatch_ */              \
   CommandList = Queue->getCmdList();
 #endif
 
+/// Number of operations after which a command list batch is submitted.
+/// CHIP_L0_BATCH_SIZE=1 submits every operation on its own.
+static size_t getBatchSizeThreshold() {
+  static size_t Threshold = [] {
+    auto Str = readEnvVar("CHIP_L0_BATCH_SIZE");
+    size_t Value = Str.empty() ? 0 : std::strtoul(Str.c_str(), nullptr, 10);
+    return Value ? Value : 32;
+  }();
+  return Threshold;
+}
+
+/// Age of a command list batch after which the stale event monitor submits
+/// it. Overridden by CHIP_L0_BATCH_TIMEOUT_US.
+static std::chrono::microseconds getBatchTimeThreshold() {
+  static std::chrono::microseconds Threshold = [] {
+    auto Str = readEnvVar("CHIP_L0_BATCH_TIMEOUT_US");
+    size_t Value = Str.empty() ? 200 : std::strtoul(Str.c_str(), nullptr, 10);
+    return std::chrono::microseconds(Value);
+  }();
+  return Threshold;
+}
+
+/// Copies of at least this many bytes are executed on the copy engine if the
+/// device has one. Overridden by CHIP_L0_COPY_ENGINE_THRESHOLD, 0 disables
+/// the use of the copy engine.
+static size_t getCopyEngineThreshold() {
+  static size_t Threshold = [] {
+    auto Str = readEnvVar("CHIP_L0_COPY_ENGINE_THRESHOLD");
+    return Str.empty() ? (size_t)1 << 20
+                       : (size_t)std::strtoul(Str.c_str(), nullptr, 10);
+  }();
+  return Threshold;
+}
+
 static ze_image_type_t getImageType(unsigned HipTextureID) {
   switch (HipTextureID) {
   default:
@@ -226,12 +262,23 @@ void CHIPEventLevel0::reset() {
   LOCK(EventMtx); // CHIPEvent::TrackCalled_
   TrackCalled_ = false;
   EventStatus_ = EVENT_STATUS_INIT;
+  PendingQueue_ = nullptr;
   *Refc_ = 1;
 #ifndef NDEBUG
   markDeleted(false);
 #endif
 }
 
+void CHIPEventLevel0::submitPending(bool Blocking) {
+  CHIPQueueLevel0 *Q;
+  {
+    LOCK(EventMtx); // CHIPEventLevel0::PendingQueue_
+    Q = PendingQueue_;
+  }
+  if (Q)
+    Q->submitBatch(Blocking);
+}
+
 ze_event_handle_t CHIPEventLevel0::peek() {
   assert(!Deleted_ && "Event use after delete!");
   return Event_;
@@ -352,49 +399,69 @@ void CHIPEventLevel0::recordStream(CHIPQueue *ChipQueue) {
     }
   }
 
+  // Only events which may be passed to hipEventElapsedTime() pay for the
+  // timestamp write and copy.
+  bool Timed = !getFlags().isDisableTiming();
   auto Dev = (CHIPDeviceLevel0 *)ChipQueue->getDevice();
-  Status = zeDeviceGetGlobalTimestamps(Dev->get(), &HostTimestamp_,
-                                       &DeviceTimestamp_);
-  CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
+  if (Timed) {
+    Status = zeDeviceGetGlobalTimestamps(Dev->get(), &HostTimestamp_,
+                                         &DeviceTimestamp_);
+    CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
+  }
 
   if (ChipQueue == nullptr)
     CHIPERR_LOG_AND_THROW("Queue passed in is null", hipErrorTbd);
 
   CHIPQueueLevel0 *Q = (CHIPQueueLevel0 *)ChipQueue;
-  GET_COMMAND_LIST(Q)
-  // The application must not call this function from
-  // simultaneous threads with the same command list handle.
-  Status = zeCommandListAppendBarrier(CommandList, nullptr, 0, nullptr);
-  CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
-  // The application must not call this function from
-  // simultaneous threads with the same command list handle.
-  Status = zeCommandListAppendWriteGlobalTimestamp(
-      CommandList, (uint64_t *)(Q->getSharedBufffer()), nullptr, 0, nullptr);
-  CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
-  // The application must not call this function from
-  // simultaneous threads with the same command list handle.
-  Status = zeCommandListAppendBarrier(CommandList, nullptr, 0, nullptr);
-  CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
-  // The application must not call this function from
-  // simultaneous threads with the same command list handle.
-  Status = zeCommandListAppendMemoryCopy(CommandList, &Timestamp_,
-                                         Q->getSharedBufffer(),
-                                         sizeof(uint64_t), Event_, 0, nullptr);
-  CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
-
   auto DestoyCommandListEvent =
       ((CHIPBackendLevel0 *)Backend)->createCHIPEvent(this->ChipContext_);
   DestoyCommandListEvent->Msg = "recordStreamComplete";
-  // The application must not call this function from
-  // simultaneous threads with the same command list handle.
-  // Done via GET_COMMAND_LIST
-  Status = zeCommandListAppendBarrier(
-      CommandList, DestoyCommandListEvent->peek(), 0, nullptr);
-  CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
+  {
+    GET_COMMAND_LIST(Q)
+    if (Timed) {
+      // The application must not call this function from
+      // simultaneous threads with the same command list handle.
+      Status = zeCommandListAppendBarrier(CommandList, nullptr, 0, nullptr);
+      CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
+      // The application must not call this function from
+      // simultaneous threads with the same command list handle.
+      Status = zeCommandListAppendWriteGlobalTimestamp(
+          CommandList, (uint64_t *)(Q->getSharedBufffer()), nullptr, 0,
+          nullptr);
+      CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
+      // The application must not call this function from
+      // simultaneous threads with the same command list handle.
+      Status = zeCommandListAppendBarrier(CommandList, nullptr, 0, nullptr);
+      CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
+      // The application must not call this function from
+      // simultaneous threads with the same command list handle.
+      Status = zeCommandListAppendMemoryCopy(
+          CommandList, &Timestamp_, Q->getSharedBufffer(), sizeof(uint64_t),
+          Event_, 0, nullptr);
+      CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
+    } else {
+      // The application must not call this function from
+      // simultaneous threads with the same command list handle.
+      Status = zeCommandListAppendBarrier(CommandList, Event_, 0, nullptr);
+      CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
+    }
+
+    // The application must not call this function from
+    // simultaneous threads with the same command list handle.
+    // Done via GET_COMMAND_LIST
+    Status = zeCommandListAppendBarrier(
+        CommandList, DestoyCommandListEvent->peek(), 0, nullptr);
+    CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
 
-  Q->executeCommandList(CommandList);
+    Q->executeCommandList(CommandList, this);
+  }
   DestoyCommandListEvent->track();
 
+  // A recorded user event is typically waited on or queried by the host
+  // soon, so don't leave it sitting in an unsubmitted batch.
+  if (isUserEvent())
+    Q->submitBatch();
+
   LOCK(EventMtx); // CHIPEvent::EventStatus_
   EventStatus_ = EVENT_STATUS_RECORDING;
   Msg = "recordStream";
@@ -404,7 +471,31 @@ bool CHIPEventLevel0::wait() {
   assert(!Deleted_ && "Event use after delete!");
   logTrace("CHIPEventLevel0::wait() {} msg={}", (void *)this, Msg);
 
-  ze_result_t Status = zeEventHostSynchronize(Event_, UINT64_MAX);
+  submitPending();
+  ChipContext_->getDevice()->getSyncPolicy().wait(
+      [&]() {
+        ze_result_t Status = zeEventQueryStatus(Event_);
+        if (Status == ZE_RESULT_NOT_READY)
+          return false;
+        CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
+        return true;
+      },
+      [&]() {
+        ze_result_t Status = zeEventHostSynchronize(Event_, UINT64_MAX);
+        CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
+      });
+
+  LOCK(EventMtx); // CHIPEvent::EventStatus_
+  EventStatus_ = EVENT_STATUS_RECORDED;
+  return true;
+}
+
+bool CHIPEventLevel0::waitFor(uint64_t TimeoutNs) {
+  assert(!Deleted_ && "Event use after delete!");
+  submitPending(false);
+  ze_result_t Status = zeEventHostSynchronize(Event_, TimeoutNs);
+  if (Status == ZE_RESULT_NOT_READY)
+    return false;
   CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
 
   LOCK(EventMtx); // CHIPEvent::EventStatus_
@@ -414,6 +505,9 @@ bool CHIPEventLevel0::wait() {
 
 bool CHIPEventLevel0::updateFinishStatus(bool ThrowErrorIfNotReady) {
   assert(!Deleted_ && "Event use after delete!");
+  // Don't block here: this is also polled by the event monitors which hold
+  // locks the appending threads may need.
+  submitPending(false);
   std::string EventStatusOld, EventStatusNew;
   {
     LOCK(EventMtx); // CHIPEvent::EventStatus_
@@ -555,23 +649,37 @@ void CHIPEventLevel0::hostSignal() {
 CHIPCallbackDataLevel0::CHIPCallbackDataLevel0(hipStreamCallback_t CallbackF,
                                                void *CallbackArgs,
                                                CHIPQueue *ChipQueue)
-    : CHIPCallbackData(CallbackF, CallbackArgs, ChipQueue) {
-  LOCK(Backend->BackendMtx) // ensure callback enqueues are submitted as one
+    : CHIPCallbackData(CallbackF, CallbackArgs, ChipQueue) {}
 
-  CHIPContext *Ctx = ChipQueue->getContext();
+void CHIPCallbackDataLevel0::enqueue() {
+  auto *ChipQueueLz = (CHIPQueueLevel0 *)ChipQueue;
 
-  CpuCallbackComplete = (CHIPEventLevel0 *)Backend->createCHIPEvent(Ctx);
+  CpuCallbackComplete = Backend->createCHIPEvent(ChipQueue->getContext());
   CpuCallbackComplete->Msg = "CpuCallbackComplete";
+  CpuCallbackComplete->track();
 
-  GpuReady = ChipQueue->enqueueBarrierImpl(nullptr);
-  GpuReady->Msg = "GpuReady";
+  GpuReady = ChipQueueLz->getLastEvent();
+  if (GpuReady)
+    GpuReady->increaseRefCount("CHIPCallbackDataLevel0 GpuReady");
 
   std::vector<CHIPEvent *> ChipEvs = {CpuCallbackComplete};
-  auto WaitForCpuComplete = ChipQueue->enqueueBarrierImpl(&ChipEvs);
-  ChipQueue->updateLastEvent(WaitForCpuComplete);
+  ChipQueue->enqueueBarrier(&ChipEvs);
+
+  if (!GpuReady) {
+    Backend->getCallbackExecutor()->setReady(this);
+    return;
+  }
+  // The callback monitor waits for GpuReady, make sure it gets executed.
+  ChipQueueLz->submitBatch();
+  ((CHIPBackendLevel0 *)Backend)->getCallbackEventMonitor()->watch(this);
+}
 
-  GpuAck = ChipQueue->enqueueMarkerImpl();
-  GpuAck->Msg = "GpuAck";
+void CHIPCallbackDataLevel0::complete() {
+  // The barrier waiting for CpuCallbackComplete keeps it alive until the
+  // device has seen the signal.
+  CpuCallbackComplete->hostSignal();
+  if (GpuReady)
+    GpuReady->decreaseRefCount("CHIPCallbackDataLevel0 complete");
 }
 
 // End CHIPCallbackDataLevel0
@@ -579,75 +687,106 @@ CHIPCallbackDataLevel0::CHIPCallbackDataLevel0(hipStreamCallback_t CallbackF,
 // CHIPEventMonitorLevel0
 // ***********************************************************************
 
+void CHIPCallbackEventMonitorLevel0::watch(CHIPCallbackDataLevel0 *Cb) {
+  {
+    LOCK(EventMonitorMtx); // CHIPCallbackEventMonitorLevel0::Watched_
+    Watched_.push_back(Cb);
+  }
+  WatchCv_.notify_one();
+}
+
 void CHIPCallbackEventMonitorLevel0::monitor() {
-  CHIPCallbackDataLevel0 *CallbackData;
+  // Level Zero has no completion callbacks, so block on the oldest watched
+  // event. The timeout bounds the delay of the other watched callbacks.
+  constexpr uint64_t WaitTimeoutNs = 1000000;
   while (true) {
-    usleep(20000);
-    LOCK(EventMonitorMtx); // CHIPEventMonitor::Stop
+    std::vector<CHIPCallbackDataLevel0 *> Ready;
+    CHIPCallbackDataLevel0 *Oldest = nullptr;
     {
-
+      // CHIPEventMonitor::Stop, CHIPCallbackEventMonitorLevel0::Watched_
+      std::unique_lock<std::mutex> Lock(EventMonitorMtx);
+      WatchCv_.wait(Lock, [&] { return Stop || !Watched_.empty(); });
       if (Stop) {
-        logTrace(
-            "CHIPCallbackEventMonitorLevel0 out of callbacks. Exiting thread");
-        if (Backend->CallbackQueue.size())
+        logTrace("CHIPCallbackEventMonitorLevel0 stopped. Exiting thread");
+        if (Watched_.size())
           logError("Callback thread exiting while there are still active "
                    "callbacks in the queue");
-        pthread_exit(0);
+        return;
       }
 
-      LOCK(Backend->CallbackQueueMtx); // CHIPBackend::CallbackQueue
-
-      if ((Backend->CallbackQueue.size() == 0))
-        continue;
-
-      // get the callback item
-      CallbackData = (CHIPCallbackDataLevel0 *)Backend->CallbackQueue.front();
-
-      // Lock the item and members
-      assert(CallbackData);
-      LOCK( // CHIPBackend::CallbackQueue
-          CallbackData->CallbackDataMtx);
-      Backend->CallbackQueue.pop();
-
-      // Update Status
-      logTrace("CHIPCallbackEventMonitorLevel0::monitor() checking event "
-               "status for {}",
-               (void *)CallbackData->GpuReady);
-      CallbackData->GpuReady->updateFinishStatus(false);
-      if (CallbackData->GpuReady->getEventStatus() != EVENT_STATUS_RECORDED) {
-        // if not ready, push to the back
-        Backend->CallbackQueue.push(CallbackData);
-        continue;
+      for (auto It = Watched_.begin(); It != Watched_.end();) {
+        if ((*It)->GpuReady->updateFinishStatus(false)) {
+          Ready.push_back(*It);
+          It = Watched_.erase(It);
+        } else {
+          ++It;
+        }
       }
+      // Only this thread removes callbacks from Watched_.
+      if (Ready.empty())
+        Oldest = Watched_.front();
     }
 
-    CallbackData->execute(hipSuccess);
-    CallbackData->CpuCallbackComplete->hostSignal();
-    CallbackData->GpuAck->wait();
+    for (auto *Cb : Ready)
+      Backend->getCallbackExecutor()->setReady(Cb);
+    if (Oldest)
+      ((CHIPEventLevel0 *)Oldest->GpuReady)->waitFor(WaitTimeoutNs);
+  }
+}
+
+void CHIPStaleEventMonitorLevel0::watchBatch(
+    CHIPQueueLevel0 *Queue, std::chrono::steady_clock::time_point Start) {
+  LOCK(BatchMtx_); // CHIPStaleEventMonitorLevel0::OpenBatches_
+  // A queue can be watched already if its previous batch was submitted
+  // before getting stale.
+  if (OpenBatches_.insert_or_assign(Queue, Start).second)
+    BatchCv_.notify_one();
+}
+
+void CHIPStaleEventMonitorLevel0::forgetBatch(CHIPQueueLevel0 *Queue) {
+  LOCK(BatchMtx_); // CHIPStaleEventMonitorLevel0::OpenBatches_
+  OpenBatches_.erase(Queue);
+}
 
-    delete CallbackData;
-    pthread_yield();
+void CHIPStaleEventMonitorLevel0::submitStaleBatches(
+    std::chrono::steady_clock::duration Period) {
+  auto Threshold = getBatchTimeThreshold();
+  auto End = std::chrono::steady_clock::now() + Period;
+  // CHIPStaleEventMonitorLevel0::OpenBatches_
+  std::unique_lock<std::mutex> Lock(BatchMtx_);
+  while (true) {
+    auto Now = std::chrono::steady_clock::now();
+    auto Wakeup = End;
+    for (auto It = OpenBatches_.begin(); It != OpenBatches_.end();) {
+      auto Deadline = It->second + Threshold;
+      // The queue locks CmdListMtx before BatchMtx_ in watchBatch(). Retry
+      // shortly if a thread is appending to the batch right now.
+      if (Deadline <= Now) {
+        if (It->first->submitBatch(false)) {
+          It = OpenBatches_.erase(It);
+          continue;
+        }
+        Deadline = Now + std::chrono::microseconds(50);
+      }
+      Wakeup = std::min(Wakeup, Deadline);
+      ++It;
+    }
+    if (Now >= End)
+      return;
+    BatchCv_.wait_until(Lock, Wakeup);
   }
 }
 
 void CHIPStaleEventMonitorLevel0::monitor() {
   // Stop is false and I have more events
   while (true) {
-    usleep(20000);
+    // Sleep between the event collections, submitting the command list
+    // batches which do not fill up on time meanwhile.
+    submitStaleBatches(std::chrono::milliseconds(20));
     LOCK(EventMonitorMtx); // CHIPEventMonitor::Stop
     std::vector<CHIPEvent *> EventsToDelete;
-    std::vector<ze_command_list_handle_t> CommandListsToDelete;
 
     LOCK(Backend->EventsMtx); // CHIPBackend::Events
-    LOCK(                     // CHIPBackendLevel0::EventCommandListMap
-        ((CHIPBackendLevel0 *)Backend)->CommandListsMtx);
-    // auto LzBackend = (CHIPBackendLevel0 *)Backend;
-    // logTrace("CHIPStaleEventMonitorLevel0::monitor() # events {} # queues
-    // {}",
-    //          Backend->Events.size(), LzBackend->EventCommandListMap.size());
-
-    auto EventCommandListMap =
-        &((CHIPBackendLevel0 *)Backend)->EventCommandListMap;
 
     for (size_t i = 0; i < Backend->Events.size(); i++) {
       CHIPEvent *ChipEvent = Backend->Events[i];
@@ -679,23 +818,6 @@ void CHIPStaleEventMonitorLevel0::monitor() {
 
         E->doActions();
 
-        // Check if this event is associated with a CommandList
-        bool CommandListFound = EventCommandListMap->count(E);
-        if (CommandListFound) {
-          logTrace("Erase cmdlist assoc w/ event: {}", (void *)E);
-          auto CommandList = (*EventCommandListMap)[E];
-          EventCommandListMap->erase(E);
-
-#ifdef DUBIOUS_LOCKS
-          LOCK(Backend->DubiousLockLevel0)
-#endif
-          // The application must not call this function
-          // from simultaneous threads with the same command list handle.
-          // Done via this is the only thread that calls it
-          auto Status = zeCommandListDestroy(CommandList);
-          CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
-        }
-
         if (E->EventPool)
           E->EventPool->returnSlot(E->EventPoolIndex);
 #ifndef NDEBUG
@@ -708,11 +830,10 @@ void CHIPStaleEventMonitorLevel0::monitor() {
     /**
      * In the case that a user doesn't destroy all the
      * created streams, we remove the streams and outstanding events in
-     * CHIPBackend::waitForThreadExit() but CHIPBackend has no knowledge of
-     * EventCommandListMap
+     * CHIPBackend::waitForThreadExit()
      */
     // TODO libCEED - re-enable this check
-    if (Stop && !EventCommandListMap->size()) {
+    if (Stop) {
       if (Backend->Events.size() > 0) {
         logError(
             "CHIPStaleEventMonitorLevel0 stop was called but not all events "
@@ -748,13 +869,24 @@ CHIPKernelLevel0::CHIPKernelLevel0(ze_kernel_handle_t ZeKernel,
   CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
 
   PrivateSize_ = Props.privateMemSize;
-  StaticLocalSize_ = Props.localMemSize;
+  Resources_.StaticLocalSize = Props.localMemSize;
 
   // TODO there doesn't seem to exist a way to get these from L0 API
-  MaxDynamicLocalSize_ =
+  Resources_.MaxDynamicLocalSize =
       Device->getAttr(hipDeviceAttributeMaxSharedMemoryPerBlock) -
-      StaticLocalSize_;
-  MaxWorkGroupSize_ = Device->getAttr(hipDeviceAttributeMaxThreadsPerBlock);
+      Resources_.StaticLocalSize;
+  Resources_.MaxWorkGroupSize =
+      Device->getAttr(hipDeviceAttributeMaxThreadsPerBlock);
+  // A block can't have more subgroups than the kernel was compiled for.
+  if (Props.maxSubgroupSize && Props.maxNumSubgroups)
+    Resources_.MaxWorkGroupSize =
+        std::min<size_t>(Resources_.MaxWorkGroupSize,
+                         (size_t)Props.maxSubgroupSize * Props.maxNumSubgroups);
+  uint32_t SubgroupSize = Props.requiredSubgroupSize
+                              ? Props.requiredSubgroupSize
+                              : Props.maxSubgroupSize;
+  if (SubgroupSize)
+    Resources_.PreferredWorkGroupSizeMultiple = SubgroupSize;
 }
 // End CHIPKernelLevelZero
 
@@ -766,9 +898,9 @@ hipError_t CHIPKernelLevel0::getAttributes(hipFuncAttributes *Attr) {
   Attr->constSizeBytes = 0; // TODO
   Attr->localSizeBytes = PrivateSize_;
 
-  Attr->maxThreadsPerBlock = MaxWorkGroupSize_;
-  Attr->sharedSizeBytes = StaticLocalSize_;
-  Attr->maxDynamicSharedSizeBytes = MaxDynamicLocalSize_;
+  Attr->maxThreadsPerBlock = Resources_.MaxWorkGroupSize;
+  Attr->sharedSizeBytes = Resources_.StaticLocalSize;
+  Attr->maxDynamicSharedSizeBytes = Resources_.MaxDynamicLocalSize;
 
   Attr->numRegs = 0;
   Attr->preferredShmemCarveout = 0;
@@ -781,6 +913,9 @@ hipError_t CHIPKernelLevel0::getAttributes(hipFuncAttributes *Attr) {
 
 CHIPQueueLevel0::~CHIPQueueLevel0() {
   logTrace("~CHIPQueueLevel0() {}", (void *)this);
+  auto *Monitor = ((CHIPBackendLevel0 *)Backend)->getStaleEventMonitor();
+  if (Monitor)
+    Monitor->forgetBatch(this);
   // From destructor post query only when queue is owned by CHIP
   // Non-owned command queues can be destroyed independently by the owner
   if (zeCmdQOwnership_) {
@@ -789,7 +924,11 @@ CHIPQueueLevel0::~CHIPQueueLevel0() {
               // we do not finish we risk the chance of StaleEventMonitor of
               // deadlocking while waiting for queue completion and subsequent
               // event status change
+  } else {
+    submitBatch();
   }
+  releaseCmdLists();
+  delete CopyQueue_;
   updateLastEvent(
       nullptr); // Just in case that unique_ptr destructor calls this, the
                 // generic ~CHIPQueue() (which calls updateLastEvent(nullptr))
@@ -802,26 +941,17 @@ CHIPQueueLevel0::~CHIPQueueLevel0() {
 #ifdef DUBIOUS_LOCKS
   LOCK(Backend->DubiousLockLevel0)
 #endif
-  if (zeCmdQOwnership_) {
+  if (Pooled_) {
+    ChipDevice_->getQueuePool().release(ZeCmdQ_, Priority_, [](void *CmdQ) {
+      zeCommandQueueDestroy((ze_command_queue_handle_t)CmdQ);
+    });
+  } else if (zeCmdQOwnership_) {
     zeCommandQueueDestroy(ZeCmdQ_);
   } else {
     logTrace("CHIP does not own cmd queue");
   }
 }
 
-void CHIPQueueLevel0::addCallback(hipStreamCallback_t Callback,
-                                  void *UserData) {
-  CHIPCallbackData *Callbackdata =
-      Backend->createCallbackData(Callback, UserData, this);
-
-  {
-    LOCK(Backend->CallbackQueueMtx); // CHIPBackend::CallbackQueue
-    Backend->CallbackQueue.push(Callbackdata);
-  }
-
-  return;
-}
-
 CHIPEventLevel0 *CHIPQueueLevel0::getLastEvent() {
   LOCK(LastEventMtx); // CHIPQueue::LastEvent_
   return (CHIPEventLevel0 *)LastEvent_;
@@ -829,18 +959,148 @@ CHIPEventLevel0 *CHIPQueueLevel0::getLastEvent() {
 
 ze_command_list_handle_t CHIPQueueLevel0::getCmdList() {
 #ifdef L0_IMM_QUEUES
-  return ZeCmdList_;
+  ze_command_list_handle_t CmdList = ZeCmdList_;
 #else
-  ze_command_list_handle_t ZeCmdList;
+  if (!ZeCmdListBatch_) {
+    recycleCmdListsNoLock();
+    if (FreeCmdLists_.size()) {
+      ZeCmdListBatch_ = FreeCmdLists_.back();
+      FreeCmdLists_.pop_back();
+    } else {
 #ifdef DUBIOUS_LOCKS
-  LOCK(Backend->DubiousLockLevel0)
+      LOCK(Backend->DubiousLockLevel0)
 #endif
-  auto Status =
-      zeCommandListCreate(ZeCtx_, ZeDev_, &CommandListDesc_, &ZeCmdList);
-  CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS,
-                              hipErrorInitializationError);
-  return ZeCmdList;
+      auto Status = zeCommandListCreate(ZeCtx_, ZeDev_, &CommandListDesc_,
+                                        &ZeCmdListBatch_);
+      CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS,
+                                  hipErrorInitializationError);
+    }
+    BatchStart_ = std::chrono::steady_clock::now();
+    auto *Monitor = ((CHIPBackendLevel0 *)Backend)->getStaleEventMonitor();
+    if (Monitor)
+      Monitor->watchBatch(this, BatchStart_);
+  }
+  ze_command_list_handle_t CmdList = ZeCmdListBatch_;
+#endif
+
+  CHIPEventLevel0 *CopyEvent;
+  {
+#ifdef L0_IMM_QUEUES
+    // GET_COMMAND_LIST holds QueueMtx but memCopyOnCopyEngine() updates the
+    // flag under CmdListMtx.
+    LOCK(CmdListMtx); // CHIPQueueLevel0::LastOpOnCopyEngine_
+#endif
+    CopyEvent = LastOpOnCopyEngine_ ? getLastEvent() : nullptr;
+    LastOpOnCopyEngine_ = false;
+  }
+  if (CopyEvent) {
+    // The last operation of the stream went to the copy engine, make the
+    // next one wait for it. The join event keeps the copy event alive until
+    // the barrier has passed it.
+    CopyEvent->submitPending();
+    auto *JoinEvent = (CHIPEventLevel0 *)Backend->createCHIPEvent(ChipContext_);
+    JoinEvent->Msg = "copyEngineJoin";
+    ze_event_handle_t CopyEventHandle = CopyEvent->get("copyEngineJoin");
+    JoinEvent->addDependency(CopyEvent);
+    // The application must not call this function from
+    // simultaneous threads with the same command list handle.
+    // Done via GET_COMMAND_LIST
+    auto Status = zeCommandListAppendBarrier(CmdList, JoinEvent->peek(), 1,
+                                             &CopyEventHandle);
+    CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
+    JoinEvent->track();
+  }
+  return CmdList;
+}
+
+bool CHIPQueueLevel0::submitBatch(bool Blocking) {
+#ifndef L0_IMM_QUEUES
+  std::unique_lock<std::mutex> Lock(CmdListMtx, std::defer_lock);
+  if (Blocking)
+    Lock.lock();
+  else if (!Lock.try_lock())
+    return false;
+  submitBatchNoLock();
+#endif
+  return true;
+}
+
+void CHIPQueueLevel0::submitBatchNoLock() {
+  if (!ZeCmdListBatch_)
+    return;
+
+  ze_result_t Status;
+  ze_fence_handle_t Fence;
+  if (FreeFences_.size()) {
+    Fence = FreeFences_.back();
+    FreeFences_.pop_back();
+  } else {
+    ze_fence_desc_t FenceDesc = {ZE_STRUCTURE_TYPE_FENCE_DESC, nullptr, 0};
+    Status = zeFenceCreate(ZeCmdQ_, &FenceDesc, &Fence);
+    CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
+  }
+
+  // The application must not call this function from
+  // simultaneous threads with the same command list handle.
+  // Done via CmdListMtx
+  Status = zeCommandListClose(ZeCmdListBatch_);
+  CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
+  {
+#ifdef DUBIOUS_LOCKS
+    LOCK(Backend->DubiousLockLevel0)
+#endif
+    Status = zeCommandQueueExecuteCommandLists(ZeCmdQ_, 1, &ZeCmdListBatch_,
+                                               Fence);
+    CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
+  }
+  logTrace("Submitted a batch of {} operations on queue {}", BatchSize_,
+           (void *)this);
+
+  SubmittedCmdLists_.emplace_back(ZeCmdListBatch_, Fence);
+  for (auto *Ev : BatchEvents_)
+    Ev->setPendingQueue(nullptr);
+  BatchEvents_.clear();
+  ZeCmdListBatch_ = nullptr;
+  BatchSize_ = 0;
+}
+
+void CHIPQueueLevel0::recycleCmdListsNoLock(bool WaitForCompletion) {
+  // Command lists complete in submission order
+  while (SubmittedCmdLists_.size()) {
+    auto CmdList = SubmittedCmdLists_.front().first;
+    auto Fence = SubmittedCmdLists_.front().second;
+    ze_result_t Status = WaitForCompletion
+                             ? zeFenceHostSynchronize(Fence, UINT64_MAX)
+                             : zeFenceQueryStatus(Fence);
+    if (Status == ZE_RESULT_NOT_READY)
+      break;
+    CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
+    SubmittedCmdLists_.pop_front();
+
+    // The application must not call this function from
+    // simultaneous threads with the same command list handle.
+    // Done via CmdListMtx
+    Status = zeCommandListReset(CmdList);
+    CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
+    Status = zeFenceReset(Fence);
+    CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
+    FreeCmdLists_.push_back(CmdList);
+    FreeFences_.push_back(Fence);
+  }
+}
+
+void CHIPQueueLevel0::releaseCmdLists() {
+  LOCK(CmdListMtx); // CHIPQueueLevel0::FreeCmdLists_
+  recycleCmdListsNoLock(true);
+#ifdef DUBIOUS_LOCKS
+  LOCK(Backend->DubiousLockLevel0)
 #endif
+  for (auto CmdList : FreeCmdLists_)
+    zeCommandListDestroy(CmdList);
+  for (auto Fence : FreeFences_)
+    zeFenceDestroy(Fence);
+  FreeCmdLists_.clear();
+  FreeFences_.clear();
 }
 
 CHIPQueueLevel0::CHIPQueueLevel0(CHIPDeviceLevel0 *ChipDev)
@@ -893,11 +1153,22 @@ CHIPQueueLevel0::CHIPQueueLevel0(CHIPDeviceLevel0 *ChipDev,
 #ifdef DUBIOUS_LOCKS
   LOCK(Backend->DubiousLockLevel0)
 #endif
-  Status = zeCommandQueueCreate(ZeCtx_, ZeDev_, &QueueDescriptor_, &ZeCmdQ_);
-  CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS,
-                              hipErrorInitializationError);
+  auto CreateCmdQ = [&]() {
+    ze_command_queue_handle_t CmdQ;
+    Status = zeCommandQueueCreate(ZeCtx_, ZeDev_, &QueueDescriptor_, &CmdQ);
+    CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS,
+                                hipErrorInitializationError);
+    return CmdQ;
+  };
+  auto &Pool = ChipDev->getQueuePool();
+  if (TheType == Compute && Pool.isEnabled()) {
+    Pooled_ = true;
+    ZeCmdQ_ = (ze_command_queue_handle_t)Pool.acquire(
+        Priority_, [&]() -> void * { return CreateCmdQ(); });
+  } else
+    ZeCmdQ_ = CreateCmdQ();
 
-#ifdef L0_IMM_QUEUEs
+#ifdef L0_IMM_QUEUES
   initializeCmdListImm();
 #endif
 }
@@ -980,13 +1251,27 @@ void CHIPDeviceLevel0::initializeQueueGroupProperties() {
     }
   }
 
+  // Drivers implementing Level Zero 1.9 or newer execute the commands of a
+  // command list created with ZE_COMMAND_LIST_FLAG_IN_ORDER (ZE_BIT(3), not
+  // in the bundled headers yet) in order, without a barrier between them.
+  ze_api_version_t ApiVersion = ZE_API_VERSION_1_0;
+  Status = zeDriverGetApiVersion(((CHIPContextLevel0 *)Ctx_)->ZeDriver,
+                                 &ApiVersion);
+  CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
+  InOrderCmdLists_ = ApiVersion >= ZE_MAKE_VERSION(1, 9);
+  ze_command_list_flags_t CommandListFlags =
+      InOrderCmdLists_ ? ZE_BIT(3) : 0;
+  logTrace("Level Zero API version {}.{}, in-order command lists: {}",
+           ZE_MAJOR_VERSION(ApiVersion), ZE_MINOR_VERSION(ApiVersion),
+           InOrderCmdLists_);
+
   // initialize compute and copy list descriptors
   assert(ComputeQueueGroupOrdinal_ > -1);
   CommandListComputeDesc_ = {
       ZE_STRUCTURE_TYPE_COMMAND_LIST_DESC,
       nullptr,
       (unsigned int)ComputeQueueGroupOrdinal_,
-      0 /* CommandListFlags */,
+      CommandListFlags,
   };
 
   if (CopyQueueAvailable_) {
@@ -995,7 +1280,7 @@ void CHIPDeviceLevel0::initializeQueueGroupProperties() {
         ZE_STRUCTURE_TYPE_COMMAND_LIST_DESC,
         nullptr,
         (unsigned int)CopyQueueGroupOrdinal_,
-        0 /* CommandListFlags */,
+        CommandListFlags,
     };
   }
 }
@@ -1105,7 +1390,7 @@ CHIPEvent *CHIPQueueLevel0::launchImpl(CHIPExecItem *ExecItem) {
   if (StatusReadyCheck != ZE_RESULT_NOT_READY) {
     logCritical("KernelLaunch event immediately ready!");
   }
-  executeCommandList(CommandList);
+  executeCommandList(CommandList, LaunchEvent);
 
   if (std::shared_ptr<CHIPArgSpillBuffer> SpillBuf =
           ExecItem->getArgSpillBuffer())
@@ -1147,7 +1432,7 @@ CHIPEvent *CHIPQueueLevel0::memFillAsyncImpl(void *Dst, size_t Size,
   ze_result_t Status = zeCommandListAppendMemoryFill(
       CommandList, Dst, Pattern, PatternSize, Size, Ev->peek(), 0, nullptr);
   CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
-  executeCommandList(CommandList);
+  executeCommandList(CommandList, Ev);
 
   return Ev;
 };
@@ -1189,7 +1474,7 @@ CHIPEvent *CHIPQueueLevel0::memCopy3DAsyncImpl(void *Dst, size_t Dpitch,
       CommandList, Dst, &DstRegion, Dpitch, Dspitch, Src, &SrcRegion, Spitch,
       Sspitch, Ev->peek(), 0, nullptr);
   CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
-  executeCommandList(CommandList);
+  executeCommandList(CommandList, Ev);
 
   return Ev;
 };
@@ -1212,7 +1497,7 @@ CHIPEvent *CHIPQueueLevel0::memCopyToImage(ze_image_handle_t Image,
         CommandList, Image, Src, 0,
         Ev->get("zeCommandListAppendImageCopyFromMemory"), 0, nullptr);
     CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
-    executeCommandList(CommandList);
+    executeCommandList(CommandList, Ev);
 
     return Ev;
   }
@@ -1240,7 +1525,7 @@ CHIPEvent *CHIPQueueLevel0::memCopyToImage(ze_image_handle_t Image,
         LastRow ? Ev->get("zeCommandListAppendImageCopyFromMemory") : nullptr,
         0, nullptr);
     CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
-    executeCommandList(CommandList);
+    executeCommandList(CommandList, LastRow ? Ev : nullptr);
     SrcRow += SrcRegion.Pitch[0];
   }
   return Ev;
@@ -1285,7 +1570,7 @@ CHIPEvent *CHIPQueueLevel0::enqueueMarkerImpl() {
       CommandList,
       MarkerEvent->get("MarkerEvent: zeCommandListAppendSignalEvent"));
   CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
-  executeCommandList(CommandList);
+  executeCommandList(CommandList, MarkerEvent);
 
   return MarkerEvent;
 }
@@ -1312,28 +1597,100 @@ CHIPQueueLevel0::enqueueBarrierImpl(std::vector<CHIPEvent *> *EventsToWaitFor) {
       CHIPASSERT(ChipEventLz);
       EventHandles[i] = ChipEventLz->get("enqueueBarrierImpl addDependency");
       EventToSignal->addDependency(ChipEventLz);
+      // An event in another queue's unsubmitted batch would never signal.
+      // Events in this queue's batch precede the barrier in the same list.
+      if (ChipEventLz->getPendingQueue() != this)
+        ChipEventLz->submitPending();
     }
   } // done gather Event_ handles to wait on
 
-  // TODO Should this be memory or compute?
+  {
+    // TODO Should this be memory or compute?
+    GET_COMMAND_LIST(this)
+    // The application must not call this function from
+    // simultaneous threads with the same command list handle.
+    // Done via GET_COMMAND_LIST
+    auto Status = zeCommandListAppendBarrier(CommandList, SignalEventHandle,
+                                             NumEventsToWaitFor, EventHandles);
+    CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
+    executeCommandList(CommandList, EventToSignal);
+  }
+
+  if (EventHandles)
+    delete[] EventHandles;
+
+  return EventToSignal;
+}
+
+CHIPEvent *CHIPQueueLevel0::memPrefetchImpl(const void *Ptr, size_t Count,
+                                            bool ToHost) {
+  CHIPEventLevel0 *PrefetchEvent =
+      (CHIPEventLevel0 *)Backend->createCHIPEvent(ChipContext_);
+  PrefetchEvent->Msg = "memPrefetch";
+
   GET_COMMAND_LIST(this)
   // The application must not call this function from
   // simultaneous threads with the same command list handle.
   // Done via GET_COMMAND_LIST
-  auto Status = zeCommandListAppendBarrier(CommandList, SignalEventHandle,
-                                           NumEventsToWaitFor, EventHandles);
+  // Level Zero only migrates shared memory towards the device. Shared memory
+  // migrates back on the host access, so a prefetch to the host only orders
+  // the stream.
+  if (!ToHost) {
+    auto Status = zeCommandListAppendMemoryPrefetch(CommandList, Ptr, Count);
+    CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
+  }
+  auto Status = zeCommandListAppendBarrier(
+      CommandList, PrefetchEvent->peek(), 0, nullptr);
   CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
-  executeCommandList(CommandList);
+  executeCommandList(CommandList, PrefetchEvent);
 
-  if (EventHandles)
-    delete[] EventHandles;
+  return PrefetchEvent;
+}
 
-  return EventToSignal;
+void CHIPQueueLevel0::memAdvise(const void *Ptr, size_t Count,
+                                hipMemoryAdvise Advice, int DstDevId) {
+  ze_memory_advice_t ZeAdvice;
+  switch (Advice) {
+  case hipMemAdviseSetReadMostly:
+    ZeAdvice = ZE_MEMORY_ADVICE_SET_READ_MOSTLY;
+    break;
+  case hipMemAdviseUnsetReadMostly:
+    ZeAdvice = ZE_MEMORY_ADVICE_CLEAR_READ_MOSTLY;
+    break;
+  case hipMemAdviseSetPreferredLocation:
+    // There is no advice for preferring system memory.
+    ZeAdvice = DstDevId == hipCpuDeviceId
+                   ? ZE_MEMORY_ADVICE_CLEAR_PREFERRED_LOCATION
+                   : ZE_MEMORY_ADVICE_SET_PREFERRED_LOCATION;
+    break;
+  case hipMemAdviseUnsetPreferredLocation:
+    ZeAdvice = ZE_MEMORY_ADVICE_CLEAR_PREFERRED_LOCATION;
+    break;
+  default:
+    // Accessed-by has no Level Zero counterpart: every device of the
+    // context can access shared memory.
+    return;
+  }
+
+  GET_COMMAND_LIST(this)
+  // The application must not call this function from
+  // simultaneous threads with the same command list handle.
+  // Done via GET_COMMAND_LIST
+  auto Status =
+      zeCommandListAppendMemAdvise(CommandList, ZeDev_, Ptr, Count, ZeAdvice);
+  CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
+  executeCommandList(CommandList);
 }
 
 CHIPEvent *CHIPQueueLevel0::memCopyAsyncImpl(void *Dst, const void *Src,
                                              size_t Size) {
   logTrace("CHIPQueueLevel0::memCopyAsync");
+  size_t CopyEngineThreshold = getCopyEngineThreshold();
+  if (QueueType == Compute && CopyEngineThreshold &&
+      Size >= CopyEngineThreshold &&
+      ((CHIPDeviceLevel0 *)ChipDevice_)->copyQueueIsAvailable())
+    return memCopyOnCopyEngine(Dst, Src, Size);
+
   CHIPContextLevel0 *ChipCtxZe = (CHIPContextLevel0 *)ChipContext_;
   CHIPEventLevel0 *MemCopyEvent =
       (CHIPEventLevel0 *)Backend->createCHIPEvent(ChipCtxZe);
@@ -1348,65 +1705,108 @@ CHIPEvent *CHIPQueueLevel0::memCopyAsyncImpl(void *Dst, const void *Src,
                                          MemCopyEvent->peek(), 0, nullptr);
   CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS,
                               hipErrorInitializationError);
-  executeCommandList(CommandList);
+  executeCommandList(CommandList, MemCopyEvent);
+
+  return MemCopyEvent;
+}
+
+CHIPEvent *CHIPQueueLevel0::memCopyOnCopyEngine(void *Dst, const void *Src,
+                                                size_t Size) {
+  logTrace("CHIPQueueLevel0::memCopyOnCopyEngine");
+  CHIPContextLevel0 *ChipCtxZe = (CHIPContextLevel0 *)ChipContext_;
+  CHIPEventLevel0 *MemCopyEvent =
+      (CHIPEventLevel0 *)Backend->createCHIPEvent(ChipCtxZe);
+  MemCopyEvent->Msg = "memCopyOnCopyEngine";
+
+  LOCK(CmdListMtx); // CHIPQueueLevel0::CopyQueue_, LastOpOnCopyEngine_
+  if (!CopyQueue_)
+    CopyQueue_ = new CHIPQueueLevel0((CHIPDeviceLevel0 *)ChipDevice_,
+                                     QueueFlags_, Priority_, Copy);
+
+  // Order the copy after the preceding compute engine work of the stream.
+  CHIPEventLevel0 *Dep = LastOpOnCopyEngine_ ? nullptr : getLastEvent();
+  ze_event_handle_t DepHandle = nullptr;
+  if (Dep) {
+    if (Dep->getPendingQueue() == this)
+      submitBatchNoLock();
+    DepHandle = Dep->get("memCopyOnCopyEngine");
+    MemCopyEvent->addDependency(Dep);
+  }
+
+  {
+    GET_COMMAND_LIST(CopyQueue_)
+    // The application must not call this function from simultaneous threads
+    // with the same command list handle
+    // Done via GET_COMMAND_LIST
+    auto Status = zeCommandListAppendMemoryCopy(
+        CommandList, Dst, Src, Size, MemCopyEvent->peek(), Dep ? 1 : 0,
+        Dep ? &DepHandle : nullptr);
+    CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
+    CopyQueue_->executeCommandList(CommandList, MemCopyEvent);
+  }
+  LastOpOnCopyEngine_ = true;
 
   return MemCopyEvent;
 }
 
 void CHIPQueueLevel0::finish() {
-  // The finish Event_ that denotes the finish of current command list items
-  pthread_yield();
+  CHIPQueueLevel0 *CopyQueue;
+  {
+    LOCK(CmdListMtx); // CHIPQueueLevel0::CopyQueue_
+    CopyQueue = CopyQueue_;
+  }
+  if (CopyQueue)
+    CopyQueue->finish();
+
+  submitBatch();
   // Using zeCommandQueueSynchronize() for ensuring the device printf
   // buffers get flushed.
+  auto Synchronize = [&](uint64_t TimeoutNs) {
 #ifdef DUBIOUS_LOCKS
-  LOCK(Backend->DubiousLockLevel0)
+    LOCK(Backend->DubiousLockLevel0)
 #endif
-  zeCommandQueueSynchronize(ZeCmdQ_, UINT64_MAX);
+    ze_result_t Status = zeCommandQueueSynchronize(ZeCmdQ_, TimeoutNs);
+    if (Status == ZE_RESULT_NOT_READY)
+      return false;
+    CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
+    return true;
+  };
+  ChipDevice_->getSyncPolicy().wait([&]() { return Synchronize(0); },
+                                    [&]() { Synchronize(UINT64_MAX); });
 
+#ifndef L0_IMM_QUEUES
+  LOCK(CmdListMtx); // CHIPQueueLevel0::SubmittedCmdLists_
+  recycleCmdListsNoLock();
+#endif
   return;
 }
 
-void CHIPQueueLevel0::executeCommandList(ze_command_list_handle_t CommandList) {
+void CHIPQueueLevel0::executeCommandList(ze_command_list_handle_t CommandList,
+                                         CHIPEventLevel0 *SignalEvent) {
 #ifdef L0_IMM_QUEUES
 #else
+  assert(CommandList == ZeCmdListBatch_ && "Not the open command list batch");
 
-  auto LastCmdListEvent =
-      ((CHIPBackendLevel0 *)Backend)->createCHIPEvent(ChipContext_);
-  LastCmdListEvent->Msg = "CmdListFinishTracker";
-
-  ze_result_t Status;
-
-  {
-    LOCK( // CHIPBackendLevel0::EventCommandListMap
-        ((CHIPBackendLevel0 *)Backend)->CommandListsMtx);
-
-    // Associate this event with the command list. Once the events are signaled,
-    // CHIPEventMonitorLevel0 will destroy the command list
-
-    logTrace("assoc event {} w/ cmdlist", (void *)LastCmdListEvent);
-    ((CHIPBackendLevel0 *)Backend)
-        ->EventCommandListMap[(CHIPEventLevel0 *)LastCmdListEvent] =
-        CommandList;
-    // The application must not call this function from
-    // simultaneous threads with the same command list handle.
-    // Done via GET_COMMAND_LIST
-    Status = zeCommandListAppendBarrier(CommandList, LastCmdListEvent->peek(),
-                                        0, nullptr);
-    CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
+  // Keep the stream order between the operations of the batch. In-order
+  // command lists do that without a barrier.
+  if (!((CHIPDeviceLevel0 *)ChipDevice_)->hasInOrderCmdLists()) {
     // The application must not call this function from
     // simultaneous threads with the same command list handle.
     // Done via GET_COMMAND_LIST
-    Status = zeCommandListClose(CommandList);
-    CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
-#ifdef DUBIOUS_LOCKS
-    LOCK(Backend->DubiousLockLevel0)
-#endif
-    Status =
-        zeCommandQueueExecuteCommandLists(ZeCmdQ_, 1, &CommandList, nullptr);
+    auto Status =
+        zeCommandListAppendBarrier(CommandList, nullptr, 0, nullptr);
     CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
   }
 
-  LastCmdListEvent->track();
+  if (SignalEvent) {
+    SignalEvent->setPendingQueue(this);
+    BatchEvents_.push_back(SignalEvent);
+  }
+
+  // Batches which do not fill up are submitted by the stale event monitor
+  // once they get older than the time threshold.
+  if (++BatchSize_ >= getBatchSizeThreshold())
+    submitBatchNoLock();
 #endif
 };
 
@@ -1521,8 +1921,11 @@ void CHIPBackendLevel0::uninitialize() {
 
   if (CallbackEventMonitor_) {
     logTrace("CHIPBackend::uninitialize(): Killing CallbackEventMonitor");
-    LOCK(CallbackEventMonitor_->EventMonitorMtx); // CHIPEventMonitor::Stop
-    CallbackEventMonitor_->Stop = true;
+    {
+      LOCK(CallbackEventMonitor_->EventMonitorMtx); // CHIPEventMonitor::Stop
+      CallbackEventMonitor_->Stop = true;
+    }
+    getCallbackEventMonitor()->wake();
   }
   CallbackEventMonitor_->join();
 
@@ -1547,8 +1950,6 @@ void CHIPBackendLevel0::uninitialize() {
         assert(E->isFinished() && "Uncollected non-user events!");
       }
     }
-    logTrace("Remaining {} command lists that haven't been collected:",
-             ((CHIPBackendLevel0 *)Backend)->EventCommandListMap.size());
   }
   return;
 }
@@ -1696,6 +2097,58 @@ void CHIPContextLevel0::freeImpl(void *Ptr) {
   zeMemFree(this->ZeCtx, Ptr);
 }
 
+// Intel extension for importing memory allocated outside of Level Zero.
+typedef ze_result_t (*zexDriverImportExternalPointer_fn)(
+    ze_driver_handle_t hDriver, void *Ptr, size_t Size);
+typedef ze_result_t (*zexDriverReleaseImportedPointer_fn)(
+    ze_driver_handle_t hDriver, void *Ptr);
+
+bool CHIPContextLevel0::registerHostMemory(void *HostPtr, size_t Size) {
+  // Devices with shared system allocation support can access any host memory.
+  ze_device_memory_access_properties_t AccessProps = {
+      ZE_STRUCTURE_TYPE_DEVICE_MEMORY_ACCESS_PROPERTIES, nullptr};
+  auto Status = zeDeviceGetMemoryAccessProperties(
+      ((CHIPDeviceLevel0 *)ChipDevice_)->get(), &AccessProps);
+  CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
+  if (AccessProps.sharedSystemAllocCapabilities &
+      ZE_MEMORY_ACCESS_CAP_FLAG_RW) {
+    logDebug("Using host memory {} as a shared system allocation", HostPtr);
+    return true;
+  }
+
+  zexDriverImportExternalPointer_fn ImportFn = nullptr;
+  Status = zeDriverGetExtensionFunctionAddress(
+      ZeDriver, "zexDriverImportExternalPointer", (void **)&ImportFn);
+  if (Status != ZE_RESULT_SUCCESS || !ImportFn)
+    return false;
+
+  LOCK(ContextMtx); // CHIPContextLevel0::ImportedHostPtrs_
+  Status = ImportFn(ZeDriver, HostPtr, Size);
+  if (Status != ZE_RESULT_SUCCESS) {
+    logDebug("zexDriverImportExternalPointer failed for {}: {}", HostPtr,
+             resultToString(Status));
+    return false;
+  }
+  ImportedHostPtrs_.insert(HostPtr);
+  return true;
+}
+
+void CHIPContextLevel0::unregisterHostMemory(void *HostPtr) {
+  LOCK(ContextMtx); // CHIPContextLevel0::ImportedHostPtrs_
+  if (!ImportedHostPtrs_.erase(HostPtr))
+    return; // A shared system allocation, nothing to release.
+
+  zexDriverReleaseImportedPointer_fn ReleaseFn = nullptr;
+  auto Status = zeDriverGetExtensionFunctionAddress(
+      ZeDriver, "zexDriverReleaseImportedPointer", (void **)&ReleaseFn);
+  if (Status != ZE_RESULT_SUCCESS || !ReleaseFn) {
+    logWarn("zexDriverReleaseImportedPointer is not available");
+    return;
+  }
+  Status = ReleaseFn(ZeDriver, HostPtr);
+  CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS, hipErrorTbd);
+}
+
 CHIPContextLevel0::~CHIPContextLevel0() {
   logTrace("~CHIPContextLevel0() {}", (void *)this);
   // The application must not call this function from
@@ -1778,6 +2231,8 @@ CHIPDeviceLevel0::CHIPDeviceLevel0(ze_device_handle_t ZeDev,
       ZeDeviceProps_() {
   initializeQueueGroupProperties();
   ZeDeviceProps_.pNext = nullptr;
+  // Host USM allocations are always accessible by both sides.
+  MemoryProfile_.HostAllocsCoherent = true;
   assert(Ctx_ != nullptr);
 }
 
@@ -1802,12 +2257,14 @@ void CHIPDeviceLevel0::populateDevicePropertiesImpl() {
   DeviceMemProps.pNext = nullptr;
   ze_device_compute_properties_t DeviceComputeProps;
   DeviceComputeProps.pNext = nullptr;
-  DeviceMemProps.stype = ZE_STRUCTURE_TYPE_DEVICE_COMPUTE_PROPERTIES;
+  DeviceComputeProps.stype = ZE_STRUCTURE_TYPE_DEVICE_COMPUTE_PROPERTIES;
   ze_device_cache_properties_t DeviceCacheProps;
   DeviceCacheProps.pNext = nullptr;
-  DeviceMemProps.stype = ZE_STRUCTURE_TYPE_DEVICE_CACHE_PROPERTIES;
+  DeviceCacheProps.stype = ZE_STRUCTURE_TYPE_DEVICE_CACHE_PROPERTIES;
+  ze_float_atomic_ext_properties_t FloatAtomicProps = {};
+  FloatAtomicProps.stype = ZE_STRUCTURE_TYPE_FLOAT_ATOMIC_EXT_PROPERTIES;
   ze_device_module_properties_t DeviceModuleProps;
-  DeviceModuleProps.pNext = nullptr;
+  DeviceModuleProps.pNext = &FloatAtomicProps;
   DeviceModuleProps.stype = ZE_STRUCTURE_TYPE_DEVICE_MODULE_PROPERTIES;
   ze_device_image_properties_t DeviceImageProps;
   DeviceImageProps.pNext = nullptr;
@@ -1869,9 +2326,11 @@ void CHIPDeviceLevel0::populateDevicePropertiesImpl() {
       1000 * ZeDeviceProps_.coreClockRate; // deviceMemoryProps.maxClockRate;
   // Dev.getInfo<CL_DEVICE_MAX_CLOCK_FREQUENCY>();
 
+  // A subslice is the unit running work-groups, like a multiprocessor does
+  // thread blocks. The thread and shared memory limits below are per
+  // subslice as well.
   HipDeviceProps_.multiProcessorCount =
-      ZeDeviceProps_.numEUsPerSubslice * ZeDeviceProps_.numSubslicesPerSlice *
-      ZeDeviceProps_.numSlices; // DeviceComputeProps.maxTotalGroupSize;
+      ZeDeviceProps_.numSubslicesPerSlice * ZeDeviceProps_.numSlices;
   //??? Dev.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
   HipDeviceProps_.l2CacheSize = DeviceCacheProps.cacheSize;
   // Dev.getInfo<CL_DEVICE_GLOBAL_MEM_CACHE_SIZE>();
@@ -1913,8 +2372,13 @@ void CHIPDeviceLevel0::populateDevicePropertiesImpl() {
   HipDeviceProps_.major = 2;
   HipDeviceProps_.minor = 0;
 
-  HipDeviceProps_.maxThreadsPerMultiProcessor =
-      ZeDeviceProps_.numEUsPerSubslice * ZeDeviceProps_.numThreadsPerEU; //  10;
+  // Work-items, not hardware threads: each hardware thread runs at least
+  // physicalEUSimdWidth work-items of a work-group. Kernels compiled for a
+  // wider SIMD run more, so a subslice always fits the largest work-group.
+  HipDeviceProps_.maxThreadsPerMultiProcessor = std::max<int>(
+      ZeDeviceProps_.numEUsPerSubslice * ZeDeviceProps_.numThreadsPerEU *
+          ZeDeviceProps_.physicalEUSimdWidth,
+      HipDeviceProps_.maxThreadsPerBlock);
 
   HipDeviceProps_.computeMode = hipComputeModeDefault;
   HipDeviceProps_.arch = {};
@@ -1930,6 +2394,36 @@ void CHIPDeviceLevel0::populateDevicePropertiesImpl() {
   HipDeviceProps_.arch.hasDoubles =
       (DeviceModuleProps.flags & ZE_DEVICE_MODULE_FLAG_FP64) ? 1 : 0;
 
+  // Native floating-point atomic adds, used by the device libraries linked
+  // at runtime.
+  auto HasAtomicAdd = [](ze_device_fp_atomic_ext_flags_t Flags) {
+    auto Add = ZE_DEVICE_FP_ATOMIC_EXT_FLAG_GLOBAL_ADD |
+               ZE_DEVICE_FP_ATOMIC_EXT_FLAG_LOCAL_ADD;
+    return (Flags & Add) == Add;
+  };
+  if (HasAtomicAdd(FloatAtomicProps.fp32Flags))
+    Features_.insert(CHIPDeviceFeature::FloatAtomicAdd);
+  if (HasAtomicAdd(FloatAtomicProps.fp64Flags))
+    Features_.insert(CHIPDeviceFeature::DoubleAtomicAdd);
+  // The SPIR-V consumed by Level Zero drivers always supports the subgroup
+  // collectives (the Groups capability).
+  Features_.insert(CHIPDeviceFeature::SubgroupCollectives);
+
+  // Linking the native device libraries needs the program extension.
+  uint32_t NumExtensions = 0;
+  auto ZeDriver = ((CHIPContextLevel0 *)Ctx_)->ZeDriver;
+  Status = zeDriverGetExtensionProperties(ZeDriver, &NumExtensions, nullptr);
+  CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS,
+                              hipErrorInitializationError);
+  std::vector<ze_driver_extension_properties_t> Extensions(NumExtensions);
+  Status = zeDriverGetExtensionProperties(ZeDriver, &NumExtensions,
+                                          Extensions.data());
+  CHIPERR_CHECK_LOG_AND_THROW(Status, ZE_RESULT_SUCCESS,
+                              hipErrorInitializationError);
+  for (const auto &Extension : Extensions)
+    if (std::string_view(Extension.name) == ZE_MODULE_PROGRAM_EXP_NAME)
+      Features_.insert(CHIPDeviceFeature::ProgramLinking);
+
   HipDeviceProps_.clockInstructionRate = ZeDeviceProps_.coreClockRate;
   HipDeviceProps_.concurrentKernels = 1;
   HipDeviceProps_.pciDomainID = 0;
@@ -1957,10 +2451,14 @@ void CHIPDeviceLevel0::populateDevicePropertiesImpl() {
   HipDeviceProps_.maxTexture3D[1] = MaxDim1;
   HipDeviceProps_.maxTexture3D[2] = MaxDim2;
 
-  // Level0 does not have alignment requirements for images that
-  // clients should follow.
-  HipDeviceProps_.textureAlignment = 1;
-  HipDeviceProps_.texturePitchAlignment = 1;
+  // Level0 has no alignment requirements for images that clients should
+  // follow and the images are not backed by pitched allocations. The rows
+  // of the pitched allocations are aligned to the width of the memory bus,
+  // but at least to two 64-byte cache lines.
+  size_t PitchAlignment = std::max<size_t>(
+      128, roundUpToPowerOfTwo(DeviceMemProps.maxBusWidth / 8));
+  HipDeviceProps_.textureAlignment = PitchAlignment;
+  HipDeviceProps_.texturePitchAlignment = PitchAlignment;
 
   // Level0 devices support basic CUDA managed memory via USM,
   // but some of the functions such as prefetch and advice are unimplemented
@@ -1973,15 +2471,13 @@ void CHIPDeviceLevel0::populateDevicePropertiesImpl() {
   HipDeviceProps_.pageableMemoryAccess = 0;
   HipDeviceProps_.pageableMemoryAccessUsesHostPageTables = 0;
 
-  HipDeviceProps_.cooperativeLaunch = 0;
+  HipDeviceProps_.cooperativeLaunch = 1;
   HipDeviceProps_.cooperativeMultiDeviceLaunch = 0;
   HipDeviceProps_.cooperativeMultiDeviceUnmatchedFunc = 0;
   HipDeviceProps_.cooperativeMultiDeviceUnmatchedGridDim = 0;
   HipDeviceProps_.cooperativeMultiDeviceUnmatchedBlockDim = 0;
   HipDeviceProps_.cooperativeMultiDeviceUnmatchedSharedMem = 0;
   HipDeviceProps_.memPitch = 1;
-  HipDeviceProps_.textureAlignment = 1;
-  HipDeviceProps_.texturePitchAlignment = 1;
   HipDeviceProps_.kernelExecTimeoutEnabled = 0;
   HipDeviceProps_.ECCEnabled = 0;
   HipDeviceProps_.asicRevision = 1;
@@ -2204,16 +2700,58 @@ void CHIPModuleLevel0::compile(CHIPDevice *ChipDev) {
 
   ze_result_t Status;
 
+  // Identical SPIR-V has been compiled for the device before: build the
+  // module from its native binary instead of JIT compiling it again.
+  NativeBinary_ = ChipDev->getNativeBinary(Src_->getBinary());
+
+  // Link the native device libraries the device supports by building them
+  // into the same module, which then imports their functions.
+  std::string LinkedIL;
+  std::vector<std::string_view> DevLibs;
+  if (!NativeBinary_)
+    DevLibs = getRtDevLibBinaries(ChipDev, LinkedIL);
+  const uint8_t *IL = FuncIL_;
+  size_t ILSize = IlSize_;
+  if (!DevLibs.empty()) {
+    IL = reinterpret_cast<const uint8_t *>(LinkedIL.data());
+    ILSize = LinkedIL.size();
+  }
+
   // Create module with global address aware
   std::string CompilerOptions = Backend->getJitFlags();
   ze_module_desc_t ModuleDesc = {ZE_STRUCTURE_TYPE_MODULE_DESC,
                                  nullptr,
                                  ZE_MODULE_FORMAT_IL_SPIRV,
-                                 IlSize_,
-                                 FuncIL_,
+                                 ILSize,
+                                 IL,
                                  CompilerOptions.c_str(),
                                  nullptr};
 
+  std::vector<size_t> InputSizes{ILSize};
+  std::vector<const uint8_t *> Inputs{IL};
+  for (auto DevLib : DevLibs) {
+    InputSizes.push_back(DevLib.size());
+    Inputs.push_back(reinterpret_cast<const uint8_t *>(DevLib.data()));
+  }
+  std::vector<const char *> BuildFlags(Inputs.size(), CompilerOptions.c_str());
+  ze_module_program_exp_desc_t ProgramDesc = {
+      ZE_STRUCTURE_TYPE_MODULE_PROGRAM_EXP_DESC,
+      nullptr,
+      static_cast<uint32_t>(Inputs.size()),
+      InputSizes.data(),
+      Inputs.data(),
+      BuildFlags.data(),
+      nullptr};
+  if (Inputs.size() > 1)
+    ModuleDesc.pNext = &ProgramDesc;
+  if (NativeBinary_) {
+    logTrace("Reusing the native binary of an identical module");
+    ModuleDesc.format = ZE_MODULE_FORMAT_NATIVE;
+    ModuleDesc.inputSize = NativeBinary_->size();
+    ModuleDesc.pInputModule =
+        reinterpret_cast<const uint8_t *>(NativeBinary_->data());
+  }
+
   CHIPContextLevel0 *ChipCtxLz = (CHIPContextLevel0 *)(ChipDev->getContext());
   CHIPDeviceLevel0 *LzDev = (CHIPDeviceLevel0 *)ChipDev;
 
@@ -2240,6 +2778,19 @@ void CHIPModuleLevel0::compile(CHIPDevice *ChipDev) {
   CHIPERR_CHECK_LOG_AND_THROW(BuildStatus, ZE_RESULT_SUCCESS, hipErrorTbd);
   logTrace("LZ CREATE MODULE via calling zeModuleCreate {} ",
            resultToString(BuildStatus));
+
+  if (!NativeBinary_) {
+    size_t BinarySize = 0;
+    Status = zeModuleGetNativeBinary(ZeModule_, &BinarySize, nullptr);
+    if (Status == ZE_RESULT_SUCCESS && BinarySize) {
+      std::string Binary(BinarySize, '\0');
+      Status = zeModuleGetNativeBinary(
+          ZeModule_, &BinarySize, reinterpret_cast<uint8_t *>(Binary.data()));
+      if (Status == ZE_RESULT_SUCCESS)
+        NativeBinary_ =
+            ChipDev->addNativeBinary(Src_->getBinary(), std::move(Binary));
+    }
+  }
   // if (Status == ZE_RESULT_ERROR_MODULE_BUILD_FAILURE) {
   //  CHIPERR_LOG_AND_THROW("Module failed to JIT: " + std::string(log_str),
   //                        hipErrorUnknown);
@@ -31,6 +31,8 @@
 #include "../include/ze_api.h"
 #include "../src/common.hh"
 
+#include <chrono>
+
 std::string resultToString(ze_result_t Status);
 
 // fw declares
@@ -91,6 +93,9 @@ private:
 
   std::vector<ActionFn> Actions_;
 
+  // Queue whose not yet submitted command list batch signals this event
+  CHIPQueueLevel0 *PendingQueue_ = nullptr;
+
 public:
   uint32_t getValidTimestampBits();
   uint64_t getHostTimestamp() { return HostTimestamp_; }
@@ -109,6 +114,12 @@ public:
 
   virtual bool wait() override;
 
+  /**
+   * @brief Wait for at most TimeoutNs nanoseconds.
+   * @return true if the event has completed
+   */
+  bool waitFor(uint64_t TimeoutNs);
+
   virtual bool updateFinishStatus(bool ThrowErrorIfNotReady = true) override;
 
   unsigned long getFinishTime();
@@ -119,6 +130,28 @@ public:
 
   void reset();
 
+  /**
+   * @brief Remember the queue holding the unsubmitted command list which
+   * signals this event. nullptr is set once the command list is submitted.
+   */
+  void setPendingQueue(CHIPQueueLevel0 *Q) {
+    LOCK(EventMtx); // CHIPEventLevel0::PendingQueue_
+    PendingQueue_ = Q;
+  }
+
+  CHIPQueueLevel0 *getPendingQueue() {
+    LOCK(EventMtx); // CHIPEventLevel0::PendingQueue_
+    return PendingQueue_;
+  }
+
+  /**
+   * @brief Submit the command list batch which signals this event, if any.
+   *
+   * @param Blocking if false, the submission is skipped when the owning queue
+   * is being appended to by another thread at the moment.
+   */
+  void submitPending(bool Blocking = true);
+
   ze_event_handle_t peek();
   ze_event_handle_t get(std::string Msg);
 
@@ -136,36 +169,58 @@ public:
 };
 
 class CHIPCallbackDataLevel0 : public CHIPCallbackData {
-private:
-  // ze_event_pool_handle_t ZeEventPool_;
-
 public:
-  std::mutex CallbackDataMtx;
   CHIPCallbackDataLevel0(hipStreamCallback_t CallbackF, void *CallbackArgs,
                          CHIPQueue *ChipQueue);
 
-  virtual ~CHIPCallbackDataLevel0() override {
-    delete GpuReady;
-    delete CpuCallbackComplete;
-    delete GpuAck;
-  }
+  virtual void enqueue() override;
+  virtual void complete() override;
 };
 
+/**
+ * @brief Hands stream callbacks to the CHIPCallbackExecutor once their
+ * GpuReady event has completed.
+ */
 class CHIPCallbackEventMonitorLevel0 : public CHIPEventMonitor {
+  std::condition_variable WatchCv_;
+  /// Callbacks waiting for their GpuReady event
+  std::vector<CHIPCallbackDataLevel0 *> Watched_;
+
 public:
   ~CHIPCallbackEventMonitorLevel0() {
     logTrace("CHIPCallbackEventMonitorLevel0 DEST");
     join();
   };
+  void watch(CHIPCallbackDataLevel0 *Cb);
+  /// Wake the monitor up after setting Stop.
+  void wake() { WatchCv_.notify_all(); }
   virtual void monitor() override;
 };
 
+/**
+ * @brief Releases the events which have completed and submits the command
+ * list batches which have been open for longer than CHIP_L0_BATCH_TIMEOUT_US.
+ */
 class CHIPStaleEventMonitorLevel0 : public CHIPEventMonitor {
+  std::mutex BatchMtx_;
+  std::condition_variable BatchCv_;
+  /// Queues with an open command list batch and the time it was opened
+  std::unordered_map<CHIPQueueLevel0 *, std::chrono::steady_clock::time_point>
+      OpenBatches_;
+
+  /// Wait for Period, submitting the batches getting stale meanwhile.
+  void submitStaleBatches(std::chrono::steady_clock::duration Period);
+
 public:
   ~CHIPStaleEventMonitorLevel0() {
     logTrace("CHIPStaleEventMonitorLevel0 DEST");
     join();
   };
+  /// Submit the batch opened on Queue at Start once it gets stale.
+  void watchBatch(CHIPQueueLevel0 *Queue,
+                  std::chrono::steady_clock::time_point Start);
+  /// Stop watching Queue, which is being destroyed.
+  void forgetBatch(CHIPQueueLevel0 *Queue);
   virtual void monitor() override;
 };
 
@@ -219,11 +274,61 @@ protected:
   ze_command_list_desc_t CommandListDesc_;
   ze_command_queue_handle_t ZeCmdQ_;
   ze_command_list_handle_t ZeCmdList_;
+  // Set if ZeCmdQ_ is returned to CHIPQueuePool on destruction
+  bool Pooled_ = false;
+
+  /**
+   * Without L0_IMM_QUEUES consecutive operations are appended into one open
+   * command list (the batch) which is submitted on synchronization, when a
+   * host needs one of its events or when the batch grows too large or old.
+   */
+  ze_command_list_handle_t ZeCmdListBatch_ = nullptr;
+  size_t BatchSize_ = 0;
+  std::chrono::steady_clock::time_point BatchStart_;
+  std::vector<CHIPEventLevel0 *> BatchEvents_;
+
+  // Submitted command lists and the fences signaled on their completion
+  std::deque<std::pair<ze_command_list_handle_t, ze_fence_handle_t>>
+      SubmittedCmdLists_;
+  // Completed command lists (reset) and fences ready for reuse
+  std::vector<ze_command_list_handle_t> FreeCmdLists_;
+  std::vector<ze_fence_handle_t> FreeFences_;
+
+  // Companion queue on the copy engine which executes the bulk transfers of
+  // this stream. Created on first use.
+  CHIPQueueLevel0 *CopyQueue_ = nullptr;
+  // Whether the last operation of the stream went to CopyQueue_
+  bool LastOpOnCopyEngine_ = false;
 
   void initializeCmdListImm();
 
+  /// Enqueue a copy on the copy engine, ordered after the preceding
+  /// operations of the stream.
+  CHIPEvent *memCopyOnCopyEngine(void *Dst, const void *Src, size_t Size);
+
+  /// Close and submit the open command list batch. CmdListMtx must be held.
+  void submitBatchNoLock();
+
+  /// Move completed command lists back into the pool. CmdListMtx must be held.
+  void recycleCmdListsNoLock(bool WaitForCompletion = false);
+
+  /// Destroy all pooled command lists and fences.
+  void releaseCmdLists();
+
 public:
+  /// Guards the command list batch and the command list pool
+  std::mutex CmdListMtx;
+
   ze_command_list_handle_t getCmdList();
+
+  /**
+   * @brief Submit the open command list batch, if any.
+   *
+   * @param Blocking if false, return without submitting when another thread
+   * holds CmdListMtx.
+   * @return false if the batch was not submitted because CmdListMtx was held.
+   */
+  bool submitBatch(bool Blocking = true);
   size_t getMaxMemoryFillPatternSize() {
     return QueueProperties_.maxMemoryFillPatternSize;
   }
@@ -238,9 +343,6 @@ public:
   CHIPQueueLevel0(CHIPDeviceLevel0 *ChipDev, ze_command_queue_handle_t ZeQue);
   virtual ~CHIPQueueLevel0() override;
 
-  virtual void addCallback(hipStreamCallback_t Callback,
-                           void *UserData) override;
-
   virtual CHIPEventLevel0 *getLastEvent() override;
 
   virtual CHIPEvent *launchImpl(CHIPExecItem *ExecItem) override;
@@ -253,9 +355,14 @@ public:
   /**
    * @brief Execute a given command list
    *
+   * Without L0_IMM_QUEUES the command list is the open batch returned by
+   * getCmdList() and it is submitted only once a batch threshold is reached.
+   *
    * @param CommandList a handle to either a compute or copy command list
+   * @param SignalEvent the event signaled by the appended command, if any
    */
-  void executeCommandList(ze_command_list_handle_t CommandList);
+  void executeCommandList(ze_command_list_handle_t CommandList,
+                          CHIPEventLevel0 *SignalEvent = nullptr);
 
   ze_command_queue_handle_t getCmdQueue() { return ZeCmdQ_; }
   void *getSharedBufffer() { return SharedBuf_; };
@@ -286,9 +393,11 @@ public:
   virtual CHIPEvent *
   enqueueBarrierImpl(std::vector<CHIPEvent *> *EventsToWaitFor) override;
 
-  virtual CHIPEvent *memPrefetchImpl(const void *Ptr, size_t Count) override {
-    UNIMPLEMENTED(nullptr);
-  }
+  virtual CHIPEvent *memPrefetchImpl(const void *Ptr, size_t Count,
+                                     bool ToHost) override;
+
+  virtual void memAdvise(const void *Ptr, size_t Count,
+                         hipMemoryAdvise Advice, int DstDevId) override;
 
   void setCmdQueueOwnership(bool isOwnedByChip) {
     zeCmdQOwnership_ = isOwnedByChip;
@@ -299,6 +408,10 @@ class CHIPContextLevel0 : public CHIPContext {
   OpenCLFunctionInfoMap FuncInfos_;
   std::vector<LZEventPool *> EventPools_;
 
+  /// Host memory imported through the zexDriverImportExternalPointer
+  /// extension, see registerHostMemory().
+  std::set<void *> ImportedHostPtrs_;
+
 public:
   CHIPEventLevel0 *getEventFromPool() {
 
@@ -336,6 +449,8 @@ public:
 
   bool isAllocatedPtrMappedToVM(void *Ptr) override { return false; } // TODO
   void freeImpl(void *Ptr) override;
+  bool registerHostMemory(void *HostPtr, size_t Size) override;
+  void unregisterHostMemory(void *HostPtr) override;
   ze_context_handle_t &get() { return ZeCtx; }
 
 }; // CHIPContextLevel0
@@ -378,9 +493,6 @@ public:
 class CHIPKernelLevel0 : public CHIPKernel {
 protected:
   ze_kernel_handle_t ZeKernel_;
-  size_t MaxDynamicLocalSize_;
-  size_t MaxWorkGroupSize_;
-  size_t StaticLocalSize_;
   size_t PrivateSize_;
 
   CHIPModuleLevel0 *Module;
@@ -463,6 +575,8 @@ class CHIPDeviceLevel0 : public CHIPDevice {
 
   ze_command_list_desc_t CommandListComputeDesc_;
   ze_command_list_desc_t CommandListCopyDesc_;
+  // Whether the command lists above are created in-order
+  bool InOrderCmdLists_ = false;
 
   ze_command_list_handle_t ZeCmdListComputeImm_;
   ze_command_list_handle_t ZeCmdListCopyImm_;
@@ -487,6 +601,9 @@ public:
   ze_command_list_desc_t getCommandListCopyDesc() {
     return CommandListCopyDesc_;
   }
+  /// Whether the driver orders the commands of the command lists created
+  /// from the descriptors above without barriers between them.
+  bool hasInOrderCmdLists() { return InOrderCmdLists_; }
   ze_command_queue_group_properties_t getComputeQueueProps() {
     return ComputeQueueProperties_;
   }
@@ -540,9 +657,6 @@ public:
                                            hipStream_t ChipQueue) override;
 
   virtual void uninitialize() override;
-  std::mutex CommandListsMtx;
-
-  std::map<CHIPEventLevel0 *, ze_command_list_handle_t> EventCommandListMap;
 
   virtual void initializeImpl(std::string CHIPPlatformStr,
                               std::string CHIPDeviceTypeStr,
@@ -572,6 +686,14 @@ public:
     return new CHIPCallbackDataLevel0(Callback, UserData, ChipQueue);
   }
 
+  CHIPCallbackEventMonitorLevel0 *getCallbackEventMonitor() {
+    return (CHIPCallbackEventMonitorLevel0 *)CallbackEventMonitor_;
+  }
+
+  CHIPStaleEventMonitorLevel0 *getStaleEventMonitor() {
+    return (CHIPStaleEventMonitorLevel0 *)StaleEventMonitor_;
+  }
+
   virtual CHIPEventMonitor *createCallbackEventMonitor_() override {
     auto Evm = new CHIPCallbackEventMonitorLevel0();
     Evm->start();
@@ -27,8 +27,9 @@
 
 #include "Utils.hh"
 
-static cl_sampler createSampler(cl_context Ctx, const hipResourceDesc &ResDesc,
-                                const hipTextureDesc &TexDesc) {
+static cl_sampler getSampler(CHIPDeviceOpenCL &Dev,
+                             const hipResourceDesc &ResDesc,
+                             const hipTextureDesc &TexDesc) {
 
   bool IsNormalized = TexDesc.normalizedCoords != 0;
 
@@ -65,17 +66,7 @@ static cl_sampler createSampler(cl_context Ctx, const hipResourceDesc &ResDesc,
   else if (TexDesc.filterMode == hipFilterModeLinear)
     FilterMode = CL_FILTER_LINEAR;
 
-  cl_sampler_properties SamplerProps[] = {CL_SAMPLER_NORMALIZED_COORDS,
-                                          TexDesc.normalizedCoords != 0,
-                                          CL_SAMPLER_ADDRESSING_MODE,
-                                          AddressMode,
-                                          CL_SAMPLER_FILTER_MODE,
-                                          FilterMode,
-                                          0};
-  cl_int Status = CL_SUCCESS;
-  auto Sampler = clCreateSamplerWithProperties(Ctx, SamplerProps, &Status);
-  CHIPERR_CHECK_LOG_AND_THROW(Status, CL_SUCCESS, hipErrorTbd);
-  return Sampler;
+  return Dev.getTextureSampler(IsNormalized, AddressMode, FilterMode);
 }
 
 static cl_mem_object_type getImageType(unsigned HipTextureID) {
@@ -195,9 +186,12 @@ static cl_mem createImage(cl_context Ctx, unsigned int TextureType,
   return Image;
 }
 
-static void memCopyToImage(cl_command_queue CmdQ, cl_mem Image,
-                           const void *HostSrc, const CHIPRegionDesc &SrcRegion,
-                           bool BlockingCopy = true) {
+/// Enqueue a copy to the image without blocking. The copy waits for
+/// WaitEvent unless it is nullptr. Returns the event of the copy.
+static cl_event memCopyToImage(cl_command_queue CmdQ, cl_mem Image,
+                               const void *HostSrc,
+                               const CHIPRegionDesc &SrcRegion,
+                               const std::vector<cl_event> &WaitEvents) {
 
   size_t InputRowPitch = SrcRegion.isPitched() ? SrcRegion.Pitch[0] : 0;
   size_t InputSlicePitch = 0;
@@ -208,10 +202,13 @@ static void memCopyToImage(cl_command_queue CmdQ, cl_mem Image,
 
   const size_t *DstOrigin = SrcRegion.Offset;
   const size_t *DstRegion = SrcRegion.Size;
-  cl_int Status = clEnqueueWriteImage(CmdQ, Image, BlockingCopy, DstOrigin,
-                                      DstRegion, InputRowPitch, InputSlicePitch,
-                                      HostSrc, 0, nullptr, nullptr);
+  cl_event CopyEvent;
+  cl_int Status = clEnqueueWriteImage(
+      CmdQ, Image, CL_FALSE, DstOrigin, DstRegion, InputRowPitch,
+      InputSlicePitch, HostSrc, WaitEvents.size(),
+      WaitEvents.empty() ? nullptr : WaitEvents.data(), &CopyEvent);
   CHIPERR_CHECK_LOG_AND_THROW(Status, CL_SUCCESS, hipErrorTbd);
+  return CopyEvent;
 }
 
 /// Annotate SVM pointers to the OpenCL driver via clSetKernelExecInfo
@@ -233,7 +230,8 @@ annotateSvmPointers(const CHIPContextOpenCL &Ctx, cl_kernel KernelAPIHandle) {
   //       discovered through kernel code inspection.
   std::vector<void *> SvmAnnotationList;
   std::unique_ptr<std::vector<std::shared_ptr<void>>> SvmKeepAlives;
-  LOCK(Ctx.ContextMtx); // CHIPContextOpenCL::SvmMemory
+  // CHIPContextOpenCL::SvmMemory, CHIPContextOpenCL::NumRegisteredHostRegions
+  LOCK(Ctx.ContextMtx);
   auto NumSvmAllocations = Ctx.SvmMemory.getNumAllocations();
   if (NumSvmAllocations) {
     SvmAnnotationList.reserve(NumSvmAllocations);
@@ -252,6 +250,17 @@ annotateSvmPointers(const CHIPContextOpenCL &Ctx, cl_kernel KernelAPIHandle) {
     CHIPERR_CHECK_LOG_AND_THROW(Status, CL_SUCCESS, hipErrorTbd);
   }
 
+  // Host memory imported by hipHostRegister() is not an SVM allocation and
+  // can be only reached indirectly through system SVM. ContextMtx is still
+  // held.
+  if (Ctx.NumRegisteredHostRegions) {
+    cl_bool UseSystemSVM = CL_TRUE;
+    auto Status = clSetKernelExecInfo(KernelAPIHandle,
+                                      CL_KERNEL_EXEC_INFO_SVM_FINE_GRAIN_SYSTEM,
+                                      sizeof(cl_bool), &UseSystemSVM);
+    CHIPERR_CHECK_LOG_AND_THROW(Status, CL_SUCCESS, hipErrorTbd);
+  }
+
   return SvmKeepAlives;
 }
 
@@ -265,18 +274,64 @@ static void CL_CALLBACK kernelEventCallback(cl_event Event,
   delete static_cast<KernelEventCallbackData *>(UserData);
 }
 
-// CHIPCallbackDataLevel0
+// CHIPCallbackDataOpenCL
 // ************************************************************************
 
 CHIPCallbackDataOpenCL::CHIPCallbackDataOpenCL(hipStreamCallback_t TheCallback,
                                                void *TheCallbackArgs,
                                                CHIPQueue *ChipQueue)
-    : ChipQueue((CHIPQueueOpenCL *)ChipQueue) {
-  if (TheCallbackArgs != nullptr)
-    CallbackArgs = TheCallbackArgs;
-  if (TheCallback == nullptr)
-    CHIPERR_LOG_AND_THROW("", hipErrorTbd);
-  CallbackF = TheCallback;
+    : CHIPCallbackData(TheCallback, TheCallbackArgs, ChipQueue) {}
+
+static void CL_CALLBACK gpuReadyCallback(cl_event Event,
+                                         cl_int CommandExecStatus,
+                                         void *UserData) {
+  Backend->getCallbackExecutor()->setReady(
+      static_cast<CHIPCallbackData *>(UserData));
+}
+
+void CHIPCallbackDataOpenCL::enqueue() {
+  logTrace("CHIPCallbackDataOpenCL::enqueue()");
+  auto *ChipQueueCl = (CHIPQueueOpenCL *)ChipQueue;
+  cl::Context *ClContext =
+      ((CHIPContextOpenCL *)ChipQueue->getContext())->get();
+
+  cl_int Err;
+  CHIPEventOpenCL *CompleteEvent = (CHIPEventOpenCL *)Backend->createCHIPEvent(
+      ChipQueue->getContext(), CHIPEventFlags(), true);
+  CompleteEvent->ClEvent = clCreateUserEvent(ClContext->get(), &Err);
+  CHIPERR_CHECK_LOG_AND_THROW(Err, CL_SUCCESS, hipErrorTbd);
+  CompleteEvent->Msg = "CpuCallbackComplete";
+  CpuCallbackComplete = CompleteEvent;
+
+  CHIPEventOpenCL *LastEvent = ChipQueueCl->getLastEvent();
+  if (LastEvent) {
+    LastEvent->increaseRefCount("CHIPCallbackDataOpenCL GpuReady");
+    GpuReady = LastEvent;
+  }
+
+  // The queue is in order: the succeeding commands wait for the user event
+  // which is set CL_COMPLETE once the callback has returned.
+  std::vector<CHIPEvent *> WaitForEvents{CpuCallbackComplete};
+  ChipQueue->enqueueBarrier(&WaitForEvents);
+  ChipQueueCl->get()->flush();
+
+  if (!LastEvent) {
+    Backend->getCallbackExecutor()->setReady(this);
+    return;
+  }
+  // OpenCL event callbacks have undefined execution ordering guarantees, so
+  // they only hand the callback over to the executor.
+  auto Status = clSetEventCallback(LastEvent->ClEvent, CL_COMPLETE,
+                                   gpuReadyCallback, this);
+  CHIPERR_CHECK_LOG_AND_THROW(Status, CL_SUCCESS, hipErrorTbd);
+}
+
+void CHIPCallbackDataOpenCL::complete() {
+  auto *CompleteEvent = (CHIPEventOpenCL *)CpuCallbackComplete;
+  clSetUserEventStatus(CompleteEvent->ClEvent, CL_COMPLETE);
+  CompleteEvent->decreaseRefCount("Notified finished.");
+  if (GpuReady)
+    GpuReady->decreaseRefCount("CHIPCallbackDataOpenCL complete");
 }
 
 // CHIPEventMonitorOpenCL
@@ -300,63 +355,67 @@ CHIPDeviceOpenCL::createTexture(const hipResourceDesc *ResDesc,
   bool NormalizedFloat = TexDesc->readMode == hipReadModeNormalizedFloat;
   auto *Q = (CHIPQueueOpenCL *)getDefaultQueue();
 
-  cl_context CLCtx = ((CHIPContextOpenCL *)getContext())->get()->get();
-  cl_sampler Sampler = createSampler(CLCtx, *ResDesc, *TexDesc);
+  // Set up a texture on an image with the layout and enqueue the upload of
+  // the resource into it. Kernels reading the texture wait for the upload
+  // instead of the host.
+  auto Create = [&](const CHIPTextureImageLayout &Layout, const void *Src,
+                    const CHIPRegionDesc &SrcRegion) -> CHIPTexture * {
+    std::vector<cl_event> Uses;
+    cl_mem Image = acquireTextureImage(Layout, Uses);
+    cl_sampler Sampler = getSampler(*this, *ResDesc, *TexDesc);
+    auto Tex = std::make_unique<CHIPTextureOpenCL>(*ResDesc, this, Layout,
+                                                   Image, Sampler);
+    logTrace("Created texture: {}", (void *)Tex.get());
+
+    // The upload is a command of the default stream. A reused image may
+    // still be read by kernels of a destroyed texture in any stream.
+    getContext()->syncQueues(Q);
+    cl_event Upload =
+        memCopyToImage(Q->get()->get(), Image, Src, SrcRegion, Uses);
+    for (cl_event Use : Uses)
+      clReleaseEvent(Use);
+    Tex->setUploadEvent(Upload);
+
+    // Order the later commands of the default queue and the queues
+    // synchronizing with it after the upload.
+    auto *UploadEvent =
+        (CHIPEventOpenCL *)Backend->createCHIPEvent(getContext());
+    clRetainEvent(Upload);
+    UploadEvent->ClEvent = Upload;
+    UploadEvent->Msg = "textureUpload";
+    Q->updateLastEvent(UploadEvent);
+    UploadEvent->track();
+
+    return Tex.release();
+  };
 
   if (ResDesc->resType == hipResourceTypeArray) {
     hipArray *Array = ResDesc->res.array.array;
     // Checked in CHIPBindings already.
     CHIPASSERT(Array->data && "Invalid hipArray.");
     CHIPASSERT(!Array->isDrv && "Not supported/implemented yet.");
-    size_t Width = Array->width;
-    size_t Height = Array->height;
-    size_t Depth = Array->depth;
-
-    cl_mem Image = createImage(CLCtx, Array->textureType, Array->desc,
-                               NormalizedFloat, Width, Height, Depth);
-
-    auto Tex = std::make_unique<CHIPTextureOpenCL>(*ResDesc, Image, Sampler);
-    logTrace("Created texture: {}", (void *)Tex.get());
-
-    CHIPRegionDesc SrcRegion = CHIPRegionDesc::from(*Array);
-    memCopyToImage(Q->get()->get(), Image, Array->data, SrcRegion);
-
-    return Tex.release();
+    CHIPTextureImageLayout Layout{Array->textureType, Array->desc,
+                                  NormalizedFloat,    Array->width,
+                                  Array->height,      Array->depth};
+    return Create(Layout, Array->data, CHIPRegionDesc::from(*Array));
   }
 
   if (ResDesc->resType == hipResourceTypeLinear) {
     auto &Res = ResDesc->res.linear;
     auto TexelByteSize = getChannelByteSize(Res.desc);
     size_t Width = Res.sizeInBytes / TexelByteSize;
-
-    cl_mem Image =
-        createImage(CLCtx, hipTextureType1D, Res.desc, NormalizedFloat, Width);
-
-    auto Tex = std::make_unique<CHIPTextureOpenCL>(*ResDesc, Image, Sampler);
-    logTrace("Created texture: {}", (void *)Tex.get());
-
-    // Copy data to image.
-    auto SrcDesc = CHIPRegionDesc::get1DRegion(Width, TexelByteSize);
-    memCopyToImage(Q->get()->get(), Image, Res.devPtr, SrcDesc);
-
-    return Tex.release();
+    CHIPTextureImageLayout Layout{hipTextureType1D, Res.desc, NormalizedFloat,
+                                  Width, 0, 0};
+    return Create(Layout, Res.devPtr,
+                  CHIPRegionDesc::get1DRegion(Width, TexelByteSize));
   }
 
   if (ResDesc->resType == hipResourceTypePitch2D) {
     auto &Res = ResDesc->res.pitch2D;
     assert(Res.pitchInBytes >= Res.width); // Checked in CHIPBindings.
-
-    cl_mem Image = createImage(CLCtx, hipTextureType2D, Res.desc,
-                               NormalizedFloat, Res.width, Res.height);
-
-    auto Tex = std::make_unique<CHIPTextureOpenCL>(*ResDesc, Image, Sampler);
-    logTrace("Created texture: {}", (void *)Tex.get());
-
-    // Copy data to image.
-    auto SrcDesc = CHIPRegionDesc::from(*ResDesc);
-    memCopyToImage(Q->get()->get(), Image, Res.devPtr, SrcDesc);
-
-    return Tex.release();
+    CHIPTextureImageLayout Layout{hipTextureType2D, Res.desc, NormalizedFloat,
+                                  Res.width, Res.height, 0};
+    return Create(Layout, Res.devPtr, CHIPRegionDesc::from(*ResDesc));
   }
 
   CHIPASSERT(false && "Unsupported/unimplemented texture resource type.");
@@ -379,6 +438,28 @@ CHIPDeviceOpenCL::CHIPDeviceOpenCL(CHIPContextOpenCL *ChipCtx,
   } else {
     logTrace("Device does not support fine grain SVM");
   }
+  this->SupportsSystemSVM =
+      DeviceSVMCapabilities & CL_DEVICE_SVM_FINE_GRAIN_SYSTEM;
+  logTrace("Device {} system SVM",
+           this->SupportsSystemSVM ? "supports" : "does not support");
+
+  std::string Extensions = DevIn->getInfo<CL_DEVICE_EXTENSIONS>();
+  this->SupportsPriorityHints =
+      Extensions.find("cl_khr_priority_hints") != std::string::npos;
+  logTrace("Device {} cl_khr_priority_hints",
+           this->SupportsPriorityHints ? "supports" : "does not support");
+
+  // Host allocations are made fine-grain if possible. On CPU devices device
+  // memory is host memory too, so every allocation is made fine-grain.
+  cl_device_type DeviceType;
+  Status = DevIn->getInfo(CL_DEVICE_TYPE, &DeviceType);
+  CHIPERR_CHECK_LOG_AND_THROW(Status, CL_SUCCESS, hipErrorTbd);
+  MemoryProfile_.HostAllocsCoherent = this->SupportsFineGrainSVM;
+  MemoryProfile_.UnifiedCoherent =
+      this->SupportsFineGrainSVM && (DeviceType & CL_DEVICE_TYPE_CPU);
+  if (MemoryProfile_.UnifiedCoherent)
+    logDebug("Device memory is coherent with the host, copies and "
+             "synchronization of host memory are done on the host");
 }
 
 CHIPDeviceOpenCL *CHIPDeviceOpenCL::create(cl::Device *ClDevice,
@@ -477,6 +558,42 @@ void CHIPDeviceOpenCL::populateDevicePropertiesImpl() {
   else
     HipDeviceProps_.arch.hasDoubles = 0;
 
+  // Native floating-point atomic adds, used by the device libraries linked
+  // at runtime.
+  if (Temp.find("cl_ext_float_atomics") != std::string::npos) {
+    auto HasAtomicAdd = [&](cl_device_info Query) {
+      cl_device_fp_atomic_capabilities_ext Caps = 0;
+      if (clGetDeviceInfo((*ClDevice)(), Query, sizeof(Caps), &Caps,
+                          nullptr) != CL_SUCCESS)
+        return false;
+      auto Add = CL_DEVICE_GLOBAL_FP_ATOMIC_ADD_EXT |
+                 CL_DEVICE_LOCAL_FP_ATOMIC_ADD_EXT;
+      return (Caps & Add) == Add;
+    };
+    if (HasAtomicAdd(CL_DEVICE_SINGLE_FP_ATOMIC_CAPABILITIES_EXT))
+      Features_.insert(CHIPDeviceFeature::FloatAtomicAdd);
+    if (HasAtomicAdd(CL_DEVICE_DOUBLE_FP_ATOMIC_CAPABILITIES_EXT))
+      Features_.insert(CHIPDeviceFeature::DoubleAtomicAdd);
+  }
+  if (Temp.find("cl_khr_subgroups") != std::string::npos)
+    Features_.insert(CHIPDeviceFeature::SubgroupCollectives);
+  if (ClDevice->getInfo<CL_DEVICE_LINKER_AVAILABLE>())
+    Features_.insert(CHIPDeviceFeature::ProgramLinking);
+
+  // Align the rows of the pitched allocations so they are valid sub-buffer
+  // origins and can back images of any format (cl_khr_image2d_from_buffer):
+  // the image pitch alignment is in pixels of up to 16 bytes. The query is
+  // not available before OpenCL 2.0.
+  size_t BaseAddrAlignment =
+      ClDevice->getInfo<CL_DEVICE_MEM_BASE_ADDR_ALIGN>() / 8;
+  cl_uint ImagePitchAlignment = 0; // Stays zero if the query fails.
+  clGetDeviceInfo((*ClDevice)(), CL_DEVICE_IMAGE_PITCH_ALIGNMENT,
+                  sizeof(ImagePitchAlignment), &ImagePitchAlignment, nullptr);
+  size_t PitchAlignment = std::max<size_t>(
+      {BaseAddrAlignment, ImagePitchAlignment * 16ul, 1});
+  HipDeviceProps_.textureAlignment = BaseAddrAlignment;
+  HipDeviceProps_.texturePitchAlignment = PitchAlignment;
+
   // TODO: OpenCL lacks queries for these. Generate best guesses which are
   // unlikely breaking the program logic.
   HipDeviceProps_.clockInstructionRate = 2465;
@@ -487,9 +604,12 @@ void CHIPDeviceOpenCL::populateDevicePropertiesImpl() {
   HipDeviceProps_.isMultiGpuBoard = 0;
   HipDeviceProps_.canMapHostMemory = 1;
   HipDeviceProps_.gcnArch = 0;
-  HipDeviceProps_.integrated = 0;
+  HipDeviceProps_.integrated = MemoryProfile_.UnifiedCoherent;
   HipDeviceProps_.maxSharedMemoryPerMultiProcessor =
       HipDeviceProps_.sharedMemPerBlock * 16;
+  // OpenCL doesn't tell how many work-groups run at the same time, so it
+  // can't be guaranteed that the blocks waiting in a grid barrier are not
+  // waiting for blocks which never get to run.
   HipDeviceProps_.cooperativeLaunch = 0;
   HipDeviceProps_.cooperativeMultiDeviceLaunch = 0;
   HipDeviceProps_.cooperativeMultiDeviceUnmatchedFunc = 0;
@@ -497,8 +617,6 @@ void CHIPDeviceOpenCL::populateDevicePropertiesImpl() {
   HipDeviceProps_.cooperativeMultiDeviceUnmatchedBlockDim = 0;
   HipDeviceProps_.cooperativeMultiDeviceUnmatchedSharedMem = 0;
   HipDeviceProps_.memPitch = 1;
-  HipDeviceProps_.textureAlignment = 1;
-  HipDeviceProps_.texturePitchAlignment = 1;
   HipDeviceProps_.kernelExecTimeoutEnabled = 0;
   HipDeviceProps_.ECCEnabled = 0;
   HipDeviceProps_.asicRevision = 1;
@@ -532,6 +650,169 @@ void CHIPDeviceOpenCL::populateDevicePropertiesImpl() {
 }
 
 void CHIPDeviceOpenCL::resetImpl() { UNIMPLEMENTED(); }
+
+int CHIPDeviceOpenCL::getMaxActiveBlocksPerCU(int BlockSize,
+                                              size_t SharedMemPerBlock) {
+  // OpenCL doesn't tell how many work-groups a compute unit runs at once.
+  // CPU drivers run a work-group to completion on a core, so only one per
+  // compute unit is assumed.
+  return std::min(
+      CHIPDevice::getMaxActiveBlocksPerCU(BlockSize, SharedMemPerBlock), 1);
+}
+
+CHIPDeviceOpenCL::~CHIPDeviceOpenCL() {
+  if (TimingQueue_)
+    clReleaseCommandQueue(TimingQueue_);
+  for (auto &Entry : TextureSamplers_)
+    clReleaseSampler(Entry.second);
+  for (auto &Idle : IdleTextureImages_) {
+    clReleaseMemObject(Idle.Image);
+    for (cl_event Use : Idle.Uses)
+      clReleaseEvent(Use);
+  }
+}
+
+cl_command_queue CHIPDeviceOpenCL::getTimingQueue() {
+  LOCK(TimingQueueMtx_); // CHIPDeviceOpenCL::TimingQueue_
+  if (TimingQueue_)
+    return TimingQueue_;
+
+  cl_int Status;
+  cl_queue_properties Props[] = {CL_QUEUE_PROPERTIES,
+                                 CL_QUEUE_PROFILING_ENABLE |
+                                     CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE,
+                                 0};
+  TimingQueue_ = clCreateCommandQueueWithProperties(
+      ClContext->get(), ClDevice->get(), Props, &Status);
+  if (Status != CL_SUCCESS) {
+    logDebug("Out-of-order timing queue not supported, using an in-order "
+             "one");
+    Props[1] = CL_QUEUE_PROFILING_ENABLE;
+    TimingQueue_ = clCreateCommandQueueWithProperties(
+        ClContext->get(), ClDevice->get(), Props, &Status);
+  }
+  CHIPERR_CHECK_LOG_AND_THROW(Status, CL_SUCCESS, hipErrorTbd);
+  return TimingQueue_;
+}
+
+cl_sampler CHIPDeviceOpenCL::getTextureSampler(cl_bool NormalizedCoords,
+                                               cl_addressing_mode AddressMode,
+                                               cl_filter_mode FilterMode) {
+  auto Key = std::make_tuple(NormalizedCoords, AddressMode, FilterMode);
+  LOCK(TextureMtx_); // CHIPDeviceOpenCL::TextureSamplers_
+  auto It = TextureSamplers_.find(Key);
+  if (It == TextureSamplers_.end()) {
+    cl_sampler_properties SamplerProps[] = {CL_SAMPLER_NORMALIZED_COORDS,
+                                            NormalizedCoords,
+                                            CL_SAMPLER_ADDRESSING_MODE,
+                                            AddressMode,
+                                            CL_SAMPLER_FILTER_MODE,
+                                            FilterMode,
+                                            0};
+    cl_int Status = CL_SUCCESS;
+    cl_sampler Sampler = clCreateSamplerWithProperties(
+        ClContext->get(), SamplerProps, &Status);
+    CHIPERR_CHECK_LOG_AND_THROW(Status, CL_SUCCESS, hipErrorTbd);
+    It = TextureSamplers_.emplace(Key, Sampler).first;
+  }
+  // The reference of the cache is released with the device.
+  clRetainSampler(It->second);
+  return It->second;
+}
+
+cl_mem CHIPDeviceOpenCL::acquireTextureImage(
+    const CHIPTextureImageLayout &Layout, std::vector<cl_event> &Uses) {
+  Uses.clear();
+  {
+    LOCK(TextureMtx_); // CHIPDeviceOpenCL::IdleTextureImages_
+    auto It = std::find_if(
+        IdleTextureImages_.begin(), IdleTextureImages_.end(),
+        [&](const IdleTextureImage &Idle) { return Idle.Layout == Layout; });
+    if (It != IdleTextureImages_.end()) {
+      cl_mem Image = It->Image;
+      Uses = std::move(It->Uses);
+      IdleTextureImages_.erase(It);
+      logTrace("Reusing texture image {}", (void *)Image);
+      return Image;
+    }
+  }
+  return createImage(ClContext->get(), Layout.TextureType, Layout.Format,
+                     Layout.NormalizedFloat, Layout.Width, Layout.Height,
+                     Layout.Depth);
+}
+
+void CHIPDeviceOpenCL::releaseTextureImage(const CHIPTextureImageLayout &Layout,
+                                           cl_mem Image,
+                                           std::vector<cl_event> &&Uses) {
+  // Images may be large so only a few are kept.
+  constexpr size_t MaxIdleTextureImages = 8;
+  IdleTextureImage Evicted{};
+  {
+    LOCK(TextureMtx_); // CHIPDeviceOpenCL::IdleTextureImages_
+    IdleTextureImages_.push_front({Layout, Image, std::move(Uses)});
+    if (IdleTextureImages_.size() <= MaxIdleTextureImages)
+      return;
+    Evicted = std::move(IdleTextureImages_.back());
+    IdleTextureImages_.pop_back();
+  }
+  clReleaseMemObject(Evicted.Image);
+  for (cl_event Use : Evicted.Uses)
+    clReleaseEvent(Use);
+}
+/// Returns true once the command of the event has completed.
+static bool isEventComplete(cl_event Event) {
+  cl_int ExecStatus;
+  auto Status = clGetEventInfo(Event, CL_EVENT_COMMAND_EXECUTION_STATUS,
+                               sizeof(cl_int), &ExecStatus, nullptr);
+  CHIPERR_CHECK_LOG_AND_THROW(Status, CL_SUCCESS, hipErrorTbd);
+  if (ExecStatus < 0)
+    CHIPERR_LOG_AND_THROW("Command terminated abnormally", hipErrorTbd);
+  return ExecStatus == CL_COMPLETE;
+}
+
+/// Wait for the event as the sync policy of the device dictates.
+static void waitForEvent(CHIPDevice *Dev, cl_event Event) {
+  // Polling does not flush the queue like clWaitForEvents() does.
+  cl_command_queue Queue = nullptr;
+  auto Status = clGetEventInfo(Event, CL_EVENT_COMMAND_QUEUE,
+                               sizeof(Queue), &Queue, nullptr);
+  CHIPERR_CHECK_LOG_AND_THROW(Status, CL_SUCCESS, hipErrorTbd);
+  if (Queue) { // nullptr for user events
+    Status = clFlush(Queue);
+    CHIPERR_CHECK_LOG_AND_THROW(Status, CL_SUCCESS, hipErrorTbd);
+  }
+
+  Dev->getSyncPolicy().wait([&]() { return isEventComplete(Event); },
+                            [&]() {
+                              Status = clWaitForEvents(1, &Event);
+                              CHIPERR_CHECK_LOG_AND_THROW(Status, CL_SUCCESS,
+                                                          hipErrorTbd);
+                            });
+}
+
+// CHIPTextureOpenCL
+// ************************************************************************
+
+void CHIPTextureOpenCL::addUse(cl_event LaunchEvent) {
+  LOCK(UsesMtx_); // CHIPTextureOpenCL::Uses_
+  // A texture may be read by many launches over its lifetime: keep only
+  // the ones which may still be reading the image.
+  auto IsDone = [](cl_event Use) {
+    cl_int ExecStatus;
+    auto Status = clGetEventInfo(Use, CL_EVENT_COMMAND_EXECUTION_STATUS,
+                                 sizeof(cl_int), &ExecStatus, nullptr);
+    // Failed commands do not read the image any more either.
+    if (Status != CL_SUCCESS || ExecStatus > CL_COMPLETE)
+      return false;
+    clReleaseEvent(Use);
+    return true;
+  };
+  Uses_.erase(std::remove_if(Uses_.begin(), Uses_.end(), IsDone),
+              Uses_.end());
+  clRetainEvent(LaunchEvent);
+  Uses_.push_back(LaunchEvent);
+}
+
 // CHIPEventOpenCL
 // ************************************************************************
 
@@ -585,7 +866,10 @@ CHIPEventOpenCL *CHIPBackendOpenCL::createCHIPEvent(CHIPContext *ChipCtx,
 
 void CHIPEventOpenCL::recordStream(CHIPQueue *ChipQueue) {
   logTrace("CHIPEvent::recordStream()");
-  auto MarkerEvent = ChipQueue->enqueueMarker();
+  auto *Q = (CHIPQueueOpenCL *)ChipQueue;
+  CHIPEvent *MarkerEvent = getFlags().isDisableTiming()
+                               ? Q->enqueueMarker()
+                               : Q->enqueueTimestamp();
   this->takeOver(MarkerEvent);
 
   this->EventStatus_ = EVENT_STATUS_RECORDING;
@@ -613,9 +897,7 @@ bool CHIPEventOpenCL::wait() {
     return false;
   }
 
-  auto Status = clWaitForEvents(1, &ClEvent);
-
-  CHIPERR_CHECK_LOG_AND_THROW(Status, CL_SUCCESS, hipErrorTbd);
+  waitForEvent(ChipContext_->getDevice(), ClEvent);
   return true;
 }
 
@@ -718,6 +1000,23 @@ void CHIPEventOpenCL::decreaseRefCount(std::string Reason) {
 // CHIPModuleOpenCL
 //*************************************************************************
 
+/// Get the native binary of a built program for the device, or an empty
+/// string if the driver does not provide it.
+static std::string getProgramBinary(const cl::Program &Program,
+                                    const cl::Device &Device) {
+  cl_int Err;
+  auto Devices = Program.getInfo<CL_PROGRAM_DEVICES>(&Err);
+  if (Err != CL_SUCCESS)
+    return "";
+  auto Binaries = Program.getInfo<CL_PROGRAM_BINARIES>(&Err);
+  if (Err != CL_SUCCESS || Binaries.size() != Devices.size())
+    return "";
+  for (size_t I = 0; I < Devices.size(); I++)
+    if (Devices[I]() == Device())
+      return std::string(Binaries[I].begin(), Binaries[I].end());
+  return "";
+}
+
 CHIPModuleOpenCL::CHIPModuleOpenCL(const SPVModule &SrcMod)
     : CHIPModule(SrcMod) {}
 
@@ -733,14 +1032,64 @@ void CHIPModuleOpenCL::compile(CHIPDevice *ChipDev) {
       (CHIPContextOpenCL *)(ChipDevOcl->getContext());
 
   int Err;
-  auto SrcBin = Src_->getBinary();
-  std::vector<char> BinaryVec(SrcBin.begin(), SrcBin.end());
-  auto Program = cl::Program(*(ChipCtxOcl->get()), BinaryVec, false, &Err);
-  CHIPERR_CHECK_LOG_AND_THROW(Err, CL_SUCCESS, hipErrorInitializationError);
-
-  //   for (CHIPDevice *chip_dev : chip_devices) {
+  cl::Program Program;
   std::string Name = ChipDevOcl->getName();
-  Err = Program.build(Backend->getJitFlags().c_str());
+  std::string JitFlags = Backend->getJitFlags();
+
+  // Identical SPIR-V has been compiled for the device before: build the
+  // program from its native binary instead of JIT compiling it again.
+  NativeBinary_ = ChipDevOcl->getNativeBinary(Src_->getBinary());
+  if (NativeBinary_) {
+    logTrace("Reusing the native binary of an identical module");
+    cl::Program::Binaries Binaries{std::vector<unsigned char>(
+        NativeBinary_->begin(), NativeBinary_->end())};
+    Program = cl::Program(*(ChipCtxOcl->get()), {*ChipDevOcl->ClDevice},
+                          Binaries, nullptr, &Err);
+    if (Err == CL_SUCCESS)
+      Err = Program.build(JitFlags.c_str());
+    // The driver may still reject the binary, e.g. for build options it
+    // does not accept for binaries. Compile the SPIR-V and cache the new
+    // binary instead.
+    if (Err != CL_SUCCESS) {
+      logWarn("The native binary of an identical module was rejected ({}), "
+              "compiling the SPIR-V",
+              resultToString(Err));
+      NativeBinary_.reset();
+    }
+  }
+  if (!NativeBinary_) {
+    // The module imports the functions of the native device libraries the
+    // device supports.
+    std::string LinkedBin;
+    auto DevLibs = getRtDevLibBinaries(ChipDevOcl, LinkedBin);
+
+    std::string_view SrcBin = DevLibs.empty() ? Src_->getBinary() : LinkedBin;
+    std::vector<char> BinaryVec(SrcBin.begin(), SrcBin.end());
+    Program = cl::Program(*(ChipCtxOcl->get()), BinaryVec, false, &Err);
+    CHIPERR_CHECK_LOG_AND_THROW(Err, CL_SUCCESS, hipErrorInitializationError);
+
+    if (DevLibs.empty())
+      Err = Program.build(JitFlags.c_str());
+    else {
+      // Compile the module and the device libraries it imports from
+      // separately and link them.
+      std::vector<cl::Program> Inputs{Program};
+      for (auto DevLib : DevLibs) {
+        std::vector<char> LibVec(DevLib.begin(), DevLib.end());
+        Inputs.emplace_back(*(ChipCtxOcl->get()), LibVec, false, &Err);
+        CHIPERR_CHECK_LOG_AND_THROW(Err, CL_SUCCESS,
+                                    hipErrorInitializationError);
+      }
+      for (auto &Input : Inputs)
+        if ((Err = Input.compile(JitFlags.c_str())) != CL_SUCCESS) {
+          Program = Input; // For the build log below.
+          break;
+        }
+      // The JIT flags are compiler options, the linker gets none.
+      if (Err == CL_SUCCESS)
+        Program = cl::linkProgram(Inputs, nullptr, nullptr, nullptr, &Err);
+    }
+  }
   auto ErrBuild = Err;
 
   std::string Log =
@@ -756,6 +1105,13 @@ void CHIPModuleOpenCL::compile(CHIPDevice *ChipDev) {
   logTrace("Program BUILD LOG for device #{}:{}:\n{}\n",
            ChipDevOcl->getDeviceId(), Name, Log);
 
+  if (!NativeBinary_) {
+    std::string Binary = getProgramBinary(Program, *ChipDevOcl->ClDevice);
+    if (!Binary.empty())
+      NativeBinary_ =
+          ChipDevOcl->addNativeBinary(Src_->getBinary(), std::move(Binary));
+  }
+
   std::vector<cl::Kernel> Kernels;
   Err = Program.createKernels(&Kernels);
   CHIPERR_CHECK_LOG_AND_THROW(Err, CL_SUCCESS, hipErrorInitializationError);
@@ -822,9 +1178,9 @@ hipError_t CHIPKernelOpenCL::getAttributes(hipFuncAttributes *Attr) {
   Attr->constSizeBytes = 0; // TODO
   Attr->localSizeBytes = PrivateSize_;
 
-  Attr->maxThreadsPerBlock = MaxWorkGroupSize_;
-  Attr->sharedSizeBytes = StaticLocalSize_;
-  Attr->maxDynamicSharedSizeBytes = MaxDynamicLocalSize_;
+  Attr->maxThreadsPerBlock = Resources_.MaxWorkGroupSize;
+  Attr->sharedSizeBytes = Resources_.StaticLocalSize;
+  Attr->maxDynamicSharedSizeBytes = Resources_.MaxDynamicLocalSize;
 
   Attr->numRegs = 0;
   Attr->preferredShmemCarveout = 0;
@@ -846,15 +1202,18 @@ CHIPKernelOpenCL::CHIPKernelOpenCL(cl::Kernel ClKernel, CHIPDeviceOpenCL *Dev,
                               "Failed to get num args for kernel");
   assert(FuncInfo_->getNumKernelArgs() == NumArgs);
 
-  MaxWorkGroupSize_ =
-      OclKernel_.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(*Device->get());
-  StaticLocalSize_ =
-      OclKernel_.getWorkGroupInfo<CL_KERNEL_LOCAL_MEM_SIZE>(*Device->get());
-  MaxDynamicLocalSize_ =
+  cl::Device &ClDev = *Device->get();
+  Resources_.MaxWorkGroupSize =
+      OclKernel_.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(ClDev);
+  Resources_.PreferredWorkGroupSizeMultiple = OclKernel_.getWorkGroupInfo<
+      CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE>(ClDev);
+  Resources_.StaticLocalSize =
+      OclKernel_.getWorkGroupInfo<CL_KERNEL_LOCAL_MEM_SIZE>(ClDev);
+  Resources_.MaxDynamicLocalSize =
       (size_t)Device->getAttr(hipDeviceAttributeMaxSharedMemoryPerBlock) -
-      StaticLocalSize_;
+      Resources_.StaticLocalSize;
   PrivateSize_ =
-      OclKernel_.getWorkGroupInfo<CL_KERNEL_PRIVATE_MEM_SIZE>(*Device->get());
+      OclKernel_.getWorkGroupInfo<CL_KERNEL_PRIVATE_MEM_SIZE>(ClDev);
 
   Name_ = OclKernel_.getInfo<CL_KERNEL_FUNCTION_NAME>();
 
@@ -885,6 +1244,21 @@ void CHIPContextOpenCL::freeImpl(void *Ptr) {
   SvmMemory.free(Ptr);
 }
 
+bool CHIPContextOpenCL::registerHostMemory(void *HostPtr, size_t Size) {
+  // With system SVM the device can use any host pointer as is.
+  if (!static_cast<CHIPDeviceOpenCL *>(ChipDevice_)->supportsSystemSVM())
+    return false;
+  LOCK(ContextMtx); // CHIPContextOpenCL::NumRegisteredHostRegions
+  NumRegisteredHostRegions++;
+  return true;
+}
+
+void CHIPContextOpenCL::unregisterHostMemory(void *HostPtr) {
+  LOCK(ContextMtx); // CHIPContextOpenCL::NumRegisteredHostRegions
+  assert(NumRegisteredHostRegions > 0);
+  NumRegisteredHostRegions--;
+}
+
 cl::Context *CHIPContextOpenCL::get() { return ClContext; }
 CHIPContextOpenCL::CHIPContextOpenCL(cl::Context *CtxIn) {
   logTrace("CHIPContextOpenCL Initialized via OpenCL Context pointer.");
@@ -898,40 +1272,24 @@ void *CHIPContextOpenCL::allocateImpl(size_t Size, size_t Alignment,
   void *Retval;
   LOCK(ContextMtx); // CHIPContextOpenCL::SvmMemory
 
-  Retval = SvmMemory.allocate(Size);
+  // Fine-grain allocations can be accessed by the host without mapping.
+  const auto &MemoryProfile = ChipDevice_->getMemoryProfile();
+  bool FineGrain = MemoryProfile.UnifiedCoherent ||
+                   (MemType == hipMemoryTypeHost &&
+                    MemoryProfile.HostAllocsCoherent);
+  auto Granularity =
+      FineGrain ? SVMemoryRegion::FINE_GRAIN : SVMemoryRegion::COARSE_GRAIN;
+  Retval = SvmMemory.allocate(Size, Granularity);
   return Retval;
 }
 
 // CHIPQueueOpenCL
 //*************************************************************************
-struct HipStreamCallbackData {
-  hipStream_t Stream;
-  hipError_t Status;
-  void *UserData;
-  hipStreamCallback_t Callback;
-  CHIPEventOpenCL *CallbackFinishEvent;
-};
-
-void CL_CALLBACK pfn_notify(cl_event Event, cl_int CommandExecStatus,
-                            void *UserData) {
-  HipStreamCallbackData *Cbo = (HipStreamCallbackData *)(UserData);
-  if (Cbo == nullptr)
-    return;
-  if (Cbo->Callback == nullptr)
-    return;
-  Cbo->Callback(Cbo->Stream, Cbo->Status, Cbo->UserData);
-  if (Cbo->CallbackFinishEvent != nullptr) {
-    clSetUserEventStatus(Cbo->CallbackFinishEvent->ClEvent, CL_COMPLETE);
-    Cbo->CallbackFinishEvent->decreaseRefCount("Notified finished.");
-  }
-  delete Cbo;
-}
-
 void CHIPQueueOpenCL::MemMap(const AllocationInfo *AllocInfo,
                              CHIPQueue::MEM_MAP_TYPE Type) {
-  if (static_cast<CHIPDeviceOpenCL *>(this->getDevice())
-          ->supportsFineGrainSVM()) {
-    logDebug("Device supports fine grain SVM. Skipping MemMap/Unmap");
+  if (getDevice()->getMemoryProfile().HostAllocsCoherent) {
+    logDebug("Host allocations are fine grain SVM. Skipping MemMap");
+    return;
   }
   cl_int Status;
   if (Type == CHIPQueue::MEM_MAP_TYPE::HOST_READ) {
@@ -956,9 +1314,9 @@ void CHIPQueueOpenCL::MemMap(const AllocationInfo *AllocInfo,
 }
 
 void CHIPQueueOpenCL::MemUnmap(const AllocationInfo *AllocInfo) {
-  if (static_cast<CHIPDeviceOpenCL *>(this->getDevice())
-          ->supportsFineGrainSVM()) {
-    logDebug("Device supports fine grain SVM. Skipping MemMap/Unmap");
+  if (getDevice()->getMemoryProfile().HostAllocsCoherent) {
+    logDebug("Host allocations are fine grain SVM. Skipping MemUnmap");
+    return;
   }
   logDebug("CHIPQueueOpenCL::MemUnmap");
 
@@ -969,65 +1327,6 @@ void CHIPQueueOpenCL::MemUnmap(const AllocationInfo *AllocInfo) {
 
 cl::CommandQueue *CHIPQueueOpenCL::get() { return ClQueue_; }
 
-void CHIPQueueOpenCL::addCallback(hipStreamCallback_t Callback,
-                                  void *UserData) {
-  logTrace("CHIPQueueOpenCL::addCallback()");
-
-  cl::Context *ClContext_ = ((CHIPContextOpenCL *)ChipContext_)->get();
-  cl_int Err;
-
-  CHIPEventOpenCL *HoldBackEvent =
-      (CHIPEventOpenCL *)Backend->createCHIPEvent(ChipContext_);
-
-  HoldBackEvent->ClEvent = clCreateUserEvent(ClContext_->get(), &Err);
-
-  std::vector<CHIPEvent *> WaitForEvents{HoldBackEvent};
-  auto LastEvent = getLastEvent();
-  if (LastEvent != nullptr)
-    WaitForEvents.push_back(LastEvent);
-
-  // Enqueue a barrier used to ensure the callback is not called too early,
-  // otherwise it would be (at worst) executed in this host thread when
-  // setting it, blocking the execution, while the clients might expect
-  // parallel execution.
-  auto HoldbackBarrierCompletedEv =
-      (CHIPEventOpenCL *)enqueueBarrier(&WaitForEvents);
-
-  // OpenCL event callbacks have undefined execution ordering/finishing
-  // guarantees. We need to enforce CUDA ordering using user events.
-
-  CHIPEventOpenCL *CallbackEvent =
-      (CHIPEventOpenCL *)Backend->createCHIPEvent(ChipContext_);
-
-  CallbackEvent->ClEvent = clCreateUserEvent(ClContext_->get(), &Err);
-  CHIPERR_CHECK_LOG_AND_THROW(Err, CL_SUCCESS, hipErrorTbd);
-
-  // Make the succeeding commands wait for the user event which will be
-  // set CL_COMPLETE by the callback trampoline function pfn_notify after
-  // finishing the user CB's execution.
-
-  HipStreamCallbackData *Cb = new HipStreamCallbackData{
-      this, hipSuccess, UserData, Callback, CallbackEvent};
-
-  std::vector<CHIPEvent *> WaitForEventsCBB{CallbackEvent};
-  auto CallbackCompleted = enqueueBarrier(&WaitForEventsCBB);
-
-  // We know that the callback won't be yet launched since it's depending
-  // on the barrier which waits for the user event.
-  auto Status = clSetEventCallback(HoldbackBarrierCompletedEv->ClEvent,
-                                   CL_COMPLETE, pfn_notify, Cb);
-  CHIPERR_CHECK_LOG_AND_THROW(Status, CL_SUCCESS, hipErrorTbd);
-
-  updateLastEvent(CallbackCompleted);
-  ClQueue_->flush();
-
-  // Now the CB can start executing in the background:
-  clSetUserEventStatus(HoldBackEvent->ClEvent, CL_COMPLETE);
-  HoldBackEvent->decreaseRefCount("Notified finished.");
-
-  return;
-};
-
 CHIPEvent *CHIPQueueOpenCL::enqueueMarkerImpl() {
   CHIPEventOpenCL *MarkerEvent =
       (CHIPEventOpenCL *)Backend->createCHIPEvent(ChipContext_);
@@ -1038,6 +1337,30 @@ CHIPEvent *CHIPQueueOpenCL::enqueueMarkerImpl() {
   return MarkerEvent;
 }
 
+CHIPEventOpenCL *CHIPQueueOpenCL::enqueueTimestamp() {
+  if (Profiling_)
+    return (CHIPEventOpenCL *)enqueueMarker();
+
+  CHIPEventOpenCL *MarkerEvent =
+      (CHIPEventOpenCL *)Backend->createCHIPEvent(ChipContext_);
+  auto *LastEvent = getLastEvent();
+  // Commands of another queue may only be waited for once they are flushed.
+  auto Status = ClQueue_->flush();
+  CHIPERR_CHECK_LOG_AND_THROW(Status, CL_SUCCESS, hipErrorTbd);
+  auto *TimingQueue = ((CHIPDeviceOpenCL *)ChipDevice_)->getTimingQueue();
+  Status = clEnqueueMarkerWithWaitList(
+      TimingQueue, LastEvent ? 1 : 0,
+      LastEvent ? LastEvent->getNativePtr() : nullptr,
+      MarkerEvent->getNativePtr());
+  CHIPERR_CHECK_LOG_AND_THROW(Status, CL_SUCCESS, hipErrorTbd);
+  clFlush(TimingQueue);
+  // The marker is not part of the stream, so it doesn't become its last
+  // event. It is tracked so that it gets released once complete.
+  MarkerEvent->Msg = "timestamp";
+  MarkerEvent->track();
+  return MarkerEvent;
+}
+
 CHIPEventOpenCL *CHIPQueueOpenCL::getLastEvent() {
   LOCK(LastEventMtx); // CHIPQueue::LastEvent_
   // TODO: shouldn't we increment the ref count here, assuming it will be
@@ -1076,11 +1399,22 @@ CHIPEvent *CHIPQueueOpenCL::launchImpl(CHIPExecItem *ExecItem) {
   auto SvmAllocationsToKeepAlive =
       annotateSvmPointers(*OclContext, Kernel->get()->get());
 
-  auto Status = clEnqueueNDRangeKernel(ClQueue_->get(), Kernel->get()->get(),
-                                       NumDims, GlobalOffset, Global, Local, 0,
-                                       nullptr, LaunchEvent->getNativePtr());
+  // The textures are uploaded asynchronously, possibly in another queue.
+  std::vector<cl_event> Uploads;
+  for (auto *Tex : ChipOclExecItem->getTextures())
+    Uploads.push_back(Tex->getUploadEvent());
+
+  auto Status = clEnqueueNDRangeKernel(
+      ClQueue_->get(), Kernel->get()->get(), NumDims, GlobalOffset, Global,
+      Local, Uploads.size(), Uploads.empty() ? nullptr : Uploads.data(),
+      LaunchEvent->getNativePtr());
   CHIPERR_CHECK_LOG_AND_THROW(Status, CL_SUCCESS, hipErrorTbd);
 
+  // Keep the images of the textures from being reused until the kernel is
+  // done with them.
+  for (auto *Tex : ChipOclExecItem->getTextures())
+    Tex->addUse(LaunchEvent->getNativeRef());
+
   std::shared_ptr<CHIPArgSpillBuffer> SpillBuf = ExecItem->getArgSpillBuffer();
 
   if (SpillBuf || SvmAllocationsToKeepAlive) {
@@ -1131,33 +1465,61 @@ CHIPQueueOpenCL::CHIPQueueOpenCL(CHIPDevice *ChipDevice, int Priority,
         hipErrorTbd);
   }
 
-  if (PrioritySelection != CL_QUEUE_PRIORITY_MED_KHR)
-    logWarn("CHIPQueueOpenCL is ignoring Priority value");
+  if (Queue) {
+    // Owned by the application, only retained here.
+    ClQueue_ = new cl::CommandQueue(Queue, true);
+    cl_command_queue_properties Props;
+    auto Status = ClQueue_->getInfo(CL_QUEUE_PROPERTIES, &Props);
+    CHIPERR_CHECK_LOG_AND_THROW(Status, CL_SUCCESS, hipErrorTbd);
+    Profiling_ = Props & CL_QUEUE_PROFILING_ENABLE;
+    return;
+  }
 
-  if (Queue)
-    ClQueue_ = new cl::CommandQueue(Queue);
-  else {
+  auto CreateQueue = [&]() {
     cl::Context *ClContext_ = ((CHIPContextOpenCL *)ChipContext_)->get();
     cl::Device *ClDevice_ = ((CHIPDeviceOpenCL *)ChipDevice_)->get();
     cl_int Status;
-    // Adding priority breaks correctness?
-    // cl_queue_properties QueueProperties[] = {
-    //     CL_QUEUE_PRIORITY_KHR, PrioritySelection, CL_QUEUE_PROPERTIES,
-    //     CL_QUEUE_PROFILING_ENABLE, 0};
-    cl_queue_properties QueueProperties[] = {CL_QUEUE_PROPERTIES,
-                                             CL_QUEUE_PROFILING_ENABLE, 0};
+    // The priority is only passed with cl_khr_priority_hints. Profiling is
+    // left off, timed events are recorded on
+    // CHIPDeviceOpenCL::getTimingQueue().
+    std::vector<cl_queue_properties> QueueProperties;
+    if (((CHIPDeviceOpenCL *)ChipDevice_)->supportsPriorityHints()) {
+      QueueProperties.push_back(CL_QUEUE_PRIORITY_KHR);
+      QueueProperties.push_back(PrioritySelection);
+    }
+    QueueProperties.push_back(0);
 
     const cl_command_queue Q = clCreateCommandQueueWithProperties(
-        ClContext_->get(), ClDevice_->get(), QueueProperties, &Status);
-    ClQueue_ = new cl::CommandQueue(Q);
-
+        ClContext_->get(), ClDevice_->get(), QueueProperties.data(), &Status);
     CHIPERR_CHECK_LOG_AND_THROW(Status, CL_SUCCESS,
                                 hipErrorInitializationError);
+    return Q;
+  };
+
+  auto &Pool = ChipDevice_->getQueuePool();
+  if (!Pool.isEnabled()) {
+    ClQueue_ = new cl::CommandQueue(CreateQueue());
+    return;
   }
+  Pooled_ = true;
+  ClQueue_ = new cl::CommandQueue(
+      (cl_command_queue)Pool.acquire(
+          Priority_, [&]() -> void * { return CreateQueue(); }),
+      false);
 }
 
 CHIPQueueOpenCL::~CHIPQueueOpenCL() {
   logTrace("~CHIPQueueOpenCL() {}", (void *)this);
+  if (Pooled_) {
+    // The next stream using the queue must not wait for our work.
+    ClQueue_->finish();
+    cl_command_queue Q = (*ClQueue_)();
+    clRetainCommandQueue(Q);
+    ChipDevice_->getQueuePool().release(Q, Priority_, [](void *Q) {
+      clReleaseCommandQueue((cl_command_queue)Q);
+    });
+  }
+  delete ClQueue_;
 }
 
 CHIPEvent *CHIPQueueOpenCL::memCopyAsyncImpl(void *Dst, const void *Src,
@@ -1192,8 +1554,20 @@ void CHIPQueueOpenCL::finish() {
 #ifdef DUBIOUS_LOCKS
   LOCK(Backend->DubiousLockOpenCL)
 #endif
-  auto Status = ClQueue_->finish();
+  if (ChipDevice_->getSyncPolicy().blocksRightAway()) {
+    auto Status = ClQueue_->finish();
+    CHIPERR_CHECK_LOG_AND_THROW(Status, CL_SUCCESS, hipErrorTbd);
+    return;
+  }
+
+  // Poll a marker which completes with the work enqueued so far. The
+  // wrapper releases it also if the wait throws.
+  cl_event Marker;
+  auto Status = clEnqueueMarkerWithWaitList(ClQueue_->get(), 0, nullptr,
+                                            &Marker);
   CHIPERR_CHECK_LOG_AND_THROW(Status, CL_SUCCESS, hipErrorTbd);
+  cl::Event MarkerOwner(Marker);
+  waitForEvent(ChipDevice_, Marker);
 }
 
 CHIPEvent *CHIPQueueOpenCL::memFillAsyncImpl(void *Dst, size_t Size,
@@ -1249,8 +1623,21 @@ hipError_t CHIPQueueOpenCL::getBackendHandles(uintptr_t *NativeInfo,
   return hipSuccess;
 }
 
-CHIPEvent *CHIPQueueOpenCL::memPrefetchImpl(const void *Ptr, size_t Count) {
-  UNIMPLEMENTED(nullptr);
+CHIPEvent *CHIPQueueOpenCL::memPrefetchImpl(const void *Ptr, size_t Count,
+                                            bool ToHost) {
+#ifdef DUBIOUS_LOCKS
+  LOCK(Backend->DubiousLockOpenCL)
+#endif
+  CHIPEventOpenCL *Event =
+      (CHIPEventOpenCL *)Backend->createCHIPEvent(ChipContext_);
+  logTrace("clEnqueueSVMMigrateMem {} / {} B to {}", Ptr, Count,
+           ToHost ? "host" : "device");
+  cl_mem_migration_flags Flags = ToHost ? CL_MIGRATE_MEM_OBJECT_HOST : 0;
+  auto Status = ::clEnqueueSVMMigrateMem(ClQueue_->get(), 1, &Ptr, &Count,
+                                         Flags, 0, nullptr,
+                                         Event->getNativePtr());
+  CHIPERR_CHECK_LOG_AND_THROW(Status, CL_SUCCESS, hipErrorTbd);
+  return Event;
 }
 
 CHIPEvent *
@@ -1302,6 +1689,7 @@ void CHIPExecItemOpenCL::setupAllArgs() {
   CHIPKernelOpenCL *Kernel = (CHIPKernelOpenCL *)getKernel();
   SPVFuncInfo *FuncInfo = Kernel->getFuncInfo();
   int Err = 0;
+  Textures_.clear();
 
   if (FuncInfo->hasByRefArgs()) {
     ArgSpillBuffer_ =
@@ -1315,8 +1703,8 @@ void CHIPExecItemOpenCL::setupAllArgs() {
       CHIPERR_LOG_AND_THROW("Internal CHIP-SPV error: Unknown argument kind",
                             hipErrorTbd);
     case SPVTypeKind::Image: {
-      auto *TexObj =
-          *reinterpret_cast<const CHIPTextureOpenCL *const *>(Arg.Data);
+      auto *TexObj = *reinterpret_cast<CHIPTextureOpenCL *const *>(Arg.Data);
+      Textures_.push_back(TexObj);
       cl_mem Image = TexObj->getImage();
       logTrace("set image arg {} for tex {}\n", Arg.Index, (void *)TexObj);
       Err = ::clSetKernelArg(Kernel->get()->get(), Arg.Index, sizeof(cl_mem),
@@ -1427,7 +1815,7 @@ CHIPQueue *CHIPBackendOpenCL::createCHIPQueue(CHIPDevice *ChipDev) {
 CHIPCallbackData *
 CHIPBackendOpenCL::createCallbackData(hipStreamCallback_t Callback,
                                       void *UserData, CHIPQueue *ChipQueue) {
-  UNIMPLEMENTED(nullptr);
+  return new CHIPCallbackDataOpenCL(Callback, UserData, ChipQueue);
 }
 
 CHIPEventMonitor *CHIPBackendOpenCL::createCallbackEventMonitor_() {
@@ -1448,7 +1836,6 @@ void CHIPBackendOpenCL::initializeImpl(std::string CHIPPlatformStr,
                                        std::string CHIPDeviceTypeStr,
                                        std::string CHIPDeviceStr) {
   logTrace("CHIPBackendOpenCL Initialize");
-  MinQueuePriority_ = CL_QUEUE_PRIORITY_MED_KHR;
 
   // transform device type string into CL
   cl_bitfield SelectedDevType = 0;
@@ -1527,6 +1914,9 @@ void CHIPBackendOpenCL::initializeImpl(std::string CHIPPlatformStr,
   // TODO for now only a single device is supported.
   cl::Device *clDev = new cl::Device(Device);
   CHIPDeviceOpenCL *ChipDev = CHIPDeviceOpenCL::create(clDev, ChipContext, 0);
+  // Without cl_khr_priority_hints there is a single priority level.
+  MinQueuePriority_ =
+      ChipDev->supportsPriorityHints() ? OCL_MIN_QUEUE_PRIORITY : 0;
 
   // Add device to context & backend
   ChipContext->setDevice(ChipDev);
@@ -1536,7 +1926,6 @@ void CHIPBackendOpenCL::initializeImpl(std::string CHIPPlatformStr,
 void CHIPBackendOpenCL::initializeFromNative(const uintptr_t *NativeHandles,
                                              int NumHandles) {
   logTrace("CHIPBackendOpenCL InitializeNative");
-  MinQueuePriority_ = CL_QUEUE_PRIORITY_MED_KHR;
   // cl_platform_id PlatId = (cl_platform_id)NativeHandles[0];
   cl_device_id DevId = (cl_device_id)NativeHandles[1];
   cl_context CtxId = (cl_context)NativeHandles[2];
@@ -1547,6 +1936,8 @@ void CHIPBackendOpenCL::initializeFromNative(const uintptr_t *NativeHandles,
 
   cl::Device *Dev = new cl::Device(DevId);
   CHIPDeviceOpenCL *ChipDev = CHIPDeviceOpenCL::create(Dev, ChipContext, 0);
+  MinQueuePriority_ =
+      ChipDev->supportsPriorityHints() ? OCL_MIN_QUEUE_PRIORITY : 0;
   logTrace("CHIPDeviceOpenCL {}", ChipDev->ClDevice->getInfo<CL_DEVICE_NAME>());
 
   // Add device to context & backend
@@ -48,12 +48,27 @@
 #include <CL/opencl.hpp>
 #pragma GCC diagnostic pop
 
+#include <list>
+#include <tuple>
+
 #include "../../CHIPBackend.hh"
 #include "exceptions.hh"
 #include "spirv.hh"
 #include "Utils.hh"
 
-#define OCL_DEFAULT_QUEUE_PRIORITY CL_QUEUE_PRIORITY_MED_KHR
+#define OCL_DEFAULT_QUEUE_PRIORITY DEFAULT_QUEUE_PRIORITY
+// Stream priorities 0, 1 and 2 map to the high, medium and low
+// cl_khr_priority_hints.
+#define OCL_MIN_QUEUE_PRIORITY 2
+
+// cl_ext_float_atomics, missing from older headers.
+#ifndef CL_DEVICE_SINGLE_FP_ATOMIC_CAPABILITIES_EXT
+typedef cl_bitfield cl_device_fp_atomic_capabilities_ext;
+#define CL_DEVICE_SINGLE_FP_ATOMIC_CAPABILITIES_EXT 0x4231
+#define CL_DEVICE_DOUBLE_FP_ATOMIC_CAPABILITIES_EXT 0x4232
+#define CL_DEVICE_GLOBAL_FP_ATOMIC_ADD_EXT (1 << 1)
+#define CL_DEVICE_LOCAL_FP_ATOMIC_ADD_EXT (1 << 17)
+#endif
 
 std::string resultToString(int Status);
 
@@ -67,16 +82,32 @@ class CHIPBackendOpenCL;
 class CHIPModuleOpenCL;
 class CHIPTextureOpenCL;
 
-class CHIPCallbackDataOpenCL {
-private:
-public:
-  CHIPQueueOpenCL *ChipQueue;
-  void *CallbackArgs;
-  hipStreamCallback_t CallbackF;
-  hipError_t Status;
+/// The layout of the image of a texture. Images of destroyed textures are
+/// reused for textures with the same layout.
+struct CHIPTextureImageLayout {
+  unsigned TextureType;
+  hipChannelFormatDesc Format;
+  bool NormalizedFloat;
+  size_t Width;
+  size_t Height;
+  size_t Depth;
+
+  bool operator==(const CHIPTextureImageLayout &Other) const {
+    return TextureType == Other.TextureType && Format.x == Other.Format.x &&
+           Format.y == Other.Format.y && Format.z == Other.Format.z &&
+           Format.w == Other.Format.w && Format.f == Other.Format.f &&
+           NormalizedFloat == Other.NormalizedFloat && Width == Other.Width &&
+           Height == Other.Height && Depth == Other.Depth;
+  }
+};
 
+class CHIPCallbackDataOpenCL : public CHIPCallbackData {
+public:
   CHIPCallbackDataOpenCL(hipStreamCallback_t CallbackF, void *CallbackArgs,
                          CHIPQueue *ChipQueue);
+
+  virtual void enqueue() override;
+  virtual void complete() override;
 };
 
 class CHIPEventMonitorOpenCL : public CHIPEventMonitor {
@@ -124,7 +155,10 @@ public:
 };
 
 class SVMemoryRegion {
+public:
   enum SVM_ALLOC_GRANULARITY { COARSE_GRAIN, FINE_GRAIN };
+
+private:
   // ContextMutex should be enough
 
   std::map<std::shared_ptr<void>, size_t, PointerCmp<void>> SvmAllocations_;
@@ -158,24 +192,53 @@ class CHIPContextOpenCL : public CHIPContext {
 public:
   bool allDevicesSupportFineGrainSVM();
   SVMemoryRegion SvmMemory;
+  /// Number of live hipHostRegister() imports. Kernels may access them
+  /// indirectly, which must be enabled per kernel launch. Guarded by
+  /// ContextMtx.
+  size_t NumRegisteredHostRegions = 0;
   cl::Context *ClContext;
   CHIPContextOpenCL(cl::Context *ClContext);
   virtual ~CHIPContextOpenCL() {}
+
   void *allocateImpl(size_t Size, size_t Alignment, hipMemoryType MemType,
                      CHIPHostAllocFlags Flags = CHIPHostAllocFlags()) override;
 
   bool isAllocatedPtrMappedToVM(void *Ptr) override { return false; } // TODO
   virtual void freeImpl(void *Ptr) override;
+  bool registerHostMemory(void *HostPtr, size_t Size) override;
+  void unregisterHostMemory(void *HostPtr) override;
   cl::Context *get();
 };
 
 class CHIPDeviceOpenCL : public CHIPDevice {
 private:
   bool SupportsFineGrainSVM = false;
+  bool SupportsSystemSVM = false;
+  bool SupportsPriorityHints = false;
+  // Created on the first timed hipEventRecord(), see getTimingQueue()
+  cl_command_queue TimingQueue_ = nullptr;
+  std::mutex TimingQueueMtx_;
+
+  /// An image of a destroyed texture and the kernel launches which read it
+  /// and may not have completed yet.
+  struct IdleTextureImage {
+    CHIPTextureImageLayout Layout;
+    cl_mem Image;
+    std::vector<cl_event> Uses;
+  };
+  /// The sampler objects of the textures, keyed by the normalized coordinates
+  /// flag, the addressing mode and the filter mode.
+  std::map<std::tuple<cl_bool, cl_addressing_mode, cl_filter_mode>,
+           cl_sampler>
+      TextureSamplers_;
+  /// The images of the destroyed textures, the most recently used first.
+  std::list<IdleTextureImage> IdleTextureImages_;
+  std::mutex TextureMtx_;
   CHIPDeviceOpenCL(CHIPContextOpenCL *ChipContext, cl::Device *ClDevice,
                    int Idx);
 
 public:
+  virtual ~CHIPDeviceOpenCL() override;
   virtual CHIPContextOpenCL *createContext() override { return nullptr; }
 
   static CHIPDeviceOpenCL *create(cl::Device *ClDevice,
@@ -184,8 +247,24 @@ public:
   cl::Context *ClContext;
   cl::Device *get() { return ClDevice; }
   bool supportsFineGrainSVM() { return SupportsFineGrainSVM; }
+  /// Whether the device can access any host memory (e.g. from malloc())
+  bool supportsSystemSVM() { return SupportsSystemSVM; }
+  /// Whether queues can be created with CL_QUEUE_PRIORITY_KHR
+  bool supportsPriorityHints() { return SupportsPriorityHints; }
+  /**
+   * @brief Get the profiling-enabled queue timed events are recorded on.
+   *
+   * Stream queues are created without CL_QUEUE_PROFILING_ENABLE so that
+   * commands don't pay for timestamps nobody reads. A timed event gets its
+   * timestamp from a marker in this queue which waits for the stream's last
+   * command. The queue is out-of-order if the device allows it so that
+   * markers of different streams don't wait for each other.
+   */
+  cl_command_queue getTimingQueue();
   virtual void populateDevicePropertiesImpl() override;
   virtual void resetImpl() override;
+  virtual int getMaxActiveBlocksPerCU(int BlockSize,
+                                      size_t SharedMemPerBlock) override;
   virtual CHIPQueue *createQueue(CHIPQueueFlags Flags, int Priority) override;
   virtual CHIPQueue *createQueue(const uintptr_t *NativeHandles,
                                  int NumHandles) override;
@@ -198,6 +277,32 @@ public:
     delete ChipTexture;
   }
 
+  /**
+   * @brief Get a sampler object with the given properties.
+   *
+   * The samplers are created once and shared by the textures. The caller
+   * owns a reference to the returned sampler.
+   */
+  cl_sampler getTextureSampler(cl_bool NormalizedCoords,
+                               cl_addressing_mode AddressMode,
+                               cl_filter_mode FilterMode);
+
+  /**
+   * @brief Get an image with the given layout for a new texture.
+   *
+   * Reuses an image of a destroyed texture if there is one with the layout.
+   *
+   * @param Uses set to the kernel launches which read a reused image. The
+   * caller owns the references to the events.
+   */
+  cl_mem acquireTextureImage(const CHIPTextureImageLayout &Layout,
+                             std::vector<cl_event> &Uses);
+
+  /// Take back the image of a destroyed texture for reuse. Takes over the
+  /// references to Image and Uses.
+  void releaseTextureImage(const CHIPTextureImageLayout &Layout, cl_mem Image,
+                           std::vector<cl_event> &&Uses);
+
   CHIPModuleOpenCL *compile(const SPVModule &SrcMod) override {
     auto CompiledModule = std::make_unique<CHIPModuleOpenCL>(SrcMod);
     CompiledModule->compile(this);
@@ -209,6 +314,11 @@ class CHIPQueueOpenCL : public CHIPQueue {
 protected:
   // Any reason to make these private/protected?
   cl::CommandQueue *ClQueue_;
+  // Set if ClQueue_ is returned to CHIPQueuePool on destruction
+  bool Pooled_ = false;
+  // Whether ClQueue_ has CL_QUEUE_PROFILING_ENABLE. Only application
+  // provided queues may have it.
+  bool Profiling_ = false;
 
   /**
    * @brief Map memory to device.
@@ -241,8 +351,6 @@ public:
   virtual ~CHIPQueueOpenCL() override;
   virtual CHIPEventOpenCL *getLastEvent() override;
   virtual CHIPEvent *launchImpl(CHIPExecItem *ExecItem) override;
-  virtual void addCallback(hipStreamCallback_t Callback,
-                           void *UserData) override;
   virtual void finish() override;
   virtual CHIPEvent *memCopyAsyncImpl(void *Dst, const void *Src,
                                       size_t Size) override;
@@ -264,16 +372,17 @@ public:
   virtual CHIPEvent *
   enqueueBarrierImpl(std::vector<CHIPEvent *> *EventsToWaitFor) override;
   virtual CHIPEvent *enqueueMarkerImpl() override;
-  virtual CHIPEvent *memPrefetchImpl(const void *Ptr, size_t Count) override;
+  /// Enqueue a marker whose CL_PROFILING_COMMAND_END is taken when the
+  /// commands enqueued so far have completed.
+  CHIPEventOpenCL *enqueueTimestamp();
+  virtual CHIPEvent *memPrefetchImpl(const void *Ptr, size_t Count,
+                                     bool ToHost) override;
 };
 
 class CHIPKernelOpenCL : public CHIPKernel {
 private:
   std::string Name_;
   cl::Kernel OclKernel_;
-  size_t MaxDynamicLocalSize_;
-  size_t MaxWorkGroupSize_;
-  size_t StaticLocalSize_;
   size_t PrivateSize_;
 
   CHIPModuleOpenCL *Module;
@@ -299,6 +408,8 @@ class CHIPExecItemOpenCL : public CHIPExecItem {
 private:
   std::unique_ptr<CHIPKernelOpenCL> ChipKernel_;
   cl::Kernel *ClKernel_;
+  // The textures passed to the kernel. Collected by setupAllArgs().
+  std::vector<CHIPTextureOpenCL *> Textures_;
 
 public:
   CHIPExecItemOpenCL(const CHIPExecItemOpenCL &Other)
@@ -330,6 +441,9 @@ public:
 
   void setKernel(CHIPKernel *Kernel) override;
   CHIPKernelOpenCL *getKernel() override { return ChipKernel_.get(); }
+  const std::vector<CHIPTextureOpenCL *> &getTextures() const {
+    return Textures_;
+  }
 };
 
 class CHIPBackendOpenCL : public CHIPBackend {
@@ -364,26 +478,48 @@ public:
 };
 
 class CHIPTextureOpenCL : public CHIPTexture {
+  CHIPDeviceOpenCL *Device_;
+  CHIPTextureImageLayout Layout_;
   cl_mem Image;
   cl_sampler Sampler;
+  /// The upload of the resource into the image. The launches reading the
+  /// texture wait for it.
+  cl_event Upload_ = nullptr;
+  /// The kernel launches which read the texture, possibly in several
+  /// queues. The image is reused only after all of them.
+  std::vector<cl_event> Uses_;
+  std::mutex UsesMtx_;
 
 public:
   CHIPTextureOpenCL() = delete;
-  CHIPTextureOpenCL(const hipResourceDesc &ResDesc, cl_mem TheImage,
+  CHIPTextureOpenCL(const hipResourceDesc &ResDesc, CHIPDeviceOpenCL *Device,
+                    const CHIPTextureImageLayout &Layout, cl_mem TheImage,
                     cl_sampler TheSampler)
-      : CHIPTexture(ResDesc), Image(TheImage), Sampler(TheSampler) {}
+      : CHIPTexture(ResDesc), Device_(Device), Layout_(Layout),
+        Image(TheImage), Sampler(TheSampler) {}
 
   virtual ~CHIPTextureOpenCL() {
     cl_int Status;
-    Status = clReleaseMemObject(Image);
-    assert(Status == CL_SUCCESS && "Invalid image handler?");
+    // Hand the image over to the device for the next texture of the same
+    // layout.
+    Device_->releaseTextureImage(Layout_, Image, std::move(Uses_));
     Status = clReleaseSampler(Sampler);
     assert(Status == CL_SUCCESS && "Invalid sampler handler?");
+    if (Upload_) {
+      Status = clReleaseEvent(Upload_);
+      assert(Status == CL_SUCCESS && "Invalid event handler?");
+    }
     (void)Status;
   }
 
   cl_mem getImage() const { return Image; }
   cl_sampler getSampler() const { return Sampler; }
+  cl_event getUploadEvent() const { return Upload_; }
+  /// Set the upload event. Takes over the reference to the event.
+  void setUploadEvent(cl_event Upload) { Upload_ = Upload; }
+  /// Record a kernel launch reading the texture. Forgets the launches
+  /// which have completed.
+  void addUse(cl_event LaunchEvent);
 };
 
 #endif
@@ -31,6 +31,7 @@
 #include <vector>
 #include <stdint.h>
 #include <string>
+#include <string_view>
 #include <memory>
 #include <unordered_set>
 #include <utility>
@@ -38,6 +39,7 @@
 #include <algorithm>
 #include <iostream>
 #include <mutex>
+#include <condition_variable>
 #include <queue>
 #include <stack>
 
@@ -53,8 +55,20 @@ struct hipGraphNode {};
 struct hipGraphExec {};
 
 bool filterSPIRV(const char *Bytes, size_t NumBytes, std::string &Dst);
+/// Parse the kernel information of the module into FuncInfoMap, the names
+/// of the functions it defines for the runtime device libraries to replace
+/// into RtDevLibExports and the format strings of its printf() calls into
+/// PrintfFormats.
 bool parseSPIR(uint32_t *Stream, size_t NumWords,
-               OpenCLFunctionInfoMap &FuncInfoMap);
+               OpenCLFunctionInfoMap &FuncInfoMap,
+               std::set<std::string> &RtDevLibExports,
+               std::string &PrintfFormats);
+/// Copy the module into Dst with the definitions of the exported functions
+/// named in Names turned into imports, so a library defining them can be
+/// linked with it. Returns false if the module is not valid SPIR-V.
+bool importDefinitions(std::string_view Binary,
+                       const std::set<std::string_view> &Names,
+                       std::string &Dst);
 
 /// A prefix given to lowered global scope device variables.
 constexpr char ChipVarPrefix[] = "__chip_var_";
@@ -88,4 +102,132 @@ constexpr char ChipSpilledArgsVarPrefix[] = "__chip_spilled_args_";
 /// the abort() function was called by a kernel.
 constexpr char ChipDeviceAbortFlagName[] = "__chipspv_abort_called";
 
+/// The name of a global variable pointing to the buffer the device-side
+/// printf() calls write their records to. Set by the runtime.
+constexpr char ChipDevicePrintfBufferName[] = "__chipspv_printf_buffer";
+
+/// The name of a global variable carrying the nul-terminated format strings
+/// of the printf() calls in a module. The records refer to the format
+/// strings by their offset in it.
+constexpr char ChipPrintfFormatsName[] = "__chip_printf_formats";
+
+/// The header of a device-side printf() buffer. The records follow it in a
+/// ring (see HipPrintf.cpp and bitcode/printf_support.cl). The offsets grow
+/// without bounds, wrapping around at 2^32, and are taken modulo the
+/// capacity to locate the records.
+struct CHIPPrintfBuffer {
+  /// Bytes reserved for the records so far.
+  uint32_t Used;
+  /// Bytes available for the records. A power of two.
+  uint32_t Capacity;
+  /// The number of records which did not fit so far.
+  uint32_t Dropped;
+  /// Bytes of records the runtime has printed so far. Their space is
+  /// cleared and can be reserved again.
+  uint32_t Consumed;
+};
+
+/// The header of a printf() record. The arguments follow it in 8-byte slots
+/// in the order of the format string. A %s argument is stored as its length
+/// followed by its characters, padded to the slot size.
+struct CHIPPrintfRecord {
+  /// Bytes taken by the record. Written last: zero marks a record which is
+  /// still being written.
+  uint32_t Size;
+  /// The offset of the format string in ChipPrintfFormatsName, or
+  /// ChipPrintfPadding.
+  uint32_t FormatOffset;
+};
+
+/// The FormatOffset of a record filling the end of the ring which the next
+/// record did not fit in.
+constexpr uint32_t ChipPrintfPadding = ~0u;
+
+/// The size of the slot of a printf() argument.
+constexpr unsigned ChipPrintfSlotSize = 8;
+
+/// The name of a global variable pointing to the heap the device-side
+/// malloc() allocates from. Set by the runtime.
+constexpr char ChipDeviceMallocHeapName[] = "__chipspv_malloc_heap";
+
+/// The device-side malloc() heap is divided into chunks of this size. A chunk
+/// is either free, split into blocks of one size class or a part of an
+/// allocation larger than the blocks. Keep the constants in sync with
+/// bitcode/malloc_support.cl.
+constexpr unsigned ChipMallocChunkSize = 1 << 16;
+/// The size of the blocks of the smallest size class. The size classes are
+/// powers of two.
+constexpr unsigned ChipMallocMinBlockSize = 16;
+constexpr unsigned ChipMallocNumClasses = 8;
+/// The value of CHIPMallocChunk::Used of chunks not split into blocks.
+constexpr uint32_t ChipMallocChunkNotSplit = 0xffffffff;
+
+/// The state of a chunk of the device-side malloc() heap.
+struct CHIPMallocChunk {
+  /// Zero if the chunk is free, one plus the size class if the chunk is split
+  /// into blocks, otherwise the chunk belongs to a larger allocation.
+  uint32_t State;
+  /// The number of reserved blocks.
+  uint32_t Used;
+  /// The allocated blocks.
+  uint32_t Bitmap[ChipMallocChunkSize / ChipMallocMinBlockSize / 32];
+};
+
+/// The header of the device-side malloc() heap. The chunk states follow it
+/// and the chunks start at ArenaOffset.
+struct CHIPMallocHeap {
+  uint32_t NumChunks;
+  uint32_t ArenaOffset;
+  /// One plus the index of the chunk each size class allocates from first,
+  /// or zero.
+  uint32_t Current[ChipMallocNumClasses];
+};
+
+/// Optional device capabilities used by the runtime device libraries.
+/// ProgramLinking is the ability to link SPIR-V modules when compiling them.
+enum class CHIPDeviceFeature {
+  ProgramLinking,
+  FloatAtomicAdd,
+  DoubleAtomicAdd,
+  SubgroupCollectives
+};
+
+/// A device library with native variants of functions whose names start
+/// with SymbolPrefix, built into '<Name>_native.spv' (see
+/// bitcode/CMakeLists.txt). The device library compiled into the modules
+/// defines emulated variants of the functions. On devices having
+/// NativeFeature and ProgramLinking the runtime turns those into imports and
+/// links the native variants instead.
+struct CHIPRtDevLib {
+  const char *Name;
+  const char *SymbolPrefix;
+  CHIPDeviceFeature NativeFeature;
+};
+
+constexpr CHIPRtDevLib ChipRtDevLibs[] = {
+    {"atomic_add_f32", "__chip_atomic_add_f32_",
+     CHIPDeviceFeature::FloatAtomicAdd},
+    {"atomic_add_f64", "__chip_atomic_add_f64_",
+     CHIPDeviceFeature::DoubleAtomicAdd},
+    {"subgroup_collectives", "__chip_sg_",
+     CHIPDeviceFeature::SubgroupCollectives},
+    {"subgroup_collectives_f64", "__chip_sg_d_",
+     CHIPDeviceFeature::SubgroupCollectives}};
+
+/// Return the runtime device library defining the symbol, or nullptr. The
+/// library with the longest matching prefix wins.
+inline const CHIPRtDevLib *findRtDevLib(std::string_view Symbol) {
+  const CHIPRtDevLib *Found = nullptr;
+  size_t FoundSize = 0;
+  for (const auto &Lib : ChipRtDevLibs) {
+    std::string_view Prefix(Lib.SymbolPrefix);
+    if (Prefix.size() > FoundSize &&
+        Symbol.substr(0, Prefix.size()) == Prefix) {
+      Found = &Lib;
+      FoundSize = Prefix.size();
+    }
+  }
+  return Found;
+}
+
 #endif
@@ -524,8 +524,12 @@ class SPIRVmodule {
   std::unordered_map<InstWord, std::unique_ptr<SPIRVinst>> IdToInstMap_;
   /// Names of globals and functions.
   std::map<InstWord, std::string_view> LinkNames_;
+  /// Names of the exported functions a runtime device library replaces.
+  std::set<std::string> RtDevLibExports_;
   std::map<std::string_view, std::vector<std::pair<uint16_t, uint16_t>>>
       SpilledArgAnnotations_;
+  /// The format strings of the printf() calls.
+  std::string PrintfFormats_;
 
   bool MemModelCL_;
   bool KernelCapab_;
@@ -573,7 +577,9 @@ public:
     return valid();
   }
 
-  bool fillModuleInfo(OpenCLFunctionInfoMap &ModuleMap) {
+  bool fillModuleInfo(OpenCLFunctionInfoMap &ModuleMap,
+                      std::set<std::string> &RtDevLibExports,
+                      std::string &PrintfFormats) {
     if (!valid())
       return false;
 
@@ -593,6 +599,8 @@ public:
       ModuleMap.emplace(std::make_pair(i.second, FnInfo));
     }
     FunctionTypeMap_.clear();
+    RtDevLibExports.insert(RtDevLibExports_.begin(), RtDevLibExports_.end());
+    PrintfFormats = std::move(PrintfFormats_);
 
     return true;
   }
@@ -671,6 +679,9 @@ private:
         auto TargetID = Inst->getWord(1);
         auto LinkName = parseLinkageAttributeName(Inst);
         LinkNames_[TargetID] = LinkName;
+        if (parseLinkageAttributeType(*Inst) == spv::LinkageTypeExport &&
+            findRtDevLib(LinkName))
+          RtDevLibExports_.emplace(LinkName);
       }
 
       if (Inst->isGlobalVariable()) {
@@ -696,6 +707,22 @@ private:
             uint16_t ArgSize = Annotation >> 16u;
             SpillAnnotation.push_back(std::make_pair(ArgIndex, ArgSize));
           }
+        } else if (Name == ChipPrintfFormatsName) {
+          auto *Init = getInstruction(Inst->getWord(4));
+          assert(Init && "Format string variable is missing an initializer.");
+          // Init is known to be OpConstantComposite of char array.
+          auto *Type = TypeMap_[Init->getResultTypeID()];
+          auto *ArrayType = dynamic_cast<SPIRVtypeArray *>(Type);
+          assert(ArrayType && "Unexpected format string variable type.");
+          auto ArrLen = ArrayType->elementCount();
+          PrintfFormats_.reserve(ArrLen);
+          for (auto EltID : getWordRange(&Init->getWord(3), ArrLen)) {
+            // OpConstant, or OpConstantNull for the nul characters.
+            auto *Char = getInstruction(EltID);
+            PrintfFormats_.push_back(Char && Char->isConstant()
+                                         ? (char)Char->getWord(3)
+                                         : '\0');
+          }
         }
       }
 
@@ -738,7 +765,8 @@ bool filterSPIRV(const char *Bytes, size_t NumBytes, std::string &Dst) {
     // This workaround drops OpName instructions, whose string matches one of
     // the OpEntryPoint names, and all linkage attribute OpDecorations from the
     // binary we don't need to preserve. OpNames do not have semantical meaning
-    // and we are not currently linking the SPIR-V modules with anything else.
+    // and the modules are only linked with the runtime device libraries,
+    // which replace the exported functions they define.
     if (Insn.isName() && EntryPoints.count(Insn.getName()))
       continue;
     if (Insn.isDecoration(spv::DecorationLinkageAttributes)) {
@@ -752,7 +780,8 @@ bool filterSPIRV(const char *Bytes, size_t NumBytes, std::string &Dst) {
         // Issue warning unless it's a magic CHIP-SPV or llvm-spirv symbol.
         if (!startsWith(LinkName, "__spirv_"))
           logWarn("Missing definition for '{}'", LinkName);
-      } else if (!startsWith(LinkName, ChipSpilledArgsVarPrefix))
+      } else if (!startsWith(LinkName, ChipSpilledArgsVarPrefix) &&
+                 LinkName != ChipPrintfFormatsName && !findRtDevLib(LinkName))
         // Some specially named variables are preserved for later analysis.
         continue;
     }
@@ -764,9 +793,103 @@ bool filterSPIRV(const char *Bytes, size_t NumBytes, std::string &Dst) {
 }
 
 bool parseSPIR(InstWord *Stream, size_t NumWords,
-               OpenCLFunctionInfoMap &Output) {
+               OpenCLFunctionInfoMap &Output,
+               std::set<std::string> &RtDevLibExports,
+               std::string &PrintfFormats) {
   SPIRVmodule Mod;
   if (!Mod.parseSPIRV(Stream, NumWords))
     return false;
-  return Mod.fillModuleInfo(Output);
+  return Mod.fillModuleInfo(Output, RtDevLibExports, PrintfFormats);
+}
+
+bool importDefinitions(std::string_view Binary,
+                       const std::set<std::string_view> &Names,
+                       std::string &Dst) {
+  logTrace("importDefinitions");
+
+  auto *WordsPtr = (const InstWord *)Binary.data();
+  size_t NumWords = Binary.size() / sizeof(InstWord);
+
+  if (!parseHeader(WordsPtr, NumWords))
+    return false; // Invalid SPIR-V binary.
+
+  // Find the functions to strip and the IDs defined in their bodies. The
+  // names and decorations of the latter must go with the bodies.
+  std::set<InstWord> Imported, BodyIDs;
+  bool InImported = false;
+  size_t InsnSize = 0;
+  for (size_t I = 0; I < NumWords; I += InsnSize) {
+    SPIRVinst Insn(WordsPtr + I);
+    InsnSize = Insn.size();
+    assert(InsnSize && "Invalid instruction size, will loop forever!");
+
+    if (Insn.isDecoration(spv::DecorationLinkageAttributes) &&
+        parseLinkageAttributeType(Insn) == spv::LinkageTypeExport &&
+        Names.count(parseLinkageAttributeName(Insn)))
+      Imported.insert(Insn.getWord(1));
+    else if (Insn.isFunction())
+      InImported = Imported.count(Insn.getFunctionID());
+    else if (Insn.getOpcode() == spv::Op::OpFunctionEnd)
+      InImported = false;
+    else if (InImported && Insn.hasResultID() &&
+             Insn.getOpcode() != spv::Op::OpFunctionParameter)
+      BodyIDs.insert(Insn.getResultID());
+  }
+
+  Dst.reserve(Binary.size());
+  Dst.append(Binary.data(), (const char *)WordsPtr); // Copy the header.
+
+  // Function declarations must precede all function definitions, so the
+  // functions are collected separately and the stripped ones are emitted
+  // with the declarations.
+  std::string Declarations, Definitions, Function;
+  bool InFunction = false, HasBody = false;
+  for (size_t I = 0; I < NumWords; I += InsnSize) {
+    SPIRVinst Insn(WordsPtr + I);
+    InsnSize = Insn.size();
+    auto Opcode = Insn.getOpcode();
+    const char *InsnBegin = (const char *)(WordsPtr + I);
+    size_t InsnBytes = InsnSize * sizeof(InstWord);
+
+    if (Insn.isFunction()) {
+      InFunction = true;
+      HasBody = false;
+      InImported = Imported.count(Insn.getFunctionID());
+    }
+
+    if (!InFunction) {
+      if ((Opcode == spv::Op::OpName || Opcode == spv::Op::OpDecorate ||
+           Opcode == spv::Op::OpDecorateId ||
+           Opcode == spv::Op::OpDecorateString) &&
+          BodyIDs.count(Insn.getWord(1)))
+        continue;
+      if (Insn.isDecoration(spv::DecorationLinkageAttributes) &&
+          Imported.count(Insn.getWord(1))) {
+        Dst.append(InsnBegin, InsnBytes - sizeof(InstWord));
+        InstWord Import = spv::LinkageTypeImport;
+        Dst.append((const char *)&Import, sizeof(InstWord));
+        continue;
+      }
+      Dst.append(InsnBegin, InsnBytes);
+      continue;
+    }
+
+    if (Opcode == spv::Op::OpLabel)
+      HasBody = true;
+    if (!InImported || Insn.isFunction() ||
+        Opcode == spv::Op::OpFunctionParameter ||
+        Opcode == spv::Op::OpFunctionEnd)
+      Function.append(InsnBegin, InsnBytes);
+
+    if (Opcode == spv::Op::OpFunctionEnd) {
+      auto &Section = HasBody && !InImported ? Definitions : Declarations;
+      Section += Function;
+      Function.clear();
+      InFunction = InImported = false;
+    }
+  }
+
+  Dst += Declarations;
+  Dst += Definitions;
+  return true;
 }
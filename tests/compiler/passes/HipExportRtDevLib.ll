@@ -0,0 +1,35 @@
+; Check HipExportRtDevLibFunctionsPass exports the emulated device library
+; functions the runtime device libraries replace and merges their per
+; translation unit copies.
+
+; CHECK-LABEL: define spir_kernel void @k(
+; CHECK: call spir_func float @__chip_atomic_add_f32_global(
+; CHECK: call spir_func float @__chip_atomic_add_f32_global(
+; CHECK: call spir_func double @__chip_atomic_add_f64_local(
+define spir_kernel void @k(ptr addrspace(1) %g, ptr addrspace(3) %l) {
+  %a = call spir_func float @__chip_atomic_add_f32_global(ptr addrspace(1) %g, float 1.0)
+  %b = call spir_func float @__chip_atomic_add_f32_global.1(ptr addrspace(1) %g, float 2.0)
+  %c = call spir_func double @__chip_atomic_add_f64_local.2(ptr addrspace(3) %l, double 3.0)
+  ret void
+}
+
+; CHECK: define dso_local spir_func float @__chip_atomic_add_f32_global(
+define internal spir_func float @__chip_atomic_add_f32_global(ptr addrspace(1) %p, float %v) noinline {
+  ret float %v
+}
+
+; CHECK-NOT: @__chip_atomic_add_f32_global.1
+define internal spir_func float @__chip_atomic_add_f32_global.1(ptr addrspace(1) %p, float %v) noinline {
+  ret float %v
+}
+
+; CHECK: define dso_local spir_func double @__chip_atomic_add_f64_local(
+define internal spir_func double @__chip_atomic_add_f64_local.2(ptr addrspace(3) %p, double %v) noinline {
+  ret double %v
+}
+
+; Other functions are not touched.
+; CHECK: define internal spir_func float @__chip_atomic_add_f32(
+define internal spir_func float @__chip_atomic_add_f32(ptr addrspace(4) %p, float %v) {
+  ret float %v
+}
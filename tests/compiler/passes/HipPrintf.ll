@@ -0,0 +1,45 @@
+; Check HipPrintfPass lowers the printf() calls to records written to the
+; buffer set up by the runtime and collects the format strings.
+
+@__chipspv_printf_buffer = weak addrspace(1) global ptr addrspace(4) null
+@.fmt = private unnamed_addr addrspace(4) constant [10 x i8] c"%d %f %s\0A\00"
+@.str = private unnamed_addr addrspace(4) constant [3 x i8] c"hi\00"
+@.bad = private unnamed_addr addrspace(4) constant [6 x i8] c"%d %d\00"
+
+declare spir_func i32 @printf(ptr addrspace(4), ...)
+
+; Each format string is stored once.
+; CHECK: @__chip_printf_formats = addrspace(1) constant [47 x i8] c"%d %f %s\0A\00Error: Invalid printf format string\0A\00"
+
+; CHECK-LABEL: define spir_kernel void @k(
+; CHECK: %[[LEN:.*]] = call spir_func i32 @_chip_printf_strlen(
+; CHECK: %[[BUF:.*]] = load ptr addrspace(4), ptr addrspace(1) @__chipspv_printf_buffer
+; CHECK: %[[REC:.*]] = call spir_func ptr addrspace(1) @_chip_printf_alloc(ptr addrspace(4) %[[BUF]], i32 %[[SIZE:.*]])
+; CHECK: icmp ne ptr addrspace(1) %[[REC]], null
+; CHECK: store i32 0, ptr addrspace(1) %{{.*}}, align 4
+; CHECK: store i64 %{{.*}}, ptr addrspace(1) %{{.*}}, align 8
+; CHECK: store double %{{.*}}, ptr addrspace(1) %{{.*}}, align 8
+; CHECK: store i64 %{{.*}}, ptr addrspace(1) %{{.*}}, align 8
+; CHECK: call spir_func void @_chip_printf_strcpy(ptr addrspace(1) %{{.*}}, ptr addrspace(4) {{.*}}, i32 %[[LEN]])
+; The size is stored last.
+; CHECK: call spir_func void @_chip_printf_commit(ptr addrspace(1) %[[REC]], i32 %[[SIZE]])
+; The return value is the number of format specifiers.
+; CHECK: store i32 3, ptr addrspace(1) %out
+; The invalid call prints an error message instead.
+; CHECK: call spir_func ptr addrspace(1) @_chip_printf_alloc(ptr addrspace(4) %{{.*}}, i32 8)
+; CHECK: store i32 10, ptr addrspace(1) %{{.*}}, align 4
+; CHECK: call spir_func void @_chip_printf_commit(ptr addrspace(1) %{{.*}}, i32 8)
+; CHECK: store i32 0, ptr addrspace(1) %{{.*}}, align 4
+; CHECK-NOT: call {{.*}} @printf(
+; CHECK: ret void
+define spir_kernel void @k(i32 %i, float %f, ptr addrspace(1) %out) {
+entry:
+  %r = call spir_func i32 (ptr addrspace(4), ...) @printf(ptr addrspace(4) @.fmt, i32 %i, float %f, ptr addrspace(4) @.str)
+  store i32 %r, ptr addrspace(1) %out
+  ; Missing an argument.
+  %r2 = call spir_func i32 (ptr addrspace(4), ...) @printf(ptr addrspace(4) @.bad, i32 %i)
+  %r3 = call spir_func i32 (ptr addrspace(4), ...) @printf(ptr addrspace(4) @.fmt, i32 %i, float %f, ptr addrspace(4) @.str)
+  ret void
+}
+
+; CHECK-NOT: declare {{.*}} @printf(
\ No newline at end of file
@@ -0,0 +1,98 @@
+; Check HipResolveAddrSpacesPass resolves the address space queries of the
+; inlined device library atomics on pointers of a known address space and
+; keeps them on generic pointers.
+
+; The number of resolved queries is reported as remarks.
+; CHECK-DAG: remark: {{.*}}resolved 2 of 2 address space queries in on_global
+; CHECK-DAG: remark: {{.*}}resolved 2 of 2 address space queries in on_local
+; CHECK-DAG: remark: {{.*}}resolved 0 of 2 address space queries in atomic_add
+
+declare ptr addrspace(1) @__to_global(ptr addrspace(4))
+declare ptr addrspace(3) @__to_local(ptr addrspace(4))
+
+; The dispatch of an atomicAdd(), which is kept on the generic pointer.
+; CHECK-LABEL: define internal spir_func i32 @atomic_add(
+; CHECK: call ptr addrspace(1) @__to_global(ptr addrspace(4) %p)
+; CHECK: call ptr addrspace(3) @__to_local(ptr addrspace(4) %p)
+define internal spir_func i32 @atomic_add(ptr addrspace(4) %p, i32 %v) {
+entry:
+  %gi = call ptr addrspace(1) @__to_global(ptr addrspace(4) %p)
+  %isg = icmp ne ptr addrspace(1) %gi, null
+  br i1 %isg, label %global, label %notglobal
+global:
+  %rg = atomicrmw add ptr addrspace(1) %gi, i32 %v seq_cst
+  ret i32 %rg
+notglobal:
+  %li = call ptr addrspace(3) @__to_local(ptr addrspace(4) %p)
+  %isl = icmp ne ptr addrspace(3) %li, null
+  br i1 %isl, label %local, label %none
+local:
+  %rl = atomicrmw add ptr addrspace(3) %li, i32 %v seq_cst
+  ret i32 %rl
+none:
+  ret i32 0
+}
+
+; The same dispatch inlined on a global pointer only keeps its null check.
+; CHECK-LABEL: define spir_kernel void @on_global(
+; CHECK-NOT: addrspacecast
+; CHECK-NOT: @__to_
+; CHECK-NOT: addrspace(3)
+; CHECK: atomicrmw add ptr addrspace(1) %out
+; CHECK-NOT: @__to_
+; CHECK: ret void
+define spir_kernel void @on_global(ptr addrspace(1) %out) {
+entry:
+  %p = addrspacecast ptr addrspace(1) %out to ptr addrspace(4)
+  %gi = call ptr addrspace(1) @__to_global(ptr addrspace(4) %p)
+  %isg = icmp ne ptr addrspace(1) %gi, null
+  br i1 %isg, label %global, label %notglobal
+global:
+  %rg = atomicrmw add ptr addrspace(1) %gi, i32 1 seq_cst
+  br label %exit
+notglobal:
+  %li = call ptr addrspace(3) @__to_local(ptr addrspace(4) %p)
+  %isl = icmp ne ptr addrspace(3) %li, null
+  br i1 %isl, label %local, label %exit
+local:
+  %rl = atomicrmw add ptr addrspace(3) %li, i32 1 seq_cst
+  br label %exit
+exit:
+  ret void
+}
+
+@buf = internal addrspace(3) global [64 x i32] undef
+
+; CHECK-LABEL: define spir_kernel void @on_local(
+; CHECK-NOT: addrspacecast
+; CHECK-NOT: @__to_
+; CHECK-NOT: addrspace(1)
+; CHECK: atomicrmw add ptr addrspace(3) @buf
+; CHECK-NOT: @__to_
+; CHECK: ret void
+define spir_kernel void @on_local() {
+entry:
+  %p = addrspacecast ptr addrspace(3) @buf to ptr addrspace(4)
+  %gi = call ptr addrspace(1) @__to_global(ptr addrspace(4) %p)
+  %isg = icmp ne ptr addrspace(1) %gi, null
+  br i1 %isg, label %global, label %notglobal
+global:
+  %rg = atomicrmw add ptr addrspace(1) %gi, i32 1 seq_cst
+  br label %exit
+notglobal:
+  %li = call ptr addrspace(3) @__to_local(ptr addrspace(4) %p)
+  %isl = icmp ne ptr addrspace(3) %li, null
+  br i1 %isl, label %local, label %exit
+local:
+  %rl = atomicrmw add ptr addrspace(3) %li, i32 1 seq_cst
+  br label %exit
+exit:
+  ret void
+}
+
+; CHECK-LABEL: define spir_kernel void @on_generic(
+; CHECK: call spir_func i32 @atomic_add(
+define spir_kernel void @on_generic(ptr addrspace(4) %p) {
+  %r = call spir_func i32 @atomic_add(ptr addrspace(4) %p, i32 1)
+  ret void
+}
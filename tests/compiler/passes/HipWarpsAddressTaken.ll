@@ -0,0 +1,24 @@
+; Check HipWarpsPass pins the subgroup size on all kernels when a function
+; reaching a warp-size sensitive function has its address taken, as its
+; callers can't be known.
+
+declare spir_func i32 @_Z8__balloti(i32)
+
+@table = addrspace(1) global ptr @helper
+
+define spir_func i32 @helper(i32 %x) {
+  %r = call spir_func i32 @_Z8__balloti(i32 %x)
+  ret i32 %r
+}
+
+; CHECK: define spir_kernel void @indirect({{.*}}) !intel_reqd_sub_group_size
+define spir_kernel void @indirect(i32 %x) {
+  %f = load ptr, ptr addrspace(1) @table
+  %r = call spir_func i32 %f(i32 %x)
+  ret void
+}
+
+; CHECK: define spir_kernel void @plain() !intel_reqd_sub_group_size
+define spir_kernel void @plain() {
+  ret void
+}
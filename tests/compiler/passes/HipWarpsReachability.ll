@@ -0,0 +1,66 @@
+; Check HipWarpsPass pins the subgroup size only on the kernels which call a
+; warp-size sensitive function, directly or through other functions.
+
+declare spir_func i32 @_Z6__shfliii(i32, i32, i32)
+declare spir_func i32 @_Z16sub_group_balloti(i32)
+declare spir_func float @_Z20sub_group_reduce_addf(float)
+declare spir_func i32 @_Z27intel_sub_group_shuffle_xorjj(i32, i32)
+declare spir_func double @_Z23intel_sub_group_shuffledj(double, i32)
+
+@llvm.used = appending global [1 x ptr] [ptr @_Z6__shfliii]
+
+define spir_func i32 @helper(i32 %x) {
+  %r = call spir_func i32 @_Z16sub_group_balloti(i32 %x)
+  ret i32 %r
+}
+
+define spir_func i32 @helper2(i32 %x) {
+  %r = call spir_func i32 @helper(i32 %x)
+  ret i32 %r
+}
+
+define spir_func i32 @unrelated(i32 %x) {
+  %r = add i32 %x, 1
+  ret i32 %r
+}
+
+; CHECK: define spir_kernel void @direct({{.*}}) !intel_reqd_sub_group_size
+define spir_kernel void @direct(i32 %x) {
+  %r = call spir_func i32 @_Z6__shfliii(i32 %x, i32 0, i32 32)
+  ret void
+}
+
+; CHECK: define spir_kernel void @transitive({{.*}}) !intel_reqd_sub_group_size
+define spir_kernel void @transitive(i32 %x) {
+  %r = call spir_func i32 @helper2(i32 %x)
+  ret void
+}
+
+; CHECK: define spir_kernel void @collective({{.*}}) !intel_reqd_sub_group_size
+define spir_kernel void @collective(float %x) {
+  %r = call spir_func float @_Z20sub_group_reduce_addf(float %x)
+  ret void
+}
+
+; CHECK: define spir_kernel void @shuffle_uint({{.*}}) !intel_reqd_sub_group_size
+define spir_kernel void @shuffle_uint(i32 %x) {
+  %r = call spir_func i32 @_Z27intel_sub_group_shuffle_xorjj(i32 %x, i32 1)
+  ret void
+}
+
+; CHECK: define spir_kernel void @shuffle_double({{.*}}) !intel_reqd_sub_group_size
+define spir_kernel void @shuffle_double(double %x) {
+  %r = call spir_func double @_Z23intel_sub_group_shuffledj(double %x, i32 0)
+  ret void
+}
+
+; CHECK: define spir_kernel void @plain(i32 %x) {
+define spir_kernel void @plain(i32 %x) {
+  %r = call spir_func i32 @unrelated(i32 %x)
+  ret void
+}
+
+; CHECK: define spir_kernel void @empty() {
+define spir_kernel void @empty() {
+  ret void
+}
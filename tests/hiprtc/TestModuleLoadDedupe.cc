@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2023 CHIP-SPV developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Test that the loads of identical code objects get modules of their own,
+// with their own device variables, which stay usable until unloaded.
+
+#include "TestCommon.hh"
+
+static void checkAdd(hipModule_t Module, int Input, int Expected) {
+  hipFunction_t Kernel;
+  HIP_CHECK(hipModuleGetFunction(&Kernel, Module, "add"));
+
+  int *InOutD;
+  HIP_CHECK(hipMalloc(&InOutD, sizeof(int)));
+  HIP_CHECK(hipMemcpy(InOutD, &Input, sizeof(int), hipMemcpyHostToDevice));
+  void *Args[] = {&InOutD};
+  HIP_CHECK(hipModuleLaunchKernel(Kernel, 1, 1, 1, 1, 1, 1, 0, nullptr, Args,
+                                  nullptr));
+  int Output;
+  HIP_CHECK(hipMemcpy(&Output, InOutD, sizeof(int), hipMemcpyDeviceToHost));
+  HIP_CHECK(hipFree(InOutD));
+  TEST_ASSERT(Output == Expected);
+}
+
+static int count(hipModule_t Module) {
+  hipFunction_t Kernel;
+  HIP_CHECK(hipModuleGetFunction(&Kernel, Module, "count"));
+
+  int *OutD;
+  HIP_CHECK(hipMalloc(&OutD, sizeof(int)));
+  void *Args[] = {&OutD};
+  HIP_CHECK(hipModuleLaunchKernel(Kernel, 1, 1, 1, 1, 1, 1, 0, nullptr, Args,
+                                  nullptr));
+  int Output;
+  HIP_CHECK(hipMemcpy(&Output, OutD, sizeof(int), hipMemcpyDeviceToHost));
+  HIP_CHECK(hipFree(OutD));
+  return Output;
+}
+
+static std::vector<char> compile(const char *Source) {
+  auto Prog = HiprtcAssertCreateProgram(Source);
+  auto Code = HiprtcAssertCompileProgram(Prog);
+  HIPRTC_CHECK(hiprtcDestroyProgram(&Prog));
+  return Code;
+}
+
+int main() {
+  auto Code = compile(R"---(
+extern "C" __global__ void add(int *X) { *X += 1; }
+extern "C" __global__ void count(int *Out) {
+  static int N = 0;
+  *Out = ++N;
+}
+)---");
+  auto OtherCode = compile(
+      R"---(extern "C" __global__ void add(int *X) { *X += 2; })---");
+
+  hipModule_t Module0, Module1, Module2;
+  HIP_CHECK(hipModuleLoadData(&Module0, Code.data()));
+  {
+    // The image may be released after loading it.
+    auto Copy = Code;
+    HIP_CHECK(hipModuleLoadData(&Module1, Copy.data()));
+  }
+  HIP_CHECK(hipModuleLoadData(&Module2, OtherCode.data()));
+  TEST_ASSERT(Module0 != Module1);
+  TEST_ASSERT(Module0 != Module2);
+
+  checkAdd(Module0, 1, 2);
+  checkAdd(Module1, 3, 4);
+  checkAdd(Module2, 1, 3);
+
+  // The loads do not share the device variables.
+  TEST_ASSERT(count(Module0) == 1);
+  TEST_ASSERT(count(Module0) == 2);
+  TEST_ASSERT(count(Module1) == 1);
+
+  // Unloading one of the loads leaves the others usable.
+  HIP_CHECK(hipModuleUnload(Module0));
+  checkAdd(Module1, 5, 6);
+  HIP_CHECK(hipModuleUnload(Module1));
+  HIP_CHECK(hipModuleUnload(Module2));
+
+  // The code can be loaded again after it has been unloaded.
+  HIP_CHECK(hipModuleLoadData(&Module0, Code.data()));
+  checkAdd(Module0, 7, 8);
+  HIP_CHECK(hipModuleUnload(Module0));
+  return 0;
+}
@@ -0,0 +1,70 @@
+// Check that the Level Zero backend submits a command list batch which does
+// not fill up once it gets older than CHIP_L0_BATCH_TIMEOUT_US, without any
+// further operation or synchronization, and that operations are appended to
+// in-order command lists without barriers. Runs against the stub Level Zero
+// loader (ZeStub.cc) reporting API version 1.9.
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <dlfcn.h>
+#include <thread>
+#include <hip/hip_runtime.h>
+
+using GetCallCountFn = size_t (*)(const char *);
+
+constexpr size_t NumOps = 4;
+
+int main() {
+  auto GetCallCount =
+      (GetCallCountFn)dlsym(RTLD_DEFAULT, "zeStubGetCallCount");
+  if (!GetCallCount) {
+    printf("SKIP: the Level Zero stub loader is not preloaded\n");
+    return 0;
+  }
+
+  hipStream_t Stream;
+  unsigned char *BufD;
+  // Non-blocking so that no barriers synchronizing with the default stream
+  // are appended.
+  assert(hipStreamCreateWithFlags(&Stream, hipStreamNonBlocking) ==
+         hipSuccess);
+  assert(hipMalloc(&BufD, NumOps) == hipSuccess);
+
+  if (GetCallCount("zeCommandListCreateImmediate")) {
+    printf("SKIP: built with immediate command lists\n");
+    return 0;
+  }
+
+  size_t ExecutesBefore = GetCallCount("zeCommandQueueExecuteCommandLists");
+  size_t BarriersBefore = GetCallCount("zeCommandListAppendBarrier@compute");
+  for (size_t i = 0; i < NumOps; i++)
+    assert(hipMemsetAsync(BufD + i, i, 1, Stream) == hipSuccess);
+
+  // The batch times out after 1 ms (CHIP_L0_BATCH_TIMEOUT_US set by the
+  // test) and the stale event monitor submits it.
+  size_t Executes = 0;
+  for (int Retry = 0; Retry < 100 && !Executes; Retry++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    Executes =
+        GetCallCount("zeCommandQueueExecuteCommandLists") - ExecutesBefore;
+  }
+  size_t Barriers =
+      GetCallCount("zeCommandListAppendBarrier@compute") - BarriersBefore;
+  printf("%zu operations, %zu submissions, %zu barriers\n", NumOps, Executes,
+         Barriers);
+  assert(Executes == 1);
+  assert(Barriers == 0);
+
+  unsigned char BufH[NumOps];
+  assert(hipMemcpy(BufH, BufD, NumOps, hipMemcpyDeviceToHost) == hipSuccess);
+  for (size_t i = 0; i < NumOps; i++)
+    assert(BufH[i] == i);
+
+  assert(hipFree(BufD) == hipSuccess);
+  assert(hipStreamDestroy(Stream) == hipSuccess);
+  printf("PASSED\n");
+  return 0;
+}
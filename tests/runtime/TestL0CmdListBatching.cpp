@@ -0,0 +1,75 @@
+// Check that the Level Zero backend batches consecutive stream operations
+// into command lists and recycles the command lists. Runs against the stub
+// Level Zero loader (ZeStub.cc) which records the API calls.
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#include <cassert>
+#include <cstdio>
+#include <dlfcn.h>
+#include <vector>
+#include <hip/hip_runtime.h>
+
+using GetCallCountFn = size_t (*)(const char *);
+
+constexpr size_t NumOps = 256;
+constexpr size_t NumRounds = 8;
+constexpr size_t BatchSize = 16; // CHIP_L0_BATCH_SIZE set by the test
+
+int main() {
+  auto GetCallCount =
+      (GetCallCountFn)dlsym(RTLD_DEFAULT, "zeStubGetCallCount");
+  if (!GetCallCount) {
+    printf("SKIP: the Level Zero stub loader is not preloaded\n");
+    return 0;
+  }
+
+  hipStream_t Stream;
+  unsigned char *BufD;
+  assert(hipStreamCreate(&Stream) == hipSuccess);
+  assert(hipMalloc(&BufD, NumOps) == hipSuccess);
+
+  if (GetCallCount("zeCommandListCreateImmediate")) {
+    printf("SKIP: built with immediate command lists\n");
+    return 0;
+  }
+
+  size_t ExecutesBefore = GetCallCount("zeCommandQueueExecuteCommandLists");
+  size_t CreatesAfterFirstRound = 0;
+  std::vector<unsigned char> BufH(NumOps);
+  for (size_t Round = 0; Round < NumRounds; Round++) {
+    for (size_t i = 0; i < NumOps; i++)
+      assert(hipMemsetAsync(BufD + i, (i + Round) & 0xff, 1, Stream) ==
+             hipSuccess);
+    assert(hipStreamSynchronize(Stream) == hipSuccess);
+    assert(hipMemcpy(BufH.data(), BufD, NumOps, hipMemcpyDeviceToHost) ==
+           hipSuccess);
+    for (size_t i = 0; i < NumOps; i++)
+      assert(BufH[i] == ((i + Round) & 0xff));
+
+    if (Round == 0)
+      CreatesAfterFirstRound = GetCallCount("zeCommandListCreate");
+  }
+
+  size_t Executes =
+      GetCallCount("zeCommandQueueExecuteCommandLists") - ExecutesBefore;
+  size_t Creates = GetCallCount("zeCommandListCreate");
+  printf("%zu operations, %zu submissions, %zu command lists created, %zu "
+         "resets\n",
+         NumOps * NumRounds, Executes, Creates,
+         GetCallCount("zeCommandListReset"));
+
+  // One submission per batch plus a few for the syncs and blocking copies.
+  // Every operation used to be submitted on its own.
+  assert(Executes <= NumRounds * (NumOps / BatchSize + 4));
+
+  // Command lists come from the pool after the first round.
+  assert(Creates == CreatesAfterFirstRound);
+  assert(GetCallCount("zeCommandListReset") > 0);
+  assert(GetCallCount("zeCommandListDestroy") == 0);
+
+  assert(hipFree(BufD) == hipSuccess);
+  assert(hipStreamDestroy(Stream) == hipSuccess);
+  printf("PASSED\n");
+  return 0;
+}
@@ -0,0 +1,59 @@
+// Check that large copies go to the Level Zero copy engine while the stream
+// order is kept with the operations on the compute engine. Runs against the
+// stub Level Zero loader (ZeStub.cc) which records the API calls.
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#include <cassert>
+#include <cstdio>
+#include <dlfcn.h>
+#include <vector>
+#include <hip/hip_runtime.h>
+
+using GetCallCountFn = size_t (*)(const char *);
+
+constexpr size_t Large = 1 << 20; // >= CHIP_L0_COPY_ENGINE_THRESHOLD
+constexpr size_t Small = 64;      // < CHIP_L0_COPY_ENGINE_THRESHOLD
+
+int main() {
+  auto GetCallCount =
+      (GetCallCountFn)dlsym(RTLD_DEFAULT, "zeStubGetCallCount");
+  if (!GetCallCount) {
+    printf("SKIP: the Level Zero stub loader is not preloaded\n");
+    return 0;
+  }
+
+  hipStream_t Stream;
+  unsigned char *A, *B;
+  assert(hipStreamCreate(&Stream) == hipSuccess);
+  assert(hipMalloc(&A, Large) == hipSuccess);
+  assert(hipMalloc(&B, Large) == hipSuccess);
+  std::vector<unsigned char> Host(Large, 0);
+
+  // Alternate between the engines: fill (compute), large copy (copy), small
+  // fill over the copy result (compute), large copy back (copy).
+  for (int Round = 1; Round <= 4; Round++) {
+    assert(hipMemsetAsync(A, Round, Large, Stream) == hipSuccess);
+    assert(hipMemcpyAsync(B, A, Large, hipMemcpyDeviceToDevice, Stream) ==
+           hipSuccess);
+    assert(hipMemsetAsync(B, 0xff, Small, Stream) == hipSuccess);
+    assert(hipMemcpyAsync(Host.data(), B, Large, hipMemcpyDeviceToHost,
+                          Stream) == hipSuccess);
+    assert(hipStreamSynchronize(Stream) == hipSuccess);
+    for (size_t i = 0; i < Large; i++)
+      assert(Host[i] == (i < Small ? 0xff : Round));
+  }
+
+  size_t CopyEngineCopies = GetCallCount("zeCommandListAppendMemoryCopy@copy");
+  size_t UnsatisfiedWaits = GetCallCount("UnsatisfiedWait");
+  printf("copy engine copies: %zu, unsatisfied waits: %zu\n", CopyEngineCopies,
+         UnsatisfiedWaits);
+  assert(CopyEngineCopies >= 8);
+  assert(UnsatisfiedWaits == 0);
+
+  assert(hipFree(A) == hipSuccess);
+  assert(hipFree(B) == hipSuccess);
+  assert(hipStreamDestroy(Stream) == hipSuccess);
+  printf("PASSED\n");
+  return 0;
+}
@@ -0,0 +1,62 @@
+// Check that hipHostRegister() imports the host memory into Level Zero
+// instead of mirroring it in device memory. Runs against the stub Level Zero
+// loader (ZeStub.cc) which supports the zexDriverImportExternalPointer
+// extension but not shared system allocations.
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <dlfcn.h>
+#include <vector>
+#include <hip/hip_runtime.h>
+
+using GetCallCountFn = size_t (*)(const char *);
+
+int main() {
+  auto GetCallCount =
+      (GetCallCountFn)dlsym(RTLD_DEFAULT, "zeStubGetCallCount");
+  if (!GetCallCount) {
+    printf("SKIP: the Level Zero stub loader is not preloaded\n");
+    return 0;
+  }
+
+  constexpr size_t Size = 16 << 20;
+  std::vector<unsigned char> Host(Size, 0x5a);
+  unsigned char *Dev;
+  assert(hipMalloc(&Dev, Size) == hipSuccess);
+
+  size_t DevAllocs = GetCallCount("zeMemAllocDevice");
+  assert(hipHostRegister(Host.data(), Size, hipHostRegisterDefault) ==
+         hipSuccess);
+  assert(GetCallCount("zexDriverImportExternalPointer") == 1);
+  assert(GetCallCount("zeMemAllocDevice") == DevAllocs); // No mirror.
+  assert(hipHostRegister(Host.data(), Size, hipHostRegisterDefault) ==
+         hipErrorHostMemoryAlreadyRegistered);
+
+  // The device uses the host address as is.
+  void *Mapped = nullptr;
+  assert(hipHostGetDevicePointer(&Mapped, Host.data(), 0) == hipSuccess);
+  assert(Mapped == Host.data());
+  assert(hipHostGetDevicePointer(&Mapped, Host.data() + 100, 0) ==
+         hipSuccess);
+  assert(Mapped == Host.data() + 100);
+
+  // Copies read the registered memory directly.
+  assert(hipMemcpy(Dev, Host.data(), Size, hipMemcpyHostToDevice) ==
+         hipSuccess);
+  memset(Host.data(), 0, Size);
+  assert(hipMemcpy(Host.data(), Dev, Size, hipMemcpyDeviceToHost) ==
+         hipSuccess);
+  for (size_t I = 0; I < Size; I++)
+    assert(Host[I] == 0x5a);
+
+  assert(hipHostUnregister(Host.data()) == hipSuccess);
+  assert(GetCallCount("zexDriverReleaseImportedPointer") == 1);
+  assert(hipHostUnregister(Host.data()) == hipErrorHostMemoryNotRegistered);
+
+  assert(hipFree(Dev) == hipSuccess);
+  printf("PASSED\n");
+  return 0;
+}
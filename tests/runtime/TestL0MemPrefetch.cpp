@@ -0,0 +1,53 @@
+// Check that hipMemPrefetchAsync() and hipMemAdvise() on managed memory reach
+// the Level Zero driver. Runs against the stub Level Zero loader (ZeStub.cc).
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#include <cassert>
+#include <cstdio>
+#include <dlfcn.h>
+#include <hip/hip_runtime.h>
+
+using GetCallCountFn = size_t (*)(const char *);
+
+int main() {
+  auto GetCallCount =
+      (GetCallCountFn)dlsym(RTLD_DEFAULT, "zeStubGetCallCount");
+  if (!GetCallCount) {
+    printf("SKIP: the Level Zero stub loader is not preloaded\n");
+    return 0;
+  }
+
+  constexpr size_t Size = 1 << 20;
+  char *Managed;
+  assert(hipMallocManaged(&Managed, Size) == hipSuccess);
+  hipStream_t Stream;
+  assert(hipStreamCreate(&Stream) == hipSuccess);
+
+  assert(hipMemAdvise(Managed, Size, hipMemAdviseSetReadMostly, 0) ==
+         hipSuccess);
+  assert(hipMemAdvise(Managed, Size, hipMemAdviseSetPreferredLocation, 0) ==
+         hipSuccess);
+  // No Level Zero counterpart, only recorded.
+  assert(hipMemAdvise(Managed, Size, hipMemAdviseSetAccessedBy, 0) ==
+         hipSuccess);
+  assert(hipDeviceSynchronize() == hipSuccess);
+  assert(GetCallCount("zeCommandListAppendMemAdvise") == 2);
+
+  assert(hipMemPrefetchAsync(Managed, Size, 0, Stream) == hipSuccess);
+  assert(hipMemPrefetchAsync(Managed + 4096, 4096, 0, Stream) == hipSuccess);
+  // Shared memory migrates to the host on access.
+  assert(hipMemPrefetchAsync(Managed, Size, hipCpuDeviceId, Stream) ==
+         hipSuccess);
+  assert(hipStreamSynchronize(Stream) == hipSuccess);
+  assert(GetCallCount("zeCommandListAppendMemoryPrefetch") == 2);
+  assert(GetCallCount("UnsatisfiedWait") == 0);
+
+  assert(hipMemPrefetchAsync(Managed, Size + 1, 0, Stream) ==
+         hipErrorInvalidValue);
+
+  assert(hipStreamDestroy(Stream) == hipSuccess);
+  assert(hipFree(Managed) == hipSuccess);
+  printf("PASSED\n");
+  return 0;
+}
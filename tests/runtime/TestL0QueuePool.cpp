@@ -0,0 +1,82 @@
+// Check that with CHIP_QUEUE_POOL_SIZE the native queues of destroyed streams
+// are reused while every live stream still gets a command queue of its own.
+// Runs against the stub Level Zero loader (ZeStub.cc) which records the API
+// calls.
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#include <cassert>
+#include <cstdio>
+#include <dlfcn.h>
+#include <vector>
+#include <hip/hip_runtime.h>
+
+using GetCallCountFn = size_t (*)(const char *);
+
+constexpr int NumStreams = 16;
+constexpr size_t PoolSize = 2; // CHIP_QUEUE_POOL_SIZE
+
+static GetCallCountFn GetCallCount;
+
+static void checkStreams(int *Data, std::vector<hipStream_t> &Streams,
+                         int Round) {
+  for (size_t S = 0; S < Streams.size(); S++) {
+    assert(hipMemsetAsync(Data + S, 0, sizeof(int), Streams[S]) ==
+           hipSuccess);
+    assert(hipMemsetAsync(Data + S, S + Round, 1, Streams[S]) == hipSuccess);
+  }
+  for (auto &Stream : Streams)
+    assert(hipStreamSynchronize(Stream) == hipSuccess);
+
+  std::vector<int> Host(Streams.size());
+  assert(hipMemcpy(Host.data(), Data, Streams.size() * sizeof(int),
+                   hipMemcpyDeviceToHost) == hipSuccess);
+  for (size_t S = 0; S < Streams.size(); S++)
+    assert(Host[S] == (int)S + Round);
+}
+
+int main() {
+  GetCallCount = (GetCallCountFn)dlsym(RTLD_DEFAULT, "zeStubGetCallCount");
+  if (!GetCallCount) {
+    printf("SKIP: the Level Zero stub loader is not preloaded\n");
+    return 0;
+  }
+
+  int *Data;
+  assert(hipMalloc(&Data, NumStreams * sizeof(int)) == hipSuccess);
+  size_t Start = GetCallCount("zeCommandQueueCreate");
+
+  // A stream per request reuses one command queue.
+  for (int Round = 1; Round <= NumStreams; Round++) {
+    std::vector<hipStream_t> Streams(1);
+    assert(hipStreamCreate(&Streams[0]) == hipSuccess);
+    checkStreams(Data, Streams, Round);
+    assert(hipStreamDestroy(Streams[0]) == hipSuccess);
+  }
+  size_t Created = GetCallCount("zeCommandQueueCreate") - Start;
+  printf("command queues created for %d consecutive streams: %zu\n",
+         NumStreams, Created);
+  assert(Created == 1);
+
+  // Live streams never share a command queue.
+  std::vector<hipStream_t> Streams(NumStreams);
+  for (auto &Stream : Streams)
+    assert(hipStreamCreate(&Stream) == hipSuccess);
+  Created = GetCallCount("zeCommandQueueCreate") - Start;
+  printf("command queues created for %d live streams: %zu\n", NumStreams,
+         Created);
+  assert(Created == NumStreams);
+  checkStreams(Data, Streams, 1);
+
+  // Only CHIP_QUEUE_POOL_SIZE idle command queues are kept.
+  size_t Destroyed = GetCallCount("zeCommandQueueDestroy");
+  for (auto &Stream : Streams)
+    assert(hipStreamDestroy(Stream) == hipSuccess);
+  Destroyed = GetCallCount("zeCommandQueueDestroy") - Destroyed;
+  assert(Destroyed == NumStreams - PoolSize);
+
+  assert(GetCallCount("UnsatisfiedWait") == 0);
+  assert(hipFree(Data) == hipSuccess);
+  printf("PASSED\n");
+  return 0;
+}
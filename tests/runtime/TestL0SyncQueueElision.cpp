@@ -0,0 +1,56 @@
+// Check that the null stream enqueues a barrier for a blocking stream only
+// when the blocking stream has new work. Runs against the stub Level Zero
+// loader (ZeStub.cc) which records the API calls.
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#include <cassert>
+#include <cstdio>
+#include <dlfcn.h>
+#include <hip/hip_runtime.h>
+
+using GetCallCountFn = size_t (*)(const char *);
+
+constexpr int NumOps = 8;
+
+int main() {
+  auto GetCallCount =
+      (GetCallCountFn)dlsym(RTLD_DEFAULT, "zeStubGetCallCount");
+  if (!GetCallCount) {
+    printf("SKIP: the Level Zero stub loader is not preloaded\n");
+    return 0;
+  }
+
+  hipStream_t Stream;
+  int *Data;
+  assert(hipStreamCreate(&Stream) == hipSuccess);
+  assert(hipMalloc(&Data, 2 * sizeof(int)) == hipSuccess);
+  assert(hipMemsetAsync(Data, 0, sizeof(int), Stream) == hipSuccess);
+  assert(hipMemsetAsync(Data + 1, 0, sizeof(int), nullptr) == hipSuccess);
+
+  // The blocking stream stays idle: its last event has been waited for.
+  size_t Start = GetCallCount("zeCommandListAppendBarrier");
+  for (int I = 0; I < NumOps; I++)
+    assert(hipMemsetAsync(Data + 1, I, sizeof(int), nullptr) == hipSuccess);
+  size_t IdleBarriers = GetCallCount("zeCommandListAppendBarrier") - Start;
+
+  // Both streams have new work every time and must wait for each other.
+  Start = GetCallCount("zeCommandListAppendBarrier");
+  for (int I = 0; I < NumOps; I++) {
+    assert(hipMemsetAsync(Data, I, sizeof(int), Stream) == hipSuccess);
+    assert(hipMemsetAsync(Data + 1, I, sizeof(int), nullptr) == hipSuccess);
+  }
+  size_t BusyBarriers = GetCallCount("zeCommandListAppendBarrier") - Start;
+
+  assert(hipDeviceSynchronize() == hipSuccess);
+  printf("barriers for %d fills: idle %zu, busy %zu (per stream)\n", NumOps,
+         IdleBarriers, BusyBarriers / 2);
+  // Without the elision each fill costs the same in both cases.
+  assert(2 * IdleBarriers < BusyBarriers);
+  assert(GetCallCount("UnsatisfiedWait") == 0);
+
+  assert(hipFree(Data) == hipSuccess);
+  assert(hipStreamDestroy(Stream) == hipSuccess);
+  printf("PASSED\n");
+  return 0;
+}
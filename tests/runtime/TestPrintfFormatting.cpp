@@ -0,0 +1,109 @@
+// Check the host-side formatting of the device printf() records.
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+#include "common.hh"
+#include "CHIPPrintf.hh"
+
+// Builds the records like the code emitted by HipPrintf.cpp.
+class RecordWriter {
+  std::vector<char> Data_;
+  size_t RecordStart_ = 0;
+
+  void append(const void *Src, size_t Size) {
+    const char *Bytes = static_cast<const char *>(Src);
+    Data_.insert(Data_.end(), Bytes, Bytes + Size);
+  }
+
+public:
+  void begin(uint32_t FormatOffset) {
+    RecordStart_ = Data_.size();
+    CHIPPrintfRecord Header{0, FormatOffset};
+    append(&Header, sizeof(Header));
+  }
+  void end() {
+    uint32_t Size = Data_.size() - RecordStart_;
+    std::memcpy(&Data_[RecordStart_], &Size, sizeof(Size));
+  }
+  void addInt(int64_t X) { append(&X, sizeof(X)); }
+  void addDouble(double X) { append(&X, sizeof(X)); }
+  void addString(const char *S) {
+    uint64_t Len = std::strlen(S);
+    append(&Len, sizeof(Len));
+    append(S, Len);
+    Data_.resize((Data_.size() + ChipPrintfSlotSize - 1) &
+                 ~size_t(ChipPrintfSlotSize - 1));
+  }
+  const std::vector<char> &data() const { return Data_; }
+};
+
+int main() {
+  const char FormatData[] = "%d %u %x|%s|\n\0"
+                            "%5.2f %*d %-3c%%\n\0"
+                            "%hhd %lld %ld\n\0"
+                            "%s\n";
+  std::string_view Formats(FormatData, sizeof(FormatData));
+  uint32_t First = 0;
+  uint32_t Second = std::strlen(FormatData) + 1;
+  uint32_t Third = Second + std::strlen(FormatData + Second) + 1;
+  uint32_t Fourth = Third + std::strlen(FormatData + Third) + 1;
+
+  RecordWriter W;
+  W.begin(First);
+  W.addInt(-1);
+  W.addInt(-1);
+  W.addInt(255);
+  W.addString("hello, world");
+  W.end();
+
+  W.begin(Second);
+  W.addDouble(3.14159);
+  W.addInt(4);
+  W.addInt(7);
+  W.addInt('a');
+  W.end();
+
+  W.begin(Third);
+  W.addInt(257);
+  W.addInt(-1234567890123LL);
+  W.addInt(42);
+  W.end();
+
+  // An empty string.
+  W.begin(Fourth);
+  W.addString("");
+  W.end();
+
+  const std::string Expected = "-1 4294967295 ff|hello, world|\n"
+                               " 3.14    7 a  %\n"
+                               "1 -1234567890123 42\n"
+                               "\n";
+  size_t Consumed;
+  auto Out = formatPrintfRecords(Formats, W.data().data(), W.data().size(),
+                                 Consumed);
+  assert(Out == Expected);
+  assert(Consumed == W.data().size());
+
+  // The records end at one still being written.
+  std::vector<char> Truncated = W.data();
+  CHIPPrintfRecord End{0, 0};
+  Truncated.insert(Truncated.begin(), reinterpret_cast<char *>(&End),
+                   reinterpret_cast<char *>(&End) + sizeof(End));
+  Out = formatPrintfRecords(Formats, Truncated.data(), Truncated.size(),
+                            Consumed);
+  assert(Out.empty() && Consumed == 0);
+
+  // The padding at the end of the ring is skipped.
+  std::vector<char> Padded(2 * ChipPrintfSlotSize);
+  CHIPPrintfRecord Padding{(uint32_t)Padded.size(), ChipPrintfPadding};
+  std::memcpy(Padded.data(), &Padding, sizeof(Padding));
+  Padded.insert(Padded.end(), W.data().begin(), W.data().end());
+  Out = formatPrintfRecords(Formats, Padded.data(), Padded.size(), Consumed);
+  assert(Out == Expected && Consumed == Padded.size());
+
+  return 0;
+}
@@ -0,0 +1,859 @@
+/*
+ * Copyright (c) 2023 CHIP-SPV developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * A stub Level Zero loader which executes on the host and records the API
+ * calls made by the runtime. It is meant to be LD_PRELOADed into tests which
+ * check how the Level Zero backend drives the API without needing a GPU.
+ *
+ * The device has a compute queue group (ordinal 0) and a copy-only queue
+ * group (ordinal 1). Command lists are executed synchronously on the host when
+ * submitted. Memory copies and fills are carried out, kernel launches and
+ * image operations are no-ops.
+ *
+ * The recorded call counts can be queried through zeStubGetCallCount().
+ * Appends and submissions are additionally counted per engine, e.g.
+ * "zeCommandListAppendMemoryCopy@copy". Commands which wait for an event not
+ * signaled by the time the command executes are counted as
+ * "UnsatisfiedWait": since submitted command lists run to completion right
+ * away, that means the runtime submitted a dependency too late or never.
+ *
+ * The driver reports API version 1.2 unless ZE_STUB_API_VERSION is set.
+ * If ZE_STUB_TRACE is set, every call is printed to stderr.
+ */
+
+#include "ze_api.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::mutex CallCountsMtx;
+std::map<std::string, size_t> CallCounts;
+
+void recordCall(const char *Name) {
+  static bool Trace = std::getenv("ZE_STUB_TRACE");
+  if (Trace)
+    fprintf(stderr, "[ZeStub] %s\n", Name);
+  std::lock_guard<std::mutex> Lock(CallCountsMtx);
+  CallCounts[Name]++;
+}
+
+#define RECORD_CALL() recordCall(__func__)
+
+constexpr uint32_t ComputeOrdinal = 0;
+constexpr uint32_t CopyOrdinal = 1;
+
+const char *engineSuffix(uint32_t Ordinal) {
+  return Ordinal == CopyOrdinal ? "@copy" : "@compute";
+}
+
+uint64_t getTimeNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+struct StubEvent {
+  std::atomic<bool> Signaled{false};
+};
+
+struct StubCommandList {
+  uint32_t Ordinal = ComputeOrdinal;
+  bool Immediate = false;
+  bool Closed = false;
+  std::vector<std::function<void()>> Commands;
+};
+
+struct StubCommandQueue {
+  uint32_t Ordinal = ComputeOrdinal;
+};
+
+struct StubFence {
+  std::atomic<bool> Signaled{false};
+};
+
+struct StubDriver {};
+struct StubDevice {};
+StubDriver TheDriver;
+StubDevice TheDevice;
+
+void signal(ze_event_handle_t Event) {
+  if (Event)
+    reinterpret_cast<StubEvent *>(Event)->Signaled = true;
+}
+
+void checkWaits(const std::vector<ze_event_handle_t> &WaitEvents) {
+  for (auto Event : WaitEvents)
+    if (!reinterpret_cast<StubEvent *>(Event)->Signaled)
+      recordCall("UnsatisfiedWait");
+}
+
+ze_result_t append(const char *Name, ze_command_list_handle_t CmdList,
+                   uint32_t NumWaitEvents, ze_event_handle_t *WaitEvents,
+                   std::function<void()> Command) {
+  auto *List = reinterpret_cast<StubCommandList *>(CmdList);
+  if (!List || List->Closed)
+    return ZE_RESULT_ERROR_INVALID_ARGUMENT;
+  recordCall((std::string(Name) + engineSuffix(List->Ordinal)).c_str());
+
+  std::vector<ze_event_handle_t> Waits(WaitEvents, WaitEvents + NumWaitEvents);
+  auto Execute = [=]() {
+    checkWaits(Waits);
+    Command();
+  };
+  if (List->Immediate)
+    Execute();
+  else
+    List->Commands.emplace_back(std::move(Execute));
+  return ZE_RESULT_SUCCESS;
+}
+
+#define APPEND(CmdList, NumWaitEvents, WaitEvents, Command)                    \
+  append(__func__, CmdList, NumWaitEvents, WaitEvents, Command)
+
+template <typename T> ze_result_t createHandle(T *Handle) {
+  // Any unique non-null value will do for objects the stub does not model.
+  *Handle = reinterpret_cast<T>(new char);
+  return ZE_RESULT_SUCCESS;
+}
+
+template <typename T> ze_result_t destroyHandle(T Handle) {
+  delete reinterpret_cast<char *>(Handle);
+  return ZE_RESULT_SUCCESS;
+}
+
+} // namespace
+
+extern "C" {
+
+/// Return how many times the given Level Zero function has been called.
+ZE_APIEXPORT size_t zeStubGetCallCount(const char *Name) {
+  std::lock_guard<std::mutex> Lock(CallCountsMtx);
+  auto It = CallCounts.find(Name);
+  return It == CallCounts.end() ? 0 : It->second;
+}
+
+/// Reset the recorded call counts.
+ZE_APIEXPORT void zeStubResetCallCounts() {
+  std::lock_guard<std::mutex> Lock(CallCountsMtx);
+  CallCounts.clear();
+}
+
+//*************************************************************************
+// Driver, device and context
+
+ze_result_t ZE_APICALL zeInit(ze_init_flags_t Flags) {
+  RECORD_CALL();
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL zeDriverGet(uint32_t *Count,
+                                   ze_driver_handle_t *Drivers) {
+  RECORD_CALL();
+  if (Drivers && *Count)
+    Drivers[0] = reinterpret_cast<ze_driver_handle_t>(&TheDriver);
+  *Count = 1;
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL zeDriverGetApiVersion(ze_driver_handle_t Driver,
+                                             ze_api_version_t *Version) {
+  RECORD_CALL();
+  // ZE_STUB_API_VERSION=<major>.<minor> overrides the reported version.
+  unsigned Major = 1, Minor = 2;
+  if (const char *Str = std::getenv("ZE_STUB_API_VERSION"))
+    sscanf(Str, "%u.%u", &Major, &Minor);
+  *Version = static_cast<ze_api_version_t>(ZE_MAKE_VERSION(Major, Minor));
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL
+zeDriverGetExtensionProperties(ze_driver_handle_t Driver, uint32_t *Count,
+                               ze_driver_extension_properties_t *Properties) {
+  RECORD_CALL();
+  *Count = 0;
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL zeDeviceGet(ze_driver_handle_t Driver, uint32_t *Count,
+                                   ze_device_handle_t *Devices) {
+  RECORD_CALL();
+  if (Devices && *Count)
+    Devices[0] = reinterpret_cast<ze_device_handle_t>(&TheDevice);
+  *Count = 1;
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL zeDeviceGetProperties(ze_device_handle_t Device,
+                                             ze_device_properties_t *Props) {
+  RECORD_CALL();
+  Props->type = ZE_DEVICE_TYPE_GPU;
+  Props->vendorId = 0x8086;
+  Props->deviceId = 0;
+  Props->flags = ZE_DEVICE_PROPERTY_FLAG_ONDEMANDPAGING;
+  Props->subdeviceId = 0;
+  Props->coreClockRate = 1000;
+  Props->maxMemAllocSize = 1ull << 30;
+  Props->maxHardwareContexts = 1;
+  Props->maxCommandQueuePriority = 0;
+  Props->numThreadsPerEU = 8;
+  Props->physicalEUSimdWidth = 8;
+  Props->numEUsPerSubslice = 8;
+  Props->numSubslicesPerSlice = 1;
+  Props->numSlices = 1;
+  Props->timerResolution = 1;
+  Props->timestampValidBits = 64;
+  Props->kernelTimestampValidBits = 64;
+  std::memset(&Props->uuid, 0, sizeof(Props->uuid));
+  std::strncpy(Props->name, "Level Zero stub device", ZE_MAX_DEVICE_NAME);
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL
+zeDeviceGetMemoryProperties(ze_device_handle_t Device, uint32_t *Count,
+                            ze_device_memory_properties_t *Props) {
+  RECORD_CALL();
+  if (Props && *Count) {
+    Props->flags = 0;
+    Props->maxClockRate = 1000;
+    Props->maxBusWidth = 64;
+    Props->totalSize = 4ull << 30;
+    std::strncpy(Props->name, "stub memory", ZE_MAX_DEVICE_NAME);
+  }
+  *Count = 1;
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL
+zeDeviceGetComputeProperties(ze_device_handle_t Device,
+                             ze_device_compute_properties_t *Props) {
+  RECORD_CALL();
+  Props->maxTotalGroupSize = 1024;
+  Props->maxGroupSizeX = 1024;
+  Props->maxGroupSizeY = 1024;
+  Props->maxGroupSizeZ = 1024;
+  Props->maxGroupCountX = UINT32_MAX;
+  Props->maxGroupCountY = UINT32_MAX;
+  Props->maxGroupCountZ = UINT32_MAX;
+  Props->maxSharedLocalMemory = 64 * 1024;
+  Props->numSubGroupSizes = 3;
+  Props->subGroupSizes[0] = 8;
+  Props->subGroupSizes[1] = 16;
+  Props->subGroupSizes[2] = 32;
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL
+zeDeviceGetCacheProperties(ze_device_handle_t Device, uint32_t *Count,
+                           ze_device_cache_properties_t *Props) {
+  RECORD_CALL();
+  if (Props && *Count) {
+    Props->flags = 0;
+    Props->cacheSize = 1 << 20;
+  }
+  *Count = 1;
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL
+zeDeviceGetModuleProperties(ze_device_handle_t Device,
+                            ze_device_module_properties_t *Props) {
+  RECORD_CALL();
+  Props->spirvVersionSupported = ZE_MAKE_VERSION(1, 2);
+  Props->flags = ZE_DEVICE_MODULE_FLAG_FP64 | ZE_DEVICE_MODULE_FLAG_INT64_ATOMICS;
+  Props->maxArgumentsSize = 4096;
+  Props->printfBufferSize = 4 * 1024 * 1024;
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL
+zeDeviceGetImageProperties(ze_device_handle_t Device,
+                           ze_device_image_properties_t *Props) {
+  RECORD_CALL();
+  Props->maxImageDims1D = 16384;
+  Props->maxImageDims2D = 16384;
+  Props->maxImageDims3D = 2048;
+  Props->maxImageBufferSize = 1ull << 30;
+  Props->maxImageArraySlices = 2048;
+  Props->maxSamplers = 16;
+  Props->maxReadImageArgs = 128;
+  Props->maxWriteImageArgs = 128;
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL zeDeviceGetCommandQueueGroupProperties(
+    ze_device_handle_t Device, uint32_t *Count,
+    ze_command_queue_group_properties_t *Props) {
+  RECORD_CALL();
+  if (Props && *Count > ComputeOrdinal) {
+    Props[ComputeOrdinal].flags = ZE_COMMAND_QUEUE_GROUP_PROPERTY_FLAG_COMPUTE |
+                                  ZE_COMMAND_QUEUE_GROUP_PROPERTY_FLAG_COPY;
+    Props[ComputeOrdinal].maxMemoryFillPatternSize = 128;
+    Props[ComputeOrdinal].numQueues = 1;
+  }
+  if (Props && *Count > CopyOrdinal) {
+    Props[CopyOrdinal].flags = ZE_COMMAND_QUEUE_GROUP_PROPERTY_FLAG_COPY;
+    Props[CopyOrdinal].maxMemoryFillPatternSize = 128;
+    Props[CopyOrdinal].numQueues = 1;
+  }
+  *Count = 2;
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL zeDeviceGetMemoryAccessProperties(
+    ze_device_handle_t Device, ze_device_memory_access_properties_t *Props) {
+  RECORD_CALL();
+  // No shared system allocations, host memory must be imported.
+  Props->hostAllocCapabilities = ZE_MEMORY_ACCESS_CAP_FLAG_RW;
+  Props->deviceAllocCapabilities = ZE_MEMORY_ACCESS_CAP_FLAG_RW;
+  Props->sharedSingleDeviceAllocCapabilities = ZE_MEMORY_ACCESS_CAP_FLAG_RW;
+  Props->sharedCrossDeviceAllocCapabilities = 0;
+  Props->sharedSystemAllocCapabilities = 0;
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL zeDeviceGetGlobalTimestamps(ze_device_handle_t Device,
+                                                   uint64_t *HostTimestamp,
+                                                   uint64_t *DeviceTimestamp) {
+  RECORD_CALL();
+  *HostTimestamp = *DeviceTimestamp = getTimeNs();
+  return ZE_RESULT_SUCCESS;
+}
+
+static ze_result_t ZE_APICALL zexDriverImportExternalPointer(
+    ze_driver_handle_t Driver, void *Ptr, size_t Size) {
+  RECORD_CALL();
+  return Ptr && Size ? ZE_RESULT_SUCCESS : ZE_RESULT_ERROR_INVALID_ARGUMENT;
+}
+
+static ze_result_t ZE_APICALL
+zexDriverReleaseImportedPointer(ze_driver_handle_t Driver, void *Ptr) {
+  RECORD_CALL();
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL zeDriverGetExtensionFunctionAddress(
+    ze_driver_handle_t Driver, const char *Name, void **Function) {
+  RECORD_CALL();
+  if (!strcmp(Name, "zexDriverImportExternalPointer"))
+    *Function = reinterpret_cast<void *>(&zexDriverImportExternalPointer);
+  else if (!strcmp(Name, "zexDriverReleaseImportedPointer"))
+    *Function = reinterpret_cast<void *>(&zexDriverReleaseImportedPointer);
+  else
+    return ZE_RESULT_ERROR_INVALID_ARGUMENT;
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL zeContextCreateEx(ze_driver_handle_t Driver,
+                                         const ze_context_desc_t *Desc,
+                                         uint32_t NumDevices,
+                                         ze_device_handle_t *Devices,
+                                         ze_context_handle_t *Context) {
+  RECORD_CALL();
+  return createHandle(Context);
+}
+
+ze_result_t ZE_APICALL zeContextDestroy(ze_context_handle_t Context) {
+  RECORD_CALL();
+  return destroyHandle(Context);
+}
+
+//*************************************************************************
+// Memory
+
+static ze_result_t allocate(size_t Size, size_t Alignment, void **Ptr) {
+  Alignment = Alignment ? Alignment : 64;
+  Size = (Size + Alignment - 1) / Alignment * Alignment;
+  *Ptr = std::aligned_alloc(Alignment, Size ? Size : Alignment);
+  return *Ptr ? ZE_RESULT_SUCCESS : ZE_RESULT_ERROR_OUT_OF_HOST_MEMORY;
+}
+
+ze_result_t ZE_APICALL zeMemAllocDevice(ze_context_handle_t Context,
+                                        const ze_device_mem_alloc_desc_t *Desc,
+                                        size_t Size, size_t Alignment,
+                                        ze_device_handle_t Device,
+                                        void **Ptr) {
+  RECORD_CALL();
+  return allocate(Size, Alignment, Ptr);
+}
+
+ze_result_t ZE_APICALL zeMemAllocHost(ze_context_handle_t Context,
+                                      const ze_host_mem_alloc_desc_t *Desc,
+                                      size_t Size, size_t Alignment,
+                                      void **Ptr) {
+  RECORD_CALL();
+  return allocate(Size, Alignment, Ptr);
+}
+
+ze_result_t ZE_APICALL zeMemAllocShared(
+    ze_context_handle_t Context, const ze_device_mem_alloc_desc_t *DeviceDesc,
+    const ze_host_mem_alloc_desc_t *HostDesc, size_t Size, size_t Alignment,
+    ze_device_handle_t Device, void **Ptr) {
+  RECORD_CALL();
+  return allocate(Size, Alignment, Ptr);
+}
+
+ze_result_t ZE_APICALL zeMemFree(ze_context_handle_t Context, void *Ptr) {
+  RECORD_CALL();
+  std::free(Ptr);
+  return ZE_RESULT_SUCCESS;
+}
+
+//*************************************************************************
+// Command queues and fences
+
+ze_result_t ZE_APICALL zeCommandQueueCreate(
+    ze_context_handle_t Context, ze_device_handle_t Device,
+    const ze_command_queue_desc_t *Desc, ze_command_queue_handle_t *Queue) {
+  RECORD_CALL();
+  auto *Q = new StubCommandQueue();
+  Q->Ordinal = Desc->ordinal;
+  *Queue = reinterpret_cast<ze_command_queue_handle_t>(Q);
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL zeCommandQueueDestroy(ze_command_queue_handle_t Queue) {
+  RECORD_CALL();
+  delete reinterpret_cast<StubCommandQueue *>(Queue);
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL zeCommandQueueExecuteCommandLists(
+    ze_command_queue_handle_t Queue, uint32_t NumCommandLists,
+    ze_command_list_handle_t *CommandLists, ze_fence_handle_t Fence) {
+  RECORD_CALL();
+  auto *Q = reinterpret_cast<StubCommandQueue *>(Queue);
+  recordCall((std::string(__func__) + engineSuffix(Q->Ordinal)).c_str());
+  for (uint32_t i = 0; i < NumCommandLists; i++) {
+    auto *List = reinterpret_cast<StubCommandList *>(CommandLists[i]);
+    if (!List->Closed || List->Ordinal != Q->Ordinal)
+      return ZE_RESULT_ERROR_INVALID_ARGUMENT;
+    for (auto &Command : List->Commands)
+      Command();
+  }
+  if (Fence)
+    reinterpret_cast<StubFence *>(Fence)->Signaled = true;
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL zeCommandQueueSynchronize(
+    ze_command_queue_handle_t Queue, uint64_t Timeout) {
+  RECORD_CALL();
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL zeFenceCreate(ze_command_queue_handle_t Queue,
+                                     const ze_fence_desc_t *Desc,
+                                     ze_fence_handle_t *Fence) {
+  RECORD_CALL();
+  *Fence = reinterpret_cast<ze_fence_handle_t>(new StubFence());
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL zeFenceDestroy(ze_fence_handle_t Fence) {
+  RECORD_CALL();
+  delete reinterpret_cast<StubFence *>(Fence);
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL zeFenceQueryStatus(ze_fence_handle_t Fence) {
+  RECORD_CALL();
+  return reinterpret_cast<StubFence *>(Fence)->Signaled ? ZE_RESULT_SUCCESS
+                                                        : ZE_RESULT_NOT_READY;
+}
+
+ze_result_t ZE_APICALL zeFenceHostSynchronize(ze_fence_handle_t Fence,
+                                              uint64_t Timeout) {
+  RECORD_CALL();
+  return reinterpret_cast<StubFence *>(Fence)->Signaled ? ZE_RESULT_SUCCESS
+                                                        : ZE_RESULT_NOT_READY;
+}
+
+ze_result_t ZE_APICALL zeFenceReset(ze_fence_handle_t Fence) {
+  RECORD_CALL();
+  reinterpret_cast<StubFence *>(Fence)->Signaled = false;
+  return ZE_RESULT_SUCCESS;
+}
+
+//*************************************************************************
+// Command lists
+
+ze_result_t ZE_APICALL zeCommandListCreate(ze_context_handle_t Context,
+                                           ze_device_handle_t Device,
+                                           const ze_command_list_desc_t *Desc,
+                                           ze_command_list_handle_t *CmdList) {
+  RECORD_CALL();
+  auto *List = new StubCommandList();
+  List->Ordinal = Desc->commandQueueGroupOrdinal;
+  *CmdList = reinterpret_cast<ze_command_list_handle_t>(List);
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL zeCommandListCreateImmediate(
+    ze_context_handle_t Context, ze_device_handle_t Device,
+    const ze_command_queue_desc_t *Desc, ze_command_list_handle_t *CmdList) {
+  RECORD_CALL();
+  auto *List = new StubCommandList();
+  List->Ordinal = Desc->ordinal;
+  List->Immediate = true;
+  *CmdList = reinterpret_cast<ze_command_list_handle_t>(List);
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL zeCommandListClose(ze_command_list_handle_t CmdList) {
+  RECORD_CALL();
+  reinterpret_cast<StubCommandList *>(CmdList)->Closed = true;
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL zeCommandListReset(ze_command_list_handle_t CmdList) {
+  RECORD_CALL();
+  auto *List = reinterpret_cast<StubCommandList *>(CmdList);
+  List->Closed = false;
+  List->Commands.clear();
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL zeCommandListDestroy(ze_command_list_handle_t CmdList) {
+  RECORD_CALL();
+  delete reinterpret_cast<StubCommandList *>(CmdList);
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL zeCommandListAppendBarrier(
+    ze_command_list_handle_t CmdList, ze_event_handle_t SignalEvent,
+    uint32_t NumWaitEvents, ze_event_handle_t *WaitEvents) {
+  RECORD_CALL();
+  return APPEND(CmdList, NumWaitEvents, WaitEvents,
+                [=]() { signal(SignalEvent); });
+}
+
+ze_result_t ZE_APICALL zeCommandListAppendSignalEvent(
+    ze_command_list_handle_t CmdList, ze_event_handle_t Event) {
+  RECORD_CALL();
+  return APPEND(CmdList, 0, nullptr, [=]() { signal(Event); });
+}
+
+ze_result_t ZE_APICALL zeCommandListAppendMemoryCopy(
+    ze_command_list_handle_t CmdList, void *Dst, const void *Src, size_t Size,
+    ze_event_handle_t SignalEvent, uint32_t NumWaitEvents,
+    ze_event_handle_t *WaitEvents) {
+  RECORD_CALL();
+  return APPEND(CmdList, NumWaitEvents, WaitEvents, [=]() {
+    std::memcpy(Dst, Src, Size);
+    signal(SignalEvent);
+  });
+}
+
+ze_result_t ZE_APICALL zeCommandListAppendMemoryCopyRegion(
+    ze_command_list_handle_t CmdList, void *Dst,
+    const ze_copy_region_t *DstRegion, uint32_t DstPitch,
+    uint32_t DstSlicePitch, const void *Src, const ze_copy_region_t *SrcRegion,
+    uint32_t SrcPitch, uint32_t SrcSlicePitch, ze_event_handle_t SignalEvent,
+    uint32_t NumWaitEvents, ze_event_handle_t *WaitEvents) {
+  RECORD_CALL();
+  ze_copy_region_t D = *DstRegion, S = *SrcRegion;
+  return APPEND(CmdList, NumWaitEvents, WaitEvents, [=]() {
+    size_t Depth = D.depth ? D.depth : 1;
+    for (size_t Z = 0; Z < Depth; Z++)
+      for (size_t Y = 0; Y < D.height; Y++)
+        std::memcpy((char *)Dst + (D.originZ + Z) * DstSlicePitch +
+                        (D.originY + Y) * DstPitch + D.originX,
+                    (const char *)Src + (S.originZ + Z) * SrcSlicePitch +
+                        (S.originY + Y) * SrcPitch + S.originX,
+                    D.width);
+    signal(SignalEvent);
+  });
+}
+
+ze_result_t ZE_APICALL zeCommandListAppendMemoryFill(
+    ze_command_list_handle_t CmdList, void *Ptr, const void *Pattern,
+    size_t PatternSize, size_t Size, ze_event_handle_t SignalEvent,
+    uint32_t NumWaitEvents, ze_event_handle_t *WaitEvents) {
+  RECORD_CALL();
+  std::vector<char> PatternCopy((const char *)Pattern,
+                                (const char *)Pattern + PatternSize);
+  return APPEND(CmdList, NumWaitEvents, WaitEvents, [=]() {
+    for (size_t i = 0; i < Size; i++)
+      ((char *)Ptr)[i] = PatternCopy[i % PatternCopy.size()];
+    signal(SignalEvent);
+  });
+}
+
+ze_result_t ZE_APICALL zeCommandListAppendMemoryPrefetch(
+    ze_command_list_handle_t CmdList, const void *Ptr, size_t Size) {
+  RECORD_CALL();
+  return APPEND(CmdList, 0, nullptr, []() {});
+}
+
+ze_result_t ZE_APICALL zeCommandListAppendMemAdvise(
+    ze_command_list_handle_t CmdList, ze_device_handle_t Device,
+    const void *Ptr, size_t Size, ze_memory_advice_t Advice) {
+  RECORD_CALL();
+  return APPEND(CmdList, 0, nullptr, []() {});
+}
+
+ze_result_t ZE_APICALL zeCommandListAppendWriteGlobalTimestamp(
+    ze_command_list_handle_t CmdList, uint64_t *DstPtr,
+    ze_event_handle_t SignalEvent, uint32_t NumWaitEvents,
+    ze_event_handle_t *WaitEvents) {
+  RECORD_CALL();
+  return APPEND(CmdList, NumWaitEvents, WaitEvents, [=]() {
+    *DstPtr = getTimeNs();
+    signal(SignalEvent);
+  });
+}
+
+ze_result_t ZE_APICALL zeCommandListAppendLaunchKernel(
+    ze_command_list_handle_t CmdList, ze_kernel_handle_t Kernel,
+    const ze_group_count_t *LaunchArgs, ze_event_handle_t SignalEvent,
+    uint32_t NumWaitEvents, ze_event_handle_t *WaitEvents) {
+  RECORD_CALL();
+  return APPEND(CmdList, NumWaitEvents, WaitEvents, [=]() { signal(SignalEvent); });
+}
+
+ze_result_t ZE_APICALL zeCommandListAppendImageCopyFromMemory(
+    ze_command_list_handle_t CmdList, ze_image_handle_t Image, const void *Src,
+    const ze_image_region_t *DstRegion, ze_event_handle_t SignalEvent,
+    uint32_t NumWaitEvents, ze_event_handle_t *WaitEvents) {
+  RECORD_CALL();
+  return APPEND(CmdList, NumWaitEvents, WaitEvents, [=]() { signal(SignalEvent); });
+}
+
+//*************************************************************************
+// Events
+
+ze_result_t ZE_APICALL zeEventPoolCreate(ze_context_handle_t Context,
+                                         const ze_event_pool_desc_t *Desc,
+                                         uint32_t NumDevices,
+                                         ze_device_handle_t *Devices,
+                                         ze_event_pool_handle_t *Pool) {
+  RECORD_CALL();
+  return createHandle(Pool);
+}
+
+ze_result_t ZE_APICALL zeEventPoolDestroy(ze_event_pool_handle_t Pool) {
+  RECORD_CALL();
+  return destroyHandle(Pool);
+}
+
+ze_result_t ZE_APICALL zeEventCreate(ze_event_pool_handle_t Pool,
+                                     const ze_event_desc_t *Desc,
+                                     ze_event_handle_t *Event) {
+  RECORD_CALL();
+  *Event = reinterpret_cast<ze_event_handle_t>(new StubEvent());
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL zeEventDestroy(ze_event_handle_t Event) {
+  RECORD_CALL();
+  delete reinterpret_cast<StubEvent *>(Event);
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL zeEventHostSignal(ze_event_handle_t Event) {
+  RECORD_CALL();
+  signal(Event);
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL zeEventHostReset(ze_event_handle_t Event) {
+  RECORD_CALL();
+  reinterpret_cast<StubEvent *>(Event)->Signaled = false;
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL zeEventQueryStatus(ze_event_handle_t Event) {
+  RECORD_CALL();
+  return reinterpret_cast<StubEvent *>(Event)->Signaled ? ZE_RESULT_SUCCESS
+                                                        : ZE_RESULT_NOT_READY;
+}
+
+ze_result_t ZE_APICALL zeEventHostSynchronize(ze_event_handle_t Event,
+                                              uint64_t Timeout) {
+  RECORD_CALL();
+  // Events are only signaled by submitted command lists or by the host. Give
+  // up after a while so a missing submission fails the test instead of
+  // hanging it.
+  auto *E = reinterpret_cast<StubEvent *>(Event);
+  constexpr uint64_t MaxWaitNs = 10000000000;
+  auto Deadline = std::chrono::steady_clock::now() +
+                  std::chrono::nanoseconds(std::min(Timeout, MaxWaitNs));
+  while (!E->Signaled) {
+    if (std::chrono::steady_clock::now() > Deadline) {
+      if (Timeout == UINT64_MAX)
+        fprintf(stderr, "[ZeStub] zeEventHostSynchronize timed out\n");
+      return ZE_RESULT_NOT_READY;
+    }
+    std::this_thread::yield();
+  }
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL zeEventQueryKernelTimestamp(
+    ze_event_handle_t Event, ze_kernel_timestamp_result_t *Result) {
+  RECORD_CALL();
+  std::memset(Result, 0, sizeof(*Result));
+  return ZE_RESULT_SUCCESS;
+}
+
+//*************************************************************************
+// Modules, kernels, images and samplers
+
+ze_result_t ZE_APICALL zeModuleCreate(ze_context_handle_t Context,
+                                      ze_device_handle_t Device,
+                                      const ze_module_desc_t *Desc,
+                                      ze_module_handle_t *Module,
+                                      ze_module_build_log_handle_t *BuildLog) {
+  RECORD_CALL();
+  if (BuildLog)
+    createHandle(BuildLog);
+  return createHandle(Module);
+}
+
+ze_result_t ZE_APICALL zeModuleDestroy(ze_module_handle_t Module) {
+  RECORD_CALL();
+  return destroyHandle(Module);
+}
+
+ze_result_t ZE_APICALL zeModuleBuildLogGetString(
+    ze_module_build_log_handle_t BuildLog, size_t *Size, char *Log) {
+  RECORD_CALL();
+  if (Log && *Size)
+    Log[0] = 0;
+  *Size = 1;
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL
+zeModuleBuildLogDestroy(ze_module_build_log_handle_t BuildLog) {
+  RECORD_CALL();
+  return destroyHandle(BuildLog);
+}
+
+ze_result_t ZE_APICALL zeModuleGetNativeBinary(ze_module_handle_t Module,
+                                               size_t *Size,
+                                               uint8_t *Binary) {
+  RECORD_CALL();
+  static const char Stub[] = "native";
+  if (Binary)
+    std::memcpy(Binary, Stub, std::min(*Size, sizeof(Stub)));
+  *Size = sizeof(Stub);
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL zeModuleGetKernelNames(ze_module_handle_t Module,
+                                              uint32_t *Count,
+                                              const char **Names) {
+  RECORD_CALL();
+  *Count = 0;
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL zeKernelCreate(ze_module_handle_t Module,
+                                      const ze_kernel_desc_t *Desc,
+                                      ze_kernel_handle_t *Kernel) {
+  RECORD_CALL();
+  return createHandle(Kernel);
+}
+
+ze_result_t ZE_APICALL zeKernelDestroy(ze_kernel_handle_t Kernel) {
+  RECORD_CALL();
+  return destroyHandle(Kernel);
+}
+
+ze_result_t ZE_APICALL zeKernelGetProperties(ze_kernel_handle_t Kernel,
+                                             ze_kernel_properties_t *Props) {
+  RECORD_CALL();
+  Props->numKernelArgs = 0;
+  Props->requiredGroupSizeX = Props->requiredGroupSizeY =
+      Props->requiredGroupSizeZ = 0;
+  Props->requiredNumSubGroups = 0;
+  Props->requiredSubgroupSize = 0;
+  Props->maxSubgroupSize = 32;
+  Props->maxNumSubgroups = 32;
+  Props->localMemSize = 0;
+  Props->privateMemSize = 0;
+  Props->spillMemSize = 0;
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL zeKernelSetGroupSize(ze_kernel_handle_t Kernel,
+                                            uint32_t X, uint32_t Y,
+                                            uint32_t Z) {
+  RECORD_CALL();
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL zeKernelSetArgumentValue(ze_kernel_handle_t Kernel,
+                                                uint32_t ArgIndex,
+                                                size_t ArgSize,
+                                                const void *ArgValue) {
+  RECORD_CALL();
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL zeKernelSetIndirectAccess(
+    ze_kernel_handle_t Kernel, ze_kernel_indirect_access_flags_t Flags) {
+  RECORD_CALL();
+  return ZE_RESULT_SUCCESS;
+}
+
+ze_result_t ZE_APICALL zeImageCreate(ze_context_handle_t Context,
+                                     ze_device_handle_t Device,
+                                     const ze_image_desc_t *Desc,
+                                     ze_image_handle_t *Image) {
+  RECORD_CALL();
+  return createHandle(Image);
+}
+
+ze_result_t ZE_APICALL zeImageDestroy(ze_image_handle_t Image) {
+  RECORD_CALL();
+  return destroyHandle(Image);
+}
+
+ze_result_t ZE_APICALL zeSamplerCreate(ze_context_handle_t Context,
+                                       ze_device_handle_t Device,
+                                       const ze_sampler_desc_t *Desc,
+                                       ze_sampler_handle_t *Sampler) {
+  RECORD_CALL();
+  return createHandle(Sampler);
+}
+
+ze_result_t ZE_APICALL zeSamplerDestroy(ze_sampler_handle_t Sampler) {
+  RECORD_CALL();
+  return destroyHandle(Sampler);
+}
+
+} // extern "C"